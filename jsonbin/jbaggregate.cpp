@@ -0,0 +1,420 @@
+//
+// JBAggregate
+//
+// Details in jbaggregate.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memset
+#include "jbaggregate.h"
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+typedef unsigned long long ull;
+
+//
+// Results
+//
+
+static void freeResult(JBAggResult &result)
+{
+	free(result.aBuckets);
+	free(result.aCategories);
+	free(result.aTable);
+	memset(&result, 0, sizeof(result));
+}
+
+static uint categoryHash(const char *text, uint len, JBType type)
+{
+	uint hash = (JB_FNV1A_SEED ^ (uint)type) * JB_FNV1A_PRIME;
+	for (uint c = 0; c < len; c++)
+		hash = ((unsigned char)text[c] ^ hash) * JB_FNV1A_PRIME;
+	return hash;
+}
+
+// count a category, false if out of memory
+static bool addCategory(JBAggResult &result, const char *text, uint len, JBType type, uint hash, uint count)
+{
+	if (result.numCategories * 2 >= result.tableSize) {
+		uint size = result.tableSize ? result.tableSize * 2 : 64;
+		uint *aTable = (uint*)calloc(size, sizeof(uint));
+		if (!aTable)
+			return false;
+		for (uint c = 0; c < result.numCategories; c++) {
+			uint slot = result.aCategories[c].hash & (size - 1);
+			while (aTable[slot])
+				slot = (slot + 1) & (size - 1);
+			aTable[slot] = c + 1;
+		}
+		free(result.aTable);
+		result.aTable = aTable;
+		result.tableSize = size;
+	}
+	uint slot = hash & (result.tableSize - 1);
+	while (uint index = result.aTable[slot]) {
+		JBAggCategory &known = result.aCategories[index - 1];
+		if (known.hash == hash && known.type == type && known.len == len && !memcmp(known.text, text, len)) {
+			known.count += count;
+			return true;
+		}
+		slot = (slot + 1) & (result.tableSize - 1);
+	}
+	if (result.numCategories == result.maxCategories) {
+		uint grow = result.maxCategories ? result.maxCategories * 2 : 32;
+		JBAggCategory *aGrow = (JBAggCategory*)realloc(result.aCategories, grow * sizeof(JBAggCategory));
+		if (!aGrow)
+			return false;
+		result.aCategories = aGrow;
+		result.maxCategories = grow;
+	}
+	JBAggCategory &added = result.aCategories[result.numCategories];
+	added.text = text;
+	added.len = len;
+	added.type = type;
+	added.hash = hash;
+	added.count = count;
+	result.aTable[slot] = ++result.numCategories;
+	return true;
+}
+
+static void addNumber(const JBAggPath &path, JBAggResult &result, double value)
+{
+	if (!result.numbers || value < result.min)
+		result.min = value;
+	if (!result.numbers || value > result.max)
+		result.max = value;
+	result.numbers++;
+	result.sum += value;
+	if (path.kind == JBAGG_HISTOGRAM && result.aBuckets) {
+		if (value < path.lo)
+			result.below++;
+		else if (value > path.hi)
+			result.above++;
+		else {
+			uint bucket = (uint)((value - path.lo) / (path.hi - path.lo) * path.numBuckets);
+			result.aBuckets[bucket < path.numBuckets ? bucket : path.numBuckets - 1]++;	// hi goes in the last bucket
+		}
+	}
+}
+
+// add a value at a path, false if out of memory
+static bool accumulate(const JBAggPath &path, JBAggResult &result, const JBToken &token)
+{
+	result.count++;
+	if (token.kind == JBTOK_BEGIN)
+		return true;
+	if (path.kind == JBAGG_HISTOGRAM && !result.aBuckets) {
+		result.aBuckets = (uint*)calloc(path.numBuckets, sizeof(uint));
+		if (!result.aBuckets)
+			return false;
+	}
+	if (token.type == JB_INT || token.type == JB_FLOAT)
+		addNumber(path, result, token.type == JB_INT ? (double)token.i : (double)token.f);
+	if (path.kind == JBAGG_CATEGORIES) {
+		JBType type = token.type == JB_NULL_VALUE ? JB_NULL : token.type;
+		return addCategory(result, token.value, token.valueLen, type, categoryHash(token.value, token.valueLen, type), 1);
+	}
+	return true;
+}
+
+static bool mergeResult(const JBAggPath &path, JBAggResult &result, const JBAggResult &other)
+{
+	if (!other.count)
+		return true;
+	if (other.numbers) {
+		if (!result.numbers || other.min < result.min)
+			result.min = other.min;
+		if (!result.numbers || other.max > result.max)
+			result.max = other.max;
+	}
+	result.count += other.count;
+	result.numbers += other.numbers;
+	result.sum += other.sum;
+	result.below += other.below;
+	result.above += other.above;
+	if (other.aBuckets) {
+		if (!result.aBuckets) {
+			result.aBuckets = (uint*)calloc(path.numBuckets, sizeof(uint));
+			if (!result.aBuckets)
+				return false;
+		}
+		for (uint b = 0; b < path.numBuckets; b++)
+			result.aBuckets[b] += other.aBuckets[b];
+	}
+	for (uint c = 0; c < other.numCategories; c++) {
+		const JBAggCategory &category = other.aCategories[c];
+		if (!addCategory(result, category.text, category.len, category.type, category.hash, category.count))
+			return false;
+	}
+	return true;
+}
+
+//
+// Reading
+//
+
+// aggregate the tokens of a reader, firstIndex is the index of the first root array element for a sequence
+static JBError aggregateTokens(const JBAggregate &agg, JBAggResult *aResults, JBTokenReader &reader, uint firstIndex)
+{
+	ull aMask[JSON_MAX_DEPTH];	// paths that lead into the object or array open at each depth
+	uint aIndex[JSON_MAX_DEPTH];	// next element index of arrays
+	aMask[0] = agg.numPaths < 64 ? (1ULL << agg.numPaths) - 1 : ~0ULL;
+	aIndex[0] = firstIndex;
+	JBToken token;
+	while (reader.next(token)) {
+		int depth = token.depth;
+		if (token.kind == JBTOK_END || !depth)
+			continue;
+		ull parent = aMask[depth - 1];
+		uint index = token.name ? 0 : aIndex[depth - 1]++;
+		uint hash = 0;
+		bool hashed = false;
+		ull carry = 0;
+		for (int p = 0; p < agg.numPaths; p++) {
+			if (!((parent >> p) & 1))
+				continue;
+			const JBAggPath &path = agg.aPaths[p];
+			const JBAggStep &step = agg.aSteps[path.firstStep + depth - 1];
+			bool match = step.any;
+			if (!match && token.name && step.key) {
+				if (!hashed) {
+					hash = token.getHash();
+					hashed = true;
+				}
+				match = step.hash == hash;
+			} else if (!match && !token.name)
+				match = step.index == (int)index;
+			if (!match)
+				continue;
+			if (path.numSteps == (uint)depth) {
+				if (!accumulate(path, aResults[p], token))
+					return JBERR_OUT_OF_MEMORY;
+			} else
+				carry |= 1ULL << p;
+		}
+		if (token.kind == JBTOK_BEGIN) {
+			if (carry) {
+				aMask[depth] = carry;
+				aIndex[depth] = 0;
+			} else
+				reader.skip();	// no path leads into this object or array
+		}
+	}
+	return reader.error();
+}
+
+JBAggregate::JBAggregate() : numPaths(0), numSteps(0), path_error(JBQERR_NONE), error_code(JBERR_NONE), error_offset(0)
+{
+	memset(aResults, 0, sizeof(aResults));
+}
+
+int JBAggregate::add(const char *path, JBAggKind kind)
+{
+	JBQuery query;
+	if (!query.compile(path)) {
+		path_error = query.last_error();
+		return -1;
+	}
+	path_error = JBQERR_NONE;
+	if (numPaths >= MAX_PATHS || numSteps + query.numSteps > MAX_STEPS)
+		path_error = JBQERR_TOO_MANY_STEPS;
+	else if (!query.numSteps)
+		path_error = JBQERR_UNSUPPORTED;	// the root itself
+	for (int s = 0; !path_error && s < query.numSteps; s++) {
+		const JBQueryStep &src = query.aSteps[s];
+		JBAggStep &step = aSteps[numSteps + s];
+		step.hash = src.hash;
+		step.index = -1;
+		step.key = false;
+		step.any = false;
+		switch (src.op) {
+			case JBQ_CHILD:
+				step.key = true;
+				step.index = src.a;	// JSON Pointer numeric segment, -1 otherwise
+				break;
+			case JBQ_INDEX:
+				if (src.a < 0)
+					path_error = JBQERR_UNSUPPORTED;	// counting from the end needs the element count
+				step.index = src.a;
+				break;
+			case JBQ_WILDCARD:
+				step.any = true;
+				break;
+			default:
+				path_error = JBQERR_UNSUPPORTED;
+				break;
+		}
+	}
+	if (path_error)
+		return -1;
+	JBAggPath &added = aPaths[numPaths];
+	added.kind = kind;
+	added.firstStep = (uint)numSteps;
+	added.numSteps = (uint)query.numSteps;
+	added.numBuckets = 0;
+	added.lo = added.hi = 0.0;
+	numSteps += query.numSteps;
+	memset(&aResults[numPaths], 0, sizeof(JBAggResult));
+	return numPaths++;
+}
+
+int JBAggregate::addHistogram(const char *path, double lo, double hi, unsigned int numBuckets)
+{
+	if (!numBuckets || !(hi > lo)) {
+		path_error = JBQERR_UNSUPPORTED;
+		return -1;
+	}
+	int slot = add(path, JBAGG_HISTOGRAM);
+	if (slot >= 0) {
+		aPaths[slot].numBuckets = numBuckets;
+		aPaths[slot].lo = lo;
+		aPaths[slot].hi = hi;
+	}
+	return slot;
+}
+
+bool JBAggregate::run(const char *json, unsigned int size)
+{
+	JBTokenReader reader(json, size);
+	error_code = aggregateTokens(*this, aResults, reader, 0);
+	error_offset = error_code ? reader.offset() : 0;
+	return !error_code;
+}
+
+//
+// Parallel reading
+//
+
+struct sAggPart {
+	const char *text;
+	uint size;
+	uint firstIndex;		// root array index of the first element
+	JBError error;
+	uint errorOffset;
+};
+
+struct sAggParallel {
+	const JBAggregate *agg;
+	sAggPart *aParts;
+	JBAggResult *aPartResults;	// numPaths per part
+};
+
+static void aggregatePart(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sAggParallel &parallel = *(sAggParallel*)user;
+	for (uint p = first; p < end; p++) {
+		sAggPart &part = parallel.aParts[p];
+		JBTokenReader reader(part.text, part.size, true);
+		part.error = aggregateTokens(*parallel.agg, parallel.aPartResults + p * parallel.agg->numPaths, reader, part.firstIndex);
+		part.errorOffset = reader.offset();
+	}
+}
+
+bool JBAggregate::runParallel(const char *json, unsigned int size, unsigned int threads)
+{
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+	JBTokenReader reader(json, size);
+	JBToken token;
+	if (threads < 2 || !numPaths || !reader.next(token) || token.type != JB_ARRAY)
+		return run(json, size);
+
+	// the end of the root array
+	const char *text = reader.json;
+	uint end = size - (uint)(text - json);
+	while (end && (unsigned char)text[end - 1] <= ' ')
+		end--;
+	if (!end || text[end - 1] != ']')
+		return run(json, size);
+	end--;
+
+	// split between root elements near equal parts of the text, the parts start with the separator
+	sAggPart aParts[JB_MAX_THREADS];
+	uint numParts = 1, elements = 0;
+	aParts[0].text = text + reader.offset();
+	aParts[0].firstIndex = 0;
+	for (;;) {
+		uint before = reader.offset();
+		if (!reader.next(token) || token.kind == JBTOK_END)
+			break;
+		if (numParts < threads && before >= (unsigned long long)end * numParts / threads) {
+			aParts[numParts].text = text + before;
+			aParts[numParts].firstIndex = elements;
+			if (++numParts == threads)
+				break;
+		}
+		elements++;
+		if (token.kind == JBTOK_BEGIN)
+			reader.skip();
+	}
+	if (reader.error())
+		return run(json, size);	// report the error where a full read finds it
+	for (uint p = 0; p < numParts; p++) {
+		const char *part_end = p + 1 < numParts ? aParts[p + 1].text : text + end;
+		aParts[p].size = (uint)(part_end - aParts[p].text);
+		aParts[p].error = JBERR_NONE;
+		aParts[p].errorOffset = 0;
+	}
+
+	sAggParallel parallel;
+	parallel.agg = this;
+	parallel.aParts = aParts;
+	parallel.aPartResults = (JBAggResult*)calloc(numParts * numPaths, sizeof(JBAggResult));
+	if (!parallel.aPartResults) {
+		error_code = JBERR_OUT_OF_MEMORY;
+		error_offset = 0;
+		return false;
+	}
+	JBParallelFor(numParts, numParts, aggregatePart, &parallel);
+
+	// merge in text order
+	error_code = JBERR_NONE;
+	error_offset = 0;
+	for (uint p = 0; p < numParts && !error_code; p++) {
+		if (aParts[p].error) {
+			error_code = aParts[p].error;
+			error_offset = (uint)(aParts[p].text - json) + aParts[p].errorOffset;
+		}
+	}
+	for (uint p = 0; p < numParts; p++) {
+		for (int r = 0; r < numPaths; r++) {
+			JBAggResult &part = parallel.aPartResults[p * numPaths + r];
+			if (!error_code && !mergeResult(aPaths[r], aResults[r], part))
+				error_code = JBERR_OUT_OF_MEMORY;
+			freeResult(part);
+		}
+	}
+	free(parallel.aPartResults);
+	return !error_code;
+}
+
+bool JBAggregate::merge(const JBAggregate &other)
+{
+	if (other.numPaths != numPaths)
+		return false;
+	for (int r = 0; r < numPaths; r++) {
+		if (!mergeResult(aPaths[r], aResults[r], other.aResults[r]))
+			return false;
+	}
+	return true;
+}
+
+void JBAggregate::reset()
+{
+	for (int r = 0; r < numPaths; r++)
+		freeResult(aResults[r]);
+	error_code = JBERR_NONE;
+	error_offset = 0;
+}
+
+void JBAggregate::release()
+{
+	reset();
+	numPaths = numSteps = 0;
+	path_error = JBQERR_NONE;
+}
+
+}	// namespace jbin
@@ -0,0 +1,138 @@
+#ifndef __JBAGGREGATE_H__
+#define __JBAGGREGATE_H__
+
+//
+// JBAggregate
+//
+// Summary
+//	- Computes count, sum, min, max, histograms and value counts over paths in
+//		JSON text while it is read with JBTokenReader, no JBItems are built and
+//		memory does not grow with the size of the text.
+//	- Objects and arrays that no path leads into are stepped over by matching
+//		brackets and quotes.
+//	- A root array can be split into parts that are read on several threads,
+//		the partial results are merged at the end.
+//
+// Usage
+//	- Add paths (JSONPath with .key, ['key'], [n] and [*] / .*, or JSON
+//		Pointer), each returns the slot of its result:
+//		JBAggregate agg;
+//		int speed = agg.add("$.records[*].speed");
+//		int kinds = agg.add("$.records[*].kind", JBAGG_CATEGORIES);
+//		int hist = agg.addHistogram("$.records[*].speed", 0.0, 100.0, 10);
+//	- Read the text and look at the results:
+//		agg.run(json, size);	// or agg.runParallel(json, size, JBHardwareThreads())
+//		const JBAggResult &r = agg.get(speed);
+//		printf("%u numbers, sum %g, min %g, max %g\n", r.numbers, r.sum, r.min, r.max);
+//		for (unsigned int c = 0; c < agg.get(kinds).numCategories; c++) ...
+//	- run() adds to the results of earlier runs so several files can be
+//		aggregated together, reset() clears the results and keeps the paths.
+//	- merge(other) adds the results of another JBAggregate with the same
+//		paths, to combine files read on different threads.
+//
+// Notes
+//	- count is every value at a path (any type), the numeric results only
+//		look at int and float values.
+//	- Category values are compared as raw text with their type, strings
+//		without decoding escape codes, and point into the text that was read,
+//		which must stay in memory while the categories are used. Categories
+//		are listed in order of first appearance.
+//	- runParallel() steps over the root array once by matching brackets and
+//		quotes to find where to split, then each part is read and validated
+//		on its own thread with a sequence JBTokenReader (which does not check
+//		the commas between root elements). Text that is not a root array is
+//		read with run().
+//	- Numbers are accumulated as double, sums of the parts of a parallel run
+//		are added in order so the result does not depend on timing.
+//	- Requires jbquery.cpp (path compiling) and jbthreads.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+#include "jbquery.h"
+
+namespace jbin {
+
+enum JBAggKind {
+	JBAGG_STATS,		// count, numbers, sum, min and max
+	JBAGG_HISTOGRAM,	// stats and counts of numbers in equal buckets between lo and hi
+	JBAGG_CATEGORIES,	// stats and counts of each distinct string, number, bool or null
+};
+
+// a distinct value and how many times it was found
+struct JBAggCategory {
+	const char *text;		// raw value text, a string without quotes
+	unsigned int len;
+	JBType type;			// JB_STRING, JB_INT, JB_FLOAT, JB_BOOL or JB_NULL (null values and elements)
+	unsigned int hash;
+	unsigned int count;
+};
+
+struct JBAggResult {
+	unsigned int count;			// values found at the path
+	unsigned int numbers;		// int and float values
+	double sum;
+	double min, max;			// of the numbers, 0 if there were none
+	unsigned int *aBuckets;		// JBAGG_HISTOGRAM, numBuckets counts
+	unsigned int below, above;	// numbers outside the histogram range
+	JBAggCategory *aCategories;	// JBAGG_CATEGORIES in order of first appearance
+	unsigned int numCategories;
+	unsigned int maxCategories;
+	unsigned int *aTable;		// category + 1 by hash
+	unsigned int tableSize;
+
+	double mean() const { return numbers ? sum / numbers : 0.0; }
+};
+
+// compiled path step
+struct JBAggStep {
+	unsigned int hash;		// key hash if key is set
+	int index;				// array element, -1 if the step does not match elements
+	bool key;				// matches an object member by hash
+	bool any;				// matches every member and element
+};
+
+struct JBAggPath {
+	JBAggKind kind;
+	unsigned int firstStep;
+	unsigned int numSteps;
+	unsigned int numBuckets;	// JBAGG_HISTOGRAM
+	double lo, hi;
+};
+
+struct JBAggregate {
+	enum {
+		MAX_PATHS = 64,		// paths in one aggregate
+		MAX_STEPS = 256,	// steps of all paths
+	};
+
+	JBAggPath aPaths[MAX_PATHS];
+	JBAggResult aResults[MAX_PATHS];
+	JBAggStep aSteps[MAX_STEPS];
+	int numPaths;
+	int numSteps;
+	JBQueryError path_error;	// error of the last add()
+	JBError error_code;			// error of the last run
+	unsigned int error_offset;	// offset in the text where the last run stopped at an error
+
+	JBAggregate();
+	~JBAggregate() { release(); }
+
+	int add(const char *path, JBAggKind kind = JBAGG_STATS);	// returns the result slot or -1 (see path_error)
+	int addHistogram(const char *path, double lo, double hi, unsigned int numBuckets);
+	const JBAggResult& get(int slot) const { return aResults[slot]; }
+
+	bool run(const char *json, unsigned int size);	// false at a syntax error or out of memory, see error_code
+	bool runParallel(const char *json, unsigned int size, unsigned int threads);
+	bool merge(const JBAggregate &other);	// add the results of an aggregate with the same paths
+	void reset();	// clear the results
+	void release();	// free the results and remove the paths
+
+private:
+	JBAggregate(const JBAggregate&);	// not copyable, the destructor frees the results
+	JBAggregate& operator=(const JBAggregate&);
+};
+
+}	// namespace jbin
+
+#endif
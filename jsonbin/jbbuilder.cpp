@@ -0,0 +1,845 @@
+//
+// JBBuilder
+//
+// Details in jbbuilder.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcpy
+#include "jbbuilder.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_SIBLING_MAX ((1 << 23) - 1)	// largest offset that fits in JBItem::sibling
+
+static uint hashChars(const jchar *str, uint len)
+{
+	uint hash = JB_FNV1A_SEED;
+	const unsigned char *bytes = (const unsigned char*)str;
+	for (uint b = 0; b < len * sizeof(jchar); b++)
+		hash = (bytes[b] ^ hash) * JB_FNV1A_PRIME;
+	return hash;
+}
+
+static uint charsLen(const jchar *str)
+{
+	const jchar *end = str;
+	while (*end)
+		end++;
+	return (uint)(end - str);
+}
+
+// JB_WCHAR16 names are converted to utf-8 first so the hash matches the parser
+unsigned int JBHashName(const jchar *name, unsigned int len)
+{
+#ifdef JB_WCHAR16
+	uint hash = 0;
+	char buf[256];
+	char *utf8 = len * 3 < sizeof(buf) ? buf : (char*)malloc(len * 3 + 1);
+	if (utf8) {
+		uint size = 0;
+		for (uint c = 0; c < len; c++) {
+			uint code = (uint)name[c];
+			if (code >= 0xd800 && code < 0xdc00 && c + 1 < len && name[c + 1] >= 0xdc00 && name[c + 1] < 0xe000)
+				code = 0x10000 + ((code - 0xd800) << 10) + ((uint)name[++c] - 0xdc00);
+			if (code < 0x80)
+				utf8[size++] = (char)code;
+			else if (code < 0x800) {
+				utf8[size++] = (char)(0xc0 | (code >> 6));
+				utf8[size++] = (char)(0x80 | (code & 0x3f));
+			} else if (code < 0x10000) {
+				utf8[size++] = (char)(0xe0 | (code >> 12));
+				utf8[size++] = (char)(0x80 | ((code >> 6) & 0x3f));
+				utf8[size++] = (char)(0x80 | (code & 0x3f));
+			} else {
+				utf8[size++] = (char)(0xf0 | (code >> 18));
+				utf8[size++] = (char)(0x80 | ((code >> 12) & 0x3f));
+				utf8[size++] = (char)(0x80 | ((code >> 6) & 0x3f));
+				utf8[size++] = (char)(0x80 | (code & 0x3f));
+			}
+		}
+		hash = JBHashKey(utf8, size);
+		if (utf8 != buf)
+			free(utf8);
+	}
+	return hash;
+#else
+	return JBHashKey(name, len);
+#endif
+}
+
+const JBItem* JBSubtreeLast(const JBItem *item)
+{
+	while (const JBItem *child = item->getChild()) {
+		while (const JBItem *next = child->getSibling())
+			child = next;
+		item = child;
+	}
+	return item;
+}
+
+bool JBBuilder::begin(JBType root_type)
+{
+	release();
+	if (root_type != JB_ROOT && root_type != JB_ARRAY)
+		return false;
+	if (!reserveItems(64))
+		return false;
+	memset(&aItems[0], 0, sizeof(JBItem));
+	aItems[0].type = root_type;
+	numItems = 1;
+	depth = 0;
+	aOpen[0] = 0;
+	aLast[0] = 0;
+	return true;
+}
+
+void JBBuilder::release()
+{
+	free(aItems);
+	free(aChars);
+	free(aStrTable);
+	aItems = NULL;
+	aChars = NULL;
+	aStrTable = NULL;
+	numItems = maxItems = numChars = maxChars = strTableSize = numStrs = 0;
+	depth = -1;
+	hasKey = false;
+	failed = false;
+}
+
+bool JBBuilder::reserveItems(uint count)
+{
+	if (numItems + count <= maxItems)
+		return true;
+	uint grow = maxItems ? maxItems : 64;
+	while (grow < numItems + count)
+		grow *= 2;
+	JBItem *aGrow = (JBItem*)realloc(aItems, grow * sizeof(JBItem));
+	if (!aGrow) {
+		failed = true;
+		return false;
+	}
+	aItems = aGrow;
+	maxItems = grow;
+	return true;
+}
+
+// add a string to the table once, returns offset + 1 or 0 if out of memory
+uint JBBuilder::addString(const jchar *str, uint len)
+{
+	if (numStrs * 2 >= strTableSize) {	// keep the table at most half full
+		uint size = strTableSize ? strTableSize * 2 : 1024;
+		uint *aTable = (uint*)calloc(size, sizeof(uint));
+		if (!aTable)
+			return 0;
+		for (uint s = 0; s < strTableSize; s++) {
+			if (uint offset = aStrTable[s]) {
+				const jchar *prev = aChars + offset - 1;
+				uint slot = hashChars(prev, charsLen(prev)) & (size - 1);
+				while (aTable[slot])
+					slot = (slot + 1) & (size - 1);
+				aTable[slot] = offset;
+			}
+		}
+		free(aStrTable);
+		aStrTable = aTable;
+		strTableSize = size;
+	}
+	uint slot = hashChars(str, len) & (strTableSize - 1);
+	while (uint offset = aStrTable[slot]) {
+		const jchar *prev = aChars + offset - 1;
+		if (!memcmp(prev, str, len * sizeof(jchar)) && !prev[len])
+			return offset;
+		slot = (slot + 1) & (strTableSize - 1);
+	}
+	if (numChars + len + 1 > maxChars) {
+		uint grow = maxChars ? maxChars : 4096;
+		while (grow < numChars + len + 1)
+			grow *= 2;
+		jchar *aGrow = (jchar*)realloc(aChars, grow * sizeof(jchar));
+		if (!aGrow)
+			return 0;
+		aChars = aGrow;
+		maxChars = grow;
+	}
+	uint offset = numChars + 1;
+	memcpy(aChars + numChars, str, len * sizeof(jchar));
+	aChars[numChars + len] = 0;
+	numChars += len + 1;
+	aStrTable[slot] = offset;
+	numStrs++;
+	return offset;
+}
+
+// record string table offsets (offset + 1, 0 = none) until finish() knows where the table is
+void JBBuilder::setName(JBItem &item, uint offset, uint len)
+{
+#ifdef JB_KEY_STRING
+#ifdef JB_INLINE_STRINGS
+	item.name.p = (const jchar*)(size_t)offset;
+#else
+	item.name.o = offset;
+#endif
+#ifdef JB_STRLEN
+	item.name.l = len;
+#else
+	(void)len;
+#endif
+#else
+	(void)item; (void)offset; (void)len;
+#endif
+}
+
+void JBBuilder::setStr(JBItem &item, uint offset, uint len)
+{
+#ifdef JB_INLINE_STRINGS
+	item.data.s.p = (const jchar*)(size_t)offset;
+#else
+	item.data.s.o = offset;
+#endif
+#ifdef JB_STRLEN
+	item.data.s.l = len;
+#else
+	(void)len;
+#endif
+}
+
+bool JBBuilder::key(const jchar *name, uint len)
+{
+	return keyHash((name && len) ? JBHashName(name, len) : 0, name, len);	// the parser hashes empty keys as 0
+}
+
+bool JBBuilder::keyHash(uint hash, const jchar *name, uint len)
+{
+	pendingName = len ? name : NULL;
+	pendingLen = name ? len : 0;
+	pendingHash = hash;
+	hasKey = true;
+	return !failed;
+}
+
+// add an item to the current container with the pending key
+JBItem* JBBuilder::add(JBType type)
+{
+	if (failed || depth < 0)
+		return NULL;
+	bool array = aItems[aOpen[depth]].type == JB_ARRAY;
+	if (!array && !hasKey) {	// object members need a key
+		failed = true;
+		return NULL;
+	}
+	uint name = 0;
+#ifdef JB_KEY_STRING
+	if (!array && pendingName && !(name = addString(pendingName, pendingLen))) {
+		failed = true;
+		return NULL;
+	}
+#endif
+	if (!reserveItems(1))
+		return NULL;
+	uint index = numItems++;
+	JBItem &item = aItems[index];
+	memset(&item, 0, sizeof(JBItem));
+	item.type = type;
+#ifdef JB_KEY_HASH
+	item.hash = array ? 0 : pendingHash;
+#endif
+	setName(item, name, array ? 0 : pendingLen);
+	hasKey = false;
+
+	// link to the previous child and count in the parent
+	if (uint last = aLast[depth]) {
+		if (index - (last - 1) > JB_SIBLING_MAX) {
+			failed = true;
+			return NULL;
+		}
+		aItems[last - 1].sibling = (int)(index - (last - 1));
+	}
+	aLast[depth] = index + 1;
+	aItems[aOpen[depth]].data.i++;
+	return &item;
+}
+
+bool JBBuilder::addInt(jbint value)
+{
+	JBItem *item = add(JB_INT);
+	if (item)
+		item->data.i = value;
+	return item != NULL;
+}
+
+bool JBBuilder::addFloat(jbfloat value)
+{
+	JBItem *item = add(JB_FLOAT);
+	if (item)
+		item->data.f = value;
+	return item != NULL;
+}
+
+bool JBBuilder::addBool(bool value)
+{
+	JBItem *item = add(JB_BOOL);
+	if (item)
+		item->data.b = value;
+	return item != NULL;
+}
+
+bool JBBuilder::addNull()
+{
+	return add(inArray() ? JB_NULL : JB_NULL_VALUE) != NULL;	// same as JSONBin
+}
+
+bool JBBuilder::addStr(const jchar *str, uint len)
+{
+	uint offset = 0;
+	if (!failed && str && len && !(offset = addString(str, len))) {	// empty strings have no string like JSONBin
+		failed = true;
+		return false;
+	}
+	JBItem *item = add(JB_STRING);
+	if (item)
+		setStr(*item, offset, len);
+	return item != NULL;
+}
+
+bool JBBuilder::open(JBType type)
+{
+	if ((type != JB_OBJECT && type != JB_ARRAY) || depth + 1 >= JSON_MAX_DEPTH) {
+		failed = true;
+		return false;
+	}
+	if (!add(type))
+		return false;
+	depth++;
+	aOpen[depth] = numItems - 1;
+	aLast[depth] = 0;
+	return true;
+}
+
+bool JBBuilder::close()
+{
+	if (failed || depth <= 0) {
+		failed = true;
+		return false;
+	}
+	depth--;
+	return true;
+}
+
+bool JBBuilder::copy(const JBItem *item)
+{
+	if (!item || failed || depth < 0)
+		return !failed && item;
+
+	// name of the copy: pending key, or the item name in an object
+	bool renamed = hasKey;
+	if (!hasKey && !inArray()) {
+#ifdef JB_KEY_STRING
+		const jchar *name = item->getName();
+		keyHash(item->getHash(), name, name ? item->getNameLen() : 0);
+#else
+		keyHash(item->getHash());
+#endif
+	}
+	JBType type = item->getType();
+	if (type == JB_ROOT)
+		type = JB_OBJECT;
+	else if (type == JB_NULL_VALUE && inArray())
+		type = JB_NULL;
+	else if (type == JB_NULL && !inArray() && renamed)	// a null tag in an object has no name
+		type = JB_NULL_VALUE;
+	uint count = (uint)(JBSubtreeLast(item) - item) + 1;
+	JBItem *top = add(type);
+	if (!top || !reserveItems(count - 1))
+		return false;
+	top = &aItems[numItems - 1];
+#ifdef JB_KEY_HASH
+	uint top_hash = top->hash;
+#endif
+	uint top_name = 0;
+#ifdef JB_KEY_STRING
+#ifdef JB_INLINE_STRINGS
+	top_name = (uint)(size_t)top->name.p;
+#else
+	top_name = top->name.o;
+#endif
+#endif
+	JBItem *dest = top;
+	memcpy(dest, item, count * sizeof(JBItem));
+	numItems += count - 1;
+
+	// the top item keeps the name and type of the added item
+	dest->type = type;
+	dest->sibling = 0;
+#ifdef JB_KEY_HASH
+	dest->hash = top_hash;
+#endif
+	setName(*dest, top_name, inArray() ? 0 : pendingLen);
+
+	// rewrite strings to the new table
+	for (uint i = 0; i < count; i++) {
+		const JBItem &src = item[i];
+		JBItem &copied = dest[i];
+#ifdef JB_KEY_STRING
+		if (i) {
+			const jchar *name = src.getName();
+			uint offset = 0;
+			if (name && !(offset = addString(name, src.getNameLen()))) {
+				failed = true;
+				return false;
+			}
+			setName(copied, offset, name ? src.getNameLen() : 0);
+		}
+#endif
+		if (src.getType() == JB_STRING) {
+			const jchar *str = src.getStr();
+			uint offset = 0;
+			if (str && !(offset = addString(str, src.getStrLen()))) {
+				failed = true;
+				return false;
+			}
+			setStr(copied, offset, str ? src.getStrLen() : 0);
+		}
+	}
+	return true;
+}
+
+JBItem* JBBuilder::finish(JBRet *info)
+{
+	if (failed || depth != 0) {
+		release();
+		return NULL;
+	}
+	size_t items_size = numItems * sizeof(JBItem);
+	size_t size = items_size + numChars * sizeof(jchar);
+	JBItem *pRet = (JBItem*)malloc(size ? size : 1);
+	if (pRet) {
+		memcpy(pRet, aItems, items_size);
+		jchar *strings = (jchar*)&pRet[numItems];
+		if (numChars)
+			memcpy(strings, aChars, numChars * sizeof(jchar));
+		for (uint i = 0; i < numItems; i++) {
+			JBItem &item = pRet[i];
+#ifdef JB_KEY_STRING
+#ifdef JB_INLINE_STRINGS
+			if (uint offset = (uint)(size_t)item.name.p)
+				item.name.p = strings + offset - 1;
+#else
+			if (uint offset = item.name.o)
+				item.name.o = (uint)((const char*)(strings + offset - 1) - (const char*)&item.name.o);
+#endif
+#endif
+			if (item.type == JB_STRING) {
+#ifdef JB_INLINE_STRINGS
+				if (uint offset = (uint)(size_t)item.data.s.p)
+					item.data.s.p = strings + offset - 1;
+#else
+				if (uint offset = item.data.s.o)
+					item.data.s.o = (uint)((const char*)(strings + offset - 1) - (const char*)&item.data);
+#endif
+			}
+		}
+		if (info) {
+			memset(info, 0, sizeof(JBRet));
+			info->bin_size = (uint)size;
+			info->num_items = numItems;
+			info->text_size = numChars * sizeof(jchar);
+			info->strings_count = numStrs;
+		}
+	} else if (info) {
+		memset(info, 0, sizeof(JBRet));
+		info->error_code = JBERR_OUT_OF_MEMORY;
+	}
+	release();
+	return pRet;
+}
+
+// string of a source block and where it goes in the new table
+struct sCopyStr {
+	const jchar *src;
+	uint offset;		// chars from the start of the new string table
+	uint len;
+	bool first;			// first source string with this text, the one that is copied
+};
+
+// string table of items copied from parsed blocks. Strings are already
+// shared within a block so they are matched by address, and by text only
+// when several blocks are combined.
+struct sCopyStrings {
+	sCopyStr *aTable;	// by source address
+	uint *aText;		// entry + 1 in aTable by text, NULL for a single block
+	uint mask;
+	uint numChars;
+	uint numStrs;
+
+	sCopyStrings() : aTable(NULL), aText(NULL), mask(0), numChars(0), numStrs(0) {}
+	~sCopyStrings() { free(aTable); free(aText); }
+
+	// max_strs is at most the number of names and strings that will be added
+	bool init(uint max_strs, bool by_text)
+	{
+		uint size = 64;
+		while (size < max_strs * 2)	// at most half full
+			size *= 2;
+		mask = size - 1;
+		aTable = (sCopyStr*)calloc(size, sizeof(sCopyStr));
+		if (by_text)
+			aText = (uint*)calloc(size, sizeof(uint));
+		return aTable && (aText || !by_text);
+	}
+
+	sCopyStr* find(const jchar *str)
+	{
+		uint slot = (uint)(((size_t)str >> 1) * 0x9e3779b1u) & mask;
+		while (aTable[slot].src && aTable[slot].src != str)
+			slot = (slot + 1) & mask;
+		return &aTable[slot];
+	}
+
+	void add(const jchar *str, uint len)
+	{
+		sCopyStr *entry = find(str);
+		if (entry->src)
+			return;
+		entry->src = str;
+		entry->len = len;
+		if (aText) {
+			uint slot = hashChars(str, len) & mask;
+			while (uint index = aText[slot]) {
+				const sCopyStr &prev = aTable[index - 1];
+				if (prev.len == len && !memcmp(prev.src, str, len * sizeof(jchar))) {
+					entry->offset = prev.offset;
+					entry->first = false;
+					return;
+				}
+				slot = (slot + 1) & mask;
+			}
+			aText[slot] = (uint)(entry - aTable) + 1;
+		}
+		entry->offset = numChars;
+		entry->first = true;
+		numChars += len + 1;
+		numStrs++;
+	}
+
+	// names and strings of a range of items
+	void addItems(const JBItem *src, uint count)
+	{
+		for (uint i = 0; i < count; i++) {
+#ifdef JB_KEY_STRING
+			if (const jchar *name = src[i].getName())
+				add(name, src[i].getNameLen());
+#endif
+			if (src[i].type == JB_STRING) {
+				if (const jchar *str = src[i].getStr())
+					add(str, src[i].getStrLen());
+			}
+		}
+	}
+
+	void write(jchar *strings) const
+	{
+		for (uint s = 0; s <= mask; s++) {
+			if (aTable[s].src && aTable[s].first)
+				memcpy(strings + aTable[s].offset, aTable[s].src, (aTable[s].len + 1) * sizeof(jchar));
+		}
+	}
+
+	// copy a range of items added with addItems and point them at the new table
+	void copyItems(JBItem *dest, const JBItem *src, uint count, jchar *strings)
+	{
+		memcpy(dest, src, count * sizeof(JBItem));
+		for (uint i = 0; i < count; i++) {
+			JBItem &item = dest[i];
+#ifdef JB_KEY_STRING
+			if (const jchar *name = src[i].getName()) {
+				const jchar *to = strings + find(name)->offset;
+#ifdef JB_INLINE_STRINGS
+				item.name.p = to;
+#else
+				item.name.o = (uint)((const char*)to - (const char*)&item.name.o);
+#endif
+			}
+#endif
+			if (src[i].type == JB_STRING) {
+				if (const jchar *str = src[i].getStr()) {
+					const jchar *to = strings + find(str)->offset;
+#ifdef JB_INLINE_STRINGS
+					item.data.s.p = to;
+#else
+					item.data.s.o = (uint)((const char*)to - (const char*)&item.data);
+#endif
+				}
+			}
+		}
+	}
+};
+
+// nameless item at the top of a new block or an array
+static void clearName(JBItem &item)
+{
+#ifdef JB_KEY_HASH
+	item.hash = 0;
+#endif
+#ifdef JB_KEY_STRING
+#ifdef JB_INLINE_STRINGS
+	item.name.p = NULL;
+#else
+	item.name.o = 0;
+#endif
+#ifdef JB_STRLEN
+	item.name.l = 0;
+#endif
+#else
+	(void)item;
+#endif
+}
+
+static JBItem* allocBlock(uint numItems, const sCopyStrings &strs, JBRet *info, size_t &size)
+{
+	size = numItems * sizeof(JBItem) + strs.numChars * sizeof(jchar);
+	JBItem *pRet = (JBItem*)malloc(size);
+	if (!pRet && info)
+		info->error_code = JBERR_OUT_OF_MEMORY;
+	return pRet;
+}
+
+static void blockInfo(JBRet *info, size_t size, uint numItems, const sCopyStrings &strs)
+{
+	if (info) {
+		info->bin_size = (uint)size;
+		info->num_items = numItems;
+		info->text_size = strs.numChars * sizeof(jchar);
+		info->strings_count = strs.numStrs;
+	}
+}
+
+JBItem* JBExtract(const JBItem *subtree, JBRet *info)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+	JBType top_type = subtree ? subtree->getType() : JB_NULL;
+	if (top_type != JB_ROOT && top_type != JB_OBJECT && top_type != JB_ARRAY)
+		return NULL;
+	uint count = (uint)(JBSubtreeLast(subtree) - subtree) + 1;
+
+	// the name of the top item is dropped
+	sCopyStrings strs;
+	if (!strs.init(count * 2, false)) {
+		if (info)
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	strs.addItems(subtree + 1, count - 1);
+	size_t size;
+	JBItem *pRet = allocBlock(count, strs, info, size);
+	if (!pRet)
+		return NULL;
+	jchar *strings = (jchar*)&pRet[count];
+	strs.write(strings);
+	pRet[0] = subtree[0];
+	pRet[0].type = top_type == JB_ARRAY ? JB_ARRAY : JB_ROOT;
+	pRet[0].sibling = 0;
+	clearName(pRet[0]);
+	strs.copyItems(pRet + 1, subtree + 1, count - 1, strings);
+	blockInfo(info, size, count, strs);
+	return pRet;
+}
+
+JBItem* JBConcat(const JBItem *const *aBlocks, unsigned int numBlocks, JBRet *info)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+
+	// a root array adds its elements, a root object adds itself
+	uint numItems = 1;
+	for (uint b = 0; b < numBlocks; b++) {
+		JBType type = aBlocks[b] ? aBlocks[b]->getType() : JB_NULL;
+		if (type != JB_ROOT && type != JB_ARRAY)
+			return NULL;
+		numItems += (uint)(JBSubtreeLast(aBlocks[b]) - aBlocks[b]) + (type == JB_ARRAY ? 0 : 1);
+	}
+	sCopyStrings strs;
+	if (!strs.init(numItems * 2, numBlocks > 1)) {
+		if (info)
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	for (uint b = 0; b < numBlocks; b++) {
+		uint count = (uint)(JBSubtreeLast(aBlocks[b]) - aBlocks[b]) + 1;
+		strs.addItems(aBlocks[b] + 1, count - 1);
+	}
+	size_t size;
+	JBItem *pRet = allocBlock(numItems, strs, info, size);
+	if (!pRet)
+		return NULL;
+	jchar *strings = (jchar*)&pRet[numItems];
+	strs.write(strings);
+	memset(&pRet[0], 0, sizeof(JBItem));
+	pRet[0].type = JB_ARRAY;
+
+	// copy each block after the previous and link the last element to the next
+	uint next = 1, last = 0;	// last element so far, 0 = none
+	for (uint b = 0; b < numBlocks; b++) {
+		const JBItem *block = aBlocks[b];
+		uint count = (uint)(JBSubtreeLast(block) - block) + 1;
+		uint first = next;
+		if (block->getType() == JB_ARRAY) {
+			if (!block->getChildCount())
+				continue;
+			strs.copyItems(&pRet[next], block + 1, count - 1, strings);
+			next += count - 1;
+			pRet[0].data.i += block->getChildCount();
+		} else {
+			pRet[next] = block[0];
+			pRet[next].type = JB_OBJECT;
+			pRet[next].sibling = 0;
+			clearName(pRet[next]);
+			strs.copyItems(&pRet[next + 1], block + 1, count - 1, strings);
+			next += count;
+			pRet[0].data.i++;
+		}
+		if (last) {
+			if (first - last > JB_SIBLING_MAX) {
+				free(pRet);
+				if (info)
+					info->error_code = JBERR_UNREPRESENTABLE;
+				return NULL;
+			}
+			pRet[last].sibling = (int)(first - last);
+		}
+		last = first;
+		while (pRet[last].sibling)
+			last += pRet[last].sibling;
+	}
+	blockInfo(info, size, numItems, strs);
+	return pRet;
+}
+
+// members of the root objects in order
+struct sMergeMember {
+	const JBItem *item;
+	uint count;			// items in the subtree
+	uint prev;			// member + 1 of the previous member with the same key, 0 = none
+	bool replaced;		// a later block has the same key
+};
+
+static bool sameKey(const JBItem *a, const JBItem *b)
+{
+	if (a->getHash() != b->getHash())
+		return false;
+#ifdef JB_KEY_STRING
+	const jchar *na = a->getName(), *nb = b->getName();
+	if (!na || !nb)
+		return na == nb;
+	uint len = a->getNameLen();
+	return len == b->getNameLen() && !memcmp(na, nb, len * sizeof(jchar));
+#else
+	return true;
+#endif
+}
+
+JBItem* JBMergeObjects(const JBItem *const *aBlocks, unsigned int numBlocks, JBRet *info)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+	uint numMembers = 0;
+	for (uint b = 0; b < numBlocks; b++) {
+		if (!aBlocks[b] || aBlocks[b]->getType() != JB_ROOT)
+			return NULL;
+		numMembers += (uint)aBlocks[b]->getChildCount();
+	}
+
+	// list members with their sizes, and match keys from earlier blocks
+	uint size = 64;
+	while (size < numMembers * 2)
+		size *= 2;
+	sMergeMember *aMembers = (sMergeMember*)malloc((numMembers ? numMembers : 1) * sizeof(sMergeMember));
+	uint *aKeys = (uint*)calloc(size, sizeof(uint));	// member + 1 of the last member with a key
+	if (!aMembers || !aKeys) {
+		free(aMembers);
+		free(aKeys);
+		if (info)
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	uint m = 0, numItems = 1;
+	for (uint b = 0; b < numBlocks; b++) {
+		const JBItem *end = JBSubtreeLast(aBlocks[b]) + 1;
+		uint first = m;
+		for (const JBItem *child = aBlocks[b]->getChild(); child; child = child->getSibling()) {
+			sMergeMember &member = aMembers[m];
+			member.item = child;
+			member.count = child->sibling ? (uint)child->sibling : (uint)(end - child);
+			member.prev = 0;
+			member.replaced = false;
+			uint slot = child->getHash() & (size - 1);
+			while (uint index = aKeys[slot]) {
+				if (sameKey(aMembers[index - 1].item, child))
+					break;
+				slot = (slot + 1) & (size - 1);
+			}
+			if ((member.prev = aKeys[slot]) && member.prev - 1 < first) {	// duplicate keys within one block are kept like JSONBin
+				for (uint p = member.prev; p && !aMembers[p - 1].replaced; p = aMembers[p - 1].prev)
+					aMembers[p - 1].replaced = true;
+			}
+			aKeys[slot] = m + 1;
+			m++;
+		}
+	}
+	free(aKeys);
+
+	// later blocks replace members with the same key
+	for (m = 0; m < numMembers; m++) {
+		if (!aMembers[m].replaced)
+			numItems += aMembers[m].count;
+	}
+	sCopyStrings strs;
+	if (!strs.init(numItems * 2, numBlocks > 1)) {
+		free(aMembers);
+		if (info)
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		return NULL;
+	}
+	for (m = 0; m < numMembers; m++) {
+		if (!aMembers[m].replaced)
+			strs.addItems(aMembers[m].item, aMembers[m].count);
+	}
+	size_t bin_size;
+	JBItem *pRet = allocBlock(numItems, strs, info, bin_size);
+	if (!pRet) {
+		free(aMembers);
+		return NULL;
+	}
+	jchar *strings = (jchar*)&pRet[numItems];
+	strs.write(strings);
+	memset(&pRet[0], 0, sizeof(JBItem));
+	pRet[0].type = JB_ROOT;
+	uint next = 1, last = 0;
+	for (m = 0; m < numMembers; m++) {
+		if (aMembers[m].replaced)
+			continue;
+		if (last && next - last > JB_SIBLING_MAX) {
+			free(aMembers);
+			free(pRet);
+			if (info)
+				info->error_code = JBERR_UNREPRESENTABLE;
+			return NULL;
+		}
+		strs.copyItems(&pRet[next], aMembers[m].item, aMembers[m].count, strings);
+		pRet[next].sibling = 0;
+		if (last)
+			pRet[last].sibling = (int)(next - last);
+		last = next;
+		next += aMembers[m].count;
+		pRet[0].data.i++;
+	}
+	free(aMembers);
+	blockInfo(info, bin_size, numItems, strs);
+	return pRet;
+}
+
+}	// namespace jbin
@@ -0,0 +1,134 @@
+#ifndef __JBBUILDER_H__
+#define __JBBUILDER_H__
+
+//
+// JBBuilder
+//
+// Summary
+//	- Builds a new block in the same format as JSONBin returns (items in depth
+//		first order followed by shared strings, relocatable unless
+//		JB_INLINE_STRINGS) from values added in order, without any JSON text.
+//	- Subtrees of existing blocks can be copied in whole, the items are copied
+//		with memcpy and only their string offsets are rewritten.
+//	- Used by the editing, patching and merging modules, and by applications
+//		that generate data directly.
+//
+// Usage
+//	- JBBuilder build; build.begin();	// or begin(JB_ARRAY) for a root array
+//	- Inside an object call key() before each value, inside an array add values
+//		directly:
+//		build.key("name", 4); build.addStr("harbor", 6);
+//		build.key("objects", 7); build.open(JB_ARRAY);
+//			build.open(JB_OBJECT); build.key("speed", 5); build.addFloat(4.5f); build.close();
+//			build.copy(pOther->findByHash(JBHashKey("crate", 5)));	// name is dropped in an array
+//		build.close();
+//	- JBItem *pJSON = build.finish(&ret);	// release with free like JSONBin data
+//	- A failed add (out of memory, too deep, missing key) sets failed and
+//		finish() returns NULL, it is enough to check the result of finish().
+//	- copy() uses the key set before it, or the name of the copied item if
+//		no key is set and the current container is an object.
+//	- keyHash() sets a key by hash only (JB_KEY_HASH builds without key
+//		strings, or to keep a name that was only available as a hash).
+//	- Cut one object or array out of a large document as its own block, to
+//		cache it or send it on without the rest:
+//		JBItem *pUser = JBExtract(pJSON->findByHash(JBHashKey("user", 4)), &ret);
+//	- Combine blocks parsed separately into one, for example the output of
+//		sharded jobs:
+//		JBItem *pAll = JBConcat(apShards, numShards, &ret);	// root array
+//		JBItem *pConfig = JBMergeObjects(apLayers, numLayers, &ret);	// root object
+//
+// Notes
+//	- Strings are utf-8 (or utf-16 with JB_WCHAR16) and are not escaped or
+//		validated. Equal strings are shared like JSONBin does.
+//	- The builder does not check for duplicate keys.
+//	- release() frees the work memory, finish() calls it.
+//	- JBExtract copies the items of the subtree with one memcpy and builds a
+//		new string table from the names and strings they reference. Strings
+//		of a block are already shared so they are matched by address without
+//		comparing characters. An object becomes the root object of the new
+//		block and an array a root array, with the same layout as JSONBin.
+//	- JBConcat returns a root array with the elements of each root array and
+//		each root object as one element. JBMergeObjects returns a root object
+//		with the members of each root object, a member of a later block
+//		replaces members with the same key in earlier blocks.
+//	- JBConcat and JBMergeObjects copy each block or member with memcpy, link
+//		the boundary siblings and count the root children. Strings are shared
+//		between the blocks, each string of a block is compared by text once.
+//	- Blocks with shared subtrees (JB_SHARED_SUBTREES) can not be copied.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+struct JBBuilder {
+	JBItem *aItems;				// items being built, strings are recorded as table offsets until finish()
+	unsigned int numItems;
+	unsigned int maxItems;
+	jchar *aChars;				// string table being built
+	unsigned int numChars;
+	unsigned int maxChars;
+	unsigned int *aStrTable;	// string dedup table, offset + 1 of a string in aChars (0 = empty slot)
+	unsigned int strTableSize;	// power of 2
+	unsigned int numStrs;
+	unsigned int aOpen[JSON_MAX_DEPTH];	// item index of each open container
+	unsigned int aLast[JSON_MAX_DEPTH];	// item index + 1 of the last child of each open container
+	int depth;
+	const jchar *pendingName;	// pending key for the next value
+	unsigned int pendingLen;
+	unsigned int pendingHash;
+	bool hasKey;
+	bool failed;
+
+	JBBuilder() : aItems(NULL), numItems(0), maxItems(0), aChars(NULL), numChars(0), maxChars(0),
+		aStrTable(NULL), strTableSize(0), numStrs(0), depth(-1), pendingName(NULL), pendingLen(0), pendingHash(0), hasKey(false), failed(false) {}
+	~JBBuilder() { release(); }
+
+	bool begin(JBType root_type = JB_ROOT);	// JB_ROOT or JB_ARRAY
+	bool key(const jchar *name, unsigned int len);	// hashed the same way as the parser
+	bool keyHash(unsigned int hash, const jchar *name = NULL, unsigned int len = 0);
+	bool addInt(jbint value);
+	bool addFloat(jbfloat value);
+	bool addBool(bool value);
+	bool addNull();
+	bool addStr(const jchar *str, unsigned int len);
+	bool open(JBType type);		// JB_OBJECT or JB_ARRAY, add children then close()
+	bool close();
+	bool copy(const JBItem *item);	// item and all its children
+	JBItem* finish(JBRet *info = 0);
+	void release();
+
+	int level() const { return depth; }	// 0 while adding to the root
+	bool inArray() const { return depth >= 0 && aItems[aOpen[depth]].type == JB_ARRAY; }
+
+	// internal
+	JBItem* add(JBType type);
+	bool reserveItems(unsigned int count);
+	unsigned int addString(const jchar *str, unsigned int len);
+	void setName(JBItem &item, unsigned int offset, unsigned int len);
+	void setStr(JBItem &item, unsigned int offset, unsigned int len);
+
+private:
+	JBBuilder(const JBBuilder&);	// not copyable, the destructor frees the work memory
+	JBBuilder& operator=(const JBBuilder&);
+};
+
+// last item in the subtree of an item (the item itself if it has no children)
+const JBItem* JBSubtreeLast(const JBItem *item);
+
+// copy an object or array and its children into a new block with only the strings it uses, NULL for other values
+JBItem* JBExtract(const JBItem *subtree, JBRet *info = 0);
+
+// root array of the elements of root arrays and of root objects, NULL if a block is not a root
+JBItem* JBConcat(const JBItem *const *aBlocks, unsigned int numBlocks, JBRet *info = 0);
+
+// root object of the members of root objects, later keys win, NULL if a block is not a root object
+JBItem* JBMergeObjects(const JBItem *const *aBlocks, unsigned int numBlocks, JBRet *info = 0);
+
+// key hash of a name in memory format (jchar), same as JBHashKey of the utf-8 key
+unsigned int JBHashName(const jchar *name, unsigned int len);
+
+}	// namespace jbin
+
+#endif
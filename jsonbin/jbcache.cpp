@@ -0,0 +1,379 @@
+//
+// JBCache
+//
+// Details in jbcache.h
+//
+
+#include <stdio.h>	// FILE
+#include <stdlib.h>	// malloc/free/qsort
+#include <string.h>	// memcpy
+#include <sys/types.h>
+#include <sys/stat.h>	// stat
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// FindFirstFile / MoveFileEx
+#include <direct.h>		// _mkdir
+#include <process.h>	// _getpid
+#include <sys/utime.h>	// _utime
+#else
+#include <dirent.h>		// opendir
+#include <unistd.h>		// getpid / unlink
+#include <utime.h>		// utime
+#endif
+#include "jbcache.h"
+#include "jbsnapshot.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+typedef unsigned long long u64;
+
+#define JB_FNV1A64_SEED 14695981039346656037ULL
+#define JB_FNV1A64_PRIME 1099511628211ULL
+#define JB_CACHE_NAME_LEN 21	// 16 hex digits + JB_CACHE_EXT
+
+static bool setError(JBCacheError *error, JBCacheError code)
+{
+	if (error)
+		*error = code;
+	return code == JBCERR_NONE;
+}
+
+static u64 hash64(const void *data, size_t size, u64 hash = JB_FNV1A64_SEED)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	while (size--)
+		hash = (*bytes++ ^ hash) * JB_FNV1A64_PRIME;
+	return hash;
+}
+
+// size and modification time of a file
+static bool statFile(const char *path, u64 &size, long long &mtime)
+{
+#ifdef WIN32
+	struct _stat64 file_stat;
+	if (_stat64(path, &file_stat))
+		return false;
+#else
+	struct stat file_stat;
+	if (stat(path, &file_stat))
+		return false;
+#endif
+	size = (u64)file_stat.st_size;
+	mtime = (long long)file_stat.st_mtime;
+	return true;
+}
+
+// append a string to a path buffer, false if it does not fit
+static bool appendPath(char *path, size_t &len, const char *str)
+{
+	size_t add = strlen(str);
+	if (len + add >= JB_CACHE_MAX_PATH)
+		return false;
+	memcpy(path + len, str, add + 1);
+	len += add;
+	return true;
+}
+
+static bool appendHex(char *path, size_t &len, u64 value, int digits)
+{
+	char hex[17];
+	for (int d = digits - 1; d >= 0; d--, value >>= 4)
+		hex[d] = "0123456789abcdef"[value & 15];
+	hex[digits] = 0;
+	return appendPath(path, len, hex);
+}
+
+static bool isEntryName(const char *name)
+{
+	if (strlen(name) != JB_CACHE_NAME_LEN || strcmp(name + 16, JB_CACHE_EXT))
+		return false;
+	for (int d = 0; d < 16; d++) {
+		if (!((name[d] >= '0' && name[d] <= '9') || (name[d] >= 'a' && name[d] <= 'f')))
+			return false;
+	}
+	return true;
+}
+
+static char* readFile(const char *path, u64 size, JBCacheError *error)
+{
+	if (size > 0xffffffffULL) {	// JSONBin sizes are 32 bit
+		setError(error, JBCERR_READ);
+		return NULL;
+	}
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "rb"))
+		f = NULL;
+#else
+	f = fopen(path, "rb");
+#endif
+	if (!f) {
+		setError(error, JBCERR_OPEN);
+		return NULL;
+	}
+	char *json = (char*)malloc(size ? (size_t)size : 1);
+	if (!json)
+		setError(error, JBCERR_OUT_OF_MEMORY);
+	else if (size && fread(json, (size_t)size, 1, f) != 1) {
+		free(json);
+		json = NULL;
+		setError(error, JBCERR_READ);
+	}
+	fclose(f);
+	return json;
+}
+
+// write a snapshot to a temporary file next to the entry and rename it into place
+static bool storeEntry(const char *entry, const JBItem *block, const JBRet &info, uint source_hash)
+{
+#ifdef JB_INLINE_STRINGS
+	(void)entry; (void)block; (void)info; (void)source_hash;
+	return false;
+#else
+	char temp[JB_CACHE_MAX_PATH];
+	size_t len = 0;
+	temp[0] = 0;
+#ifdef WIN32
+	u64 pid = (u64)_getpid();
+#else
+	u64 pid = (u64)getpid();
+#endif
+	if (!appendPath(temp, len, entry) || !appendPath(temp, len, ".tmp") || !appendHex(temp, len, pid, 8))
+		return false;
+
+	JBSnapshotHeader header;
+	JBSnapshotInitHeader(header, info.bin_size, info.num_items, JBSnapshotChecksum(block, info.bin_size));
+	header.source_hash = source_hash;
+
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, temp, "wb"))
+		f = NULL;
+#else
+	f = fopen(temp, "wb");
+#endif
+	if (!f)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(block, info.bin_size, 1, f) == 1;
+	if (fclose(f))
+		written = false;
+#ifdef WIN32
+	if (written && !MoveFileExA(temp, entry, MOVEFILE_REPLACE_EXISTING))
+		written = false;
+#else
+	if (written && rename(temp, entry))
+		written = false;
+#endif
+	if (!written)
+		remove(temp);
+	return written;
+#endif
+}
+
+void JBCacheDoc::release()
+{
+	if (pAllocated)
+		free(pAllocated);
+	else if (pJSON)
+		JBUnloadMapped(pJSON);
+	pJSON = NULL;
+	pAllocated = NULL;
+	hit = false;
+}
+
+bool JBCache::init(const char *cache_directory, unsigned long long size_limit)
+{
+	size_t len = 0;
+	directory[0] = 0;
+	max_bytes = size_limit;
+	// room for the directory, a separator and an entry name with a temporary suffix
+	if (!cache_directory || !*cache_directory || strlen(cache_directory) + JB_CACHE_NAME_LEN + 14 >= JB_CACHE_MAX_PATH)
+		return false;
+	appendPath(directory, len, cache_directory);
+#ifdef WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0777);
+#endif
+	u64 size;
+	long long mtime;
+	if (!statFile(directory, size, mtime)) {
+		directory[0] = 0;
+		return false;
+	}
+	return true;
+}
+
+bool JBCache::load(const char *path, JBCacheDoc &doc, JBCacheError *error)
+{
+	doc.release();
+	doc.info = JBRet();
+	if (!directory[0] || !path)
+		return setError(error, JBCERR_PATH);
+
+	u64 size;
+	long long mtime;
+	if (!statFile(path, size, mtime))
+		return setError(error, JBCERR_OPEN);
+
+	// entry name is a hash of the file identity
+	u64 key = hash64(path, strlen(path));
+	key = hash64(&size, sizeof(size), key);
+	key = hash64(&mtime, sizeof(mtime), key);
+	char entry[JB_CACHE_MAX_PATH];
+	size_t len = 0;
+	entry[0] = 0;
+	if (!appendPath(entry, len, directory) || !appendPath(entry, len, "/") ||
+		!appendHex(entry, len, key, 16) || !appendPath(entry, len, JB_CACHE_EXT))
+		return setError(error, JBCERR_PATH);
+
+	char *json = NULL;
+	uint source_hash = 0;
+	if (check_content) {
+		if (!(json = readFile(path, size, error)))
+			return false;
+		source_hash = JBSnapshotChecksum(json, (uint)size);
+	}
+
+	if (const JBItem *mapped = JBLoadMapped(entry)) {
+		const JBSnapshotHeader &header = *((const JBSnapshotHeader*)mapped - 1);
+		if (!check_content || header.source_hash == source_hash) {
+			free(json);
+#ifdef WIN32
+			_utime(entry, NULL);	// last use time for trim
+#else
+			utime(entry, NULL);
+#endif
+			doc.pJSON = mapped;
+			doc.info.bin_size = header.block_size;
+			doc.info.num_items = header.num_items;
+			doc.hit = true;
+			hits++;
+			return setError(error, JBCERR_NONE);
+		}
+		JBUnloadMapped(mapped);
+	}
+
+	misses++;
+	if (!json) {
+		if (!(json = readFile(path, size, error)))
+			return false;
+		source_hash = JBSnapshotChecksum(json, (uint)size);
+	}
+	JBItem *block = JSONBin(json, (uint)size, &doc.info);
+	free(json);
+	if (!block)
+		return setError(error, JBCERR_PARSE);
+
+	const JBItem *mapped = storeEntry(entry, block, doc.info, source_hash) ? JBLoadMapped(entry) : NULL;
+	if (!mapped) {
+		doc.pJSON = doc.pAllocated = block;
+		return setError(error, JBCERR_STORE);
+	}
+	free(block);
+	doc.pJSON = mapped;
+	stores++;
+	if (max_bytes)
+		trim();
+	return setError(error, JBCERR_NONE);
+}
+
+// cache entry found by trim
+struct sCacheEntry {
+	char name[JB_CACHE_NAME_LEN + 1];
+	u64 size;
+	long long mtime;
+};
+
+static int compareEntryAge(const void *a, const void *b)
+{
+	const sCacheEntry *ea = (const sCacheEntry*)a, *eb = (const sCacheEntry*)b;
+	return ea->mtime < eb->mtime ? -1 : (ea->mtime > eb->mtime ? 1 : 0);
+}
+
+// add an entry to a growing list
+static bool addEntry(sCacheEntry *&aEntries, int &numEntries, int &maxEntries, const char *name, u64 size, long long mtime)
+{
+	if (numEntries == maxEntries) {
+		int grow = maxEntries ? maxEntries * 2 : 64;
+		sCacheEntry *aGrow = (sCacheEntry*)realloc(aEntries, grow * sizeof(sCacheEntry));
+		if (!aGrow)
+			return false;
+		aEntries = aGrow;
+		maxEntries = grow;
+	}
+	sCacheEntry &e = aEntries[numEntries++];
+	memcpy(e.name, name, JB_CACHE_NAME_LEN + 1);
+	e.size = size;
+	e.mtime = mtime;
+	return true;
+}
+
+void JBCache::trim()
+{
+	if (!directory[0] || !max_bytes)
+		return;
+
+	sCacheEntry *aEntries = NULL;
+	int numEntries = 0, maxEntries = 0;
+	u64 total = 0;
+	char path[JB_CACHE_MAX_PATH];
+	size_t len = 0;
+	path[0] = 0;
+	appendPath(path, len, directory);
+	appendPath(path, len, "/");
+	size_t dir_len = len;
+#ifdef WIN32
+	appendPath(path, len, "*" JB_CACHE_EXT);
+	WIN32_FIND_DATAA find;
+	HANDLE search = FindFirstFileA(path, &find);
+	if (search == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if (!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isEntryName(find.cFileName)) {
+			u64 size = ((u64)find.nFileSizeHigh << 32) | find.nFileSizeLow;
+			long long mtime = ((long long)find.ftLastWriteTime.dwHighDateTime << 32) | find.ftLastWriteTime.dwLowDateTime;
+			if (!addEntry(aEntries, numEntries, maxEntries, find.cFileName, size, mtime))
+				break;
+			total += size;
+		}
+	} while (FindNextFileA(search, &find));
+	FindClose(search);
+#else
+	DIR *dir = opendir(directory);
+	if (!dir)
+		return;
+	while (struct dirent *file = readdir(dir)) {
+		if (!isEntryName(file->d_name))
+			continue;
+		u64 size;
+		long long mtime;
+		len = dir_len;
+		path[len] = 0;
+		if (appendPath(path, len, file->d_name) && statFile(path, size, mtime)) {
+			if (!addEntry(aEntries, numEntries, maxEntries, file->d_name, size, mtime))
+				break;
+			total += size;
+		}
+	}
+	closedir(dir);
+#endif
+
+	// remove the least recently used entries first
+	if (total > max_bytes && numEntries) {
+		qsort(aEntries, numEntries, sizeof(sCacheEntry), compareEntryAge);
+		for (int e = 0; e < numEntries && total > max_bytes; e++) {
+			len = dir_len;
+			path[len] = 0;
+			appendPath(path, len, aEntries[e].name);
+			if (!remove(path)) {	// fails on Windows while another process has the entry mapped
+				total -= aEntries[e].size;
+				evictions++;
+			}
+		}
+	}
+	free(aEntries);
+}
+
+}	// namespace jbin
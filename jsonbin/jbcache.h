@@ -0,0 +1,98 @@
+#ifndef __JBCACHE_H__
+#define __JBCACHE_H__
+
+//
+// JBCache
+//
+// Summary
+//	- Persistent parse cache in front of JSONBin. Parsed blocks are stored as
+//		snapshots (jbsnapshot.h) in a cache directory and memory mapped on the
+//		next load of the same unchanged file instead of parsed again.
+//	- Entries are keyed by the path, size and modification time of the JSON
+//		file and record a content hash of the text they were parsed from.
+//	- New entries are written to a temporary file and renamed into place so
+//		other processes sharing the directory never map a partial entry.
+//	- An optional size limit evicts the least recently used entries.
+//
+// Usage
+//	- Set up a cache (on stack or as a member) with a directory and an
+//		optional size limit in bytes (0 = no limit):
+//		JBCache cache; cache.init("build/jsoncache", 512 * 1024 * 1024);
+//	- Load a file through the cache:
+//		JBCacheDoc doc;
+//		if (cache.load("level.json", doc)) { ... doc.pJSON ... }
+//		doc.release();	// or let the destructor release it
+//	- load() returns false if the file could not be read or parsed, check
+//		doc.info for parse errors (same as JSONBin). If the block was parsed
+//		but could not be stored the document is still valid, the error is
+//		JBCERR_STORE and doc.pJSON points to allocated memory instead.
+//	- hits / misses / stores / evictions count cache activity, reset them
+//		any time.
+//	- check_content (default on) reads and hashes the JSON text on a hit and
+//		treats a different hash as a miss. Turn it off to trust size and
+//		modification time and skip reading the file on a hit.
+//	- trim() evicts least recently used entries down to the size limit, it is
+//		called after each store when a limit is set. A hit touches the entry
+//		modification time which is used as the last use time.
+//
+// Notes
+//	- Requires jbsnapshot.cpp, and relocatable data (no JB_INLINE_STRINGS).
+//	- Entries saved with different compiled traits are replaced, not reused.
+//	- A JBCache is not thread safe, use one per thread. Several processes can
+//		share a cache directory.
+//	- Only files named like cache entries (16 hex digits + ".jbin") are evicted.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+#define JB_CACHE_MAX_PATH 1024	// longest cache directory and entry path
+#define JB_CACHE_EXT ".jbin"
+
+// ERROR CODES (JBCache::load)
+enum JBCacheError {
+	JBCERR_NONE = 0,		// no error, must be 0
+	JBCERR_PATH,			// cache directory or entry path too long, or cache not initialized
+	JBCERR_OPEN,			// JSON file could not be opened
+	JBCERR_READ,			// JSON file could not be read
+	JBCERR_OUT_OF_MEMORY,	// could not allocate memory for the JSON text
+	JBCERR_PARSE,			// JSONBin failed, details in JBCacheDoc::info
+	JBCERR_STORE,			// parsed but could not be stored in the cache (document is still valid)
+};
+
+// a document loaded through JBCache
+struct JBCacheDoc {
+	const JBItem *pJSON;	// mapped cache entry or allocated block
+	JBItem *pAllocated;		// set if the block is allocated (not stored in the cache)
+	JBRet info;				// bin_size and num_items, or parse error
+	bool hit;				// loaded from the cache
+
+	JBCacheDoc() : pJSON(NULL), pAllocated(NULL), info(), hit(false) {}
+	~JBCacheDoc() { release(); }
+	void release();
+
+private:
+	JBCacheDoc(const JBCacheDoc&);	// not copyable, release() unmaps or frees the block
+	JBCacheDoc& operator=(const JBCacheDoc&);
+};
+
+struct JBCache {
+	char directory[JB_CACHE_MAX_PATH];
+	unsigned long long max_bytes;	// size limit of all entries, 0 = no limit
+	bool check_content;				// hash the JSON text on a hit (default true)
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int stores;
+	unsigned int evictions;
+
+	JBCache() : max_bytes(0), check_content(true), hits(0), misses(0), stores(0), evictions(0) { directory[0] = 0; }
+	bool init(const char *cache_directory, unsigned long long size_limit = 0);	// creates the directory if missing
+	bool load(const char *path, JBCacheDoc &doc, JBCacheError *error = 0);
+	void trim();	// evict least recently used entries down to max_bytes
+};
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,440 @@
+//
+// JBColumns
+//
+// Details in jbcolumns.h
+//
+
+#include <stdio.h>	// FILE
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcpy
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// CreateFileMapping / MapViewOfFile
+#else
+#include <fcntl.h>		// open
+#include <unistd.h>		// close
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#endif
+#include "jbcolumns.h"
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_COLUMN_CHUNK 64	// records per range unit, a multiple of 8 so threads do not share bitmap bytes
+
+static size_t valueSize(JBColumnType type)
+{
+	switch (type) {
+		case JBCOL_INT: return sizeof(jbint);
+		case JBCOL_FLOAT: return sizeof(jbfloat);
+		case JBCOL_BOOL: return sizeof(unsigned char);
+		case JBCOL_STRING: return sizeof(uint);
+	}
+	return 0;
+}
+
+static size_t valuesSize(JBColumnType type, uint numRecords)
+{
+	return valueSize(type) * (type == JBCOL_STRING ? (size_t)numRecords + 1 : numRecords);
+}
+
+// columns with names stored after them in one allocation
+static JBColumn* allocColumns(uint numColumns, const char *const *aNames)
+{
+	size_t size = numColumns * sizeof(JBColumn);
+	for (uint c = 0; c < numColumns; c++)
+		size += strlen(aNames[c]) + 1;
+	JBColumn *aColumns = (JBColumn*)calloc(1, size ? size : 1);
+	if (aColumns) {
+		char *names = (char*)&aColumns[numColumns];
+		for (uint c = 0; c < numColumns; c++) {
+			size_t len = strlen(aNames[c]) + 1;
+			memcpy(names, aNames[c], len);
+			aColumns[c].name = names;
+			names += len;
+		}
+	}
+	return aColumns;
+}
+
+void JBColumns::release()
+{
+	if (mapped) {
+#ifdef WIN32
+		UnmapViewOfFile(mapped);
+#else
+		munmap((void*)mapped, mappedSize);
+#endif
+	} else if (aColumns) {
+		for (uint c = 0; c < numColumns; c++) {
+			free(aColumns[c].aValues);
+			free(aColumns[c].aValid);
+			free(aColumns[c].aChars);
+		}
+	}
+	free(aColumns);
+	aColumns = NULL;
+	numColumns = numRecords = 0;
+	mapped = NULL;
+	mappedSize = 0;
+}
+
+const JBColumn* JBColumns::find(uint hash) const
+{
+	for (uint c = 0; c < numColumns; c++) {
+		if (aColumns[c].hash == hash)
+			return &aColumns[c];
+	}
+	return NULL;
+}
+
+//
+// Filling columns
+//
+
+struct sColumnFill {
+	JBColumns *columns;
+	const JBItem **aChunks;		// first record of each chunk
+	const jchar **aSources;		// string of each record for each string column
+	uint *aSourceColumn;		// string column index of each column
+	JBFieldCache *aCaches;		// numColumns per thread
+};
+
+// values, valid bits and string lengths of a range of chunks
+static void fillValues(void *user, uint first, uint end, uint thread)
+{
+	sColumnFill &fill = *(sColumnFill*)user;
+	const JBColumns &columns = *fill.columns;
+	JBFieldCache *aCaches = fill.aCaches + thread * columns.numColumns;
+	for (uint chunk = first; chunk < end; chunk++) {
+		const JBItem *record = fill.aChunks[chunk];
+		uint r = chunk * JB_COLUMN_CHUNK;
+		uint last = r + JB_COLUMN_CHUNK < columns.numRecords ? r + JB_COLUMN_CHUNK : columns.numRecords;
+		for (; r < last; r++, record = record->getSibling()) {
+			if (record->getType() != JB_OBJECT)
+				continue;
+			for (uint c = 0; c < columns.numColumns; c++) {
+				const JBColumn &column = columns.aColumns[c];
+				const JBItem *value = aCaches[c].find(record);
+				JBType type = value ? value->getType() : JB_NULL;
+				bool valid = false;
+				switch (column.type) {
+					case JBCOL_INT:
+						if ((valid = type == JB_INT || type == JB_FLOAT))
+							((jbint*)column.aValues)[r] = value->getInt();
+						break;
+					case JBCOL_FLOAT:
+						if ((valid = type == JB_INT || type == JB_FLOAT))
+							((jbfloat*)column.aValues)[r] = value->getFloat();
+						break;
+					case JBCOL_BOOL:
+						if ((valid = type == JB_BOOL))
+							((unsigned char*)column.aValues)[r] = value->getBool() ? 1 : 0;
+						break;
+					case JBCOL_STRING:
+						if ((valid = type == JB_STRING)) {
+							fill.aSources[(size_t)fill.aSourceColumn[c] * columns.numRecords + r] = value->getStr();
+							((uint*)column.aValues)[r + 1] = value->getStrLen() + 1;
+						}
+						break;
+				}
+				if (valid)
+					column.aValid[r >> 3] |= (unsigned char)(1 << (r & 7));
+			}
+		}
+	}
+}
+
+// copy strings of a range of chunks once the offsets are known
+static void fillStrings(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sColumnFill &fill = *(sColumnFill*)user;
+	const JBColumns &columns = *fill.columns;
+	uint r_first = first * JB_COLUMN_CHUNK;
+	uint r_end = end * JB_COLUMN_CHUNK < columns.numRecords ? end * JB_COLUMN_CHUNK : columns.numRecords;
+	for (uint c = 0; c < columns.numColumns; c++) {
+		const JBColumn &column = columns.aColumns[c];
+		if (column.type != JBCOL_STRING)
+			continue;
+		const uint *aOffsets = (const uint*)column.aValues;
+		const jchar **aSources = fill.aSources + (size_t)fill.aSourceColumn[c] * columns.numRecords;
+		for (uint r = r_first; r < r_end; r++) {
+			if (!column.valid(r))
+				continue;
+			uint len = aOffsets[r + 1] - aOffsets[r] - 1;
+			if (len)
+				memcpy(column.aChars + aOffsets[r], aSources[r], len * sizeof(jchar));
+			column.aChars[aOffsets[r] + len] = 0;
+		}
+	}
+}
+
+bool JBToColumns(JBColumns &columns, const JBItem *array, const JBColumnDef *aSchema, uint numColumns, uint threads)
+{
+	columns.release();
+	if (!array || array->getType() != JB_ARRAY)
+		return false;
+	uint numRecords = (uint)array->getChildCount();
+	uint numChunks = (numRecords + JB_COLUMN_CHUNK - 1) / JB_COLUMN_CHUNK;
+	if (threads < 1)
+		threads = 1;
+	if (threads > numChunks)
+		threads = numChunks ? numChunks : 1;
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+
+	// columns, zeroed values and bitmaps
+	const char **aNames = (const char**)calloc(numColumns + 1, sizeof(const char*));
+	uint *aSourceColumn = (uint*)calloc(numColumns + 1, sizeof(uint));
+	uint strings = 0;
+	if (aNames && aSourceColumn) {
+		for (uint c = 0; c < numColumns; c++) {
+			aNames[c] = aSchema[c].key;
+			if (aSchema[c].type == JBCOL_STRING)
+				aSourceColumn[c] = strings++;
+		}
+		columns.aColumns = allocColumns(numColumns, aNames);
+	}
+	free(aNames);
+	if (!columns.aColumns) {
+		free(aSourceColumn);
+		return false;
+	}
+	columns.numColumns = numColumns;
+	columns.numRecords = numRecords;
+	bool ok = true;
+	for (uint c = 0; c < numColumns; c++) {
+		JBColumn &column = columns.aColumns[c];
+		column.hash = JBHashKey(aSchema[c].key, (uint)strlen(aSchema[c].key));
+		column.type = aSchema[c].type;
+		column.aValues = calloc(1, valuesSize(column.type, numRecords) + 1);
+		column.aValid = (unsigned char*)calloc(1, numRecords / 8 + 1);
+		ok = ok && column.aValues && column.aValid;
+	}
+
+	sColumnFill fill;
+	fill.columns = &columns;
+	fill.aChunks = (const JBItem**)malloc((numChunks + 1) * sizeof(const JBItem*));
+	fill.aSources = strings ? (const jchar**)calloc((size_t)strings * numRecords + 1, sizeof(const jchar*)) : NULL;
+	fill.aSourceColumn = aSourceColumn;
+	fill.aCaches = (JBFieldCache*)malloc(threads * (numColumns + 1) * sizeof(JBFieldCache));
+	ok = ok && fill.aChunks && fill.aCaches && (fill.aSources || !strings);
+	if (ok) {
+		uint r = 0;
+		for (const JBItem *record = array->getChild(); record; record = record->getSibling(), r++) {
+			if (!(r % JB_COLUMN_CHUNK))
+				fill.aChunks[r / JB_COLUMN_CHUNK] = record;
+		}
+		for (uint t = 0; t < threads; t++) {
+			for (uint c = 0; c < numColumns; c++)
+				fill.aCaches[t * numColumns + c] = JBFieldCache(columns.aColumns[c].hash);
+		}
+		JBParallelFor(numChunks, threads, fillValues, &fill);
+
+		// string offsets from the lengths, then the characters
+		for (uint c = 0; ok && c < numColumns; c++) {
+			JBColumn &column = columns.aColumns[c];
+			if (column.type != JBCOL_STRING)
+				continue;
+			uint *aOffsets = (uint*)column.aValues;
+			unsigned long long total = 0;
+			for (uint r = 0; r < numRecords; r++) {
+				total += aOffsets[r + 1];
+				aOffsets[r + 1] = (uint)total;
+			}
+			column.numChars = (uint)total;
+			column.aChars = (jchar*)malloc((size_t)total * sizeof(jchar) + sizeof(jchar));
+			ok = total < 0xffffffffULL && column.aChars;
+		}
+		if (ok && strings)
+			JBParallelFor(numChunks, threads, fillStrings, &fill);
+	}
+	free(fill.aChunks);
+	free(fill.aSources);
+	free(fill.aSourceColumn);
+	free(fill.aCaches);
+	if (!ok)
+		columns.release();
+	return ok;
+}
+
+//
+// Column files
+//
+
+static uint alignUp(uint value)
+{
+	return (value + 7) & ~7U;
+}
+
+static bool writePadded(FILE *f, const void *data, size_t size, uint &offset)
+{
+	static const char aZero[8] = { 0 };
+	if (size && fwrite(data, size, 1, f) != 1)
+		return false;
+	uint end = alignUp(offset + (uint)size);
+	if (end > offset + size && fwrite(aZero, end - offset - size, 1, f) != 1)
+		return false;
+	offset = end;
+	return true;
+}
+
+bool JBColumns::save(const char *path) const
+{
+	// layout: header, entries, names, then values, bitmap and characters of each column
+	JBColumnsEntry *aEntries = (JBColumnsEntry*)calloc(numColumns + 1, sizeof(JBColumnsEntry));
+	if (!aEntries)
+		return false;
+	unsigned long long offset = sizeof(JBColumnsHeader) + numColumns * sizeof(JBColumnsEntry);
+	for (uint c = 0; c < numColumns; c++) {
+		aEntries[c].name = (uint)offset;
+		offset += strlen(aColumns[c].name) + 1;
+	}
+	offset = (offset + 7) & ~7ULL;
+	for (uint c = 0; c < numColumns; c++) {
+		const JBColumn &column = aColumns[c];
+		JBColumnsEntry &entry = aEntries[c];
+		entry.hash = column.hash;
+		entry.type = column.type;
+		entry.values = (uint)offset;
+		offset = (offset + valuesSize(column.type, numRecords) + 7) & ~7ULL;
+		entry.valid = (uint)offset;
+		offset = (offset + (numRecords + 7) / 8 + 7) & ~7ULL;
+		entry.chars = (uint)offset;
+		entry.num_chars = column.numChars;
+		offset = (offset + (unsigned long long)column.numChars * sizeof(jchar) + 7) & ~7ULL;
+	}
+	if (offset > 0xffffffffULL) {
+		free(aEntries);
+		return false;
+	}
+
+	JBColumnsHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JB_COLUMNS_MAGIC, sizeof(header.magic));
+	header.version = JB_COLUMNS_VERSION;
+	header.endian = JB_COLUMNS_ENDIAN;
+	header.int_size = sizeof(jbint);
+	header.float_size = sizeof(jbfloat);
+	header.char_size = sizeof(jchar);
+	header.num_columns = numColumns;
+	header.num_records = numRecords;
+	header.file_size = (uint)offset;
+
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "wb"))
+		f = NULL;
+#else
+	f = fopen(path, "wb");
+#endif
+	if (!f) {
+		free(aEntries);
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		(!numColumns || fwrite(aEntries, sizeof(JBColumnsEntry), numColumns, f) == numColumns);
+	uint at = (uint)(sizeof(JBColumnsHeader) + numColumns * sizeof(JBColumnsEntry));
+	for (uint c = 0; written && c < numColumns; c++) {
+		size_t len = strlen(aColumns[c].name) + 1;
+		written = fwrite(aColumns[c].name, len, 1, f) == 1;
+		at += (uint)len;
+	}
+	written = written && writePadded(f, NULL, 0, at);
+	for (uint c = 0; written && c < numColumns; c++) {
+		const JBColumn &column = aColumns[c];
+		written = writePadded(f, column.aValues, valuesSize(column.type, numRecords), at) &&
+			writePadded(f, column.aValid, (numRecords + 7) / 8, at) &&
+			writePadded(f, column.aChars, (size_t)column.numChars * sizeof(jchar), at);
+	}
+	if (fclose(f))
+		written = false;
+	free(aEntries);
+	return written;
+}
+
+bool JBColumns::load(const char *path)
+{
+	release();
+	size_t size = 0;
+	const char *base = NULL;
+#ifdef WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(JBColumnsHeader)) {
+		size = (size_t)file_size.QuadPart;
+		if (HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) {
+			base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);	// the view keeps the mapping open
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat file_stat;
+	if (!fstat(file, &file_stat) && file_stat.st_size >= (off_t)sizeof(JBColumnsHeader)) {
+		size = (size_t)file_stat.st_size;
+		void *pMapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		base = pMapped != MAP_FAILED ? (const char*)pMapped : NULL;
+	}
+	close(file);	// the mapping stays valid after closing
+#endif
+	if (!base)
+		return false;
+	mapped = base;
+	mappedSize = size;
+
+	// check the header and that every buffer is inside the file
+	const JBColumnsHeader &header = *(const JBColumnsHeader*)base;
+	bool ok = !memcmp(header.magic, JB_COLUMNS_MAGIC, sizeof(header.magic)) && header.endian == JB_COLUMNS_ENDIAN &&
+		header.version == JB_COLUMNS_VERSION && header.int_size == sizeof(jbint) && header.float_size == sizeof(jbfloat) &&
+		header.char_size == sizeof(jchar) && header.file_size == size &&
+		header.num_columns <= (size - sizeof(JBColumnsHeader)) / sizeof(JBColumnsEntry);
+	const JBColumnsEntry *aEntries = (const JBColumnsEntry*)(base + sizeof(JBColumnsHeader));
+	for (uint c = 0; ok && c < header.num_columns; c++) {
+		const JBColumnsEntry &entry = aEntries[c];
+		ok = entry.type <= JBCOL_STRING && entry.name < size && memchr(base + entry.name, 0, size - entry.name) &&
+			entry.values + valuesSize((JBColumnType)entry.type, header.num_records) <= size &&
+			entry.valid + (header.num_records + 7) / 8 <= size &&
+			entry.chars + (unsigned long long)entry.num_chars * sizeof(jchar) <= size;
+		if (ok && entry.type == JBCOL_STRING)	// offsets are not checked one by one, only the end
+			ok = ((const uint*)(base + entry.values))[header.num_records] <= entry.num_chars;
+	}
+	if (ok) {
+		const char **aNames = (const char**)malloc((header.num_columns + 1) * sizeof(const char*));
+		if ((ok = aNames != NULL)) {
+			for (uint c = 0; c < header.num_columns; c++)
+				aNames[c] = base + aEntries[c].name;
+			aColumns = allocColumns(header.num_columns, aNames);
+			free(aNames);
+			ok = aColumns != NULL;
+		}
+	}
+	if (!ok) {
+		release();
+		return false;
+	}
+	numColumns = header.num_columns;
+	numRecords = header.num_records;
+	for (uint c = 0; c < numColumns; c++) {
+		const JBColumnsEntry &entry = aEntries[c];
+		JBColumn &column = aColumns[c];
+		column.hash = entry.hash;
+		column.type = (JBColumnType)entry.type;
+		column.aValues = (void*)(base + entry.values);
+		column.aValid = (unsigned char*)(base + entry.valid);
+		column.aChars = (jchar*)(base + entry.chars);
+		column.numChars = entry.num_chars;
+	}
+	return true;
+}
+
+}	// namespace jbin
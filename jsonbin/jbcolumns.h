@@ -0,0 +1,137 @@
+#ifndef __JBCOLUMNS_H__
+#define __JBCOLUMNS_H__
+
+//
+// JBColumns
+//
+// Summary
+//	- Turns an array of objects (records) in a block returned by JSONBin into
+//		columns: one contiguous buffer of values per key with a bitmap of
+//		which records have a value, so scans over a field read memory in order
+//		without looking at items or branching on types.
+//	- Records are split into ranges that can be filled on several threads.
+//	- Columns can be saved to a columnar file that is loaded memory mapped.
+//
+// Usage
+//	- Describe the columns and fill them:
+//		JBColumnDef aSchema[] = { { "name", JBCOL_STRING }, { "speed", JBCOL_FLOAT } };
+//		JBColumns cols;
+//		JBToColumns(cols, pJSON->findByHash(_FNV1A_objects), aSchema, 2, JBHardwareThreads());
+//	- Read values:
+//		const jbfloat *aSpeed = cols.aColumns[1].floats();
+//		for (unsigned int r = 0; r < cols.numRecords; r++)
+//			if (cols.aColumns[1].valid(r)) sum += aSpeed[r];
+//		const jchar *name = cols.aColumns[0].getStr(r);	// NULL if no value
+//	- Save and load:
+//		cols.save("objects.jbcol");
+//		JBColumns mapped; mapped.load("objects.jbcol");	// columns point into the mapped file
+//	- release() frees or unmaps the columns, the destructor calls it.
+//
+// Notes
+//	- Keys are matched with JBFieldCache per column and thread, records that
+//		repeat their keys in the same order find each key without scanning.
+//	- A value is valid when the record has the key with a value of the column
+//		type. Int and float columns accept both kinds of numbers (converted
+//		like getInt / getFloat), bool and string columns only their own type.
+//		Invalid values are 0 and records that are not objects have no values.
+//	- Strings are copied into one buffer per column, zero terminated, with
+//		numRecords + 1 offsets (in jchars) so the length of a string is the
+//		difference of two offsets minus 1.
+//	- Column files start with a header with the value and character sizes of
+//		the traits that saved them, a file with different sizes or byte order
+//		is refused. Buffers are 8 byte aligned in the file.
+//	- Requires jbthreads.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+#define JB_COLUMNS_MAGIC "JBCL"
+#define JB_COLUMNS_VERSION 1
+#define JB_COLUMNS_ENDIAN 0x01020304	// written in native byte order
+
+enum JBColumnType {
+	JBCOL_INT = 0,		// jbint values
+	JBCOL_FLOAT,		// jbfloat values
+	JBCOL_BOOL,			// unsigned char values, 0 or 1
+	JBCOL_STRING,		// unsigned int offsets into the column characters
+};
+
+// a column to extract
+struct JBColumnDef {
+	const char *key;	// utf-8 member name in each record
+	JBColumnType type;
+};
+
+struct JBColumn {
+	unsigned int hash;			// key hash
+	JBColumnType type;
+	const char *name;			// key (utf-8)
+	void *aValues;				// one value per record, numRecords + 1 offsets for strings
+	unsigned char *aValid;		// bit per record, set if the record has a value
+	jchar *aChars;				// string characters
+	unsigned int numChars;
+
+	bool valid(unsigned int record) const { return (aValid[record >> 3] >> (record & 7)) & 1; }
+	const jbint* ints() const { return type == JBCOL_INT ? (const jbint*)aValues : NULL; }
+	const jbfloat* floats() const { return type == JBCOL_FLOAT ? (const jbfloat*)aValues : NULL; }
+	const unsigned char* bools() const { return type == JBCOL_BOOL ? (const unsigned char*)aValues : NULL; }
+	const unsigned int* offsets() const { return type == JBCOL_STRING ? (const unsigned int*)aValues : NULL; }
+	const jchar* getStr(unsigned int record) const { return (type == JBCOL_STRING && valid(record)) ? aChars + ((const unsigned int*)aValues)[record] : NULL; }
+	unsigned int getStrLen(unsigned int record) const { return type == JBCOL_STRING && valid(record) ? ((const unsigned int*)aValues)[record + 1] - ((const unsigned int*)aValues)[record] - 1 : 0; }
+};
+
+// column file header
+struct JBColumnsHeader {
+	char magic[4];				// JB_COLUMNS_MAGIC
+	unsigned int version;		// JB_COLUMNS_VERSION
+	unsigned int endian;		// JB_COLUMNS_ENDIAN
+	unsigned int int_size;		// sizeof(jbint)
+	unsigned int float_size;	// sizeof(jbfloat)
+	unsigned int char_size;		// sizeof(jchar)
+	unsigned int num_columns;	// JBColumnsEntry entries following the header
+	unsigned int num_records;
+	unsigned int file_size;
+	unsigned int reserved[3];
+};
+
+// column file index entry, offsets are from the start of the file
+struct JBColumnsEntry {
+	unsigned int hash;
+	unsigned int type;			// JBColumnType
+	unsigned int name;			// zero terminated utf-8 key
+	unsigned int values;
+	unsigned int valid;
+	unsigned int chars;
+	unsigned int num_chars;
+	unsigned int reserved;
+};
+
+struct JBColumns {
+	JBColumn *aColumns;
+	unsigned int numColumns;
+	unsigned int numRecords;
+	const char *mapped;			// file mapping when loaded, the buffers point into it
+	size_t mappedSize;
+
+	JBColumns() : aColumns(NULL), numColumns(0), numRecords(0), mapped(NULL), mappedSize(0) {}
+	~JBColumns() { release(); }
+	void release();
+
+	bool save(const char *path) const;
+	bool load(const char *path);	// memory mapped read-only
+	const JBColumn* find(unsigned int hash) const;
+
+private:
+	JBColumns(const JBColumns&);	// not copyable, the destructor frees or unmaps the columns
+	JBColumns& operator=(const JBColumns&);
+};
+
+// fill columns from the records of an array, false if out of memory or array is not an array
+bool JBToColumns(JBColumns &columns, const JBItem *array, const JBColumnDef *aSchema, unsigned int numColumns, unsigned int threads = 1);
+
+}	// namespace jbin
+
+#endif
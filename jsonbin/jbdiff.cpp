@@ -0,0 +1,401 @@
+//
+// JBDiff
+//
+// Details in jbdiff.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include "jbdiff.h"
+#include "jbbuilder.h"
+#include "../jsonout/jsonout.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+typedef unsigned long long u64;
+
+#define JB_DIFF_MAX_PATH 4096		// longest JSON Pointer written
+#define JB_DIFF_LINEAR_MEMBERS 8	// objects with more members are matched with a hash table
+
+#define JB_FNV1A64_PRIME 1099511628211ULL
+#define JB_FNV1A64_SEED 14695981039346656037ULL
+
+static u64 hashBytes(u64 hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t b = 0; b < size; b++)
+		hash = (bytes[b] ^ hash) * JB_FNV1A64_PRIME;
+	return hash;
+}
+
+// spread the bits of a member hash before it is added to an object hash
+static u64 mixMember(u64 hash)
+{
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	return hash ^ (hash >> 31);
+}
+
+// type used for comparing, the root is an object and both nulls are the same
+static JBType diffType(const JBItem *item)
+{
+	JBType type = item->getType();
+	if (type == JB_ROOT)
+		return JB_OBJECT;
+	return type == JB_NULL_VALUE ? JB_NULL : type;
+}
+
+// items are in depth first order so stepping backwards hashes children before their parent
+unsigned long long* JBSubtreeHashes(const JBItem *pJSON)
+{
+	if (!pJSON)
+		return NULL;
+	uint count = (uint)(JBSubtreeLast(pJSON) - pJSON) + 1;
+	u64 *aHashes = (u64*)malloc(count * sizeof(u64));
+	if (!aHashes)
+		return NULL;
+	for (uint index = count; index--;) {
+		const JBItem *item = pJSON + index;
+		unsigned char type = (unsigned char)diffType(item);
+		u64 hash = hashBytes(JB_FNV1A64_SEED, &type, 1);
+		switch (type) {
+			case JB_OBJECT: {
+				u64 members = 0;	// sum so member order does not matter
+				for (const JBItem *child = item->getChild(); child; child = child->getSibling())
+					members += mixMember(aHashes[child - pJSON] ^ ((u64)child->getHash() * 0x9e3779b97f4a7c15ULL));
+				hash = hashBytes(hash, &members, sizeof(members));
+				break;
+			}
+			case JB_ARRAY:
+				for (const JBItem *child = item->getChild(); child; child = child->getSibling())
+					hash = hashBytes(hash, &aHashes[child - pJSON], sizeof(u64));
+				break;
+			case JB_STRING:
+				if (item->getStr())
+					hash = hashBytes(hash, item->getStr(), item->getStrLen() * sizeof(jchar));
+				break;
+			case JB_INT: {
+				jbint value = item->getInt();
+				hash = hashBytes(hash, &value, sizeof(value));
+				break;
+			}
+			case JB_FLOAT: {
+				jbfloat value = item->getFloat();
+				hash = hashBytes(hash, &value, sizeof(value));
+				break;
+			}
+			case JB_BOOL: {
+				unsigned char value = item->getBool() ? 1 : 0;
+				hash = hashBytes(hash, &value, 1);
+				break;
+			}
+			case JB_NULL:
+				break;
+			default:
+				hash = hashBytes(hash, &item->data, sizeof(item->data));
+				break;
+		}
+		aHashes[index] = hash;
+	}
+	return aHashes;
+}
+
+// push a value with a name, returns the first child if the value is an object or array with children
+template<class C> static const JBItem* pushValue(jout::JSONOut &out, const C *name, const JBItem *item)
+{
+	const JBItem *children = NULL;
+	switch (item->getType()) {
+		case JB_ROOT:
+		case JB_OBJECT:
+			out.push_object(name);
+			if (!(children = item->getChild()))
+				out.scope_end();
+			break;
+		case JB_ARRAY:
+			out.push_array(name);
+			if (!(children = item->getChild()))
+				out.scope_end();
+			break;
+		case JB_STRING:
+			out.push(name, item->getStr(), (int)item->getStrLen());
+			break;
+		case JB_INT:
+			out.push(name, item->getInt());
+			break;
+		case JB_FLOAT:
+			out.push(name, item->getFloat());
+			break;
+		case JB_BOOL:
+			out.push(name, item->getBool());
+			break;
+		case JB_NULL:
+		case JB_NULL_VALUE:
+			if (name)
+				out.push_null(name);
+			else
+				out.push_null();
+			break;
+		case JB_DEFERRED:
+		case JB_SHARED:
+			break;
+	}
+	return children;
+}
+
+// write a value and its children as a named member of the current object
+static void writeValue(jout::JSONOut &out, const char *name, const JBItem *value)
+{
+	const JBItem *aStack[JSON_MAX_DEPTH];
+	int sp = 0;
+	const JBItem *i = pushValue(out, name, value);
+	bool open = i != NULL;	// the value is an object or array with children
+	while (i || sp) {
+		if (!i) {
+			i = aStack[--sp];
+			out.scope_end();
+			continue;
+		}
+		static const jchar empty_name[1] = { 0 };	// the empty key has no name string
+		const jchar *name = i->getName();
+		const JBItem *children = pushValue(out, out.inArray() ? (const jchar*)NULL : (name ? name : empty_name), i);
+		i = i->getSibling();
+		if (children) {
+			if (sp >= JSON_MAX_DEPTH)
+				return;
+			aStack[sp++] = i;
+			i = children;
+		}
+	}
+	if (open)
+		out.scope_end();
+}
+
+struct sDiff {
+	jout::JSONOut &out;
+	const JBItem *pFrom, *pTo;
+	const u64 *aFrom, *aTo;
+	jchar aPath[JB_DIFF_MAX_PATH];	// JSON Pointer of the current value
+	uint pathLen;
+	bool failed;
+
+	sDiff(jout::JSONOut &o) : out(o), pFrom(NULL), pTo(NULL), aFrom(NULL), aTo(NULL), pathLen(0), failed(false) { aPath[0] = 0; }
+
+	bool same(const JBItem *a, const JBItem *b) const { return aFrom[a - pFrom] == aTo[b - pTo]; }
+	bool pushKey(const JBItem *item);
+	bool pushIndex(uint index);
+	void pop(uint len) { pathLen = len; aPath[len] = 0; }
+	void op(const char *name, const JBItem *value);
+	void diff(const JBItem *a, const JBItem *b);
+	void diffObject(const JBItem *a, const JBItem *b);
+	void diffArray(const JBItem *a, const JBItem *b);
+};
+
+// add "/key" with '~' and '/' escaped
+bool sDiff::pushKey(const JBItem *item)
+{
+	const jchar *name = item->getName();
+	uint len = name ? item->getNameLen() : 0;
+	if (pathLen + 1 >= JB_DIFF_MAX_PATH)
+		return !(failed = true);
+	aPath[pathLen++] = '/';
+	for (uint c = 0; c < len; c++) {
+		bool escape = name[c] == '~' || name[c] == '/';
+		if (pathLen + (escape ? 2 : 1) >= JB_DIFF_MAX_PATH)
+			return !(failed = true);
+		if (escape) {
+			aPath[pathLen++] = '~';
+			aPath[pathLen++] = name[c] == '~' ? '0' : '1';
+		} else
+			aPath[pathLen++] = name[c];
+	}
+	aPath[pathLen] = 0;
+	return true;
+}
+
+bool sDiff::pushIndex(uint index)
+{
+	char digits[12];
+	int num = 0;
+	do {
+		digits[num++] = (char)('0' + index % 10);
+		index /= 10;
+	} while (index);
+	if (pathLen + num + 1 >= JB_DIFF_MAX_PATH)
+		return !(failed = true);
+	aPath[pathLen++] = '/';
+	while (num)
+		aPath[pathLen++] = digits[--num];
+	aPath[pathLen] = 0;
+	return true;
+}
+
+void sDiff::op(const char *name, const JBItem *value)
+{
+	out.element_object();
+	out.push("op", name);
+	out.push("path", aPath, (int)pathLen);
+	if (value)
+		writeValue(out, "value", value);
+	out.scope_end();
+	if (out.last_error() != jout::JSONOut::ERR_NONE)
+		failed = true;
+}
+
+void sDiff::diff(const JBItem *a, const JBItem *b)
+{
+	if (failed || same(a, b))
+		return;
+	JBType type = diffType(a);
+	if (type != diffType(b) || (type != JB_OBJECT && type != JB_ARRAY))
+		op("replace", b);
+	else if (type == JB_OBJECT)
+		diffObject(a, b);
+	else
+		diffArray(a, b);
+}
+
+// members of a large object by key hash, open addressing
+struct sMemberTable {
+	const JBItem **apSlots;
+	uint size;
+
+	sMemberTable() : apSlots(NULL), size(0) {}
+	~sMemberTable() { free(apSlots); }
+	bool build(const JBItem *object);
+	const JBItem* find(const JBItem *object, uint hash) const;
+};
+
+bool sMemberTable::build(const JBItem *object)
+{
+	uint count = (uint)object->getChildCount();
+	if (count <= JB_DIFF_LINEAR_MEMBERS)
+		return true;	// stepping through the members is faster
+	for (size = 16; size < count * 2; size *= 2);
+	if (!(apSlots = (const JBItem**)calloc(size, sizeof(const JBItem*))))
+		return false;
+	for (const JBItem *m = object->getChild(); m; m = m->getSibling()) {
+		uint slot = m->getHash() & (size - 1);
+		while (apSlots[slot])
+			slot = (slot + 1) & (size - 1);
+		apSlots[slot] = m;
+	}
+	return true;
+}
+
+const JBItem* sMemberTable::find(const JBItem *object, uint hash) const
+{
+	if (!apSlots)
+		return object->findByHash(hash);
+	for (uint slot = hash & (size - 1); apSlots[slot]; slot = (slot + 1) & (size - 1)) {
+		if (apSlots[slot]->getHash() == hash)
+			return apSlots[slot];
+	}
+	return NULL;
+}
+
+// members are matched by key hash: removed and changed members, then added members
+void sDiff::diffObject(const JBItem *a, const JBItem *b)
+{
+	uint len = pathLen;
+	sMemberTable membersA, membersB;
+	if (!membersA.build(a) || !membersB.build(b)) {
+		failed = true;
+		return;
+	}
+	for (const JBItem *m = a->getChild(); m && !failed; m = m->getSibling()) {
+		const JBItem *match = membersB.find(b, m->getHash());
+		if (!pushKey(m))
+			break;
+		if (match)
+			diff(m, match);
+		else
+			op("remove", NULL);
+		pop(len);
+	}
+	for (const JBItem *m = b->getChild(); m && !failed; m = m->getSibling()) {
+		if (!membersA.find(a, m->getHash())) {
+			if (!pushKey(m))
+				break;
+			op("add", m);
+			pop(len);
+		}
+	}
+}
+
+// equal elements at the start and end are skipped, the rest is compared by index
+void sDiff::diffArray(const JBItem *a, const JBItem *b)
+{
+	uint len = pathLen;
+	uint numA = (uint)a->getChildCount(), numB = (uint)b->getChildCount();
+	const JBItem **apA = (const JBItem**)malloc((numA + numB + 1) * sizeof(const JBItem*));
+	if (!apA) {
+		failed = true;
+		return;
+	}
+	const JBItem **apB = apA + numA;
+	uint n = 0;
+	for (const JBItem *e = a->getChild(); e; e = e->getSibling())
+		apA[n++] = e;
+	n = 0;
+	for (const JBItem *e = b->getChild(); e; e = e->getSibling())
+		apB[n++] = e;
+
+	uint start = 0, end = 0;
+	while (start < numA && start < numB && same(apA[start], apB[start]))
+		start++;
+	while (end < numA - start && end < numB - start && same(apA[numA - 1 - end], apB[numB - 1 - end]))
+		end++;
+	uint changedA = numA - start - end, changedB = numB - start - end;
+	uint index = start;
+	for (; index - start < changedA && index - start < changedB && !failed; index++) {
+		if (pushIndex(index)) {
+			diff(apA[index], apB[index]);
+			pop(len);
+		}
+	}
+	for (uint extra = changedA; extra > changedB && !failed; extra--) {	// removing at the same index shifts the rest down
+		if (pushIndex(index)) {
+			op("remove", NULL);
+			pop(len);
+		}
+	}
+	for (; index - start < changedB && !failed; index++) {
+		if (pushIndex(index)) {
+			op("add", apB[index]);
+			pop(len);
+		}
+	}
+	free(apA);
+}
+
+bool JBDiff(const JBItem *from, const JBItem *to, jout::JSONOut &out, const unsigned long long *fromHashes, const unsigned long long *toHashes)
+{
+	if (!from || !to)
+		return false;
+	if (!out.inArray()) {
+#ifdef JO_ALLOW_ROOT_ARRAY
+		if (!out.set_rootArray())
+			return false;
+#else
+		return false;
+#endif
+	}
+	u64 *aOwnFrom = fromHashes ? NULL : JBSubtreeHashes(from);
+	u64 *aOwnTo = toHashes ? NULL : JBSubtreeHashes(to);
+	sDiff state(out);
+	state.pFrom = from;
+	state.pTo = to;
+	state.aFrom = fromHashes ? fromHashes : aOwnFrom;
+	state.aTo = toHashes ? toHashes : aOwnTo;
+	if (state.aFrom && state.aTo)
+		state.diff(from, to);
+	else
+		state.failed = true;
+	free(aOwnFrom);
+	free(aOwnTo);
+	return out.finish() && !state.failed;
+}
+
+}	// namespace jbin
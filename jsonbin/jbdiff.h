@@ -0,0 +1,55 @@
+#ifndef __JBDIFF_H__
+#define __JBDIFF_H__
+
+//
+// JBDiff
+//
+// Summary
+//	- Structural diff of two blocks returned by JSONBin, written as RFC 6902
+//		JSON Patch operations with JSONOut (see JBApplyPatch to apply them).
+//	- Every object and array has a 64 bit hash of its whole subtree, computed
+//		in one pass over the block. Subtrees with the same hash are skipped
+//		without looking inside, so the cost follows the size of the changes
+//		rather than the size of the documents.
+//
+// Usage
+//	- Compare and write the patch:
+//		jout::JSONOut out(file, true);	// the patch is a JSON array
+//		JBDiff(pOld, pNew, out);
+//	- Hashes can be computed once per version and kept with the block:
+//		unsigned long long *aHashes = JBSubtreeHashes(pJSON);	// aHashes[i] is the subtree of pJSON[i], release with free
+//		JBDiff(pOld, pNew, out, aOldHashes, aNewHashes);
+//	- Two documents are equal if aOldHashes[0] == aNewHashes[0].
+//
+// Notes
+//	- Object members are matched by key hash and the hash of an object does
+//		not depend on member order. Array elements are matched by index after
+//		skipping equal elements at the start and end, so a value inserted or
+//		removed in an array is one operation but a moved element is two.
+//	- Numbers compare by type and value, 1 and 1.0 are different.
+//	- Paths use the key strings, a block without key strings (JB_KEY_HASH
+//		only) writes the printed hashes returned by getName.
+//	- Equal hashes are taken as equal subtrees, a 64 bit hash makes a false
+//		match unlikely but not impossible.
+//	- JBDiff writes a whole patch file and calls finish, a JSONOut that is not
+//		in an array is switched to a root array (JO_ALLOW_ROOT_ARRAY).
+//	- Requires jsonout.cpp and jbbuilder.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jout { struct JSONOut; }
+
+namespace jbin {
+
+// hash of every item and its children in a block, NULL if out of memory
+unsigned long long* JBSubtreeHashes(const JBItem *pJSON);
+
+// write the operations that turn from into to, false if the output failed
+bool JBDiff(const JBItem *from, const JBItem *to, jout::JSONOut &out,
+	const unsigned long long *fromHashes = 0, const unsigned long long *toHashes = 0);
+
+}	// namespace jbin
+
+#endif
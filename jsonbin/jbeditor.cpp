@@ -0,0 +1,740 @@
+//
+// JBEditor
+//
+// Details in jbeditor.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memset
+#include "jbeditor.h"
+#include "jbbuilder.h"
+#include "../jsonout/jsonout.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_EDIT_CHUNK_SIZE 16384	// minimum size of a block of edit records and strings
+
+// edit record of a base item, or a value added in the editor
+struct JBEditNode {
+	const JBItem *base;		// base item of an edit record, NULL for added values
+	JBEditNode *pNext;		// next added value in the parent container
+	JBEditNode *pAdded;		// first added child value (containers)
+	const JBItem *before;	// base child an added value is placed before, NULL for the end
+	const JBItem *source;	// item the value is read from (setCopy)
+	const jchar *name;		// added values in objects
+	uint nameLen;
+	uint hash;
+	const jchar *str;		// JB_STRING value
+	uint strLen;
+	JBType type;			// value type if replaced or added
+	bool replaced;			// base item value is replaced by type and value
+	bool removed;			// base item is removed from its parent
+	bool addedBefore;		// values are added before this base item
+	union {
+		jbint i;
+		jbfloat f;
+		bool b;
+	} data;
+};
+
+struct JBEditChunk {
+	JBEditChunk *pNext;
+	uint used;
+	uint size;
+};
+
+static bool isContainer(JBType type)
+{
+	return type == JB_ROOT || type == JB_OBJECT || type == JB_ARRAY;
+}
+
+void JBEditor::open(const JBItem *base)
+{
+	release();
+	pBase = base;
+	pBaseLast = base ? JBSubtreeLast(base) : NULL;
+}
+
+void JBEditor::release()
+{
+	while (JBEditChunk *chunk = pChunks) {
+		pChunks = chunk->pNext;
+		free(chunk);
+	}
+	free(apRecords);
+	free(aEdited);
+	apRecords = NULL;
+	aEdited = NULL;
+	recordTableSize = 0;
+	numRecords = 0;
+	pBase = NULL;
+	pBaseLast = NULL;
+}
+
+void* JBEditor::alloc(uint size)
+{
+	size = (size + 7) & ~7U;
+	if (!pChunks || pChunks->used + size > pChunks->size) {
+		uint chunk_size = size > JB_EDIT_CHUNK_SIZE ? size : JB_EDIT_CHUNK_SIZE;
+		JBEditChunk *chunk = (JBEditChunk*)malloc(sizeof(JBEditChunk) + chunk_size);
+		if (!chunk)
+			return NULL;
+		chunk->pNext = pChunks;
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		pChunks = chunk;
+	}
+	void *mem = (char*)(pChunks + 1) + pChunks->used;
+	pChunks->used += size;
+	return mem;
+}
+
+const jchar* JBEditor::copyChars(const jchar *str, uint &len)
+{
+	len = 0;
+	if (!str)
+		return NULL;
+	while (str[len])
+		len++;
+	jchar *copy = (jchar*)alloc((len + 1) * sizeof(jchar));
+	if (copy)
+		memcpy(copy, str, (len + 1) * sizeof(jchar));
+	return copy;
+}
+
+//
+// Edit records of base items
+//
+
+static uint recordSlot(uint index, uint size)
+{
+	return (index * 2654435761U) & (size - 1);
+}
+
+JBEditNode* JBEditor::record(const JBItem *item) const
+{
+	if (!numRecords || !inBase(item))
+		return NULL;
+	uint index = (uint)(item - pBase);
+	for (uint slot = recordSlot(index, recordTableSize); apRecords[slot]; slot = (slot + 1) & (recordTableSize - 1)) {
+		if (apRecords[slot]->base == item)
+			return apRecords[slot];
+	}
+	return NULL;
+}
+
+JBEditNode* JBEditor::addRecord(const JBItem *item)
+{
+	if (!inBase(item))	// items of other blocks are read only
+		return NULL;
+	if (JBEditNode *rec = record(item))
+		return rec;
+	if ((numRecords + 1) * 2 > recordTableSize) {	// keep the table at most half full
+		uint size = recordTableSize ? recordTableSize * 2 : 256;
+		JBEditNode **apGrow = (JBEditNode**)calloc(size, sizeof(JBEditNode*));
+		uint *aGrow = (uint*)realloc(aEdited, size / 2 * sizeof(uint));
+		if (!apGrow || !aGrow) {
+			free(apGrow);
+			if (aGrow)
+				aEdited = aGrow;
+			return NULL;
+		}
+		aEdited = aGrow;
+		for (uint s = 0; s < recordTableSize; s++) {
+			if (JBEditNode *rec = apRecords[s]) {
+				uint slot = recordSlot((uint)(rec->base - pBase), size);
+				while (apGrow[slot])
+					slot = (slot + 1) & (size - 1);
+				apGrow[slot] = rec;
+			}
+		}
+		free(apRecords);
+		apRecords = apGrow;
+		recordTableSize = size;
+	}
+	JBEditNode *rec = (JBEditNode*)alloc(sizeof(JBEditNode));
+	if (!rec)
+		return NULL;
+	memset(rec, 0, sizeof(JBEditNode));
+	rec->base = item;
+	uint index = (uint)(item - pBase);
+	uint slot = recordSlot(index, recordTableSize);
+	while (apRecords[slot])
+		slot = (slot + 1) & (recordTableSize - 1);
+	apRecords[slot] = rec;
+
+	// sorted item indices so compact() can tell if a subtree has edits
+	uint pos = numRecords;
+	while (pos && aEdited[pos - 1] > index) {
+		aEdited[pos] = aEdited[pos - 1];
+		pos--;
+	}
+	aEdited[pos] = index;
+	numRecords++;
+	return rec;
+}
+
+// true if the item or anything in its subtree has an edit record
+bool JBEditor::edited(const JBItem *item) const
+{
+	if (!inBase(item))
+		return false;
+	uint first = (uint)(item - pBase), last = (uint)(JBSubtreeLast(item) - pBase);
+	uint low = 0, high = numRecords;
+	while (low < high) {
+		uint mid = (low + high) / 2;
+		if (aEdited[mid] < first)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low < numRecords && aEdited[low] <= last;
+}
+
+// the edited value of a ref, NULL if it reads from an item
+JBEditNode* JBEditor::value(const JBEditRef &ref) const
+{
+	JBEditNode *n = ref.node;
+	if (!n && (!(n = record(ref.item)) || !n->replaced))
+		return NULL;
+	return n->source ? NULL : n;
+}
+
+// the item a ref reads from, NULL if it has an edited value
+const JBItem* JBEditor::readItem(const JBEditRef &ref) const
+{
+	JBEditNode *n = ref.node;
+	if (!n && (!(n = record(ref.item)) || !n->replaced))
+		return ref.item;
+	return n->source;
+}
+
+// the node that holds added children of a container, NULL if there are none
+JBEditNode* JBEditor::container(const JBEditRef &ref) const
+{
+	return ref.node ? ref.node : record(ref.item);
+}
+
+// prepare a value to be replaced
+JBEditNode* JBEditor::editValue(const JBEditRef &ref)
+{
+	if (!ref.valid() || ref.item == pBase)	// the root can not be replaced
+		return NULL;
+	JBEditNode *n = ref.node;
+	if (!n) {
+		if (!(n = addRecord(ref.item)) || n->removed)
+			return NULL;
+		n->replaced = true;
+	}
+	n->pAdded = NULL;	// children of a replaced container are dropped
+	n->source = NULL;
+	n->str = NULL;
+	n->strLen = 0;
+	return n;
+}
+
+//
+// Navigation
+//
+
+JBEditRef JBEditor::root() const
+{
+	JBEditRef ref;
+	ref.item = pBase;
+	return ref;
+}
+
+// first visible child starting at a base child: values added before it, itself if not removed, and so on
+JBEditRef JBEditor::firstFrom(const JBItem *parentItem, JBEditNode *parentNode, const JBItem *next) const
+{
+	JBEditNode *owner = parentNode ? parentNode : record(parentItem);
+	JBEditRef ref;
+	ref.parentItem = parentItem;
+	ref.parentNode = parentNode;
+	for (;;) {
+		JBEditNode *rec = record(next);
+		if (!next || (rec && rec->addedBefore)) {
+			for (JBEditNode *added = owner ? owner->pAdded : NULL; added; added = added->pNext) {
+				if (added->before == next) {
+					ref.node = added;
+					return ref;
+				}
+			}
+		}
+		if (!next)
+			return ref;
+		if (!rec || !rec->removed) {
+			ref.item = next;
+			return ref;
+		}
+		next = next->getSibling();
+	}
+}
+
+JBEditRef JBEditor::child(const JBEditRef &ref) const
+{
+	if (!isContainer(getType(ref)))
+		return JBEditRef();
+	const JBItem *read = readItem(ref);
+	if (!read) {	// added or replaced container, only added children
+		JBEditRef first;
+		first.node = container(ref)->pAdded;
+		first.parentItem = ref.item;
+		first.parentNode = ref.node;
+		return first.node ? first : JBEditRef();
+	}
+	return firstFrom(read, NULL, read->getChild());
+}
+
+JBEditRef JBEditor::sibling(const JBEditRef &ref) const
+{
+	if (!ref.parentItem && !ref.parentNode)
+		return JBEditRef();
+	if (ref.node) {
+		// values added before the same base child keep their insertion order
+		for (JBEditNode *added = ref.node->pNext; added; added = added->pNext) {
+			if (added->before == ref.node->before) {
+				JBEditRef next = ref;
+				next.node = added;
+				return next;
+			}
+		}
+		const JBItem *before = ref.node->before;
+		if (!before)
+			return JBEditRef();
+		JBEditNode *rec = record(before);
+		if (!rec || !rec->removed) {
+			JBEditRef next = ref;
+			next.node = NULL;
+			next.item = before;
+			return next;
+		}
+		return firstFrom(ref.parentItem, ref.parentNode, before->getSibling());
+	}
+	JBEditRef parent;
+	parent.item = ref.parentItem;
+	if (readItem(parent) != ref.parentItem)	// parent was replaced, base children are gone
+		return JBEditRef();
+	return firstFrom(ref.parentItem, NULL, ref.item->getSibling());
+}
+
+JBEditRef JBEditor::find(const JBEditRef &ref, unsigned int hash) const
+{
+	JBType type = getType(ref);
+	const JBItem *read = readItem(ref);
+	if (read && (type == JB_ROOT || type == JB_OBJECT)) {	// step through the base children without building refs
+		JBEditRef found;
+		found.parentItem = read;
+		for (const JBItem *c = read->getChild(); c; c = c->getSibling()) {
+			JBEditNode *rec;
+			if (c->getHash() == hash && (!(rec = record(c)) || !rec->removed)) {
+				found.item = c;
+				return found;
+			}
+		}
+		JBEditNode *owner = record(read);
+		for (JBEditNode *added = owner ? owner->pAdded : NULL; added; added = added->pNext) {
+			if (added->hash == hash) {
+				found.node = added;
+				return found;
+			}
+		}
+	} else if (type == JB_ROOT || type == JB_OBJECT) {
+		for (JBEditRef c = child(ref); c; c = sibling(c)) {
+			if (getHash(c) == hash)
+				return c;
+		}
+	}
+	return JBEditRef();
+}
+
+//
+// Reading
+//
+
+JBType JBEditor::getType(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type;
+	const JBItem *read = readItem(ref);
+	return read ? read->getType() : JB_NULL;
+}
+
+unsigned int JBEditor::getHash(const JBEditRef &ref) const
+{
+	if (ref.node)
+		return ref.node->hash;
+	return ref.item ? ref.item->getHash() : 0;
+}
+
+const jchar* JBEditor::getName(const JBEditRef &ref) const
+{
+	if (ref.node)
+		return ref.node->name;
+	return ref.item ? ref.item->getName() : NULL;
+}
+
+const jchar* JBEditor::getStr(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type == JB_STRING ? n->str : NULL;
+	const JBItem *read = readItem(ref);
+	return read ? read->getStr() : NULL;
+}
+
+unsigned int JBEditor::getStrLen(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type == JB_STRING ? n->strLen : 0;
+	const JBItem *read = readItem(ref);
+	return read ? read->getStrLen() : 0;
+}
+
+jbint JBEditor::getInt(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type == JB_INT ? n->data.i : (n->type == JB_FLOAT ? (jbint)n->data.f : 0);
+	const JBItem *read = readItem(ref);
+	return read ? read->getInt() : 0;
+}
+
+jbfloat JBEditor::getFloat(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type == JB_FLOAT ? n->data.f : (n->type == JB_INT ? (jbfloat)n->data.i : jbfloat(0));
+	const JBItem *read = readItem(ref);
+	return read ? read->getFloat() : jbfloat(0);
+}
+
+bool JBEditor::getBool(const JBEditRef &ref) const
+{
+	if (JBEditNode *n = value(ref))
+		return n->type == JB_BOOL ? n->data.b : false;
+	const JBItem *read = readItem(ref);
+	return read ? read->getBool() : false;
+}
+
+jbint JBEditor::getChildCount(const JBEditRef &ref) const
+{
+	jbint count = 0;
+	for (JBEditRef c = child(ref); c; c = sibling(c))
+		count++;
+	return count;
+}
+
+//
+// Editing
+//
+
+bool JBEditor::setInt(const JBEditRef &ref, jbint value)
+{
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = JB_INT;
+		n->data.i = value;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setFloat(const JBEditRef &ref, jbfloat value)
+{
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = JB_FLOAT;
+		n->data.f = value;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setBool(const JBEditRef &ref, bool value)
+{
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = JB_BOOL;
+		n->data.b = value;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setNull(const JBEditRef &ref)
+{
+	JBEditRef parent;
+	parent.item = ref.parentItem;
+	parent.node = ref.parentNode;
+	JBType null_type = getType(parent) == JB_ARRAY ? JB_NULL : JB_NULL_VALUE;	// same as JSONBin
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = null_type;
+		n->data.i = 0;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setStr(const JBEditRef &ref, const jchar *str)
+{
+	JBEditNode *n = editValue(ref);
+	if (!n)
+		return false;
+	uint len;
+	const jchar *copy = copyChars(str, len);
+	if (str && !copy)
+		return false;
+	n->type = JB_STRING;
+	n->str = len ? copy : NULL;	// empty strings have no string like JSONBin
+	n->strLen = len;
+	return true;
+}
+
+bool JBEditor::setObject(const JBEditRef &ref)
+{
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = JB_OBJECT;
+		n->data.i = 0;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setArray(const JBEditRef &ref)
+{
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = JB_ARRAY;
+		n->data.i = 0;
+	}
+	return n != NULL;
+}
+
+bool JBEditor::setCopy(const JBEditRef &ref, const JBItem *item)
+{
+	if (!item)
+		return false;
+	JBEditNode *n = editValue(ref);
+	if (n) {
+		n->type = item->getType();
+		n->source = item;
+	}
+	return n != NULL;
+}
+
+JBEditRef JBEditor::insert(const JBEditRef &parent, const jchar *name, const JBEditRef &before)
+{
+	JBType type = getType(parent);
+	bool array = type == JB_ARRAY;
+	if (!isContainer(type) || (!array && !name))
+		return JBEditRef();
+	const JBItem *read = readItem(parent);
+	if (read && read != parent.item)	// copied values are read only
+		return JBEditRef();
+	JBEditNode *owner = parent.node;
+	if (!owner && (!(owner = addRecord(parent.item)) || owner->removed))
+		return JBEditRef();
+	if (before.item && (owner->replaced || before.parentItem != parent.item))	// before must be a base child of parent
+		return JBEditRef();
+	if (before.item) {
+		JBEditNode *rec = addRecord(before.item);
+		if (!rec)
+			return JBEditRef();
+		rec->addedBefore = true;
+	}
+
+	JBEditNode *n = (JBEditNode*)alloc(sizeof(JBEditNode));
+	if (!n)
+		return JBEditRef();
+	memset(n, 0, sizeof(JBEditNode));
+	n->type = array ? JB_NULL : JB_NULL_VALUE;
+	if (!array) {
+		if (!(n->name = copyChars(name, n->nameLen)))
+			return JBEditRef();
+		n->hash = n->nameLen ? JBHashName(n->name, n->nameLen) : 0;	// the parser hashes empty keys as 0
+		if (!n->nameLen)
+			n->name = NULL;
+	}
+
+	// link before an added value, or at the end of the values added before a base item or the end
+	JBEditNode **link = &owner->pAdded;
+	if (before.node) {
+		while (*link && *link != before.node)
+			link = &(*link)->pNext;
+		if (!*link)
+			return JBEditRef();
+		n->before = before.node->before;
+	} else {
+		while (*link)
+			link = &(*link)->pNext;
+		n->before = before.item;
+	}
+	n->pNext = *link;
+	*link = n;
+
+	JBEditRef ref;
+	ref.node = n;
+	ref.parentItem = parent.item;
+	ref.parentNode = parent.node;
+	return ref;
+}
+
+bool JBEditor::remove(const JBEditRef &ref)
+{
+	if (ref.node) {
+		JBEditRef parent;
+		parent.item = ref.parentItem;
+		parent.node = ref.parentNode;
+		JBEditNode *owner = container(parent);
+		for (JBEditNode **link = owner ? &owner->pAdded : NULL; link && *link; link = &(*link)->pNext) {
+			if (*link == ref.node) {
+				*link = ref.node->pNext;
+				return true;
+			}
+		}
+		return false;
+	}
+	if (!ref.item || ref.item == pBase)
+		return false;
+	JBEditNode *rec = addRecord(ref.item);
+	if (rec)
+		rec->removed = true;
+	return rec != NULL;
+}
+
+//
+// Output
+//
+
+bool JBEditor::write(jout::JSONOut &out) const
+{
+	if (!pBase)
+		return false;
+#ifdef JO_ALLOW_ROOT_ARRAY
+	if (pBase->getType() == JB_ARRAY && !out.inArray())
+		out.set_rootArray();
+#endif
+	JBEditRef aStack[JSON_MAX_DEPTH];
+	int sp = 0;
+	JBEditRef i = child(root());
+	while (i || sp) {
+		if (!i) {
+			i = aStack[--sp];
+			out.scope_end();
+			continue;
+		}
+		JBEditRef children;
+		const jchar *name = getName(i);
+		switch (getType(i)) {
+			case JB_ROOT:
+			case JB_OBJECT:
+				out.push_object(name);
+				if (!(children = child(i)))
+					out.scope_end();
+				break;
+			case JB_ARRAY:
+				out.push_array(name);
+				if (!(children = child(i)))
+					out.scope_end();
+				break;
+			case JB_STRING:
+				out.push(name, getStr(i), (int)getStrLen(i));
+				break;
+			case JB_INT:
+				out.push(name, getInt(i));
+				break;
+			case JB_FLOAT:
+				out.push(name, getFloat(i));
+				break;
+			case JB_BOOL:
+				out.push(name, getBool(i));
+				break;
+			case JB_NULL:
+				if (out.inArray() || !name)
+					out.push_null();
+				else	// null element copied into an object
+					out.push_null(name);
+				break;
+			case JB_NULL_VALUE:
+				out.push_null(name);
+				break;
+			case JB_DEFERRED:	// not parsed, nothing to write
+			case JB_SHARED:		// not returned by getType
+				break;
+		}
+		if (out.last_error() != jout::JSONOut::ERR_NONE)
+			return false;
+		i = sibling(i);
+		if (children) {
+			if (sp >= JSON_MAX_DEPTH)
+				return false;
+			aStack[sp++] = i;
+			i = children;
+		}
+	}
+	return out.finish();
+}
+
+// set the key of the next builder value from an object member
+static void builderKey(JBBuilder &build, const JBEditor &edit, const JBEditRef &ref)
+{
+	if (build.inArray())
+		return;
+	const jchar *name = NULL;
+	uint len = 0;
+	if (ref.node) {
+		name = ref.node->name;
+		len = ref.node->nameLen;
+	}
+#ifdef JB_KEY_STRING
+	else if ((name = ref.item->getName()))
+		len = ref.item->getNameLen();
+#endif
+	build.keyHash(edit.getHash(ref), name, len);
+}
+
+JBItem* JBEditor::compact(JBRet *info) const
+{
+	JBBuilder build;
+	if (!pBase || !build.begin(pBase->getType() == JB_ARRAY ? JB_ARRAY : JB_ROOT))
+		return NULL;
+	JBEditRef aStack[JSON_MAX_DEPTH];
+	int sp = 0;
+	JBEditRef i = child(root());
+	while ((i || sp) && !build.failed) {
+		if (!i) {
+			i = aStack[--sp];
+			build.close();
+			continue;
+		}
+		JBEditRef children;
+		builderKey(build, *this, i);
+		const JBItem *read = readItem(i);
+		if (read && !edited(read))	// unedited subtree, copy as is
+			build.copy(read);
+		else {
+			switch (JBType type = getType(i)) {
+				case JB_ROOT:
+				case JB_OBJECT:
+				case JB_ARRAY:
+					build.open(type == JB_ARRAY ? JB_ARRAY : JB_OBJECT);
+					if (!(children = child(i)))
+						build.close();
+					break;
+				case JB_STRING: build.addStr(getStr(i), getStrLen(i)); break;
+				case JB_INT: build.addInt(getInt(i)); break;
+				case JB_FLOAT: build.addFloat(getFloat(i)); break;
+				case JB_BOOL: build.addBool(getBool(i)); break;
+				case JB_NULL:
+				case JB_NULL_VALUE: build.addNull(); break;
+				case JB_DEFERRED: build.copy(read); break;
+				case JB_SHARED: break;
+			}
+		}
+		i = sibling(i);
+		if (children) {
+			aStack[sp++] = i;
+			i = children;
+		}
+	}
+	return build.finish(info);
+}
+
+}	// namespace jbin
@@ -0,0 +1,138 @@
+#ifndef __JBEDITOR_H__
+#define __JBEDITOR_H__
+
+//
+// JBEditor
+//
+// Summary
+//	- Copy-on-write edit overlay on top of a block returned by JSONBin (or
+//		JBLoad, JBLoadMapped etc.). The block is never written to, values that
+//		are set, inserted or removed are recorded in a small side structure and
+//		reads fall through to the block for everything else.
+//	- The edited document can be written with JSONOut or compacted into a new
+//		block, unedited subtrees are copied as they are (see JBBuilder).
+//	- Cost of an edit is proportional to the edit, not the document.
+//
+// Usage
+//	- JBEditor edit(pJSON);	// or edit.open(pJSON), the block must outlive the editor
+//	- Values are referred to with JBEditRef, found from the root like JBItem:
+//		JBEditRef scene = edit.find(edit.root(), JBHashKey("scene", 5));
+//		for (JBEditRef r = edit.child(scene); r; r = edit.sibling(r)) ...
+//	- Reading: getType, getName, getHash, getStr, getInt, getFloat, getBool,
+//		getChildCount work on any JBEditRef and return the edited value.
+//	- Editing:
+//		edit.setInt(ref, 5); edit.setStr(ref, "text"); edit.setNull(ref);
+//		edit.setObject(ref) / setArray(ref) replaces a value with an empty container.
+//		edit.setCopy(ref, pOther->findByHash(hash));	// value and children of an item in any block
+//		JBEditRef added = edit.insert(parent, "name");	// new null member, then set it
+//		edit.insert(array, NULL, before);	// new element before another element
+//		edit.remove(ref);
+//	- Output:
+//		edit.write(out);	// jout::JSONOut, as if the edited document was parsed
+//		JBItem *pEdited = edit.compact(&ret);	// new block, release with free
+//	- release() frees the edit records, the base block is not touched.
+//
+// Notes
+//	- JBEditRef values stay valid across edits except for refs to removed
+//		values and refs to children of a value that was replaced.
+//	- Setting a container replaces its children, setting a value inside a
+//		container keeps the other children.
+//	- Names and strings are copied into the editor, zero terminated jchar.
+//	- setCopy() refers to the item instead of copying it, the item must outlive
+//		the editor. Values inside an item of another block can be read but not
+//		edited, and edits made later to base items inside a copied base item
+//		show in both places.
+//	- write() requires jsonout.cpp, compact() requires jbbuilder.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jout { struct JSONOut; }
+
+namespace jbin {
+
+struct JBEditNode;
+struct JBEditChunk;
+
+// a value in the edited document: a base block item or a value added in the editor
+struct JBEditRef {
+	const JBItem *item;			// base item (NULL for a value added in the editor)
+	JBEditNode *node;			// value added in the editor
+	const JBItem *parentItem;	// parent container in the base block
+	JBEditNode *parentNode;		// parent container added in the editor
+
+	JBEditRef() : item(NULL), node(NULL), parentItem(NULL), parentNode(NULL) {}
+	bool valid() const { return item || node; }
+	operator bool() const { return item || node; }
+};
+
+struct JBEditor {
+	const JBItem *pBase;		// base block, read only
+	const JBItem *pBaseLast;	// last item of the base block
+	JBEditNode **apRecords;		// edit records of base items by item index (open addressing)
+	unsigned int recordTableSize;
+	unsigned int numRecords;
+	unsigned int *aEdited;		// sorted item indices with edit records
+	JBEditChunk *pChunks;		// memory for edit records and strings
+
+	JBEditor() : pBase(NULL), pBaseLast(NULL), apRecords(NULL), recordTableSize(0), numRecords(0), aEdited(NULL), pChunks(NULL) {}
+	JBEditor(const JBItem *base) : pBase(NULL), pBaseLast(NULL), apRecords(NULL), recordTableSize(0), numRecords(0), aEdited(NULL), pChunks(NULL) { open(base); }
+	~JBEditor() { release(); }
+	void open(const JBItem *base);
+	void release();
+
+	// navigate
+	JBEditRef root() const;
+	JBEditRef child(const JBEditRef &ref) const;
+	JBEditRef sibling(const JBEditRef &ref) const;
+	JBEditRef find(const JBEditRef &ref, unsigned int hash) const;
+
+	// read
+	JBType getType(const JBEditRef &ref) const;
+	unsigned int getHash(const JBEditRef &ref) const;
+	const jchar* getName(const JBEditRef &ref) const;
+	const jchar* getStr(const JBEditRef &ref) const;
+	unsigned int getStrLen(const JBEditRef &ref) const;
+	jbint getInt(const JBEditRef &ref) const;
+	jbfloat getFloat(const JBEditRef &ref) const;
+	bool getBool(const JBEditRef &ref) const;
+	jbint getChildCount(const JBEditRef &ref) const;
+
+	// edit
+	bool setInt(const JBEditRef &ref, jbint value);
+	bool setFloat(const JBEditRef &ref, jbfloat value);
+	bool setBool(const JBEditRef &ref, bool value);
+	bool setNull(const JBEditRef &ref);
+	bool setStr(const JBEditRef &ref, const jchar *str);
+	bool setObject(const JBEditRef &ref);
+	bool setArray(const JBEditRef &ref);
+	bool setCopy(const JBEditRef &ref, const JBItem *item);
+	JBEditRef insert(const JBEditRef &parent, const jchar *name, const JBEditRef &before = JBEditRef());
+	bool remove(const JBEditRef &ref);
+
+	// output
+	bool write(jout::JSONOut &out) const;
+	JBItem* compact(JBRet *info = 0) const;
+
+	// internal
+	JBEditNode* record(const JBItem *item) const;
+	JBEditNode* addRecord(const JBItem *item);
+	JBEditNode* value(const JBEditRef &ref) const;
+	const JBItem* readItem(const JBEditRef &ref) const;
+	bool inBase(const JBItem *item) const { return item >= pBase && item <= pBaseLast; }
+	JBEditNode* editValue(const JBEditRef &ref);
+	JBEditNode* container(const JBEditRef &ref) const;
+	JBEditRef firstFrom(const JBItem *parentItem, JBEditNode *parentNode, const JBItem *next) const;
+	void* alloc(unsigned int size);
+	const jchar* copyChars(const jchar *str, unsigned int &len);
+	bool edited(const JBItem *item) const;
+
+private:
+	JBEditor(const JBEditor&);	// not copyable, the destructor frees the edit records
+	JBEditor& operator=(const JBEditor&);
+};
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,426 @@
+//
+// JBStringIndex
+//
+// Details in jbindex.h
+//
+
+#include <stdio.h>	// FILE
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcpy
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// CreateFileMapping / MapViewOfFile
+#else
+#include <fcntl.h>		// open
+#include <unistd.h>		// close
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#endif
+#include "jbindex.h"
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_INDEX_PARTITION_BITS 6
+#define JB_INDEX_PARTITIONS (1 << JB_INDEX_PARTITION_BITS)
+
+static uint textHash(const jchar *str, uint len)
+{
+	uint hash = JB_FNV1A_SEED;
+	const unsigned char *bytes = (const unsigned char*)str;
+	for (uint b = 0; b < len * sizeof(jchar); b++)
+		hash = (bytes[b] ^ hash) * JB_FNV1A_PRIME;
+	return hash;
+}
+
+// offset of the string value of an item from the block, 0 for an empty string
+static inline uint stringOffset(const JBItem *block, const JBItem &item)
+{
+	const jchar *str = item.getStr();
+	return str ? (uint)((const char*)str - (const char*)block) : 0;
+}
+
+static inline uint partitionOf(uint offset)
+{
+	return (offset * 0x9e3779b1u) >> (32 - JB_INDEX_PARTITION_BITS);
+}
+
+//
+// Building
+//
+
+struct sIndexBuild {
+	JBStringIndex *index;
+	uint numRanges;				// item ranges, one per thread
+	uint *aCounts;				// string items of each range in each partition, then the write position
+	uint *aPairs;				// string offset and item index, grouped by partition
+	uint aPartFirst[JB_INDEX_PARTITIONS + 1];	// first pair of each partition
+	uint aPartStrings[JB_INDEX_PARTITIONS];		// unique strings found in each partition
+	uint *aTmpStrings;			// unique strings of a partition start at its first pair, like their first hits
+	uint *aTmpFirst;
+	uint *aTmpHash;
+	volatile bool failed;
+};
+
+static void countStrings(void *user, uint first, uint end, uint range)
+{
+	sIndexBuild &build = *(sIndexBuild*)user;
+	const JBItem *block = build.index->pBlock;
+	uint *aCounts = build.aCounts + range * JB_INDEX_PARTITIONS;
+	for (uint i = first; i < end; i++) {
+		if (block[i].type == JB_STRING)
+			aCounts[partitionOf(stringOffset(block, block[i]))]++;
+	}
+}
+
+static void writePairs(void *user, uint first, uint end, uint range)
+{
+	sIndexBuild &build = *(sIndexBuild*)user;
+	const JBItem *block = build.index->pBlock;
+	uint *aPos = build.aCounts + range * JB_INDEX_PARTITIONS;
+	for (uint i = first; i < end; i++) {
+		if (block[i].type == JB_STRING) {
+			uint offset = stringOffset(block, block[i]);
+			uint *pair = build.aPairs + 2 * aPos[partitionOf(offset)]++;
+			pair[0] = offset;
+			pair[1] = i;
+		}
+	}
+}
+
+// group the hits of each partition by string, in item order
+static void groupPartitions(void *user, uint first, uint end, uint range)
+{
+	(void)range;
+	sIndexBuild &build = *(sIndexBuild*)user;
+	JBStringIndex &index = *build.index;
+	for (uint part = first; part < end && !build.failed; part++) {
+		uint start = build.aPartFirst[part], count = build.aPartFirst[part + 1] - start;
+		if (!count)
+			continue;
+		const uint *aPairs = build.aPairs + 2 * start;
+		uint size = 16;
+		while (size < count * 2)
+			size *= 2;
+		uint *aSlots = (uint*)calloc(size, sizeof(uint));	// local string + 1 by offset
+		uint *aLocal = (uint*)malloc((count + 1) * sizeof(uint));	// local string of each pair
+		if (!aSlots || !aLocal) {
+			free(aSlots);
+			free(aLocal);
+			build.failed = true;
+			return;
+		}
+		uint *aStrings = build.aTmpStrings + start;
+		uint *aFirst = build.aTmpFirst + start;
+		uint numStrings = 0;
+		for (uint p = 0; p < count; p++) {
+			uint offset = aPairs[2 * p];
+			uint slot = (offset * 0x85ebca6bu) & (size - 1);
+			while (aSlots[slot] && aStrings[aSlots[slot] - 1] != offset)
+				slot = (slot + 1) & (size - 1);
+			if (!aSlots[slot]) {
+				aStrings[numStrings] = offset;
+				aFirst[numStrings] = 0;
+				aSlots[slot] = ++numStrings;
+			}
+			aLocal[p] = aSlots[slot] - 1;
+			aFirst[aLocal[p]]++;
+		}
+
+		// counts to first hits, then place the hits
+		uint total = 0;
+		for (uint s = 0; s < numStrings; s++) {
+			uint hits = aFirst[s];
+			aFirst[s] = total;
+			total += hits;
+		}
+		for (uint p = 0; p < count; p++) {
+			uint hit = start + aFirst[aLocal[p]]++;
+			uint item = aPairs[2 * p + 1];
+			index.aItems[hit] = item;
+			index.aKeys[hit] = index.pBlock[item].getHash();
+		}
+		for (uint s = 0; s < numStrings; s++) {	// aFirst is now the end of each string, step back to the start
+			const JBItem &item = index.pBlock[index.aItems[start + (s ? aFirst[s - 1] : 0)]];
+			build.aTmpHash[start + s] = textHash(item.getStr(), item.getStr() ? item.getStrLen() : 0);
+		}
+		for (uint s = numStrings - 1; s > 0; s--)	// the end of the last string is the next partition
+			aFirst[s] = aFirst[s - 1];
+		aFirst[0] = 0;
+		build.aPartStrings[part] = numStrings;
+		free(aSlots);
+		free(aLocal);
+	}
+}
+
+bool JBStringIndex::build(const JBItem *block, const JBRet *info, uint threads)
+{
+	release();
+	if (!block || !info || !info->num_items)
+		return false;
+	pBlock = block;
+	numItems = info->num_items;
+	blockSize = info->bin_size;
+	if (threads < 1)
+		threads = 1;
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+	if (threads > numItems)
+		threads = numItems;
+
+	// count the string items of each range in each partition
+	sIndexBuild build;
+	memset(&build, 0, sizeof(build));
+	build.index = this;
+	build.numRanges = threads;
+	build.aCounts = (uint*)calloc(threads * JB_INDEX_PARTITIONS, sizeof(uint));
+	if (!build.aCounts)
+		return false;
+	JBParallelFor(numItems, threads, countStrings, &build);
+
+	// pairs of a partition are stored range after range so each partition is in item order
+	uint total = 0;
+	for (uint part = 0; part < JB_INDEX_PARTITIONS; part++) {
+		build.aPartFirst[part] = total;
+		for (uint range = 0; range < threads; range++) {
+			uint count = build.aCounts[range * JB_INDEX_PARTITIONS + part];
+			build.aCounts[range * JB_INDEX_PARTITIONS + part] = total;
+			total += count;
+		}
+	}
+	build.aPartFirst[JB_INDEX_PARTITIONS] = total;
+	numHits = total;
+	build.aPairs = (uint*)malloc(((size_t)total + 1) * 2 * sizeof(uint));
+	build.aTmpStrings = (uint*)malloc((total + 1) * sizeof(uint));
+	build.aTmpFirst = (uint*)malloc((total + 1) * sizeof(uint));
+	build.aTmpHash = (uint*)malloc((total + 1) * sizeof(uint));
+	aItems = (uint*)malloc((total + 1) * sizeof(uint));
+	aKeys = (uint*)malloc((total + 1) * sizeof(uint));
+	bool ok = build.aPairs && build.aTmpStrings && build.aTmpFirst && build.aTmpHash && aItems && aKeys;
+	if (ok) {
+		JBParallelFor(numItems, threads, writePairs, &build);
+		JBParallelFor(JB_INDEX_PARTITIONS, threads, groupPartitions, &build);
+		ok = !build.failed;
+	}
+
+	// unique strings of every partition in one list
+	if (ok) {
+		for (uint part = 0; part < JB_INDEX_PARTITIONS; part++)
+			numStrings += build.aPartStrings[part];
+		tableSize = 16;
+		while (tableSize < numStrings * 2)
+			tableSize *= 2;
+		aStrings = (uint*)malloc((numStrings + 1) * sizeof(uint));
+		aFirst = (uint*)malloc((numStrings + 1) * sizeof(uint));
+		aTable = (uint*)calloc(tableSize, sizeof(uint));
+		ok = aStrings && aFirst && aTable;
+	}
+	if (ok) {
+		uint id = 0;
+		for (uint part = 0; part < JB_INDEX_PARTITIONS; part++) {
+			uint start = build.aPartFirst[part];
+			for (uint s = 0; s < build.aPartStrings[part]; s++, id++) {
+				aStrings[id] = build.aTmpStrings[start + s];
+				aFirst[id] = start + build.aTmpFirst[start + s];
+				uint slot = build.aTmpHash[start + s] & (tableSize - 1);
+				while (aTable[slot])
+					slot = (slot + 1) & (tableSize - 1);
+				aTable[slot] = id + 1;
+			}
+		}
+		aFirst[numStrings] = numHits;
+	}
+	free(build.aCounts);
+	free(build.aPairs);
+	free(build.aTmpStrings);
+	free(build.aTmpFirst);
+	free(build.aTmpHash);
+	if (!ok)
+		release();
+	return ok;
+}
+
+void JBStringIndex::release()
+{
+	if (mapped) {
+#ifdef WIN32
+		UnmapViewOfFile(mapped);
+#else
+		munmap((void*)mapped, mappedSize);
+#endif
+	} else {
+		free(aStrings);
+		free(aFirst);
+		free(aItems);
+		free(aKeys);
+		free(aTable);
+	}
+	pBlock = NULL;
+	aStrings = aFirst = aItems = aKeys = aTable = NULL;
+	numStrings = numHits = tableSize = numItems = blockSize = 0;
+	mapped = NULL;
+	mappedSize = 0;
+}
+
+//
+// Queries
+//
+
+int JBStringIndex::findString(const jchar *str, uint len) const
+{
+	if (!tableSize)
+		return -1;
+	uint slot = textHash(str, len) & (tableSize - 1);
+	while (uint id = aTable[slot]) {
+		const JBItem &item = pBlock[aItems[aFirst[id - 1]]];
+		const jchar *value = item.getStr();
+		if (value ? (item.getStrLen() == len && !memcmp(value, str, len * sizeof(jchar))) : !len)
+			return (int)id - 1;
+		slot = (slot + 1) & (tableSize - 1);
+	}
+	return -1;
+}
+
+uint JBStringIndex::getHits(int id, const uint **aItemIndices, const uint **aKeyHashes) const
+{
+	if (id < 0 || (uint)id >= numStrings) {
+		*aItemIndices = NULL;
+		if (aKeyHashes)
+			*aKeyHashes = NULL;
+		return 0;
+	}
+	*aItemIndices = aItems + aFirst[id];
+	if (aKeyHashes)
+		*aKeyHashes = aKeys + aFirst[id];
+	return aFirst[id + 1] - aFirst[id];
+}
+
+uint JBStringIndex::findAll(const jchar *str, uint len, const JBItem **aResults, uint maxResults) const
+{
+	const uint *aHits;
+	uint count = getHits(findString(str, len), &aHits);
+	for (uint h = 0; h < count && h < maxResults; h++)
+		aResults[h] = pBlock + aHits[h];
+	return count;
+}
+
+uint JBStringIndex::findByKey(uint key_hash, const jchar *str, uint len, const JBItem **aResults, uint maxResults) const
+{
+	const uint *aHits, *aHitKeys;
+	uint hits = getHits(findString(str, len), &aHits, &aHitKeys);
+	uint count = 0;
+	for (uint h = 0; h < hits; h++) {
+		if (aHitKeys[h] == key_hash) {
+			if (count < maxResults)
+				aResults[count] = pBlock + aHits[h];
+			count++;
+		}
+	}
+	return count;
+}
+
+//
+// Index files
+//
+
+bool JBStringIndex::save(const char *path) const
+{
+	if (!pBlock)
+		return false;
+	JBIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JB_INDEX_MAGIC, sizeof(header.magic));
+	header.version = JB_INDEX_VERSION;
+	header.endian = JB_INDEX_ENDIAN;
+	header.char_size = sizeof(jchar);
+	header.num_items = numItems;
+	header.block_size = blockSize;
+	header.num_strings = numStrings;
+	header.num_hits = numHits;
+	header.table_size = tableSize;
+
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "wb"))
+		f = NULL;
+#else
+	f = fopen(path, "wb");
+#endif
+	if (!f)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(aStrings, sizeof(uint), numStrings, f) == numStrings &&
+		fwrite(aFirst, sizeof(uint), numStrings + 1, f) == numStrings + 1 &&
+		fwrite(aItems, sizeof(uint), numHits, f) == numHits &&
+		fwrite(aKeys, sizeof(uint), numHits, f) == numHits &&
+		fwrite(aTable, sizeof(uint), tableSize, f) == tableSize;
+	if (fclose(f))
+		written = false;
+	return written;
+}
+
+bool JBStringIndex::load(const char *path, const JBItem *block, uint num_items, uint block_size)
+{
+	release();
+	if (!block)
+		return false;
+	size_t size = 0;
+	const char *base = NULL;
+#ifdef WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(JBIndexHeader)) {
+		size = (size_t)file_size.QuadPart;
+		if (HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) {
+			base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);	// the view keeps the mapping open
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat file_stat;
+	if (!fstat(file, &file_stat) && file_stat.st_size >= (off_t)sizeof(JBIndexHeader)) {
+		size = (size_t)file_stat.st_size;
+		void *pMapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		base = pMapped != MAP_FAILED ? (const char*)pMapped : NULL;
+	}
+	close(file);	// the mapping stays valid after closing
+#endif
+	if (!base)
+		return false;
+	mapped = base;
+	mappedSize = size;
+
+	const JBIndexHeader &header = *(const JBIndexHeader*)base;
+	unsigned long long expect = sizeof(JBIndexHeader) + ((unsigned long long)header.num_strings * 2 + 1 +
+		(unsigned long long)header.num_hits * 2 + header.table_size) * sizeof(uint);
+	if (memcmp(header.magic, JB_INDEX_MAGIC, sizeof(header.magic)) || header.endian != JB_INDEX_ENDIAN ||
+		header.version != JB_INDEX_VERSION || header.char_size != sizeof(jchar) ||
+		header.num_items != num_items || header.block_size != block_size || expect != size ||
+		!header.table_size || (header.table_size & (header.table_size - 1))) {
+		release();
+		return false;
+	}
+	uint *aData = (uint*)(base + sizeof(JBIndexHeader));
+	aStrings = aData;
+	aFirst = aStrings + header.num_strings;
+	aItems = aFirst + header.num_strings + 1;
+	aKeys = aItems + header.num_hits;
+	aTable = aKeys + header.num_hits;
+	numStrings = header.num_strings;
+	numHits = header.num_hits;
+	tableSize = header.table_size;
+	numItems = num_items;
+	blockSize = block_size;
+	pBlock = block;
+	return true;
+}
+
+}	// namespace jbin
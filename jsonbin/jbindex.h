@@ -0,0 +1,110 @@
+#ifndef __JBINDEX_H__
+#define __JBINDEX_H__
+
+//
+// JBStringIndex
+//
+// Summary
+//	- Inverted index of the string values in a block returned by JSONBin: for
+//		each unique string, the items that have it as their value and their
+//		key hashes. JSONBin already shares equal strings, so a string is
+//		identified by its offset in the block and the index is built without
+//		comparing any text.
+//	- An equality query hashes the text once and then costs the number of
+//		hits instead of a walk over the whole document.
+//
+// Usage
+//	- Build after parsing (or loading a snapshot), on several threads:
+//		JBRet ret; JBItem *pJSON = JSONBin(json, size, &ret);
+//		JBStringIndex index;
+//		index.build(pJSON, &ret, JBHardwareThreads());
+//	- Every object with "street": "Harbor Road":
+//		const JBItem *aHits[64];
+//		unsigned int count = index.findByKey(JBHashKey("street", 6), "Harbor Road", 11, aHits, 64);
+//		(aHits[h] is the string item, its parent object is the record)
+//	- All items with a value, or the raw lists:
+//		int id = index.findString("Harbor Road", 11);	// -1 if no item has this value
+//		const unsigned int *aItems, *aKeys;
+//		unsigned int hits = index.getHits(id, &aItems, &aKeys);	// item indices and their key hashes
+//	- Save next to a snapshot and load it with the snapshot:
+//		JBSave("file.jbin", pJSON, &ret); index.save("file.jbin.idx");
+//		const JBItem *pMapped = JBLoadMapped("file.jbin");
+//		index.load("file.jbin.idx", pMapped, ret.num_items, ret.bin_size);	// memory mapped
+//
+// Notes
+//	- Only string values are indexed, not key names. Empty strings are
+//		indexed with offset 0 (JSONBin stores them without a string).
+//	- Results count every hit but only fill in up to maxResults items, in item
+//		order. Array elements have key hash 0.
+//	- Items are grouped by partitions of string offsets, each thread counts and
+//		groups a range of items or partitions so the work is split without
+//		locks. The text lookup table is filled at the end from the unique
+//		strings.
+//	- The index stores item indices and string offsets, not pointers, so it
+//		stays valid for a copy of the block (saved, loaded or mapped). load()
+//		refuses an index built for a block with a different item count or size.
+//	- Requires jbthreads.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+#define JB_INDEX_MAGIC "JBIX"
+#define JB_INDEX_VERSION 1
+#define JB_INDEX_ENDIAN 0x01020304	// written in native byte order
+
+// index file header, the arrays follow in the order of JBStringIndex
+struct JBIndexHeader {
+	char magic[4];				// JB_INDEX_MAGIC
+	unsigned int version;		// JB_INDEX_VERSION
+	unsigned int endian;		// JB_INDEX_ENDIAN
+	unsigned int char_size;		// sizeof(jchar)
+	unsigned int num_items;		// items in the indexed block
+	unsigned int block_size;	// bytes of the indexed block
+	unsigned int num_strings;
+	unsigned int num_hits;
+	unsigned int table_size;
+	unsigned int reserved[3];
+};
+
+struct JBStringIndex {
+	const JBItem *pBlock;
+	unsigned int *aStrings;		// byte offset of each unique string from the block (0 = empty string)
+	unsigned int *aFirst;		// first hit of each string, numStrings + 1
+	unsigned int *aItems;		// item index of each hit, grouped by string
+	unsigned int *aKeys;		// key hash of each hit
+	unsigned int *aTable;		// string + 1 by text hash, tableSize (power of 2)
+	unsigned int numStrings;
+	unsigned int numHits;
+	unsigned int tableSize;
+	unsigned int numItems;		// block the index was built for
+	unsigned int blockSize;
+	const char *mapped;			// file mapping when loaded
+	size_t mappedSize;
+
+	JBStringIndex() : pBlock(NULL), aStrings(NULL), aFirst(NULL), aItems(NULL), aKeys(NULL), aTable(NULL),
+		numStrings(0), numHits(0), tableSize(0), numItems(0), blockSize(0), mapped(NULL), mappedSize(0) {}
+	~JBStringIndex() { release(); }
+
+	// index the string values of a block, info supplies the item count and block size
+	bool build(const JBItem *block, const JBRet *info, unsigned int threads = 1);
+	void release();
+
+	bool save(const char *path) const;
+	bool load(const char *path, const JBItem *block, unsigned int num_items, unsigned int block_size);
+
+	int findString(const jchar *str, unsigned int len) const;	// unique string id or -1
+	unsigned int getHits(int id, const unsigned int **aItemIndices, const unsigned int **aKeyHashes = 0) const;
+	unsigned int findAll(const jchar *str, unsigned int len, const JBItem **aResults, unsigned int maxResults) const;
+	unsigned int findByKey(unsigned int key_hash, const jchar *str, unsigned int len, const JBItem **aResults, unsigned int maxResults) const;
+
+private:
+	JBStringIndex(const JBStringIndex&);	// not copyable, the destructor frees or unmaps the tables
+	JBStringIndex& operator=(const JBStringIndex&);
+};
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,203 @@
+//
+// JSONBinLines
+//
+// Details in jblines.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcpy
+#include "jblines.h"
+#include "jbbuilder.h"
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+// a range of whole lines parsed on one thread
+struct sLinesPart {
+	const char *text;
+	uint size;
+	uint offset;			// of the part in the whole text
+	uint numLines;
+	uint numRecords;
+	JBItem *pBlock;			// root array of the records
+	JBLineError *aErrors;	// line numbers from the start of the part until merged
+	uint numErrors;
+	uint maxErrors;
+	JBError error;			// the part could not be parsed at all
+};
+
+// check that a line is one object or array, JBERR_NONE if it is
+static JBError checkLine(const char *line, uint len, bool parse, uint &offset)
+{
+	JBTokenReader reader(line, len);
+	JBToken token;
+	while (reader.next(token)) {}
+	offset = reader.offset();
+	if (reader.error())
+		return reader.error();
+	for (; offset < len; offset++) {
+		if ((unsigned char)line[offset] > ' ')
+			return JBERR_UNEXPECTED_CHARACTER;	// more after the record
+	}
+	if (parse) {	// a line that the reader accepts but the parser does not
+		JBRet ret;
+		JBItem *pLine = JSONBin(line, len, &ret);
+		if (!pLine) {
+			offset = ret.bytes_read < len ? ret.bytes_read : 0;
+			return ret.error_code;
+		}
+		free(pLine);
+	}
+	return JBERR_NONE;
+}
+
+static bool addError(sLinesPart &part, uint line, uint offset, JBError error)
+{
+	if (part.numErrors == part.maxErrors) {
+		uint grow = part.maxErrors ? part.maxErrors * 2 : 16;
+		JBLineError *aGrow = (JBLineError*)realloc(part.aErrors, grow * sizeof(JBLineError));
+		if (!aGrow)
+			return false;
+		part.aErrors = aGrow;
+		part.maxErrors = grow;
+	}
+	JBLineError &added = part.aErrors[part.numErrors++];
+	added.line = line;
+	added.offset = offset;
+	added.error_code = error;
+	return true;
+}
+
+// copy the good lines of a part into an array and parse it, parse checks each line with JSONBin
+static JBError parsePart(sLinesPart &part, bool parse)
+{
+	char *buf = (char*)malloc(part.size + 2);	// lines with commas for newlines and brackets
+	if (!buf)
+		return JBERR_OUT_OF_MEMORY;
+	uint len = 0;
+	buf[len++] = '[';
+	part.numLines = part.numRecords = part.numErrors = 0;
+	const char *line = part.text, *end = part.text + part.size;
+	while (line < end) {
+		const char *eol = (const char*)memchr(line, '\n', (size_t)(end - line));
+		uint line_len = (uint)((eol ? eol : end) - line);
+		uint line_num = ++part.numLines;
+		uint first = 0;
+		while (first < line_len && (unsigned char)line[first] <= ' ')
+			first++;
+		if (first < line_len) {
+			uint offset;
+			if (JBError error = checkLine(line + first, line_len - first, parse, offset)) {
+				if (!addError(part, line_num, part.offset + (uint)(line - part.text) + first + offset, error)) {
+					free(buf);
+					return JBERR_OUT_OF_MEMORY;
+				}
+			} else {
+				if (part.numRecords++)
+					buf[len++] = ',';
+				memcpy(buf + len, line + first, line_len - first);
+				len += line_len - first;
+			}
+		}
+		if (!eol)
+			break;
+		line = eol + 1;
+	}
+	buf[len++] = ']';
+	JBError error = JBERR_NONE;
+	if (part.numRecords) {
+		JBRet ret;
+		if (!(part.pBlock = JSONBin(buf, len, &ret)))
+			error = ret.error_code ? ret.error_code : JBERR_OUT_OF_MEMORY;
+	}
+	free(buf);
+	return error;
+}
+
+static void parseParts(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sLinesPart *aParts = (sLinesPart*)user;
+	for (uint p = first; p < end; p++) {
+		sLinesPart &part = aParts[p];
+		part.error = parsePart(part, false);
+		if (part.error && part.error != JBERR_OUT_OF_MEMORY)
+			part.error = parsePart(part, true);	// find the lines that JSONBin does not accept
+	}
+}
+
+JBItem* JSONBinLines(const char *json, unsigned int size, unsigned int threads, JBRet *info, JBLinesReport *report)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+	if (report)
+		report->numErrors = report->numLines = report->numRecords = 0;
+	uint start = 0;
+#ifdef JB_HANDLE_UTF8_BOM
+	if (size >= 3 && (unsigned char)json[0] == 0xef && (unsigned char)json[1] == 0xbb && (unsigned char)json[2] == 0xbf)
+		start = 3;
+#endif
+
+	// split into parts of about the same size at newlines
+	if (threads < 1)
+		threads = 1;
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+	sLinesPart aParts[JB_MAX_THREADS];
+	uint numParts = 0;
+	for (uint t = 1; start < size && t <= threads; t++) {
+		uint end = t < threads ? (uint)((unsigned long long)size * t / threads) : size;
+		if (end <= start)
+			continue;	// the previous part ran past this one
+		const char *eol = (const char*)memchr(json + end - 1, '\n', size - (end - 1));	// the part ends after a newline
+		end = eol ? (uint)(eol - json) + 1 : size;
+		sLinesPart &part = aParts[numParts++];
+		memset(&part, 0, sizeof(sLinesPart));
+		part.text = json + start;
+		part.size = end - start;
+		part.offset = start;
+		start = end;
+	}
+	JBParallelFor(numParts, numParts, parseParts, aParts);
+
+	// combine the blocks and report the errors in line order
+	JBError error = JBERR_NONE;
+	const JBItem *apBlocks[JB_MAX_THREADS];
+	uint numBlocks = 0, line = 0;
+	for (uint p = 0; p < numParts; p++) {
+		sLinesPart &part = aParts[p];
+		if (part.error && !error)
+			error = part.error;
+		if (part.pBlock)
+			apBlocks[numBlocks++] = part.pBlock;
+		if (report) {
+			for (uint e = 0; e < part.numErrors; e++) {
+				if (report->aErrors && report->numErrors < report->maxErrors) {
+					report->aErrors[report->numErrors] = part.aErrors[e];
+					report->aErrors[report->numErrors].line += line;
+				}
+				report->numErrors++;
+			}
+			report->numRecords += part.numRecords;
+		}
+		line += part.numLines;
+	}
+	if (report)
+		report->numLines = line;
+	JBItem *pRet = NULL;
+	if (!error) {
+		pRet = JBConcat(apBlocks, numBlocks, info);
+		if (info && pRet)
+			info->bytes_read = size;
+	} else if (info)
+		info->error_code = error;
+	for (uint p = 0; p < numParts; p++) {
+		free(aParts[p].pBlock);
+		free(aParts[p].aErrors);
+	}
+	return pRet;
+}
+
+}	// namespace jbin
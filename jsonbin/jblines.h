@@ -0,0 +1,70 @@
+#ifndef __JBLINES_H__
+#define __JBLINES_H__
+
+//
+// JSONBinLines
+//
+// Summary
+//	- Parses newline delimited JSON (NDJSON / JSON Lines, one object or array
+//		per line) into a single block with a root array that holds every
+//		record in file order, with strings shared across all records.
+//	- The text is split into parts at newlines and each part is parsed with
+//		one JSONBin call on its own thread, so the work memory and string
+//		cache are set up once per thread instead of once per record.
+//	- Malformed lines are left out and reported, the rest of the file is
+//		still parsed.
+//
+// Usage
+//	- Parse a log file on several threads:
+//		JBRet ret;
+//		JBItem *pRecords = JSONBinLines(json, size, JBHardwareThreads(), &ret);
+//		for (const JBItem *pRecord = pRecords->getChild(); pRecord; pRecord = pRecord->getSibling()) ...
+//		free(pRecords);
+//	- Find out which lines were left out:
+//		JBLineError aErrors[16];
+//		JBLinesReport report = { aErrors, 16 };
+//		JBItem *pRecords = JSONBinLines(json, size, threads, &ret, &report);
+//		for (unsigned int e = 0; e < report.numErrors && e < report.maxErrors; e++)
+//			printf("line %u: error %d\n", aErrors[e].line, aErrors[e].error_code);
+//
+// Notes
+//	- Each line must hold one object or array (a root array requires
+//		JB_ALLOW_ROOT_ARRAY), white space around it is allowed and empty
+//		lines are skipped. A line with anything else, or with text after the
+//		record, is a malformed line.
+//	- Lines are checked with JBTokenReader before they are parsed. A part
+//		that JSONBin still fails on is checked again one line at a time with
+//		JSONBin so that only the lines it can not parse are left out.
+//	- Each part copies its good lines into a work buffer separated by commas
+//		and the part blocks are combined with JBConcat, so the work memory is
+//		about the size of the text plus the part blocks.
+//	- info describes the returned block, error_code is only set if there is
+//		no block (out of memory or the combined block can not be represented).
+//	- Requires jbbuilder.cpp (JBConcat) and jbthreads.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+struct JBLineError {
+	unsigned int line;		// line number, 1 for the first line
+	unsigned int offset;	// offset in the text where the error was found
+	JBError error_code;
+};
+
+struct JBLinesReport {
+	JBLineError *aErrors;		// filled in by line number up to maxErrors, can be NULL
+	unsigned int maxErrors;
+	unsigned int numErrors;		// malformed lines, including the ones that did not fit in aErrors
+	unsigned int numLines;
+	unsigned int numRecords;	// elements of the root array
+};
+
+// root array of the records of newline delimited JSON, malformed lines are left out
+JBItem* JSONBinLines(const char *json, unsigned int size, unsigned int threads = 1, JBRet *info = 0, JBLinesReport *report = 0);
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,188 @@
+//
+// JBLiveDoc
+//
+// Details in jblive.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memset
+#ifdef WIN32
+#include <intrin.h>	// _Interlocked*
+#endif
+#include "jblive.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+// a replaced version and the epoch it was replaced in
+struct JBLiveRetired {
+	JBItem *block;
+	uint epoch;
+	JBLiveRetired *next;
+};
+
+// atomic operations, all sequentially consistent: a reader stores its epoch then
+// reads the pointer while the updater stores the pointer then reads the epochs
+static void *exchangePointer(void * volatile *dest, void *value)
+{
+#ifdef WIN32
+	return _InterlockedExchangePointer(dest, value);
+#else
+	return __atomic_exchange_n(dest, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void *loadPointer(void * volatile *src)
+{
+#ifdef WIN32
+	return _InterlockedCompareExchangePointer(src, NULL, NULL);	// plain volatile reads are only ordered with /volatile:ms
+#else
+	return __atomic_load_n(src, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static uint loadUint(volatile uint *src)
+{
+#ifdef WIN32
+	return (uint)_InterlockedOr((volatile long*)src, 0);
+#else
+	return __atomic_load_n(src, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void storeUint(volatile uint *dest, uint value)
+{
+#ifdef WIN32
+	_InterlockedExchange((volatile long*)dest, (long)value);	// full barrier
+#else
+	__atomic_store_n(dest, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// returns the value before the increment
+static uint incrementUint(volatile uint *dest)
+{
+#ifdef WIN32
+	return (uint)_InterlockedIncrement((volatile long*)dest) - 1;
+#else
+	return __atomic_fetch_add(dest, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static bool claimUint(volatile uint *dest)
+{
+#ifdef WIN32
+	return _InterlockedCompareExchange((volatile long*)dest, 1, 0) == 0;
+#else
+	return __sync_bool_compare_and_swap(dest, 0, 1);
+#endif
+}
+
+JBLiveDoc::JBLiveDoc() : pCurrent(NULL), epoch(1), pRetired(NULL), numRetired(0)
+{
+	memset((void*)aSlots, 0, sizeof(aSlots));
+}
+
+JBLiveDoc::~JBLiveDoc()
+{
+	free(pCurrent);
+	while (JBLiveRetired *retired = pRetired) {
+		pRetired = retired->next;
+		free(retired->block);
+		free(retired);
+	}
+}
+
+int JBLiveDoc::attach()
+{
+	for (int slot = 0; slot < JB_LIVE_MAX_READERS; slot++) {
+		if (!loadUint(&aSlots[slot].claimed) && claimUint(&aSlots[slot].claimed))
+			return slot;
+	}
+	return -1;
+}
+
+void JBLiveDoc::detach(int slot)
+{
+	if (slot >= 0 && slot < JB_LIVE_MAX_READERS) {
+		storeUint(&aSlots[slot].epoch, 0);
+		storeUint(&aSlots[slot].claimed, 0);
+	}
+}
+
+const JBItem* JBLiveDoc::enter(int slot)
+{
+	if (slot < 0 || slot >= JB_LIVE_MAX_READERS)
+		return NULL;
+	storeUint(&aSlots[slot].epoch, loadUint(&epoch));	// announce before reading the pointer
+	return (const JBItem*)loadPointer((void * volatile *)&pCurrent);
+}
+
+void JBLiveDoc::leave(int slot)
+{
+	if (slot >= 0 && slot < JB_LIVE_MAX_READERS)
+		storeUint(&aSlots[slot].epoch, 0);
+}
+
+bool JBLiveDoc::publish(JBItem *block)
+{
+	if (!block)
+		return false;
+	JBLiveRetired *retired = (JBLiveRetired*)malloc(sizeof(JBLiveRetired));
+	if (!retired)
+		return false;
+	JBItem *prev = (JBItem*)exchangePointer((void * volatile *)&pCurrent, block);
+	if (prev) {
+		// readers that announce a later epoch read the pointer after the swap
+		retired->block = prev;
+		retired->epoch = incrementUint(&epoch);
+		retired->next = pRetired;
+		pRetired = retired;
+		numRetired++;
+	} else {
+		incrementUint(&epoch);
+		free(retired);
+	}
+	reclaim();
+	return true;
+}
+
+bool JBLiveDoc::reload(const char *json, unsigned int size, JBRet *info)
+{
+	JBItem *block = JSONBin(json, size, info);
+	if (!block)
+		return false;
+	if (!publish(block)) {
+		free(block);
+		return false;
+	}
+	return true;
+}
+
+void JBLiveDoc::reclaim()
+{
+	if (!pRetired)
+		return;
+
+	// oldest epoch any reader is in, versions retired before it are unreachable
+	uint current = loadUint(&epoch);
+	uint oldest = current;
+	for (int slot = 0; slot < JB_LIVE_MAX_READERS; slot++) {
+		uint reader = loadUint(&aSlots[slot].epoch);
+		if (reader && (int)(reader - oldest) < 0)
+			oldest = reader;
+	}
+	JBLiveRetired **link = &pRetired;
+	while (JBLiveRetired *retired = *link) {
+		if ((int)(retired->epoch - oldest) < 0) {
+			*link = retired->next;
+			free(retired->block);
+			free(retired);
+			numRetired--;
+		} else
+			link = &retired->next;
+	}
+}
+
+}	// namespace jbin
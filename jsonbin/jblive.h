@@ -0,0 +1,98 @@
+#ifndef __JBLIVE_H__
+#define __JBLIVE_H__
+
+//
+// JBLiveDoc
+//
+// Summary
+//	- Holds the current version of a document that is replaced while many
+//		threads read it. A new version is parsed on the updating thread and
+//		published with an atomic pointer swap, readers never lock or wait.
+//	- Old versions are freed with epoch based reclamation: a replaced block is
+//		retired with the current epoch and freed once every reader that could
+//		still see it has left.
+//
+// Usage
+//	- Create one JBLiveDoc for the document (as a member or global).
+//	- Each reader thread claims a slot once and uses it for every read:
+//		int slot = live.attach();				// -1 if all JB_LIVE_MAX_READERS slots are taken
+//		const JBItem *pJSON = live.enter(slot);	// current version (NULL before the first publish)
+//		... read pJSON ...
+//		live.leave(slot);						// pJSON may be freed after this
+//		live.detach(slot);						// when the thread is done with the document
+//		JBLiveRead read(live, slot) enters in its constructor and leaves in its
+//		destructor.
+//	- The updating thread parses and publishes new versions:
+//		live.reload(json, size, &ret);	// parse and publish, false on parse error (current version stays)
+//		live.publish(pJSON);			// or publish a block from JSONBin / JBLoad (ownership passes)
+//		Both free retired versions that no reader can see anymore, reclaim()
+//		does only that and can be called any time from the updating thread.
+//
+// Notes
+//	- enter() and leave() are wait-free: one epoch read, one slot store and
+//		one pointer read. A reader must not hold a version across leave().
+//	- A slot is used by one thread at a time and enter/leave do not nest.
+//	- publish(), reload() and reclaim() must be called from one thread at a
+//		time (the updating thread).
+//	- Blocks are released with free so they must come from JSONBin, JSONBinSelect
+//		or JBLoad. The destructor frees the current and retired versions, no
+//		reader may be active at that point.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+#ifndef JB_LIVE_MAX_READERS
+#define JB_LIVE_MAX_READERS 256	// reader slots per JBLiveDoc
+#endif
+
+// reader slot, one per cache line so readers do not share lines
+struct JBLiveSlot {
+	volatile unsigned int epoch;	// epoch seen on enter, 0 while not reading
+	volatile unsigned int claimed;	// slot is attached to a reader
+	char pad[64 - 2 * sizeof(unsigned int)];
+};
+
+struct JBLiveRetired;
+
+struct JBLiveDoc {
+	JBItem * volatile pCurrent;		// current version
+	volatile unsigned int epoch;	// advanced on every publish, starts at 1
+	JBLiveRetired *pRetired;		// replaced versions waiting for readers to leave
+	unsigned int numRetired;
+	JBLiveSlot aSlots[JB_LIVE_MAX_READERS];
+
+	JBLiveDoc();
+	~JBLiveDoc();
+
+	// readers
+	int attach();
+	void detach(int slot);
+	const JBItem* enter(int slot);
+	void leave(int slot);
+
+	// updating thread
+	bool publish(JBItem *block);
+	bool reload(const char *json, unsigned int size, JBRet *info = 0);
+	void reclaim();
+
+private:
+	JBLiveDoc(const JBLiveDoc&);	// not copyable, the destructor frees the current and retired versions
+	JBLiveDoc& operator=(const JBLiveDoc&);
+};
+
+// enter a JBLiveDoc for the lifetime of this object
+struct JBLiveRead {
+	JBLiveDoc &doc;
+	int slot;
+	const JBItem *pJSON;
+
+	JBLiveRead(JBLiveDoc &live, int reader_slot) : doc(live), slot(reader_slot), pJSON(live.enter(reader_slot)) {}
+	~JBLiveRead() { doc.leave(slot); }
+};
+
+}	// namespace jbin
+
+#endif
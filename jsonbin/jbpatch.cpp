@@ -0,0 +1,564 @@
+//
+// JBPatch
+//
+// Details in jbpatch.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcmp
+#include "jbpatch.h"
+#include "jbbuilder.h"
+#include "jbeditor.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_PATCH_MAX_KEY 1024	// longest key in a JSON Pointer
+#define JB_PATCH_MAX_COPIES 64	// copied base subtrees tracked before the edits are compacted
+#define JB_PATCH_MAX_HELD 4		// compacted blocks kept alive during one operation
+
+static bool isNull(const JBItem *item)
+{
+	return item->getType() == JB_NULL || item->getType() == JB_NULL_VALUE;
+}
+
+static bool isObject(JBType type)
+{
+	return type == JB_ROOT || type == JB_OBJECT;
+}
+
+// key of an item for the next builder value
+static void keyOf(JBBuilder &build, const JBItem *item)
+{
+#ifdef JB_KEY_STRING
+	const jchar *name = item->getName();
+	build.keyHash(item->getHash(), name, name ? item->getNameLen() : 0);
+#else
+	build.keyHash(item->getHash());
+#endif
+}
+
+//
+// JSON Merge Patch
+//
+
+static void mergeValue(JBBuilder &build, const JBItem *target, const JBItem *patch);
+
+// add the members of target merged with patch to the open object
+static void mergeMembers(JBBuilder &build, const JBItem *target, const JBItem *patch)
+{
+	for (const JBItem *t = target ? target->getChild() : NULL; t && !build.failed; t = t->getSibling()) {
+		const JBItem *p = patch->findByHash(t->getHash());
+		if (!p)
+			build.copy(t);
+		else if (!isNull(p)) {
+			keyOf(build, t);
+			mergeValue(build, t, p);
+		}	// null removes the member
+	}
+	for (const JBItem *p = patch->getChild(); p && !build.failed; p = p->getSibling()) {
+		if (!isNull(p) && !(target && target->findByHash(p->getHash()))) {
+			keyOf(build, p);
+			mergeValue(build, NULL, p);
+		}
+	}
+}
+
+static void mergeValue(JBBuilder &build, const JBItem *target, const JBItem *patch)
+{
+	if (!isObject(patch->getType()))
+		build.copy(patch);	// values and arrays replace the target
+	else if (build.open(JB_OBJECT)) {
+		mergeMembers(build, (target && isObject(target->getType())) ? target : NULL, patch);
+		build.close();
+	}
+}
+
+JBItem* JBMergePatch(const JBItem *base, const JBItem *patch, JBRet *info)
+{
+	if (!base || !patch)
+		return NULL;
+	JBBuilder build;
+	if (patch->getType() == JB_ARRAY) {	// replaces the document
+		if (!build.begin(JB_ARRAY))
+			return NULL;
+		for (const JBItem *p = patch->getChild(); p; p = p->getSibling())
+			build.copy(p);
+	} else {
+		if (!build.begin(JB_ROOT))
+			return NULL;
+		mergeMembers(build, base->getType() == JB_ROOT ? base : NULL, patch);
+	}
+	return build.finish(info);
+}
+
+//
+// JSON Patch
+//
+
+// compare a jchar string value to ascii text
+static bool strIs(const JBItem *item, const char *text)
+{
+	const jchar *str = item ? item->getStr() : NULL;
+	if (!str)
+		return false;
+	while (*text && (uint)*str == (uint)(unsigned char)*text) {
+		str++;
+		text++;
+	}
+	return !*text && !*str;
+}
+
+// next JSON Pointer segment with "~0" and "~1" decoded, false at the end of the path or on an invalid segment
+static bool nextSegment(const jchar *&path, jchar *key, uint &len, bool &valid)
+{
+	valid = true;
+	len = 0;
+	if (!path || !*path)
+		return false;
+	if (*path != '/') {
+		valid = false;
+		return false;
+	}
+	for (path++; *path && *path != '/'; path++) {
+		jchar c = *path;
+		if (c == '~') {
+			if (path[1] != '0' && path[1] != '1') {
+				valid = false;
+				return false;
+			}
+			c = *++path == '0' ? '~' : '/';
+		}
+		if (len + 1 >= JB_PATCH_MAX_KEY) {
+			valid = false;
+			return false;
+		}
+		key[len++] = c;
+	}
+	key[len] = 0;
+	return true;
+}
+
+// array index of a segment, -1 if not a valid index ("-" is handled by the caller)
+static int segmentIndex(const jchar *key, uint len)
+{
+	if (!len || (key[0] == '0' && len > 1))
+		return -1;
+	uint index = 0;
+	for (uint c = 0; c < len; c++) {
+		if (key[c] < '0' || key[c] > '9' || index > (0x7fffffffU - (key[c] - '0')) / 10)
+			return -1;
+		index = index * 10 + (key[c] - '0');
+	}
+	return (int)index;
+}
+
+static uint segmentHash(const jchar *key, uint len)
+{
+	return len ? JBHashName(key, len) : 0;	// the parser hashes empty keys as 0
+}
+
+// true if a path is a proper prefix of another path ("/a" of "/a/b")
+static bool isPrefixPath(const jchar *prefix, const jchar *path)
+{
+	if (!prefix)
+		return path && *path;
+	while (*prefix && *prefix == *path) {
+		prefix++;
+		path++;
+	}
+	return !*prefix && *path == '/';
+}
+
+static bool samePath(const jchar *a, const jchar *b)
+{
+	if (!a || !b)
+		return (a ? *a : 0) == (b ? *b : 0);
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+// JSON Patch state, the document is the base or the last compacted block with the edits on top
+struct sPatch {
+	JBEditor edit;
+	JBItem *pOwned;				// last compacted block
+	JBItem *apHeld[JB_PATCH_MAX_HELD];	// replaced compacted blocks still read by the current operation
+	int numHeld;
+	uint aCopied[JB_PATCH_MAX_COPIES][2];	// first and last item index of base subtrees used by setCopy
+	int numCopied;
+	JBItem **apSnapshots;		// values copied into themselves
+	int numSnapshots;
+	jchar key[JB_PATCH_MAX_KEY];	// last segment of a path
+	uint keyLen;
+
+	sPatch() : pOwned(NULL), numHeld(0), numCopied(0), apSnapshots(NULL), numSnapshots(0), keyLen(0) {}
+	~sPatch();
+
+	bool compactEdits();
+	bool replaceDocument(JBItem *block);
+	void releaseHeld();
+	bool isHeld(const JBItem *item) const;
+	const JBItem* snapshot(const JBItem *value);
+	bool isCopy(const JBEditRef &ref) const;
+	bool isCopied(const JBEditRef &ref) const;
+	bool copyValue(const JBEditRef &ref, const JBItem *value);
+	JBPatchError resolve(const jchar *path, bool toParent, JBEditRef &ref, bool &throughCopy);
+	JBPatchError add(const jchar *path, const JBItem *value);
+	JBPatchError remove(const jchar *path);
+	JBPatchError replace(const jchar *path, const JBItem *value);
+	JBPatchError source(const jchar *from, const JBItem *&value, bool removeSource);
+	JBPatchError test(const jchar *path, const JBItem *value);
+	bool equal(const JBEditRef &ref, const JBItem *value, int depth) const;
+};
+
+// replace the document with the compacted edits
+bool sPatch::compactEdits()
+{
+	JBItem *block = edit.compact();
+	return block && replaceDocument(block);
+}
+
+bool sPatch::replaceDocument(JBItem *block)
+{
+	if (numHeld >= JB_PATCH_MAX_HELD) {
+		free(block);
+		return false;
+	}
+	edit.open(block);
+	if (pOwned)
+		apHeld[numHeld++] = pOwned;	// values of the current operation may still be read from it
+	pOwned = block;
+	numCopied = 0;
+	return true;
+}
+
+void sPatch::releaseHeld()
+{
+	while (numHeld)
+		free(apHeld[--numHeld]);
+}
+
+sPatch::~sPatch()
+{
+	releaseHeld();
+	free(pOwned);
+	while (numSnapshots)
+		free(apSnapshots[--numSnapshots]);
+	free(apSnapshots);
+}
+
+bool sPatch::isHeld(const JBItem *item) const
+{
+	for (int h = 0; h < numHeld; h++) {
+		if (item >= apHeld[h] && item <= JBSubtreeLast(apHeld[h]))
+			return true;
+	}
+	return false;
+}
+
+// separate copy of a value for copying it into its own subtree
+const JBItem* sPatch::snapshot(const JBItem *value)
+{
+	JBItem **apGrow = (JBItem**)realloc(apSnapshots, (numSnapshots + 1) * sizeof(JBItem*));
+	if (!apGrow)
+		return NULL;
+	apSnapshots = apGrow;
+	JBBuilder build;
+	if (!build.begin(JB_ARRAY) || !build.copy(value))
+		return NULL;
+	JBItem *block = build.finish();
+	if (!block)
+		return NULL;
+	apSnapshots[numSnapshots++] = block;
+	return block->getChild();
+}
+
+// value read from another item (copied value, or inside one), edits have to be compacted before changing it
+bool sPatch::isCopy(const JBEditRef &ref) const
+{
+	const JBItem *read = edit.readItem(ref);
+	return read && (read != ref.item || !edit.inBase(read));
+}
+
+// base item inside a subtree that a copied value reads from
+bool sPatch::isCopied(const JBEditRef &ref) const
+{
+	if (!ref.item || !edit.inBase(ref.item))
+		return false;
+	uint index = (uint)(ref.item - edit.pBase);
+	for (int c = 0; c < numCopied; c++) {
+		if (index >= aCopied[c][0] && index <= aCopied[c][1])
+			return true;
+	}
+	return false;
+}
+
+bool sPatch::copyValue(const JBEditRef &ref, const JBItem *value)
+{
+	if (edit.inBase(value)) {
+		if (numCopied >= JB_PATCH_MAX_COPIES)
+			return false;
+		aCopied[numCopied][0] = (uint)(value - edit.pBase);
+		aCopied[numCopied][1] = (uint)(JBSubtreeLast(value) - edit.pBase);
+		numCopied++;
+	}
+	return edit.setCopy(ref, value);
+}
+
+// find the value at a path, or the container of the last segment (stored in key)
+JBPatchError sPatch::resolve(const jchar *path, bool toParent, JBEditRef &ref, bool &throughCopy)
+{
+	ref = edit.root();
+	throughCopy = false;
+	bool valid;
+	keyLen = 0;
+	while (nextSegment(path, key, keyLen, valid)) {
+		if (toParent && (!*path))
+			return JBPATCH_NONE;
+		JBType type = edit.getType(ref);
+		throughCopy = throughCopy || isCopy(ref);
+		if (isObject(type))
+			ref = edit.find(ref, segmentHash(key, keyLen));
+		else if (type == JB_ARRAY) {
+			int index = segmentIndex(key, keyLen);
+			if (index < 0)
+				return JBPATCH_PATH;
+			for (ref = edit.child(ref); ref && index; index--)
+				ref = edit.sibling(ref);
+		} else
+			return JBPATCH_PATH;
+		if (!ref)
+			return JBPATCH_PATH;
+	}
+	if (!valid)
+		return JBPATCH_PATH;
+	return toParent ? JBPATCH_PATH : JBPATCH_NONE;	// the root has no parent
+}
+
+JBPatchError sPatch::add(const jchar *path, const JBItem *value)
+{
+	if (!path || !*path) {	// replace the document
+		JBType type = value->getType();
+		JBBuilder build;
+		if ((!isObject(type) && type != JB_ARRAY) || !build.begin(type == JB_ARRAY ? JB_ARRAY : JB_ROOT))
+			return isObject(type) || type == JB_ARRAY ? JBPATCH_OUT_OF_MEMORY : JBPATCH_ROOT;
+		for (const JBItem *child = value->getChild(); child; child = child->getSibling())
+			build.copy(child);
+		JBItem *block = build.finish();
+		return (block && replaceDocument(block)) ? JBPATCH_NONE : JBPATCH_OUT_OF_MEMORY;
+	}
+	for (int attempt = 0; attempt < 2; attempt++) {
+		JBEditRef parent;
+		bool throughCopy;
+		JBPatchError error = resolve(path, true, parent, throughCopy);
+		if (error != JBPATCH_NONE)
+			return error;
+		JBType type = edit.getType(parent);
+		JBEditRef at, before;
+		if (isObject(type))
+			at = edit.find(parent, segmentHash(key, keyLen));
+		else if (type == JB_ARRAY) {
+			if (keyLen != 1 || key[0] != '-') {	// "-" is the end of the array
+				int index = segmentIndex(key, keyLen);
+				if (index < 0)
+					return JBPATCH_PATH;
+				for (before = edit.child(parent); before && index; index--)
+					before = edit.sibling(before);
+				if (index)
+					return JBPATCH_PATH;
+			}
+		} else
+			return JBPATCH_PATH;
+
+		// values inside copies can not be edited in place
+		if (throughCopy || isCopy(parent) || (at ? isCopied(at) : isCopied(parent)) || numCopied >= JB_PATCH_MAX_COPIES) {
+			if (attempt || !compactEdits())
+				return JBPATCH_OUT_OF_MEMORY;
+			continue;
+		}
+		if (!at && edit.inBase(value) && parent.item >= value && parent.item <= JBSubtreeLast(value) && !(value = snapshot(value)))
+			return JBPATCH_OUT_OF_MEMORY;	// adding to the copied value would add to the copy too
+		if (!at && !(at = edit.insert(parent, type == JB_ARRAY ? NULL : key, before)))
+			return JBPATCH_OUT_OF_MEMORY;
+		return copyValue(at, value) ? JBPATCH_NONE : JBPATCH_OUT_OF_MEMORY;
+	}
+	return JBPATCH_OUT_OF_MEMORY;
+}
+
+JBPatchError sPatch::remove(const jchar *path)
+{
+	if (!path || !*path)
+		return JBPATCH_ROOT;
+	for (int attempt = 0; attempt < 2; attempt++) {
+		JBEditRef ref;
+		bool throughCopy;
+		JBPatchError error = resolve(path, false, ref, throughCopy);
+		if (error != JBPATCH_NONE)
+			return error;
+		if (throughCopy || isCopied(ref)) {
+			if (attempt || !compactEdits())
+				return JBPATCH_OUT_OF_MEMORY;
+			continue;
+		}
+		return edit.remove(ref) ? JBPATCH_NONE : JBPATCH_OUT_OF_MEMORY;
+	}
+	return JBPATCH_OUT_OF_MEMORY;
+}
+
+JBPatchError sPatch::replace(const jchar *path, const JBItem *value)
+{
+	if (!path || !*path)
+		return add(path, value);
+	for (int attempt = 0; attempt < 2; attempt++) {
+		JBEditRef ref;
+		bool throughCopy;
+		JBPatchError error = resolve(path, false, ref, throughCopy);
+		if (error != JBPATCH_NONE)
+			return error;
+		if (throughCopy || isCopied(ref) || numCopied >= JB_PATCH_MAX_COPIES) {
+			if (attempt || !compactEdits())
+				return JBPATCH_OUT_OF_MEMORY;
+			continue;
+		}
+		return copyValue(ref, value) ? JBPATCH_NONE : JBPATCH_OUT_OF_MEMORY;
+	}
+	return JBPATCH_OUT_OF_MEMORY;
+}
+
+// item to copy for "copy" and "move", an edited value is compacted first so it can be copied as a whole
+JBPatchError sPatch::source(const jchar *from, const JBItem *&value, bool removeSource)
+{
+	for (int attempt = 0; attempt < 2; attempt++) {
+		JBEditRef ref;
+		bool throughCopy;
+		JBPatchError error = resolve(from, false, ref, throughCopy);
+		if (error != JBPATCH_NONE)
+			return error;
+		value = edit.readItem(ref);
+		if (!value || edit.edited(value) || (removeSource && (throughCopy || isCopied(ref)))) {
+			if (attempt || !compactEdits())
+				return JBPATCH_OUT_OF_MEMORY;
+			continue;
+		}
+		if (removeSource && !edit.remove(ref))
+			return JBPATCH_OUT_OF_MEMORY;
+		return JBPATCH_NONE;
+	}
+	return JBPATCH_OUT_OF_MEMORY;
+}
+
+JBPatchError sPatch::test(const jchar *path, const JBItem *value)
+{
+	JBEditRef ref;
+	bool throughCopy;
+	JBPatchError error = resolve(path, false, ref, throughCopy);
+	if (error != JBPATCH_NONE)
+		return error;
+	return equal(ref, value, 0) ? JBPATCH_NONE : JBPATCH_TEST;
+}
+
+bool sPatch::equal(const JBEditRef &ref, const JBItem *value, int depth) const
+{
+	JBType a = edit.getType(ref), b = value->getType();
+	if ((a == JB_INT || a == JB_FLOAT) && (b == JB_INT || b == JB_FLOAT)) {
+		if (a == JB_INT && b == JB_INT)
+			return edit.getInt(ref) == value->getInt();
+		return edit.getFloat(ref) == value->getFloat();
+	}
+	if ((a == JB_NULL || a == JB_NULL_VALUE) && (b == JB_NULL || b == JB_NULL_VALUE))
+		return true;
+	if (isObject(a) && isObject(b)) {
+		if (depth >= JSON_MAX_DEPTH || edit.getChildCount(ref) != value->getChildCount())
+			return false;
+		for (const JBItem *child = value->getChild(); child; child = child->getSibling()) {
+			JBEditRef member = edit.find(ref, child->getHash());
+			if (!member || !equal(member, child, depth + 1))
+				return false;
+		}
+		return true;
+	}
+	if (a != b)
+		return false;
+	switch (a) {
+		case JB_STRING: {
+			uint len = edit.getStrLen(ref);
+			return len == value->getStrLen() && (!len || !memcmp(edit.getStr(ref), value->getStr(), len * sizeof(jchar)));
+		}
+		case JB_BOOL:
+			return edit.getBool(ref) == value->getBool();
+		case JB_ARRAY: {
+			if (depth >= JSON_MAX_DEPTH)
+				return false;
+			JBEditRef element = edit.child(ref);
+			const JBItem *child = value->getChild();
+			for (; element && child; element = edit.sibling(element), child = child->getSibling()) {
+				if (!equal(element, child, depth + 1))
+					return false;
+			}
+			return !element && !child;
+		}
+		default:
+			return false;
+	}
+}
+
+JBItem* JBApplyPatch(const JBItem *base, const JBItem *patch, JBRet *info, JBPatchError *error)
+{
+	JBPatchError result = JBPATCH_NONE;
+	sPatch apply;
+	if (!base || !patch || patch->getType() != JB_ARRAY)
+		result = JBPATCH_INVALID;
+	else
+		apply.edit.open(base);
+
+	const uint hOp = JBHashKey("op", 2), hPath = JBHashKey("path", 4), hFrom = JBHashKey("from", 4), hValue = JBHashKey("value", 5);
+	for (const JBItem *op = result == JBPATCH_NONE ? patch->getChild() : NULL; op && result == JBPATCH_NONE; op = op->getSibling()) {
+		const JBItem *name = op->findByHash(hOp), *path = op->findByHash(hPath);
+		const JBItem *from = op->findByHash(hFrom), *value = op->findByHash(hValue);
+		if (!name || !path || path->getType() != JB_STRING)
+			result = JBPATCH_INVALID;
+		else if (strIs(name, "add") || strIs(name, "replace") || strIs(name, "test")) {
+			if (!value)
+				result = JBPATCH_INVALID;
+			else if (strIs(name, "add"))
+				result = apply.add(path->getStr(), value);
+			else if (strIs(name, "replace"))
+				result = apply.replace(path->getStr(), value);
+			else
+				result = apply.test(path->getStr(), value);
+		} else if (strIs(name, "remove"))
+			result = apply.remove(path->getStr());
+		else if (strIs(name, "move") || strIs(name, "copy")) {
+			bool move = strIs(name, "move");
+			const JBItem *source = NULL;
+			if (!from || from->getType() != JB_STRING)
+				result = JBPATCH_INVALID;
+			else if (move && samePath(from->getStr(), path->getStr()))
+				;	// moving a value to itself leaves it in place
+			else if (move && isPrefixPath(from->getStr(), path->getStr()))
+				result = JBPATCH_INVALID;	// can not move a value into itself
+			else if (move && (!from->getStr() || !*from->getStr()))
+				result = JBPATCH_ROOT;
+			else if ((result = apply.source(from->getStr(), source, move)) == JBPATCH_NONE) {
+				result = apply.add(path->getStr(), source);
+				if (result == JBPATCH_NONE && apply.isHeld(source) && !apply.compactEdits())	// the copy reads from a replaced block
+					result = JBPATCH_OUT_OF_MEMORY;
+			}
+		} else
+			result = JBPATCH_INVALID;
+		apply.releaseHeld();
+	}
+
+	JBItem *patched = NULL;
+	if (result == JBPATCH_NONE && !(patched = apply.edit.compact(info)))
+		result = JBPATCH_OUT_OF_MEMORY;
+	if (error)
+		*error = result;
+	return patched;
+}
+
+}	// namespace jbin
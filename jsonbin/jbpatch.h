@@ -0,0 +1,62 @@
+#ifndef __JBPATCH_H__
+#define __JBPATCH_H__
+
+//
+// JBPatch
+//
+// Summary
+//	- Applies an RFC 7396 JSON Merge Patch or an RFC 6902 JSON Patch to a block
+//		returned by JSONBin and returns the result as a new block, without
+//		writing or parsing any JSON text.
+//	- Subtrees that the patch does not touch are copied as they are (see
+//		JBBuilder), the base block is not changed.
+//
+// Usage
+//	- Parse the patch with JSONBin like any other JSON file.
+//	- Merge patch, an object with the members to add or replace and null for
+//		members to remove:
+//		JBItem *pPatched = JBMergePatch(pJSON, pPatch, &ret);
+//	- JSON Patch, an array of operations (use JB_ALLOW_ROOT_ARRAY):
+//		JBPatchError error;
+//		JBItem *pPatched = JBApplyPatch(pJSON, pPatch, &ret, &error);
+//	- Both return NULL on failure, release the result with free.
+//
+// Notes
+//	- A merge patch is applied in one pass over the base block. Members of each
+//		object are matched by key hash by stepping through the patch object, so
+//		the cost is the size of the base plus the members of each patched object
+//		times the members of its patch.
+//	- JSON Patch operations are recorded with JBEditor and the result is
+//		compacted once at the end. An operation that has to change a value that
+//		an earlier operation added or copied first compacts the edits so far.
+//	- Paths are JSON Pointers, matched by key hash. A failed operation fails the
+//		whole patch, "test" compares numbers by value and objects regardless of
+//		member order.
+//	- The result root must be an object or an array, a patch that replaces the
+//		root with another value fails with JBPATCH_ROOT.
+//	- Requires jbbuilder.cpp and jbeditor.cpp (JBApplyPatch).
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+enum JBPatchError {
+	JBPATCH_NONE = 0,			// patch applied
+	JBPATCH_OUT_OF_MEMORY,		// could not allocate the result or the edits
+	JBPATCH_INVALID,			// patch is not an array of operations or an operation is not valid
+	JBPATCH_PATH,				// a path does not exist or is not a valid JSON Pointer
+	JBPATCH_TEST,				// a test operation did not match
+	JBPATCH_ROOT,				// the result root would not be an object or an array
+};
+
+// RFC 7396 JSON Merge Patch, the patch is an object or replaces the whole document
+JBItem* JBMergePatch(const JBItem *base, const JBItem *patch, JBRet *info = 0);
+
+// RFC 6902 JSON Patch, the patch is an array of operation objects
+JBItem* JBApplyPatch(const JBItem *base, const JBItem *patch, JBRet *info = 0, JBPatchError *error = 0);
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,813 @@
+//
+// JBQuery
+//
+// Details in jbquery.h
+//
+
+#include <stdlib.h>	// strtod, realloc
+#include <string.h>	// strlen, memcpy
+#include "jbquery.h"
+
+namespace jbin {
+
+typedef unsigned char u8;
+typedef unsigned int uint;
+
+#define JB_QUERY_MAX_INDEX 0x7fffffff	// largest array index accepted in a path
+
+static bool isContainer(const JBItem *item)
+{
+	return item->getType() == JB_ROOT || item->getType() == JB_OBJECT || item->getType() == JB_ARRAY;
+}
+
+// get an array element by index, negative index counts from the end
+static const JBItem *arrayElement(const JBItem *array, int index)
+{
+	int count = (int)array->getChildCount();
+	if (index < 0)
+		index += count;
+	if (index < 0 || index >= count)
+		return NULL;
+	const JBItem *child = array->getChild();
+	while (index--)
+		child = child->getSibling();
+	return child;
+}
+
+static const char *skipSpace(const char *str, const char *end)
+{
+	while (str < end && (u8)*str <= ' ')
+		str++;
+	return str;
+}
+
+// read a signed integer, returns NULL if no digits
+static const char *readInt(const char *str, const char *end, int &value)
+{
+	bool neg = false;
+	if (str < end && *str == '-') {
+		neg = true;
+		str++;
+	}
+	if (str >= end || *str < '0' || *str > '9')
+		return NULL;
+	uint v = 0;
+	while (str < end && *str >= '0' && *str <= '9') {
+		uint d = (uint)(*str++ - '0');
+		if (v > (JB_QUERY_MAX_INDEX - d) / 10)
+			return NULL;	// out of range, not a valid index
+		v = v * 10 + d;
+	}
+	value = neg ? -(int)v : (int)v;
+	return str;
+}
+
+// compare a parsed string (which may be NULL for empty strings) with a utf-8 literal
+static int compareStr(const jchar *str, const char *lit, uint lit_len)
+{
+	if (!str)
+		return lit_len ? -1 : 0;
+	while (lit_len) {
+		uint c = (u8)*lit;
+		uint len = 1;
+#ifdef JB_WCHAR16
+		if (c >= 0xc0 && c < 0xf8) {	// decode utf-8 to compare against utf-16
+			uint total = c >= 0xf0 ? 4 : (c >= 0xe0 ? 3 : 2);
+			uint c8 = c & (0x7f >> total);
+			for (len = 1; len < total && len < lit_len; len++)
+				c8 = (c8 << 6) | ((u8)lit[len] & 0x3f);
+			c = c8;
+		}
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			uint hi = 0xd800 | ((c >> 10) & 0x3ff), lo = 0xdc00 | (c & 0x3ff);
+			if ((uint)*str != hi)
+				return (int)(uint)*str - (int)hi;
+			str++;
+			c = lo;
+		}
+		uint s = (uint)*str;
+#else
+		uint s = (u8)*str;
+#endif
+		if (s != c)
+			return (int)s - (int)c;
+		str++;
+		lit += len;
+		lit_len -= len;
+	}
+	return *str ? 1 : 0;
+}
+
+// check if an item passes a filter step
+static bool filterItem(const JBQueryStep &step, const JBItem *item, const char *aLiterals)
+{
+	const JBItem *target = item;
+	if (!(step.flags & JBQF_SELF)) {
+		if (item->getType() != JB_OBJECT)
+			return false;
+		target = item->findByHash(step.hash);
+	}
+	if (!target)
+		return false;
+	if (step.cmp == JBQC_EXISTS)
+		return true;
+
+	int cmp = 0;
+	bool same_type = false;
+	switch (step.lit_type) {
+		case JB_FLOAT:
+			if ((same_type = target->getType() == JB_INT || target->getType() == JB_FLOAT)) {
+				double v = target->getType() == JB_INT ? (double)target->getInt() : (double)target->getFloat();
+				cmp = v < step.num ? -1 : (v > step.num ? 1 : 0);
+			}
+			break;
+		case JB_STRING:
+			if ((same_type = target->getType() == JB_STRING))
+				cmp = compareStr(target->getStr(), aLiterals + step.a, step.b);
+			break;
+		case JB_BOOL:
+			if ((same_type = target->getType() == JB_BOOL))
+				cmp = (int)target->getBool() - (int)(step.num != 0.0);
+			break;
+		case JB_NULL_VALUE:
+			same_type = target->getType() == JB_NULL || target->getType() == JB_NULL_VALUE;
+			break;
+	}
+	if (!same_type)
+		return step.cmp == JBQC_NE;
+	switch (step.cmp) {
+		case JBQC_EQ: return cmp == 0;
+		case JBQC_NE: return cmp != 0;
+		case JBQC_LT: return cmp < 0;
+		case JBQC_LE: return cmp <= 0;
+		case JBQC_GT: return cmp > 0;
+		case JBQC_GE: return cmp >= 0;
+	}
+	return false;
+}
+
+//
+// Compiling
+//
+
+bool JBQuery::addStep(JBQueryOp op, const char *path, const char *pos)
+{
+	if (numSteps >= MAX_STEPS) {
+		error_code = JBQERR_TOO_MANY_STEPS;
+		error_pos = (int)(pos - path);
+		return false;
+	}
+	JBQueryStep &step = aSteps[numSteps++];
+	memset(&step, 0, sizeof(step));
+	step.op = (unsigned char)op;
+	return true;
+}
+
+bool JBQuery::addKey(JBQueryOp op, const char *key, unsigned int len, int index, const char *path, const char *pos)
+{
+	if (!addStep(op, path, pos))
+		return false;
+	aSteps[numSteps - 1].hash = JBHashKey(key, len);
+	aSteps[numSteps - 1].a = index;
+	return true;
+}
+
+// JSON Pointer, RFC 6901
+bool JBQuery::compilePointer(const char *path, unsigned int len)
+{
+	const char *end = path + len;
+	const char *pos = path;
+	char key[MAX_KEY_LENGTH];
+	while (pos < end) {
+		if (*pos++ != '/') {
+			error_code = JBQERR_SYNTAX;
+			error_pos = (int)(pos - 1 - path);
+			return false;
+		}
+		uint key_len = 0;
+		uint index = 0;
+		bool numeric = pos < end && *pos != '/';
+		if (numeric && *pos == '0' && pos + 1 < end && pos[1] != '/')
+			numeric = false;	// leading zeroes are not array indices
+		const char *seg = pos;
+		while (pos < end && *pos != '/') {
+			char c = *pos++;
+			if (c == '~' && pos < end && (*pos == '0' || *pos == '1'))
+				c = *pos++ == '0' ? '~' : '/';
+			if (c < '0' || c > '9')
+				numeric = false;
+			else if (numeric) {
+				if (index > (JB_QUERY_MAX_INDEX - (uint)(c - '0')) / 10) {
+					error_code = JBQERR_SYNTAX;	// index out of range
+					error_pos = (int)(seg - path);
+					return false;
+				}
+				index = index * 10 + (uint)(c - '0');
+			}
+			if (key_len >= MAX_KEY_LENGTH) {
+				error_code = JBQERR_KEY_SIZE;
+				error_pos = (int)(seg - path);
+				return false;
+			}
+			key[key_len++] = c;
+		}
+		if (!addKey(JBQ_CHILD, key, key_len, numeric ? (int)index : -1, path, seg))
+			return false;
+	}
+	return true;
+}
+
+// JSONPath subset
+bool JBQuery::compilePath(const char *path, unsigned int len)
+{
+	const char *end = path + len;
+	const char *pos = path + 1;	// skip '$'
+	char key[MAX_KEY_LENGTH];
+	while (pos < end) {
+		const char *start = pos;
+		bool ok = true;
+		if (*pos == '.') {
+			pos++;
+			if (pos < end && *pos == '.') {	// recursive descent
+				ok = addStep(JBQ_DESCENT, path, start);
+				pos++;
+				if (ok && pos < end && *pos == '[')
+					continue;	// ..[selector]
+			}
+			if (!ok) {
+			} else if (pos < end && *pos == '*') {
+				ok = addStep(JBQ_WILDCARD, path, start);
+				pos++;
+			} else {
+				const char *name = pos;
+				while (pos < end && *pos != '.' && *pos != '[')
+					pos++;
+				if (pos == name || (uint)(pos - name) > MAX_KEY_LENGTH) {
+					error_code = pos == name ? JBQERR_SYNTAX : JBQERR_KEY_SIZE;
+					error_pos = (int)(name - path);
+					return false;
+				}
+				ok = addKey(JBQ_CHILD, name, (uint)(pos - name), -1, path, start);
+			}
+		} else if (*pos == '[') {
+			pos = skipSpace(pos + 1, end);
+			if (pos < end && (*pos == '\'' || *pos == '"')) {	// ['key']
+				char quote = *pos++;
+				uint key_len = 0;
+				while (pos < end && *pos != quote) {
+					if (*pos == '\\' && pos + 1 < end)
+						pos++;
+					if (key_len >= MAX_KEY_LENGTH) {
+						error_code = JBQERR_KEY_SIZE;
+						error_pos = (int)(start - path);
+						return false;
+					}
+					key[key_len++] = *pos++;
+				}
+				if (pos >= end)
+					ok = false;
+				else if ((ok = addKey(JBQ_CHILD, key, key_len, -1, path, start)))
+					pos++;
+			} else if (pos < end && *pos == '*') {	// [*]
+				ok = addStep(JBQ_WILDCARD, path, start);
+				pos++;
+			} else if (pos < end && *pos == '?') {	// [?(@...)]
+				pos = skipSpace(pos + 1, end);
+				if ((ok = pos < end && *pos == '(' && addStep(JBQ_FILTER, path, start))) {
+					JBQueryStep &step = aSteps[numSteps - 1];
+					pos = skipSpace(pos + 1, end);
+					ok = pos < end && *pos++ == '@';
+					if (ok && pos < end && (*pos == '.' || *pos == '[')) {	// @.key or @['key']
+						const char *name = pos + 1, *name_end = name;
+						if (*pos == '.') {
+							while (name_end < end && *name_end != ' ' && *name_end != ')' && *name_end != '=' &&
+								*name_end != '!' && *name_end != '<' && *name_end != '>')
+								name_end++;
+							pos = name_end;
+						} else {
+							char quote = *name++;
+							name_end = name;
+							while (name_end < end && *name_end != quote)
+								name_end++;
+							pos = name_end + 1;
+							ok = (quote == '\'' || quote == '"') && pos < end && *pos++ == ']';
+						}
+						ok = ok && name_end > name;
+						step.hash = ok ? JBHashKey(name, (uint)(name_end - name)) : 0;
+					} else
+						step.flags |= JBQF_SELF;
+					pos = skipSpace(pos, end);
+					step.cmp = JBQC_EXISTS;
+					if (ok && pos + 1 < end && *pos != ')') {	// comparison
+						switch (*pos++) {
+							case '=': step.cmp = JBQC_EQ; ok = *pos++ == '='; break;
+							case '!': step.cmp = JBQC_NE; ok = *pos++ == '='; break;
+							case '<': step.cmp = JBQC_LT; if (*pos == '=') { step.cmp = JBQC_LE; pos++; } break;
+							case '>': step.cmp = JBQC_GT; if (*pos == '=') { step.cmp = JBQC_GE; pos++; } break;
+							default: ok = false; break;
+						}
+						pos = skipSpace(pos, end);
+						if (!ok || pos >= end) {
+							ok = false;
+						} else if (*pos == '\'' || *pos == '"') {	// string literal
+							char quote = *pos++;
+							const char *lit = pos;
+							while (pos < end && *pos != quote)
+								pos++;
+							uint lit_len = (uint)(pos - lit);
+							if (litSize + lit_len > MAX_LITERALS) {
+								error_code = JBQERR_LITERAL_SIZE;
+								error_pos = (int)(lit - path);
+								return false;
+							}
+							memcpy(aLiterals + litSize, lit, lit_len);
+							step.lit_type = JB_STRING;
+							step.a = litSize;
+							step.b = (int)lit_len;
+							litSize += lit_len;
+							ok = pos++ < end;
+						} else if ((uint)(end - pos) >= 4 && !memcmp(pos, "true", 4)) {
+							step.lit_type = JB_BOOL;
+							step.num = 1.0;
+							pos += 4;
+						} else if ((uint)(end - pos) >= 5 && !memcmp(pos, "false", 5)) {
+							step.lit_type = JB_BOOL;
+							pos += 5;
+						} else if ((uint)(end - pos) >= 4 && !memcmp(pos, "null", 4)) {
+							step.lit_type = JB_NULL_VALUE;
+							pos += 4;
+						} else {
+							char num[64];
+							uint num_len = 0;
+							while (pos < end && num_len < sizeof(num) - 1 && ((*pos >= '0' && *pos <= '9') ||
+								*pos == '-' || *pos == '+' || *pos == '.' || *pos == 'e' || *pos == 'E'))
+								num[num_len++] = *pos++;
+							num[num_len] = 0;
+							step.lit_type = JB_FLOAT;
+							step.num = strtod(num, NULL);
+							ok = num_len > 0;
+						}
+						pos = skipSpace(pos, end);
+					}
+					ok = ok && pos < end && *pos++ == ')';
+				}
+			} else {	// [n] or [start:end:step]
+				int values[3] = { 0, 0, 1 };
+				int count = 0;
+				bool present[3] = { false, false, false };
+				for (;;) {
+					pos = skipSpace(pos, end);
+					if (const char *num_end = readInt(pos, end, values[count])) {
+						present[count] = true;
+						pos = skipSpace(num_end, end);
+					}
+					if (pos < end && *pos == ':' && count < 2) {
+						count++;
+						pos++;
+					} else
+						break;
+				}
+				if (!count) {
+					if ((ok = present[0] && addStep(JBQ_INDEX, path, start)))
+						aSteps[numSteps - 1].a = values[0];
+				} else if ((ok = values[2] > 0 && addStep(JBQ_SLICE, path, start))) {
+					JBQueryStep &step = aSteps[numSteps - 1];
+					step.a = values[0];
+					step.b = values[1];
+					step.c = values[2];
+					step.flags = (unsigned char)((present[0] ? 0 : JBQS_NO_START) | (present[1] ? 0 : JBQS_NO_END));
+				}
+			}
+			pos = skipSpace(pos, end);
+			ok = ok && pos < end && *pos++ == ']';
+		} else
+			ok = false;
+
+		if (!ok) {
+			if (error_code == JBQERR_NONE) {
+				error_code = JBQERR_SYNTAX;
+				error_pos = (int)(start - path);
+			}
+			return false;
+		}
+	}
+	if (numSteps && aSteps[numSteps - 1].op == JBQ_DESCENT) {	// "$.." needs a following selector
+		error_code = JBQERR_SYNTAX;
+		error_pos = (int)len;
+		return false;
+	}
+	return true;
+}
+
+bool JBQuery::compile(const char *path)
+{
+	return compile(path, (unsigned int)strlen(path));
+}
+
+bool JBQuery::compile(const char *path, unsigned int len)
+{
+	numSteps = 0;
+	litSize = 0;
+	error_code = JBQERR_NONE;
+	error_pos = 0;
+	if (!len || *path == '/')
+		return compilePointer(path, len);
+	else if (*path == '$')
+		return compilePath(path, len);
+	error_code = JBQERR_SYNTAX;
+	return false;
+}
+
+//
+// Running
+//
+
+struct JBQueryRun {
+	const JBQuery *query;
+	JBQueryCallback callback;
+	void *user;
+	int count;
+	const JBKeySummary *summary;	// optional, prunes descent to a key
+
+	bool eval(int step, const JBItem *item);		// returns false to stop
+	bool descend(int step, const JBItem *item);
+};
+
+bool JBQueryRun::descend(int step, const JBItem *item)
+{
+	if (summary && query->aSteps[step].op == JBQ_CHILD && !summary->mayContain(item, query->aSteps[step].hash))
+		return true;	// no key below item matches
+	if (!eval(step, item))
+		return false;
+	for (const JBItem *child = item->getChild(); child; child = child->getSibling()) {
+		if (isContainer(child) && !descend(step, child))
+			return false;
+	}
+	return true;
+}
+
+bool JBQueryRun::eval(int step, const JBItem *item)
+{
+	if (step == query->numSteps) {
+		count++;
+		return callback(item, user);
+	}
+	const JBQueryStep &s = query->aSteps[step];
+	if (s.op == JBQ_DESCENT)
+		return descend(step + 1, item);
+	if (!isContainer(item))
+		return true;
+
+	bool array = item->getType() == JB_ARRAY;
+	switch (s.op) {
+		case JBQ_CHILD:
+			if (!array) {
+				if (const JBItem *child = item->findByHash(s.hash))
+					return eval(step + 1, child);
+			} else if (s.a >= 0) {	// JSON Pointer numeric segment on an array
+				if (const JBItem *child = arrayElement(item, s.a))
+					return eval(step + 1, child);
+			}
+			break;
+		case JBQ_INDEX:
+			if (array) {
+				if (const JBItem *child = arrayElement(item, s.a))
+					return eval(step + 1, child);
+			}
+			break;
+		case JBQ_WILDCARD:
+			for (const JBItem *child = item->getChild(); child; child = child->getSibling()) {
+				if (!eval(step + 1, child))
+					return false;
+			}
+			break;
+		case JBQ_SLICE: {
+			if (!array)
+				break;
+			int count = (int)item->getChildCount();
+			int first = (s.flags & JBQS_NO_START) ? 0 : (s.a < 0 ? count + s.a : s.a);
+			int last = (s.flags & JBQS_NO_END) ? count : (s.b < 0 ? count + s.b : s.b);
+			if (first < 0)
+				first = 0;
+			if (last > count)
+				last = count;
+			int index = 0;
+			for (const JBItem *child = item->getChild(); child && index < last; child = child->getSibling(), index++) {
+				if (index >= first && !((index - first) % s.c) && !eval(step + 1, child))
+					return false;
+			}
+			break;
+		}
+		case JBQ_FILTER:
+			for (const JBItem *child = item->getChild(); child; child = child->getSibling()) {
+				if (filterItem(s, child, query->aLiterals) && !eval(step + 1, child))
+					return false;
+			}
+			break;
+	}
+	return true;
+}
+
+int JBQuery::visit(const JBItem *root, JBQueryCallback callback, void *user, const JBKeySummary *summary) const
+{
+	if (!root || !valid())
+		return 0;
+	JBQueryRun run = { this, callback, user, 0, summary };
+	run.eval(0, root);
+	return run.count;
+}
+
+struct JBQueryCollect {
+	const JBItem **aResults;
+	int maxResults;
+	int count;
+};
+
+static bool collectResult(const JBItem *item, void *user)
+{
+	JBQueryCollect *collect = (JBQueryCollect*)user;
+	if (collect->count < collect->maxResults)
+		collect->aResults[collect->count] = item;
+	collect->count++;
+	return true;
+}
+
+static bool firstResult(const JBItem *item, void *user)
+{
+	*(const JBItem**)user = item;
+	return false;
+}
+
+int JBQuery::run(const JBItem *root, const JBItem **aResults, int maxResults, const JBKeySummary *summary) const
+{
+	JBQueryCollect collect = { aResults, maxResults, 0 };
+	visit(root, collectResult, &collect, summary);
+	return collect.count;
+}
+
+const JBItem* JBQuery::first(const JBItem *root, const JBKeySummary *summary) const
+{
+	const JBItem *result = NULL;
+	visit(root, firstResult, &result, summary);
+	return result;
+}
+
+//
+// Key summaries
+//
+
+#define JB_KEY_BLOOM_PROBES 3	// bits set per key, each from 8 bits of the hash
+
+static void bloomAdd(uint *aBits, uint hash)
+{
+	for (uint p = 0; p < JB_KEY_BLOOM_PROBES; p++) {
+		uint bit = (hash >> (p * 8)) & (JB_KEY_BLOOM_BITS - 1);
+		aBits[bit >> 5] |= 1u << (bit & 31);
+	}
+}
+
+static bool bloomHas(const uint *aBits, uint hash)
+{
+	for (uint p = 0; p < JB_KEY_BLOOM_PROBES; p++) {
+		uint bit = (hash >> (p * 8)) & (JB_KEY_BLOOM_BITS - 1);
+		if (!(aBits[bit >> 5] & (1u << (bit & 31))))
+			return false;
+	}
+	return true;
+}
+
+struct sSummaryBuild {
+	JBKeySummary *summary;
+	uint maxBlooms;
+	bool failed;
+};
+
+// add the keys below item to aBits, returns the number of items below item
+static uint summarize(sSummaryBuild &build, const JBItem *item, uint *aBits)
+{
+	JBKeySummary &summary = *build.summary;
+	uint entry = summary.numBlooms;	// reserve the entry first so filters stay in item order
+	if (entry >= build.maxBlooms) {
+		uint grow = build.maxBlooms ? build.maxBlooms * 2 : 64;
+		JBKeyBloom *aGrow = (JBKeyBloom*)realloc(summary.aBlooms, grow * sizeof(JBKeyBloom));
+		if (!aGrow) {
+			build.failed = true;
+			return 0;
+		}
+		summary.aBlooms = aGrow;
+		build.maxBlooms = grow;
+	}
+	summary.numBlooms++;
+
+	uint aKeys[JB_KEY_BLOOM_BITS / 32] = { 0 };
+	bool keys = item->getType() != JB_ARRAY;
+	uint count = 0;
+	for (const JBItem *child = item->getChild(); child && !build.failed; child = child->getSibling()) {
+		count++;
+		if (keys)
+			bloomAdd(aKeys, child->getHash());
+		if (child->getChild())
+			count += summarize(build, child, aKeys);
+	}
+	if (count >= summary.minItems && !build.failed) {
+		JBKeyBloom &bloom = summary.aBlooms[entry];
+		bloom.item = (uint)(item - summary.pBlock);
+		memcpy(bloom.aBits, aKeys, sizeof(aKeys));
+	} else
+		summary.numBlooms = entry;	// subtrees below a small one are smaller and already removed
+	for (uint w = 0; w < JB_KEY_BLOOM_BITS / 32; w++)
+		aBits[w] |= aKeys[w];
+	return count;
+}
+
+bool JBKeySummary::build(const JBItem *pJSON, unsigned int minItems)
+{
+	release();
+	if (!pJSON)
+		return true;
+	pBlock = pJSON;
+	this->minItems = minItems ? minItems : 1;
+	sSummaryBuild build = { this, 0, false };
+	uint aBits[JB_KEY_BLOOM_BITS / 32] = { 0 };
+	summarize(build, pJSON, aBits);
+	if (build.failed) {
+		release();
+		return false;
+	}
+	return true;
+}
+
+void JBKeySummary::release()
+{
+	free(aBlooms);
+	pBlock = NULL;
+	aBlooms = NULL;
+	numBlooms = 0;
+}
+
+const JBKeyBloom* JBKeySummary::find(const JBItem *item) const
+{
+	if (!numBlooms || item < pBlock)
+		return NULL;
+	uint index = (uint)(item - pBlock), first = 0, end = numBlooms;
+	while (first < end) {
+		uint mid = (first + end) / 2;
+		if (aBlooms[mid].item < index)
+			first = mid + 1;
+		else
+			end = mid;
+	}
+	return first < numBlooms && aBlooms[first].item == index ? &aBlooms[first] : NULL;
+}
+
+bool JBKeySummary::mayContain(const JBItem *item, unsigned int hash) const
+{
+	const JBKeyBloom *bloom = find(item);
+	return !bloom || bloomHas(bloom->aBits, hash);
+}
+
+const JBItem* JBKeySummary::findBelow(const JBItem *item, unsigned int hash) const
+{
+	if (!item || !mayContain(item, hash))
+		return NULL;
+	bool keys = item->getType() != JB_ARRAY;
+	for (const JBItem *child = item->getChild(); child; child = child->getSibling()) {
+		if (keys && child->getHash() == hash)
+			return child;
+		if (child->getChild()) {
+			if (const JBItem *found = findBelow(child, hash))
+				return found;
+		}
+	}
+	return NULL;
+}
+
+//
+// Multiple path extraction
+//
+
+void JBMultiPath::reset()
+{
+	memset(&aNodes[0], 0, sizeof(Node));
+	aNodes[0].slot = -1;
+	numNodes = 1;
+	numSlots = 0;
+	error_code = JBQERR_NONE;
+}
+
+// trie node kind for a compiled key or index step
+static short stepKind(const JBQueryStep &step)
+{
+	return step.op == JBQ_INDEX ? JBMultiPath::INDEX : (step.a >= 0 ? JBMultiPath::KEY | JBMultiPath::INDEX : JBMultiPath::KEY);
+}
+
+// find the child of a trie node that matches a step, 0 if none
+int JBMultiPath::findNode(int node, const JBQueryStep &step) const
+{
+	short kind = stepKind(step);
+	unsigned int hash = (kind & KEY) ? step.hash : 0;
+	int index = (kind & INDEX) ? step.a : 0;
+	for (int child = aNodes[node].first; child; child = aNodes[child].next) {
+		if (aNodes[child].kind == kind && aNodes[child].hash == hash && aNodes[child].index == index)
+			return child;
+	}
+	return 0;
+}
+
+int JBMultiPath::add(const char *path)
+{
+	JBQuery query;
+	error_code = JBQERR_NONE;
+	if (!query.compile(path)) {
+		error_code = query.last_error();
+		return -1;
+	}
+	for (int s = 0; s < query.numSteps; s++) {
+		if (query.aSteps[s].op != JBQ_CHILD && query.aSteps[s].op != JBQ_INDEX) {
+			error_code = JBQERR_UNSUPPORTED;
+			return -1;
+		}
+	}
+	// follow the steps already in the trie, the rest of the path needs new nodes
+	int node = 0;
+	int s = 0;
+	for (; s < query.numSteps; s++) {
+		int child = findNode(node, query.aSteps[s]);
+		if (!child)
+			break;
+		node = child;
+	}
+	if (numNodes + query.numSteps - s > MAX_NODES) {
+		error_code = JBQERR_TOO_MANY_NODES;
+		return -1;
+	}
+	for (; s < query.numSteps; s++) {
+		const JBQueryStep &step = query.aSteps[s];
+		int child = numNodes++;
+		Node &n = aNodes[child];
+		n.kind = stepKind(step);
+		n.hash = (n.kind & KEY) ? step.hash : 0;
+		n.index = (n.kind & INDEX) ? step.a : 0;
+		n.slot = -1;
+		n.first = 0;
+		n.next = 0;
+		n.count = 0;
+		if (int last = aNodes[node].first) {
+			while (aNodes[last].next)
+				last = aNodes[last].next;
+			aNodes[last].next = (short)child;
+		} else
+			aNodes[node].first = (short)child;
+		aNodes[node].count++;
+		node = child;
+	}
+	if (aNodes[node].slot < 0)
+		aNodes[node].slot = (short)numSlots++;
+	return aNodes[node].slot;
+}
+
+// match the children of item against the child nodes of a trie node
+int JBMultiPath::extractNode(int node, const JBItem *item, const JBItem **aSlots) const
+{
+	int found = 0;
+	int left = aNodes[node].count;
+	bool array = item->getType() == JB_ARRAY;
+	int count = array ? (int)item->getChildCount() : 0;
+	int index = 0;
+	unsigned int aMatched[(MAX_NODES + 31) / 32] = { 0 };	// trie nodes already matched at this level, first duplicate key wins
+	for (const JBItem *child = item->getChild(); child && left; child = child->getSibling(), index++) {
+		unsigned int hash = array ? 0 : child->getHash();
+		for (int n = aNodes[node].first; n; n = aNodes[n].next) {
+			const Node &trie = aNodes[n];
+			bool match = array ? ((trie.kind & INDEX) && (trie.index >= 0 ? trie.index : count + trie.index) == index) :
+				((trie.kind & KEY) && trie.hash == hash);
+			if (!match || (aMatched[n >> 5] & (1u << (n & 31))))
+				continue;
+			aMatched[n >> 5] |= 1u << (n & 31);
+			if (trie.slot >= 0 && !aSlots[trie.slot]) {
+				aSlots[trie.slot] = child;
+				found++;
+			}
+			if (trie.first && isContainer(child))
+				found += extractNode(n, child, aSlots);
+			left--;
+		}
+	}
+	return found;
+}
+
+int JBMultiPath::extract(const JBItem *root, const JBItem **aSlots) const
+{
+	for (int s = 0; s < numSlots; s++)
+		aSlots[s] = NULL;
+	if (!root || !isContainer(root))
+		return 0;
+	if (aNodes[0].slot >= 0) {	// empty path refers to the root
+		aSlots[aNodes[0].slot] = root;
+		return 1 + extractNode(0, root, aSlots);
+	}
+	return extractNode(0, root, aSlots);
+}
+
+}	// namespace jbin
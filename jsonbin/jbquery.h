@@ -0,0 +1,223 @@
+#ifndef __JBQUERY_H__
+#define __JBQUERY_H__
+
+//
+// JBQuery
+//
+// Summary
+//	- Compiles a JSON Pointer (RFC 6901) or a JSONPath subset into a reusable
+//		query object that can be run any number of times over parsed JBItem data.
+//	- Key names are hashed once at compile time so running a query is only
+//		hash compares and sibling steps, no string processing and no allocations.
+//
+// Usage
+//	- Create a JBQuery (on stack or as a member, fixed size) and call compile()
+//		with a path, check the result or call valid() / last_error().
+//	- JSON Pointer paths start with '/' (or are empty to refer to the root):
+//		"/scene/objects/0/name", "~0" and "~1" are decoded as '~' and '/'.
+//		A numeric segment matches both an array index and a key of the same name.
+//	- JSONPath paths start with '$' and support:
+//		.key ['key'] ["key"]	- child by name
+//		[n] [-n]				- array element by index (negative from end)
+//		.* [*]					- all children of an object or array
+//		[start:end:step]		- array slice, step must be positive
+//		..						- recursive descent, next step is applied at every depth
+//		[?(@.key)]				- children that have a key
+//		[?(@.key op literal)]	- children where the value of key compares to a literal
+//		[?(@ op literal)]		- children (values) that compare to a literal
+//			op is one of == != < <= > >=, literal is a number, 'string', "string",
+//			true, false or null.
+//	- Running a query:
+//		first(root): returns the first matching item or NULL
+//		run(root, aResults, maxResults): fills in up to maxResults items and
+//			returns the total number of matches
+//		visit(root, callback, user): calls callback for each match until the
+//			callback returns false
+//	- Pruning recursive descent in large documents:
+//		JBKeySummary keeps a small Bloom filter of the key hashes below each
+//			object or array with at least minItems items (a side table, build()
+//			it once after parsing). Pass it to first / run / visit and "..key"
+//			steps skip every subtree that can not contain the key.
+//		findBelow(item, hash) returns the first item with a key anywhere below
+//			item, mayContain(item, hash) is false if there is none.
+//	- Extracting many fields at once:
+//		JBMultiPath merges a set of paths into a trie of key hashes, add()
+//			returns the output slot for a path. Paths can only contain keys and
+//			indices (JSON Pointer, or JSONPath with .key, ['key'] and [n]).
+//		extract(root, aSlots) fills in every slot (NULL if not found) in one
+//			depth first pass, subtrees that no path needs are stepped over by
+//			their sibling offsets and each level stops once all its keys are found.
+//
+// Notes
+//	- Keys are hashed with JBHashKey so matching follows the same rules as
+//		JBItem::findByHash (two keys with the same hash are not told apart).
+//	- Filter string literals are stored in the query and compared in full.
+//	- A key summary must be built from the block it is used with. Only
+//		recursive descent followed by a key (.key or ['key']) is pruned. A
+//		filter has JB_KEY_BLOOM_BITS bits and fills up in subtrees with many
+//		distinct keys, those are walked as before.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+// step operations of a compiled query
+enum JBQueryOp {
+	JBQ_CHILD,		// child by key hash, or array element if index is >= 0 (JSON Pointer)
+	JBQ_INDEX,		// array element by index, negative index counts from end
+	JBQ_WILDCARD,	// all children of an object or array
+	JBQ_SLICE,		// array elements [start:end:step]
+	JBQ_DESCENT,	// apply the next step to this item and every descendant
+	JBQ_FILTER,		// children passing a filter expression
+};
+
+// filter comparisons
+enum JBQueryCmp {
+	JBQC_EXISTS,	// [?(@.key)]
+	JBQC_EQ,		// ==
+	JBQC_NE,		// !=
+	JBQC_LT,		// <
+	JBQC_LE,		// <=
+	JBQC_GT,		// >
+	JBQC_GE,		// >=
+};
+
+// ERROR CODES (return from JBQuery::last_error)
+enum JBQueryError {
+	JBQERR_NONE = 0,			// query compiled, must be 0
+	JBQERR_NOT_COMPILED,		// compile has not been called
+	JBQERR_SYNTAX,				// path could not be interpreted
+	JBQERR_TOO_MANY_STEPS,		// path has more steps than JBQuery::MAX_STEPS
+	JBQERR_KEY_SIZE,			// a key is longer than JBQuery::MAX_KEY_LENGTH
+	JBQERR_LITERAL_SIZE,		// filter strings exceed JBQuery::MAX_LITERALS
+	JBQERR_UNSUPPORTED,			// path step can not be used in this context (JBMultiPath only takes keys and indices)
+	JBQERR_TOO_MANY_NODES,		// JBMultiPath trie is full, increase JBMultiPath::MAX_NODES
+};
+
+// slice flags
+enum {
+	JBQS_NO_START = 1,	// [:end]
+	JBQS_NO_END = 2,	// [start:]
+	JBQF_SELF = 4,		// filter on the child value itself (@) instead of a key of the child
+};
+
+struct JBQueryStep {
+	unsigned char op;		// JBQueryOp
+	unsigned char cmp;		// JBQueryCmp for filters
+	unsigned char lit_type;	// JBType of filter literal (JB_STRING, JB_FLOAT, JB_BOOL or JB_NULL_VALUE)
+	unsigned char flags;	// JBQS_* / JBQF_* flags
+	unsigned int hash;		// key hash for JBQ_CHILD and JBQ_FILTER
+	int a, b, c;			// index / slice start, end, step / filter literal offset and length
+	double num;				// filter numeric literal (or bool)
+};
+
+// callback for each item matched by a query, return false to stop
+typedef bool(*JBQueryCallback)(const JBItem *item, void *user);
+
+#define JB_KEY_BLOOM_BITS 256	// bits of the key filter of each summarized subtree
+
+// key filter of an object or array
+struct JBKeyBloom {
+	unsigned int item;			// index of the object or array in the block
+	unsigned int aBits[JB_KEY_BLOOM_BITS / 32];
+};
+
+// Bloom filters of the keys below large subtrees, to prune recursive searches
+struct JBKeySummary {
+	const JBItem *pBlock;
+	JBKeyBloom *aBlooms;		// in item order
+	unsigned int numBlooms;
+	unsigned int minItems;		// smallest subtree with a filter
+
+	JBKeySummary() : pBlock(NULL), aBlooms(NULL), numBlooms(0), minItems(0) {}
+	~JBKeySummary() { release(); }
+
+	// summarize the objects and arrays with at least minItems items below them, false if out of memory
+	bool build(const JBItem *pJSON, unsigned int minItems = 64);
+	void release();
+
+	const JBKeyBloom* find(const JBItem *item) const;	// NULL if item has no filter
+	bool mayContain(const JBItem *item, unsigned int hash) const;	// false if no item below has the key
+	const JBItem* findBelow(const JBItem *item, unsigned int hash) const;	// first item below with the key, depth first
+
+private:
+	JBKeySummary(const JBKeySummary&);	// not copyable, the destructor frees the filters
+	JBKeySummary& operator=(const JBKeySummary&);
+};
+
+struct JBQuery {
+	enum {
+		MAX_STEPS = 32,			// max number of steps in a path
+		MAX_KEY_LENGTH = 256,	// max length of a single key (in bytes)
+		MAX_LITERALS = 256,		// bytes of filter string literals
+	};
+
+	JBQueryStep aSteps[MAX_STEPS];
+	int numSteps;
+	int litSize;
+	JBQueryError error_code;
+	int error_pos;				// offset into path where compile failed
+	char aLiterals[MAX_LITERALS];
+
+	JBQuery() : numSteps(0), litSize(0), error_code(JBQERR_NOT_COMPILED), error_pos(0) {}
+	JBQuery(const char *path) { compile(path); }
+
+	bool compile(const char *path);	// JSON Pointer ('/...') or JSONPath ('$...'), zero terminated
+	bool compile(const char *path, unsigned int len);
+	bool valid() const { return error_code == JBQERR_NONE; }
+	JBQueryError last_error() const { return error_code; }
+
+	const JBItem* first(const JBItem *root, const JBKeySummary *summary = 0) const;	// first match or NULL
+	int run(const JBItem *root, const JBItem **aResults, int maxResults, const JBKeySummary *summary = 0) const;	// returns total number of matches
+	int visit(const JBItem *root, JBQueryCallback callback, void *user, const JBKeySummary *summary = 0) const;	// returns number of items passed to callback
+
+	// internal
+	bool addStep(JBQueryOp op, const char *path, const char *pos);
+	bool addKey(JBQueryOp op, const char *key, unsigned int len, int index, const char *path, const char *pos);
+	bool compilePointer(const char *path, unsigned int len);
+	bool compilePath(const char *path, unsigned int len);
+};
+
+// A set of key/index paths merged into a trie for extracting many fields in one pass
+struct JBMultiPath {
+	enum {
+		MAX_NODES = 256,	// total number of unique path steps (+1 for root)
+	};
+
+	enum {
+		KEY = 1,		// node matches an object child by key hash
+		INDEX = 2,		// node matches an array element by index
+	};
+
+	struct Node {
+		unsigned int hash;	// key hash
+		int index;			// array index (negative from end)
+		short kind;			// KEY and/or INDEX
+		short slot;			// output slot or -1 if only an intermediate step
+		short first;		// first child node or 0 if none
+		short next;			// next sibling node or 0 if last
+		short count;		// number of child nodes
+	};
+
+	Node aNodes[MAX_NODES];	// aNodes[0] is the root
+	int numNodes;
+	int numSlots;
+	JBQueryError error_code;
+
+	JBMultiPath() { reset(); }
+	void reset();
+	int add(const char *path);	// returns output slot for path or -1 on error (see last_error, paths already added are kept)
+	int slots() const { return numSlots; }	// number of entries to allocate for extract
+	JBQueryError last_error() const { return error_code; }
+	int extract(const JBItem *root, const JBItem **aSlots) const;	// returns number of slots found
+
+	// internal
+	int findNode(int node, const JBQueryStep &step) const;
+	int extractNode(int node, const JBItem *item, const JBItem **aSlots) const;
+};
+
+}	// namespace jbin
+
+#endif
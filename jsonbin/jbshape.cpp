@@ -0,0 +1,185 @@
+//
+// JBShapes
+//
+// Details in jbshape.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcmp
+#include "jbshape.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+// grow an array to hold count elements
+static bool reserve(void **pArray, uint count, uint &max, size_t elem)
+{
+	if (count <= max)
+		return true;
+	uint grow = max ? max : 64;
+	while (grow < count)
+		grow *= 2;
+	void *pGrow = realloc(*pArray, grow * elem);
+	if (!pGrow)
+		return false;
+	*pArray = pGrow;
+	max = grow;
+	return true;
+}
+
+// same keys in the same order
+static bool sameKeys(const JBItem *a, const JBItem *b)
+{
+	for (; a && b; a = a->getSibling(), b = b->getSibling()) {
+		if (a->getHash() != b->getHash())
+			return false;
+#ifdef JB_KEY_STRING
+		if (a->getName() != b->getName())	// equal names share a string
+			return false;
+#endif
+	}
+	return a == b;
+}
+
+void JBShapes::release()
+{
+	free(aShapes);
+	free(aArrays);
+	free(aKeyHashes);
+	aShapes = NULL;
+	aArrays = NULL;
+	aKeyHashes = NULL;
+	numShapes = numArrays = numKeyHashes = 0;
+}
+
+bool JBShapes::build(const JBItem *pJSON, uint minRecords)
+{
+	release();
+	if (!pJSON)
+		return true;
+	if (minRecords < 1)
+		minRecords = 1;
+
+	// last item of the block
+	const JBItem *last = pJSON;
+	while (const JBItem *child = last->getChild()) {
+		while (const JBItem *next = child->getSibling())
+			child = next;
+		last = child;
+	}
+
+	uint maxShapes = 0, maxArrays = 0, maxKeyHashes = 0;
+	uint *aTable = NULL;	// shape + 1 by hash of the key list
+	uint tableSize = 0;
+	bool ok = true;
+	for (const JBItem *item = pJSON; ok && item <= last; item++) {
+		if (item->type != JB_ARRAY || (uint)item->data.i < minRecords)
+			continue;
+		const JBItem *first = item + 1;
+		if (first->getType() != JB_OBJECT)
+			continue;
+
+		// every element is an object with the keys of the first one
+		const JBItem *keys = first->getChild();
+		uint numKeys = (uint)first->getChildCount();
+		uint keysHash = JB_FNV1A_SEED;
+		for (const JBItem *key = keys; key; key = key->getSibling())
+			keysHash = (key->getHash() ^ keysHash) * JB_FNV1A_PRIME;
+		bool shaped = true, flat = true;
+		for (const JBItem *rec = first; shaped && rec; rec = rec->getSibling()) {
+			if (rec->type != JB_OBJECT)
+				flat = false;
+			shaped = rec->getType() == JB_OBJECT && (uint)rec->getChildCount() == numKeys && (rec == first || sameKeys(keys, rec->getChild()));
+			for (const JBItem *value = rec->getChild(); shaped && flat && value; value = value->getSibling())
+				flat = !value->getChild();
+		}
+		if (!shaped)
+			continue;
+
+		// find or add the shape
+		if (numShapes * 2 >= tableSize) {
+			uint size = tableSize ? tableSize * 2 : 64;
+			uint *aGrow = (uint*)calloc(size, sizeof(uint));
+			if (!aGrow) {
+				ok = false;
+				break;
+			}
+			for (uint s = 0; s < numShapes; s++) {
+				uint hash = JB_FNV1A_SEED;
+				for (uint k = 0; k < aShapes[s].numKeys; k++)
+					hash = (aKeyHashes[aShapes[s].firstHash + k] ^ hash) * JB_FNV1A_PRIME;
+				uint slot = hash & (size - 1);
+				while (aGrow[slot])
+					slot = (slot + 1) & (size - 1);
+				aGrow[slot] = s + 1;
+			}
+			free(aTable);
+			aTable = aGrow;
+			tableSize = size;
+		}
+		uint slot = keysHash & (tableSize - 1);
+		while (uint index = aTable[slot]) {
+			const JBShape &known = aShapes[index - 1];
+			if (known.numKeys == numKeys && sameKeys(known.keys, keys))
+				break;
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		uint shape = aTable[slot];
+		if (!shape) {
+			if (!reserve((void**)&aShapes, numShapes + 1, maxShapes, sizeof(JBShape)) ||
+				!reserve((void**)&aKeyHashes, numKeyHashes + numKeys, maxKeyHashes, sizeof(uint))) {
+				ok = false;
+				break;
+			}
+			JBShape &added = aShapes[numShapes];
+			added.keys = keys;
+			added.firstHash = numKeyHashes;
+			added.numKeys = numKeys;
+			added.numRecords = 0;
+			for (const JBItem *key = keys; key; key = key->getSibling())
+				aKeyHashes[numKeyHashes++] = key->getHash();
+			shape = aTable[slot] = ++numShapes;
+		}
+		if (!reserve((void**)&aArrays, numArrays + 1, maxArrays, sizeof(JBShapedArray))) {
+			ok = false;
+			break;
+		}
+		JBShapedArray &array = aArrays[numArrays++];
+		array.array = item;
+		array.shape = shape - 1;
+		array.flat = flat;
+		aShapes[shape - 1].numRecords += (uint)item->data.i;
+	}
+	free(aTable);
+	if (!ok)
+		release();
+	return ok;
+}
+
+const JBShapedArray* JBShapes::find(const JBItem *array) const
+{
+	uint lo = 0, hi = numArrays;
+	while (lo < hi) {
+		uint mid = (lo + hi) / 2;
+		if (aArrays[mid].array < array)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < numArrays && aArrays[lo].array == array) ? &aArrays[lo] : NULL;
+}
+
+int JBShapes::slot(uint shape, uint hash) const
+{
+	if (shape >= numShapes)
+		return -1;
+	const uint *aHashes = aKeyHashes + aShapes[shape].firstHash;
+	for (uint k = 0; k < aShapes[shape].numKeys; k++) {
+		if (aHashes[k] == hash)
+			return (int)k;
+	}
+	return -1;
+}
+
+}	// namespace jbin
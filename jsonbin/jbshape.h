@@ -0,0 +1,101 @@
+#ifndef __JBSHAPE_H__
+#define __JBSHAPE_H__
+
+//
+// JBShapes
+//
+// Summary
+//	- Finds the arrays in a block returned by JSONBin where every element is
+//		an object with the same ordered list of keys (records), and stores each
+//		distinct key list once as a shape.
+//	- A key is resolved to a slot index once per shape, after that a field of
+//		each record is found by position instead of comparing key hashes.
+//		Records where no value is an object or array with children have a
+//		fixed layout and a field is read directly from its slot.
+//
+// Usage
+//	- Find shapes after parsing:
+//		JBShapes shapes;
+//		shapes.build(pJSON);
+//	- Look up a field in every record of an array:
+//		const JBItem *pObjects = pJSON->findByHash(_FNV1A_objects);
+//		if (const JBShapedArray *records = shapes.find(pObjects)) {
+//			int speed = shapes.slot(records->shape, JBHashKey("speed", 5));	// -1 if no such key
+//			for (JBIterator rec = pObjects->begin(); speed >= 0 && rec != pObjects->end(); ++rec)
+//				float value = records->field(*rec, speed)->getFloat();
+//		}
+//	- getShape(id) returns the key list, numShapes and numArrays how much was
+//		found. release() frees the tables, the destructor calls it.
+//
+// Notes
+//	- The block is not changed, findByHash and the iterators work the same on
+//		shaped arrays and shapes are an index next to the block. Every record
+//		still has its own name and hash per field since JBItem is fixed size.
+//	- build() is one pass over the items, arrays are found in item order and
+//		find() is a binary search.
+//	- Key lists are compared by hash (and by name string with JB_KEY_STRING,
+//		equal names share the same string in a block).
+//	- An array needs at least minRecords records to get a shape (default 2).
+//		Arrays in a shared subtree (JB_SHARED_SUBTREES) are not flat.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+// ordered key list shared by records
+struct JBShape {
+	const JBItem *keys;			// first member of the first record with this shape, names are read from its siblings
+	unsigned int firstHash;		// index in JBShapes::aKeyHashes of the hash of each slot
+	unsigned int numKeys;
+	unsigned int numRecords;	// records in all arrays with this shape
+};
+
+// array of records with the same shape
+struct JBShapedArray {
+	const JBItem *array;
+	unsigned int shape;			// index of the shape in JBShapes
+	bool flat;					// no value has children, slot n of a record is item n + 1
+
+	// value at a slot of a record in this array, NULL if slot is -1
+	const JBItem* field(const JBItem *record, int slot) const {
+		if (slot < 0)
+			return NULL;
+		if (flat)
+			return record + 1 + slot;
+		const JBItem *child = record->getChild();
+		while (slot--)
+			child = child->getSibling();
+		return child;
+	}
+};
+
+struct JBShapes {
+	JBShape *aShapes;
+	unsigned int numShapes;
+	JBShapedArray *aArrays;		// in item order
+	unsigned int numArrays;
+	unsigned int *aKeyHashes;	// key hashes of every shape
+	unsigned int numKeyHashes;
+
+	JBShapes() : aShapes(NULL), numShapes(0), aArrays(NULL), numArrays(0), aKeyHashes(NULL), numKeyHashes(0) {}
+	~JBShapes() { release(); }
+
+	// find the shaped arrays of a block, false if out of memory
+	bool build(const JBItem *pJSON, unsigned int minRecords = 2);
+	void release();
+
+	const JBShapedArray* find(const JBItem *array) const;	// NULL if array is not shaped
+	int slot(unsigned int shape, unsigned int hash) const;	// slot of a key, -1 if not in the shape
+	const JBShape& getShape(unsigned int shape) const { return aShapes[shape]; }
+	unsigned int getKeyHash(unsigned int shape, int slot) const { return aKeyHashes[aShapes[shape].firstHash + slot]; }
+
+private:
+	JBShapes(const JBShapes&);	// not copyable, the destructor frees the tables
+	JBShapes& operator=(const JBShapes&);
+};
+
+}	// namespace jbin
+
+#endif
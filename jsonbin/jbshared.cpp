@@ -0,0 +1,224 @@
+//
+// JBShared
+//
+// Details in jbshared.h
+//
+
+#include <string.h>	// memcpy
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// CreateFileMapping / MapViewOfFile
+#else
+#include <fcntl.h>		// O_* constants
+#include <unistd.h>		// ftruncate / close
+#include <sys/mman.h>	// shm_open / mmap
+#include <sys/stat.h>	// fstat / fchmod
+#endif
+#include "jbshared.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+static bool setError(JBSnapshotError *error, JBSnapshotError code)
+{
+	if (error)
+		*error = code;
+	return code == JBSERR_NONE;
+}
+
+// shared memory object name for the platform, false if too long
+static bool sharedName(const char *name, char *buf)
+{
+	size_t len = name ? strlen(name) : 0;
+	size_t prefix = 0;
+#ifndef WIN32
+	if (!len || name[0] != '/')
+		prefix = 1;	// shm_open names start with a single '/'
+#endif
+	if (!len || len + prefix >= JB_SHARED_MAX_NAME)
+		return false;
+	buf[0] = '/';
+	memcpy(buf + prefix, name, len + 1);
+	return true;
+}
+
+bool JBShared::publish(const char *name, const JBItem *block, const JBRet *info, JBSnapshotError *error)
+{
+	detach();
+#ifdef JB_INLINE_STRINGS
+	(void)name; (void)block; (void)info;
+	return setError(error, JBSERR_INLINE_STRINGS);
+#else
+	char object_name[JB_SHARED_MAX_NAME];
+	if (!block || !info || !info->bin_size || !info->num_items)
+		return setError(error, JBSERR_INVALID_BLOCK);
+	if (!sharedName(name, object_name))
+		return setError(error, JBSERR_OPEN);
+
+	size_t total = sizeof(JBSnapshotHeader) + (size_t)info->bin_size;
+	char *mapped = NULL;
+#ifdef WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)total >> 32), (DWORD)total, object_name);
+	if (!mapping)
+		return setError(error, JBSERR_OPEN);
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(mapping);
+		return setError(error, JBSERR_OPEN);
+	}
+	if (!(mapped = (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, total))) {
+		CloseHandle(mapping);
+		return setError(error, JBSERR_WRITE);
+	}
+#else
+	int fd = shm_open(object_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return setError(error, JBSERR_OPEN);
+	void *writable = MAP_FAILED;
+	if (!ftruncate(fd, (off_t)total))
+		writable = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (writable == MAP_FAILED) {
+		close(fd);
+		shm_unlink(object_name);
+		return setError(error, JBSERR_WRITE);
+	}
+	mapped = (char*)writable;
+#endif
+
+	// block first and the header magic last so readers only accept complete data
+	JBSnapshotHeader header;
+	JBSnapshotInitHeader(header, info->bin_size, info->num_items, JBSnapshotChecksum(block, info->bin_size));
+	memcpy(mapped + sizeof(JBSnapshotHeader), block, info->bin_size);
+	memcpy(mapped + sizeof(header.magic), (const char*)&header + sizeof(header.magic), sizeof(header) - sizeof(header.magic));
+#ifdef WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+	memcpy(mapped, header.magic, sizeof(header.magic));
+
+	// seal: no more writes through any mapping
+#ifdef WIN32
+	DWORD old_protect;
+	VirtualProtect(mapped, total, PAGE_READONLY, &old_protect);
+	handle = mapping;
+#else
+	fchmod(fd, 0444);
+	munmap(mapped, total);
+	mapped = (char*)mmap(NULL, total, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ((void*)mapped == MAP_FAILED) {
+		shm_unlink(object_name);
+		return setError(error, JBSERR_READ);
+	}
+#endif
+	base = mapped;
+	size = total;
+	pJSON = (const JBItem*)(base + sizeof(JBSnapshotHeader));
+	return setError(error, JBSERR_NONE);
+#endif
+}
+
+bool JBShared::attach(const char *name, JBSnapshotError *error, bool verify)
+{
+	detach();
+	char object_name[JB_SHARED_MAX_NAME];
+	if (!sharedName(name, object_name))
+		return setError(error, JBSERR_OPEN);
+
+	const char *mapped = NULL;
+	size_t mapped_size = 0;
+#ifdef WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, object_name);
+	if (!mapping)
+		return setError(error, JBSERR_OPEN);
+	mapped = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION region;
+	if (mapped && VirtualQuery(mapped, &region, sizeof(region)))
+		mapped_size = region.RegionSize;	// rounded up to pages, checked against the header below
+	if (!mapped || mapped_size < sizeof(JBSnapshotHeader)) {
+		if (mapped)
+			UnmapViewOfFile(mapped);
+		CloseHandle(mapping);
+		return setError(error, mapped ? JBSERR_NOT_SNAPSHOT : JBSERR_READ);
+	}
+#else
+	int fd = shm_open(object_name, O_RDONLY, 0);
+	if (fd < 0)
+		return setError(error, JBSERR_OPEN);
+	struct stat object_stat;
+	if (fstat(fd, &object_stat) || object_stat.st_size < (off_t)sizeof(JBSnapshotHeader)) {
+		close(fd);
+		return setError(error, JBSERR_NOT_SNAPSHOT);
+	}
+	mapped_size = (size_t)object_stat.st_size;
+	void *readable = mmap(NULL, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (readable == MAP_FAILED)
+		return setError(error, JBSERR_READ);
+	mapped = (const char*)readable;
+#endif
+
+	const JBSnapshotHeader &header = *(const JBSnapshotHeader*)mapped;
+	JBSnapshotError result = JBSnapshotCheckHeader(header);
+	size_t total = (size_t)header.header_size + header.block_size;
+#ifdef WIN32
+	if (result == JBSERR_NONE && mapped_size < total)
+		result = JBSERR_SIZE;
+#else
+	if (result == JBSERR_NONE && mapped_size != total)
+		result = JBSERR_SIZE;
+#endif
+	if (result == JBSERR_NONE && verify && JBSnapshotChecksum(mapped + header.header_size, header.block_size) != header.checksum)
+		result = JBSERR_CHECKSUM;
+	if (result != JBSERR_NONE) {
+#ifdef WIN32
+		UnmapViewOfFile(mapped);
+		CloseHandle(mapping);
+#else
+		munmap((void*)mapped, mapped_size);
+#endif
+		return setError(error, result);
+	}
+#ifdef WIN32
+	handle = mapping;
+#endif
+	base = mapped;
+	size = total;
+	pJSON = (const JBItem*)(base + header.header_size);
+	return setError(error, JBSERR_NONE);
+}
+
+void JBShared::detach()
+{
+	if (base) {
+#ifdef WIN32
+		UnmapViewOfFile(base);
+#else
+		munmap((void*)base, size);
+#endif
+	}
+#ifdef WIN32
+	if (handle)
+		CloseHandle((HANDLE)handle);
+#endif
+	pJSON = NULL;
+	base = NULL;
+	size = 0;
+	handle = NULL;
+}
+
+bool JBUnpublishShared(const char *name)
+{
+	char object_name[JB_SHARED_MAX_NAME];
+	if (!sharedName(name, object_name))
+		return false;
+#ifdef WIN32
+	return true;
+#else
+	return !shm_unlink(object_name);
+#endif
+}
+
+}	// namespace jbin
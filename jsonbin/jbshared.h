@@ -0,0 +1,72 @@
+#ifndef __JBSHARED_H__
+#define __JBSHARED_H__
+
+//
+// JBShared
+//
+// Summary
+//	- Publishes a block returned by JSONBin in named shared memory so other
+//		processes on the same host can attach to it read-only without copying
+//		or parsing. JBItem data is relocatable so each process can map it at a
+//		different address.
+//	- The shared memory holds the same header and block as a snapshot file
+//		(jbsnapshot.h) so attaching checks format version, traits, item size
+//		and byte order before handing out the block.
+//
+// Usage
+//	- Publisher (parses once):
+//		JBRet ret; JBItem *pJSON = JSONBin(json, size, &ret);
+//		JBShared shared;
+//		if (shared.publish("/refdoc", pJSON, &ret)) free(pJSON);	// shared.pJSON is the published copy
+//	- Readers (any number of processes):
+//		JBShared doc;
+//		if (doc.attach("/refdoc")) { ... doc.pJSON ... }
+//	- detach() (or the destructor) unmaps the block. The name stays published
+//		until JBUnpublishShared(name) is called, attached readers keep their
+//		mapping after that.
+//
+// Notes
+//	- Names follow shm_open rules on POSIX systems (a leading '/' is added if
+//		missing, link with -lrt on older systems), and CreateFileMapping rules
+//		on Windows ("Local\\name" or "Global\\name").
+//	- publish() fails if the name already exists, unpublish a stale name first.
+//	- The object is sealed after it is filled in: on POSIX it is made read-only
+//		for everyone (mode 0444) and the publisher remaps it read-only, on
+//		Windows readers open it with read access only. The header magic is
+//		written last so a reader never accepts a partially written block.
+//	- On Windows a named mapping exists while any process has it open, the
+//		publisher must stay attached for as long as the name should be found.
+//	- Requires jbsnapshot.cpp, and relocatable data (no JB_INLINE_STRINGS).
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+#include "jbsnapshot.h"
+
+namespace jbin {
+
+#define JB_SHARED_MAX_NAME 256
+
+struct JBShared {
+	const JBItem *pJSON;	// published or attached block
+	const char *base;		// mapped header and block
+	size_t size;
+	void *handle;			// file mapping handle (Windows only)
+
+	JBShared() : pJSON(NULL), base(NULL), size(0), handle(NULL) {}
+	~JBShared() { detach(); }
+	bool publish(const char *name, const JBItem *block, const JBRet *info, JBSnapshotError *error = 0);
+	bool attach(const char *name, JBSnapshotError *error = 0, bool verify = false);
+	void detach();
+
+private:
+	JBShared(const JBShared&);	// not copyable, detach() unmaps the block
+	JBShared& operator=(const JBShared&);
+};
+
+// remove a published name, mapped blocks stay valid (no-op on Windows, see notes)
+bool JBUnpublishShared(const char *name);
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,553 @@
+//
+// JBSnapshot
+//
+// Details in jbsnapshot.h
+//
+
+#include <stdio.h>	// FILE
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memcpy
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// CreateFileMapping / MapViewOfFile
+#else
+#include <fcntl.h>		// open
+#include <unistd.h>		// close
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#endif
+#include "jbsnapshot.h"
+
+namespace jbin {
+
+typedef unsigned char u8;
+typedef unsigned int uint;
+
+static bool setError(JBSnapshotError *error, JBSnapshotError code)
+{
+	if (error)
+		*error = code;
+	return code == JBSERR_NONE;
+}
+
+unsigned int JBSnapshotTraits()
+{
+	uint traits = 0;
+#ifdef JB_KEY_HASH
+	traits |= JBS_TRAIT_KEY_HASH;
+#endif
+#ifdef JB_KEY_STRING
+	traits |= JBS_TRAIT_KEY_STRING;
+#endif
+#ifdef JB_64BIT_VALUES
+	traits |= JBS_TRAIT_64BIT_VALUES;
+#endif
+#ifdef JB_STRLEN
+	traits |= JBS_TRAIT_STRLEN;
+#endif
+#ifdef JB_WCHAR16
+	traits |= JBS_TRAIT_WCHAR16;
+#endif
+	return traits;
+}
+
+// fnv1a over 32 bit words (native order, the header records the byte order) and the remaining bytes
+unsigned int JBSnapshotChecksum(const void *data, unsigned int size, unsigned int checksum)
+{
+	const u8 *bytes = (const u8*)data;
+	for (; size >= 4; size -= 4, bytes += 4) {
+		uint word;
+		memcpy(&word, bytes, sizeof(word));
+		checksum = (word ^ checksum) * JB_FNV1A_PRIME;
+	}
+	while (size--)
+		checksum = (*bytes++ ^ checksum) * JB_FNV1A_PRIME;
+	return checksum;
+}
+
+void JBSnapshotInitHeader(JBSnapshotHeader &header, unsigned int block_size, unsigned int num_items, unsigned int checksum, unsigned int version)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JB_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = version;
+	header.endian = JB_SNAPSHOT_ENDIAN;
+	header.traits = JBSnapshotTraits();
+	header.item_size = sizeof(JBItem);
+	header.header_size = sizeof(JBSnapshotHeader);
+	header.block_size = block_size;
+	header.num_items = num_items;
+	header.checksum = checksum;
+}
+
+JBSnapshotError JBSnapshotCheckHeader(const JBSnapshotHeader &header, unsigned int version)
+{
+	if (memcmp(header.magic, JB_SNAPSHOT_MAGIC, sizeof(header.magic)))
+		return JBSERR_NOT_SNAPSHOT;
+	if (header.endian != JB_SNAPSHOT_ENDIAN)
+		return JBSERR_ENDIAN;	// check before anything else that is read as a number
+	if (header.version != version)
+		return JBSERR_VERSION;
+	if (version == JB_SNAPSHOT_VERSION ? header.header_size != sizeof(JBSnapshotHeader) :
+		(header.num_sections > (0xffffffffU - sizeof(JBSnapshotHeader)) / sizeof(JBSnapshotSection) ||
+		header.header_size < sizeof(JBSnapshotHeader) + header.num_sections * sizeof(JBSnapshotSection)))
+		return JBSERR_SIZE;
+	if (header.traits != JBSnapshotTraits() || header.item_size != sizeof(JBItem))
+		return JBSERR_TRAITS;
+	if (header.block_size < sizeof(JBItem) || header.num_items < 1 ||
+		header.num_items > header.block_size / sizeof(JBItem))
+		return JBSERR_SIZE;
+	return JBSERR_NONE;
+}
+
+bool JBSave(const char *path, const JBItem *block, const JBRet *info, JBSnapshotError *error)
+{
+#ifdef JB_INLINE_STRINGS
+	(void)path; (void)block; (void)info;
+	return setError(error, JBSERR_INLINE_STRINGS);
+#else
+	if (!block || !info || !info->bin_size || !info->num_items)
+		return setError(error, JBSERR_INVALID_BLOCK);
+
+	JBSnapshotHeader header;
+	JBSnapshotInitHeader(header, info->bin_size, info->num_items, JBSnapshotChecksum(block, info->bin_size));
+
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "wb"))
+		f = NULL;
+#else
+	f = fopen(path, "wb");
+#endif
+	if (!f)
+		return setError(error, JBSERR_OPEN);
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(block, info->bin_size, 1, f) == 1;
+	if (fclose(f))
+		written = false;
+	return setError(error, written ? JBSERR_NONE : JBSERR_WRITE);
+#endif
+}
+
+JBItem* JBLoad(const char *path, JBSnapshotError *error, bool verify)
+{
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "rb"))
+		f = NULL;
+#else
+	f = fopen(path, "rb");
+#endif
+	if (!f) {
+		setError(error, JBSERR_OPEN);
+		return NULL;
+	}
+	JBSnapshotHeader header;
+	JBSnapshotError result = JBSERR_NONE;
+	JBItem *block = NULL;
+	if (fread(&header, sizeof(header), 1, f) != 1)
+		result = JBSERR_NOT_SNAPSHOT;
+	else if ((result = JBSnapshotCheckHeader(header)) == JBSERR_NONE) {
+		if (!(block = (JBItem*)malloc(header.block_size)))
+			result = JBSERR_OUT_OF_MEMORY;
+		else if (fread(block, header.block_size, 1, f) != 1)
+			result = JBSERR_SIZE;
+		else if (verify && JBSnapshotChecksum(block, header.block_size) != header.checksum)
+			result = JBSERR_CHECKSUM;
+	}
+	fclose(f);
+	if (result != JBSERR_NONE && block) {
+		free(block);
+		block = NULL;
+	}
+	setError(error, result);
+	return block;
+}
+
+// map a file read-only, returns NULL if it can not be opened or mapped or is smaller than a header
+static const char *mapFile(const char *path, size_t &size, JBSnapshotError *error)
+{
+	const char *base = NULL;
+	size = 0;
+#ifdef WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		setError(error, JBSERR_OPEN);
+		return NULL;
+	}
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(JBSnapshotHeader)) {
+		size = (size_t)file_size.QuadPart;
+		if (HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) {
+			base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);	// the view keeps the mapping open
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) {
+		setError(error, JBSERR_OPEN);
+		return NULL;
+	}
+	struct stat file_stat;
+	if (!fstat(file, &file_stat) && file_stat.st_size >= (off_t)sizeof(JBSnapshotHeader)) {
+		size = (size_t)file_stat.st_size;
+		void *mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		base = mapped != MAP_FAILED ? (const char*)mapped : NULL;
+	}
+	close(file);	// the mapping stays valid after closing
+#endif
+	if (!base)
+		setError(error, size ? JBSERR_READ : JBSERR_NOT_SNAPSHOT);
+	return base;
+}
+
+static void unmapFile(const char *base, size_t size)
+{
+#ifdef WIN32
+	(void)size;
+	UnmapViewOfFile(base);
+#else
+	munmap((void*)base, size);
+#endif
+}
+
+const JBItem* JBLoadMapped(const char *path, JBSnapshotError *error, bool verify)
+{
+	size_t size;
+	const char *base = mapFile(path, size, error);
+	if (!base)
+		return NULL;
+
+	const JBSnapshotHeader &header = *(const JBSnapshotHeader*)base;
+	JBSnapshotError result = JBSnapshotCheckHeader(header);
+	if (result == JBSERR_NONE && size != (size_t)header.header_size + header.block_size)
+		result = JBSERR_SIZE;
+	if (result == JBSERR_NONE && verify && JBSnapshotChecksum(base + header.header_size, header.block_size) != header.checksum)
+		result = JBSERR_CHECKSUM;
+	if (result != JBSERR_NONE) {
+		unmapFile(base, size);
+		setError(error, result);
+		return NULL;
+	}
+	setError(error, JBSERR_NONE);
+	return (const JBItem*)(base + header.header_size);
+}
+
+void JBUnloadMapped(const JBItem *block)
+{
+	if (!block)
+		return;
+	const char *base = (const char*)block - sizeof(JBSnapshotHeader);
+	const JBSnapshotHeader &header = *(const JBSnapshotHeader*)base;
+	unmapFile(base, (size_t)header.header_size + header.block_size);
+}
+
+//
+// Sectioned snapshots
+//
+
+#define JB_SNAPSHOT_PAGE 4096	// section alignment is a multiple of this and of sizeof(JBItem)
+#define JB_SIBLING_MAX ((1 << 23) - 1)	// largest offset that fits in JBItem::sibling
+
+// length of a zero terminated string in bytes including the terminator
+static uint stringBytes(const jchar *str)
+{
+	const jchar *end = str;
+	while (*end)
+		end++;
+	return (uint)((end - str + 1) * sizeof(jchar));
+}
+
+// one section being built: items of a child of the root followed by the strings they use
+struct sSection {
+	char *data;
+	uint size;
+	uint capacity;
+	const jchar **apSource;	// string dedup table by source address
+	uint *aOffset;			// section offset of each string in apSource
+	uint tableSize;			// power of 2
+
+	bool reserve(uint bytes);
+	bool copyString(const jchar *src, uint &offset);
+	bool build(const JBItem *first, uint count);
+	void release();
+};
+
+bool sSection::reserve(uint bytes)
+{
+	if (size + bytes <= capacity)
+		return true;
+	uint grow = capacity ? capacity : JB_SNAPSHOT_PAGE;
+	while (grow < size + bytes)
+		grow *= 2;
+	char *data_grow = (char*)realloc(data, grow);
+	if (!data_grow)
+		return false;
+	data = data_grow;
+	capacity = grow;
+	return true;
+}
+
+// add a string to the section once, offset is the position in the section
+bool sSection::copyString(const jchar *src, uint &offset)
+{
+	uint slot = (uint)(((size_t)src >> 1) * 2654435761U) & (tableSize - 1);
+	while (apSource[slot] && apSource[slot] != src)
+		slot = (slot + 1) & (tableSize - 1);
+	if (!apSource[slot]) {
+		uint bytes = stringBytes(src);
+		if (!reserve(bytes))
+			return false;
+		apSource[slot] = src;
+		aOffset[slot] = size;
+		memcpy(data + size, src, bytes);
+		size += bytes;
+	}
+	offset = aOffset[slot];
+	return true;
+}
+
+// copy a range of items and the strings they use, string offsets are rewritten for the new location
+bool sSection::build(const JBItem *first, uint count)
+{
+	size = 0;
+	uint table = 16;
+	while (table < count * 4)	// at most a key and a string per item, half full
+		table *= 2;
+	if (table > tableSize) {
+		free(apSource);
+		if (!(apSource = (const jchar**)malloc(table * (sizeof(const jchar*) + sizeof(uint))))) {
+			tableSize = 0;
+			return false;
+		}
+		aOffset = (uint*)&apSource[table];
+		tableSize = table;
+	}
+	memset(apSource, 0, tableSize * sizeof(const jchar*));
+	if (!reserve(count * sizeof(JBItem)))
+		return false;
+	memcpy(data, first, count * sizeof(JBItem));
+	size = count * sizeof(JBItem);
+	for (uint i = 0; i < count; i++) {
+		const JBItem &src = first[i];
+		uint offset;
+#ifdef JB_KEY_STRING
+		if (src.getName()) {
+			if (!copyString(src.getName(), offset))
+				return false;
+			JBItem &dst = ((JBItem*)data)[i];
+			dst.name.o = offset - (uint)((const char*)&dst.name.o - data);
+		}
+#endif
+		if (src.getStr()) {
+			if (!copyString(src.getStr(), offset))
+				return false;
+			JBItem &dst = ((JBItem*)data)[i];
+			dst.data.s.o = offset - (uint)((const char*)&dst.data - data);
+		}
+	}
+	return true;
+}
+
+void sSection::release()
+{
+	free(data);
+	free(apSource);
+}
+
+static int compareSection(const void *a, const void *b)
+{
+	const JBSnapshotSection *sa = (const JBSnapshotSection*)a, *sb = (const JBSnapshotSection*)b;
+	if (sa->hash != sb->hash)
+		return sa->hash < sb->hash ? -1 : 1;
+	return sa->item < sb->item ? -1 : (sa->item > sb->item ? 1 : 0);
+}
+
+static uint alignUp(uint value, uint align)
+{
+	return (value + align - 1) / align * align;
+}
+
+bool JBSaveSectioned(const char *path, const JBItem *block, const JBRet *info, JBSnapshotError *error)
+{
+#ifdef JB_INLINE_STRINGS
+	(void)path; (void)block; (void)info;
+	return setError(error, JBSERR_INLINE_STRINGS);
+#else
+	if (!block || !info || !info->bin_size || !info->num_items)
+		return setError(error, JBSERR_INVALID_BLOCK);
+
+	// sections are aligned to pages and a whole number of items apart so sibling offsets still work
+	uint align = JB_SNAPSHOT_PAGE;
+	while (align % sizeof(JBItem))
+		align += JB_SNAPSHOT_PAGE;
+
+	// the root item ends where the first section starts
+	uint numSections = (uint)block->getChildCount();
+	uint index_end = sizeof(JBSnapshotHeader) + numSections * sizeof(JBSnapshotSection);
+	uint root_offset = alignUp(index_end + sizeof(JBItem), align) - sizeof(JBItem);
+
+	JBSnapshotSection *aSections = numSections ? (JBSnapshotSection*)calloc(numSections, sizeof(JBSnapshotSection)) : NULL;
+	if (numSections && !aSections)
+		return setError(error, JBSERR_OUT_OF_MEMORY);
+
+	FILE *f = NULL;
+#ifdef WIN32
+	if (fopen_s(&f, path, "wb"))
+		f = NULL;
+#else
+	f = fopen(path, "wb");
+#endif
+	if (!f) {
+		free(aSections);
+		return setError(error, JBSERR_OPEN);
+	}
+
+	// header and index are written last, start with the root item
+	JBSnapshotError result = JBSERR_NONE;
+	JBItem root = *block;
+	root.sibling = 0;
+	if (fseek(f, root_offset, SEEK_SET) || fwrite(&root, sizeof(JBItem), 1, f) != 1)
+		result = JBSERR_WRITE;
+
+	sSection section = { 0 };
+	static const char aZero[JB_SNAPSHOT_PAGE] = { 0 };
+	uint file_size = root_offset + sizeof(JBItem);
+	const JBItem *items_end = block + info->num_items;
+	uint s = 0;
+	for (const JBItem *child = block->getChild(); child && result == JBSERR_NONE; child = child->getSibling(), s++) {
+		const JBItem *next = child->getSibling();
+		uint count = (uint)((next ? next : items_end) - child);
+		if (!section.build(child, count)) {
+			result = JBSERR_OUT_OF_MEMORY;
+			break;
+		}
+		uint section_end = alignUp(file_size + section.size, align);
+		if (next) {	// link to the next section
+			uint sibling = (section_end - file_size) / sizeof(JBItem);
+			if (sibling > JB_SIBLING_MAX) {
+				result = JBSERR_SECTION_RANGE;
+				break;
+			}
+			((JBItem*)section.data)->sibling = (int)sibling;
+		}
+		aSections[s].hash = child->getHash();
+		aSections[s].item = (uint)((file_size - root_offset) / sizeof(JBItem));	// position in the file, not in the source block
+		aSections[s].offset = file_size;
+		aSections[s].size = section.size;
+		if (fwrite(section.data, section.size, 1, f) != 1)
+			result = JBSERR_WRITE;
+		for (uint pad = section_end - file_size - section.size; pad && result == JBSERR_NONE; ) {
+			uint bytes = pad < JB_SNAPSHOT_PAGE ? pad : JB_SNAPSHOT_PAGE;
+			if (fwrite(aZero, bytes, 1, f) != 1)
+				result = JBSERR_WRITE;
+			pad -= bytes;
+		}
+		file_size = section_end;
+	}
+	section.release();
+	if (aSections)	// sort after the sibling links are set so items stay in document order
+		qsort(aSections, numSections, sizeof(JBSnapshotSection), compareSection);
+
+	// checksum everything after the header by reading it back
+	if (result == JBSERR_NONE) {
+		if (fflush(f) || fseek(f, sizeof(JBSnapshotHeader), SEEK_SET))
+			result = JBSERR_WRITE;
+		else if (numSections && fwrite(aSections, sizeof(JBSnapshotSection), numSections, f) != numSections)
+			result = JBSERR_WRITE;
+	}
+	free(aSections);
+	if (result == JBSERR_NONE) {
+		fclose(f);
+		FILE *r = NULL;
+#ifdef WIN32
+		if (fopen_s(&r, path, "r+b"))
+			r = NULL;
+#else
+		r = fopen(path, "r+b");
+#endif
+		if (!r)
+			return setError(error, JBSERR_OPEN);
+		uint checksum = JB_FNV1A_SEED;
+		char buf[JB_SNAPSHOT_PAGE];
+		fseek(r, sizeof(JBSnapshotHeader), SEEK_SET);
+		for (uint left = file_size - sizeof(JBSnapshotHeader); left && result == JBSERR_NONE; ) {
+			uint bytes = left < sizeof(buf) ? left : (uint)sizeof(buf);
+			if (fread(buf, bytes, 1, r) != 1)
+				result = JBSERR_WRITE;
+			checksum = JBSnapshotChecksum(buf, bytes, checksum);
+			left -= bytes;
+		}
+		JBSnapshotHeader header;
+		JBSnapshotInitHeader(header, file_size - root_offset, info->num_items, checksum, JB_SNAPSHOT_SECTIONED_VERSION);
+		header.header_size = root_offset;
+		header.num_sections = numSections;
+		if (result == JBSERR_NONE && (fseek(r, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, r) != 1))
+			result = JBSERR_WRITE;
+		if (fclose(r))
+			result = JBSERR_WRITE;
+	} else
+		fclose(f);
+	return setError(error, result);
+#endif
+}
+
+bool JBSectioned::open(const char *path, JBSnapshotError *error, bool verify)
+{
+	close();
+	size_t mapped_size;
+	const char *mapped = mapFile(path, mapped_size, error);
+	if (!mapped)
+		return false;
+	const JBSnapshotHeader &header = *(const JBSnapshotHeader*)mapped;
+	JBSnapshotError result = JBSnapshotCheckHeader(header, JB_SNAPSHOT_SECTIONED_VERSION);
+	if (result == JBSERR_NONE && mapped_size != (size_t)header.header_size + header.block_size)
+		result = JBSERR_SIZE;
+	if (result == JBSERR_NONE && verify &&
+		JBSnapshotChecksum(mapped + sizeof(JBSnapshotHeader), (uint)mapped_size - sizeof(JBSnapshotHeader)) != header.checksum)
+		result = JBSERR_CHECKSUM;
+	if (result != JBSERR_NONE) {
+		unmapFile(mapped, mapped_size);
+		return setError(error, result);
+	}
+	base = mapped;
+	size = (uint)mapped_size;
+	aSections = (const JBSnapshotSection*)(mapped + sizeof(JBSnapshotHeader));
+	numSections = (int)header.num_sections;
+	return setError(error, JBSERR_NONE);
+}
+
+void JBSectioned::close()
+{
+	if (base)
+		unmapFile(base, size);
+	base = NULL;
+	size = 0;
+	aSections = NULL;
+	numSections = 0;
+}
+
+const JBItem* JBSectioned::root() const
+{
+	return base ? (const JBItem*)(base + ((const JBSnapshotHeader*)base)->header_size) : NULL;
+}
+
+const JBItem* JBSectioned::section(int index) const
+{
+	return (base && index >= 0 && index < numSections) ? root() + aSections[index].item : NULL;
+}
+
+const JBItem* JBSectioned::findByHash(unsigned int hash) const
+{
+	int low = 0, high = numSections;
+	while (low < high) {	// first entry with this hash, entries with equal hashes are in document order
+		int mid = (low + high) / 2;
+		if (aSections[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return (low < numSections && aSections[low].hash == hash) ? section(low) : NULL;
+}
+
+}	// namespace jbin
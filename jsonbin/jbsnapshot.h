@@ -0,0 +1,139 @@
+#ifndef __JBSNAPSHOT_H__
+#define __JBSNAPSHOT_H__
+
+//
+// JBSnapshot
+//
+// Summary
+//	- Saves a block returned by JSONBin to a binary file and loads it back
+//		without parsing, either memory mapped read-only or into allocated memory.
+//	- The file starts with a header that identifies the format and the compiled
+//		traits of the program that saved it, a file saved with different traits,
+//		item size or byte order is refused instead of misread.
+//
+// Usage
+//	- Save after parsing:
+//		JBRet ret; JBItem *pJSON = JSONBin(json, size, &ret);
+//		JBSave("file.jbin", pJSON, &ret);	// ret supplies block size and item count
+//	- Load memory mapped (no copy, pages are read as they are accessed):
+//		const JBItem *pJSON = JBLoadMapped("file.jbin");
+//		... JBUnloadMapped(pJSON);
+//	- Load into allocated memory (release with free like JSONBin data):
+//		JBItem *pJSON = JBLoad("file.jbin");
+//	- Pass a JBSnapshotError pointer to find out why a call failed, pass
+//		verify = true to check the block checksum while loading (reads the
+//		entire file, off by default so mapping stays free).
+//	- Sectioned snapshots for partial paging of large files:
+//		JBSaveSectioned("file.jbsec", pJSON, &ret) gives each child of the root
+//		its own page aligned section with its own strings, and writes an index
+//		of key hash to section after the header.
+//		JBSectioned doc; doc.open("file.jbsec"); maps the file and
+//		doc.findByHash(hash) finds a child of the root through the index so only
+//		the header and the sections that are used are paged in. doc.root() is a
+//		regular block (JBItem::findByHash on it works but touches every section).
+//
+// Notes
+//	- Requires relocatable data, JB_INLINE_STRINGS builds can not save snapshots.
+//	- JB_DEFERRED items refer to the original text and are not meaningful in a
+//		snapshot, save fully parsed blocks.
+//	- Memory mapping uses mmap on POSIX systems and file mapping objects on Windows.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+#define JB_SNAPSHOT_MAGIC "JBIN"
+#define JB_SNAPSHOT_VERSION 1
+#define JB_SNAPSHOT_SECTIONED_VERSION 2	// JBSaveSectioned files
+#define JB_SNAPSHOT_ENDIAN 0x01020304	// written in native byte order
+
+// trait bits in the snapshot header, saved and loaded files must match
+enum {
+	JBS_TRAIT_KEY_HASH = 1,
+	JBS_TRAIT_KEY_STRING = 2,
+	JBS_TRAIT_64BIT_VALUES = 4,
+	JBS_TRAIT_STRLEN = 8,
+	JBS_TRAIT_WCHAR16 = 16,
+};
+
+// ERROR CODES (JBSave / JBLoad / JBLoadMapped)
+enum JBSnapshotError {
+	JBSERR_NONE = 0,			// no error, must be 0
+	JBSERR_INVALID_BLOCK,		// no block or JBRet passed to JBSave
+	JBSERR_INLINE_STRINGS,		// JB_INLINE_STRINGS data is not relocatable
+	JBSERR_OPEN,				// file could not be opened or created
+	JBSERR_WRITE,				// file could not be written
+	JBSERR_READ,				// file could not be read or mapped
+	JBSERR_NOT_SNAPSHOT,		// file does not start with a snapshot header
+	JBSERR_VERSION,				// snapshot was saved with a different format version
+	JBSERR_TRAITS,				// snapshot was saved with different compiled traits or item size
+	JBSERR_ENDIAN,				// snapshot was saved with a different byte order
+	JBSERR_SIZE,				// file size does not match the header
+	JBSERR_CHECKSUM,			// block checksum does not match the header
+	JBSERR_OUT_OF_MEMORY,		// JBLoad could not allocate the block
+	JBSERR_SECTION_RANGE,		// sections too far apart for a sibling offset (see JBItem::sibling)
+};
+
+// 64 bytes, keeps the block that follows aligned
+struct JBSnapshotHeader {
+	char magic[4];				// JB_SNAPSHOT_MAGIC
+	unsigned int version;		// JB_SNAPSHOT_VERSION
+	unsigned int endian;		// JB_SNAPSHOT_ENDIAN
+	unsigned int traits;		// JBS_TRAIT_* bits
+	unsigned int item_size;		// sizeof(JBItem)
+	unsigned int header_size;	// offset of the block in the file
+	unsigned int block_size;	// bytes of items and strings (JBRet::bin_size)
+	unsigned int num_items;		// JBRet::num_items
+	unsigned int checksum;		// JBSnapshotChecksum of the block (sectioned: everything after the header)
+	unsigned int num_sections;	// sectioned: number of JBSnapshotSection entries following the header
+	unsigned int source_hash;	// JBSnapshotChecksum of the JSON text the block was parsed from (0 if unknown)
+	unsigned int reserved[5];
+};
+
+// sectioned snapshot index entry, sorted by hash then item
+struct JBSnapshotSection {
+	unsigned int hash;			// key hash of the root child (0 for array elements)
+	unsigned int item;			// item index of the root child relative to the root item in the file
+	unsigned int offset;		// file offset of the section (page aligned)
+	unsigned int size;			// bytes of items and strings in the section
+};
+
+bool JBSave(const char *path, const JBItem *block, const JBRet *info, JBSnapshotError *error = 0);
+JBItem* JBLoad(const char *path, JBSnapshotError *error = 0, bool verify = false);
+const JBItem* JBLoadMapped(const char *path, JBSnapshotError *error = 0, bool verify = false);
+void JBUnloadMapped(const JBItem *block);	// only for blocks returned by JBLoadMapped
+
+bool JBSaveSectioned(const char *path, const JBItem *block, const JBRet *info, JBSnapshotError *error = 0);
+
+// memory mapped sectioned snapshot
+struct JBSectioned {
+	const char *base;					// mapped file
+	unsigned int size;
+	const JBSnapshotSection *aSections;	// index following the header
+	int numSections;
+
+	JBSectioned() : base(NULL), size(0), aSections(NULL), numSections(0) {}
+	~JBSectioned() { close(); }
+	bool open(const char *path, JBSnapshotError *error = 0, bool verify = false);
+	void close();
+
+	const JBItem* root() const;
+	const JBItem* findByHash(unsigned int hash) const;	// child of the root by key hash through the index
+	const JBItem* section(int index) const;				// child of the root for an index entry
+
+private:
+	JBSectioned(const JBSectioned&);	// not copyable, the destructor unmaps the file
+	JBSectioned& operator=(const JBSectioned&);
+};
+
+// header and checksum helpers
+unsigned int JBSnapshotTraits();
+void JBSnapshotInitHeader(JBSnapshotHeader &header, unsigned int block_size, unsigned int num_items, unsigned int checksum, unsigned int version = JB_SNAPSHOT_VERSION);
+JBSnapshotError JBSnapshotCheckHeader(const JBSnapshotHeader &header, unsigned int version = JB_SNAPSHOT_VERSION);
+unsigned int JBSnapshotChecksum(const void *data, unsigned int size, unsigned int checksum = JB_FNV1A_SEED);
+
+}	// namespace jbin
+
+#endif
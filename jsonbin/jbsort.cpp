@@ -0,0 +1,417 @@
+//
+// JBSortArray / JBGroupBy
+//
+// Details in jbsort.h
+//
+
+#include <stdio.h>	// snprintf
+#include <stdlib.h>	// malloc/free, strtod
+#include <string.h>	// memcpy
+#include "jbsort.h"
+#include "jbbuilder.h"
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+#define JB_SIBLING_MAX ((1 << 23) - 1)	// largest offset that fits in JBItem::sibling
+#define JB_SORT_INSERTION 16	// keys sorted by insertion before merging
+#define JB_SORT_MIN_RUN 1024	// fewest keys sorted on a thread of its own
+
+// order of values of different types
+enum {
+	SORT_NUMBER,
+	SORT_STRING,
+	SORT_FALSE,
+	SORT_TRUE,
+	SORT_NULL,
+	SORT_CONTAINER,		// objects and arrays
+	SORT_MISSING,		// not an object or no value for the key
+};
+
+struct sSortKey {
+	const JBItem *element;
+	const jchar *str;	// SORT_STRING, NULL if empty
+	double num;			// SORT_NUMBER
+	jbint i;
+	bool isInt;
+	uint len;
+	uint rank;
+	uint count;			// items in the element
+	uint dest;			// item index of the element in the sorted block
+};
+
+static void readKey(const JBItem *value, sSortKey &key)
+{
+	key.str = NULL;
+	key.num = 0.0;
+	key.i = 0;
+	key.isInt = false;
+	key.len = 0;
+	switch (value ? value->getType() : JB_NULL) {
+		case JB_INT:
+			key.rank = SORT_NUMBER;
+			key.i = value->getInt();
+			key.num = (double)key.i;
+			key.isInt = true;
+			return;
+		case JB_FLOAT:
+			key.rank = SORT_NUMBER;
+			key.num = (double)value->getFloat();
+			return;
+		case JB_STRING:
+			key.rank = SORT_STRING;
+			if ((key.str = value->getStr()))
+				key.len = value->getStrLen();
+			return;
+		case JB_BOOL:
+			key.rank = value->getBool() ? SORT_TRUE : SORT_FALSE;
+			return;
+		case JB_ROOT:
+		case JB_OBJECT:
+		case JB_ARRAY:
+			key.rank = SORT_CONTAINER;
+			return;
+		default:
+			key.rank = value ? SORT_NULL : SORT_MISSING;
+			return;
+	}
+}
+
+static int compareValues(const sSortKey &a, const sSortKey &b)
+{
+	if (a.rank != b.rank)
+		return a.rank < b.rank ? -1 : 1;
+	if (a.rank == SORT_NUMBER) {
+		if (a.isInt && b.isInt)
+			return a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+		return a.num < b.num ? -1 : (a.num > b.num ? 1 : 0);
+	}
+	if (a.rank == SORT_STRING) {
+		uint len = a.len < b.len ? a.len : b.len;
+		for (uint c = 0; c < len; c++) {
+			if (a.str[c] != b.str[c])	// sign extended chars keep the order of the bytes
+				return (uint)a.str[c] < (uint)b.str[c] ? -1 : 1;
+		}
+		return a.len < b.len ? -1 : (a.len > b.len ? 1 : 0);
+	}
+	return 0;
+}
+
+// elements without the key stay last in descending order
+static int compareKeys(const sSortKey &a, const sSortKey &b, bool descending)
+{
+	int order = compareValues(a, b);
+	return (descending && a.rank != SORT_MISSING && b.rank != SORT_MISSING) ? -order : order;
+}
+
+static void mergeKeys(const sSortKey *a, uint numA, const sSortKey *b, uint numB, sSortKey *out, bool descending)
+{
+	while (numA && numB) {
+		if (compareKeys(*b, *a, descending) < 0) {	// equal keys take a first to keep the order
+			*out++ = *b++;
+			numB--;
+		} else {
+			*out++ = *a++;
+			numA--;
+		}
+	}
+	memcpy(out, a, numA * sizeof(sSortKey));
+	memcpy(out + numA, b, numB * sizeof(sSortKey));
+}
+
+// stable sort of count keys, temp has room for count keys
+static void sortKeys(sSortKey *aKeys, sSortKey *aTemp, uint count, bool descending)
+{
+	for (uint first = 0; first < count; first += JB_SORT_INSERTION) {
+		uint end = first + JB_SORT_INSERTION < count ? first + JB_SORT_INSERTION : count;
+		for (uint k = first + 1; k < end; k++) {
+			sSortKey key = aKeys[k];
+			uint slot = k;
+			for (; slot > first && compareKeys(key, aKeys[slot - 1], descending) < 0; slot--)
+				aKeys[slot] = aKeys[slot - 1];
+			aKeys[slot] = key;
+		}
+	}
+	sSortKey *src = aKeys, *dst = aTemp;
+	for (uint width = JB_SORT_INSERTION; width < count; width *= 2) {
+		for (uint first = 0; first < count; first += 2 * width) {
+			uint mid = first + width < count ? first + width : count;
+			uint end = mid + width < count ? mid + width : count;
+			mergeKeys(src + first, mid - first, src + mid, end - mid, dst + first, descending);
+		}
+		sSortKey *swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != aKeys)
+		memcpy(aKeys, src, count * sizeof(sSortKey));
+}
+
+//
+// Parallel sorting
+//
+
+struct sSortParallel {
+	sSortKey *aKeys;
+	sSortKey *aTemp;
+	sSortKey *src;				// merge round input
+	sSortKey *dst;
+	uint count;
+	uint keyHash;
+	bool descending;
+	uint aRuns[JB_MAX_THREADS + 1];	// first key of each sorted run and count
+	uint numRuns;
+	JBItem *pBlock;				// placing elements
+	const JBItem *aSource;
+};
+
+static void readKeys(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sSortParallel &parallel = *(sSortParallel*)user;
+	for (uint k = first; k < end; k++) {
+		sSortKey &key = parallel.aKeys[k];
+		const JBItem *element = key.element;
+		if (!parallel.keyHash)
+			readKey(element, key);
+		else {
+			JBType type = element->getType();
+			readKey((type == JB_OBJECT || type == JB_ROOT) ? element->findByHash(parallel.keyHash) : NULL, key);
+		}
+	}
+}
+
+static void sortRuns(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sSortParallel &parallel = *(sSortParallel*)user;
+	for (uint r = first; r < end; r++) {
+		uint start = parallel.aRuns[r];
+		sortKeys(parallel.aKeys + start, parallel.aTemp + start, parallel.aRuns[r + 1] - start, parallel.descending);
+	}
+}
+
+// merge pairs of runs from src to dst
+static void mergeRuns(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sSortParallel &parallel = *(sSortParallel*)user;
+	for (uint p = first; p < end; p++) {
+		uint start = parallel.aRuns[2 * p];
+		uint mid = parallel.aRuns[2 * p + 1 < parallel.numRuns ? 2 * p + 1 : parallel.numRuns];
+		uint stop = parallel.aRuns[2 * p + 2 < parallel.numRuns ? 2 * p + 2 : parallel.numRuns];
+		mergeKeys(parallel.src + start, mid - start, parallel.src + mid, stop - mid, parallel.dst + start, parallel.descending);
+	}
+}
+
+// keys of the elements of an array in sorted order, NULL if out of memory (free parallel.aKeys and aTemp)
+static sSortKey* sortElements(sSortParallel &parallel, const JBItem *array, uint keyHash, bool descending, uint threads)
+{
+	uint count = (uint)array->getChildCount();
+	parallel.count = count;
+	parallel.keyHash = keyHash;
+	parallel.descending = descending;
+	parallel.aKeys = (sSortKey*)malloc((count ? count : 1) * sizeof(sSortKey));
+	parallel.aTemp = (sSortKey*)malloc((count ? count : 1) * sizeof(sSortKey));
+	if (!parallel.aKeys || !parallel.aTemp)
+		return NULL;
+
+	// elements and their sizes in order
+	uint k = 0;
+	for (const JBItem *element = array->getChild(); element && k < count; element = element->getSibling()) {
+		sSortKey &key = parallel.aKeys[k++];
+		key.element = element;
+		key.count = element->sibling ? (uint)element->sibling : (uint)(JBSubtreeLast(element) - element) + 1;
+	}
+	parallel.count = count = k;
+	if (threads < 1)
+		threads = 1;
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+	JBParallelFor(count, threads, readKeys, &parallel);
+
+	// sort a run on each thread, then merge pairs of runs until one is left
+	uint numRuns = threads;
+	while (numRuns > 1 && count / numRuns < JB_SORT_MIN_RUN)
+		numRuns--;
+	for (uint r = 0; r <= numRuns; r++)
+		parallel.aRuns[r] = (uint)((unsigned long long)count * r / numRuns);
+	parallel.numRuns = numRuns;
+	JBParallelFor(numRuns, numRuns, sortRuns, &parallel);
+	parallel.src = parallel.aKeys;
+	parallel.dst = parallel.aTemp;
+	while (parallel.numRuns > 1) {
+		uint pairs = (parallel.numRuns + 1) / 2;
+		JBParallelFor(pairs, pairs, mergeRuns, &parallel);
+		for (uint r = 0; r < pairs; r++)
+			parallel.aRuns[r] = parallel.aRuns[2 * r];
+		parallel.aRuns[pairs] = count;
+		parallel.numRuns = pairs;
+		sSortKey *swap = parallel.src;
+		parallel.src = parallel.dst;
+		parallel.dst = swap;
+	}
+	return parallel.src;
+}
+
+//
+// Sorted block
+//
+
+// copy elements from the extracted items to their sorted places
+static void placeElements(void *user, uint first, uint end, uint thread)
+{
+	(void)thread;
+	sSortParallel &parallel = *(sSortParallel*)user;
+	for (uint k = first; k < end; k++) {
+		const sSortKey &key = parallel.src[k];
+		uint from = (uint)(key.element - parallel.pBlock);
+		JBItem *dest = parallel.pBlock + key.dest;
+		memcpy(dest, parallel.aSource + from, key.count * sizeof(JBItem));
+#ifndef JB_INLINE_STRINGS
+		if (from != key.dest) {	// string offsets are relative to the item, the table does not move
+			uint delta = (from - key.dest) * (uint)sizeof(JBItem);
+			for (uint i = 0; i < key.count; i++) {
+				JBItem &item = dest[i];
+#ifdef JB_KEY_STRING
+				if (item.name.o)
+					item.name.o += delta;
+#endif
+				if (item.type == JB_STRING && item.data.s.o)
+					item.data.s.o += delta;
+			}
+		}
+#endif
+		dest->sibling = k + 1 < parallel.count ? (int)key.count : 0;
+	}
+}
+
+JBItem* JBSortArray(const JBItem *array, unsigned int keyHash, JBSortOrder order, unsigned int threads, JBRet *info)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+	if (!array || array->getType() != JB_ARRAY)
+		return NULL;
+	JBRet ret;
+	JBItem *pRet = JBExtract(array, &ret);
+	if (!pRet) {
+		if (info)
+			info->error_code = ret.error_code;
+		return NULL;
+	}
+
+	sSortParallel parallel;
+	JBError error = JBERR_NONE;
+	JBItem *aSource = NULL;
+	sSortKey *aSorted = sortElements(parallel, pRet, keyHash, order == JBSORT_DESCENDING, threads);
+	if (!aSorted || !(aSource = (JBItem*)malloc(ret.num_items * sizeof(JBItem))))
+		error = JBERR_OUT_OF_MEMORY;
+	else {
+		uint dest = 1;
+		for (uint k = 0; k < parallel.count; k++) {
+			if (aSorted[k].count > JB_SIBLING_MAX && k + 1 < parallel.count)
+				error = JBERR_UNREPRESENTABLE;
+			aSorted[k].dest = dest;
+			dest += aSorted[k].count;
+		}
+	}
+	if (!error) {
+		memcpy(aSource, pRet, ret.num_items * sizeof(JBItem));
+		parallel.pBlock = pRet;
+		parallel.aSource = aSource;
+		JBParallelFor(parallel.count, threads, placeElements, &parallel);
+	}
+	free(aSource);
+	free(parallel.aKeys);
+	free(parallel.aTemp);
+	if (error) {
+		free(pRet);
+		if (info)
+			info->error_code = error;
+		return NULL;
+	}
+	if (info)
+		*info = ret;
+	return pRet;
+}
+
+//
+// Groups
+//
+
+// member name of a group, buf has room for 32 characters
+static const jchar* groupName(const sSortKey &key, jchar *buf, uint &len)
+{
+	char text[32];
+	switch (key.rank) {
+		case SORT_STRING:
+			len = key.len;
+			if (key.str)
+				return key.str;
+			buf[0] = 0;
+			return buf;
+		case SORT_NUMBER:
+			if (key.isInt)
+				snprintf(text, sizeof(text), "%lld", (long long)key.i);
+			else {
+				for (int precision = 6; precision <= 17; precision++) {	// shortest text that reads back the same
+					snprintf(text, sizeof(text), "%.*g", precision, key.num);
+					if (strtod(text, NULL) == key.num)
+						break;
+				}
+			}
+			break;
+		case SORT_FALSE:
+			strcpy(text, "false");
+			break;
+		case SORT_TRUE:
+			strcpy(text, "true");
+			break;
+		default:
+			strcpy(text, "null");
+			break;
+	}
+	for (len = 0; text[len]; len++)
+		buf[len] = (jchar)text[len];
+	buf[len] = 0;
+	return buf;
+}
+
+JBItem* JBGroupBy(const JBItem *array, unsigned int keyHash, unsigned int threads, JBRet *info)
+{
+	if (info)
+		memset(info, 0, sizeof(JBRet));
+	if (!array || array->getType() != JB_ARRAY)
+		return NULL;
+
+	// stable sort so equal values are next to each other in their original order
+	sSortParallel parallel;
+	sSortKey *aSorted = sortElements(parallel, array, keyHash, false, threads);
+	JBItem *pRet = NULL;
+	if (aSorted) {
+		JBBuilder build;
+		build.begin(JB_ROOT);
+		jchar buf[32];
+		for (uint k = 0; k < parallel.count && aSorted[k].rank < SORT_CONTAINER;) {
+			const sSortKey &group = aSorted[k];
+			uint len;
+			const jchar *name = groupName(group, buf, len);
+			build.key(name, len);
+			build.open(JB_ARRAY);
+			do
+				build.copy(aSorted[k++].element);
+			while (k < parallel.count && !compareValues(aSorted[k], group));
+			build.close();
+		}
+		pRet = build.finish(info);
+	}
+	free(parallel.aKeys);
+	free(parallel.aTemp);
+	if (!pRet && info)
+		info->error_code = JBERR_OUT_OF_MEMORY;
+	return pRet;
+}
+
+}	// namespace jbin
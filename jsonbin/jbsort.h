@@ -0,0 +1,72 @@
+#ifndef __JBSORT_H__
+#define __JBSORT_H__
+
+//
+// JBSortArray / JBGroupBy
+//
+// Summary
+//	- Sorts the elements of an array (usually an array of objects, by the
+//		value of one key) into a new block without writing JSON text or
+//		building application structures.
+//	- Groups the elements of an array by the value of a key into a root
+//		object of arrays.
+//	- The sort keys are read into a compact array and sorted with a merge
+//		sort on several threads, the elements are then copied to their new
+//		places on several threads.
+//
+// Usage
+//	- Sort records by a key, the result is a root array:
+//		const JBItem *pRecords = pJSON->findByHash(JBHashKey("records", 7));
+//		JBItem *pSorted = JBSortArray(pRecords, JBHashKey("speed", 5), JBSORT_DESCENDING, JBHardwareThreads(), &ret);
+//	- Sort an array of numbers or strings by the values themselves:
+//		JBItem *pSorted = JBSortArray(pNames, 0);
+//	- Group records by a key, the result is a root object with an array
+//		member for each value of the key:
+//		JBItem *pByKind = JBGroupBy(pRecords, JBHashKey("kind", 4), JBHardwareThreads(), &ret);
+//		const JBItem *pCrates = pByKind->findByHash(JBHashKey("crate", 5));
+//	- Release the results with free like JSONBin data.
+//
+// Notes
+//	- Values compare as numbers (int and float by value), then strings (by
+//		character codes, which is code point order for utf-8), then false,
+//		true, null, and objects and arrays which are all equal. Elements that
+//		are not objects or do not have the key come last, also in descending
+//		order. The sort is stable so equal elements keep their order.
+//	- keyHash 0 sorts by the element values (0 is also the hash of an empty
+//		key, which can not be used as a sort key).
+//	- JBSortArray cuts the array out of its block with JBExtract and moves the
+//		elements in the new block, only string offsets are adjusted so the
+//		string table of the extract is kept as is.
+//	- JBGroupBy members are in the sort order of their values and the
+//		elements of each group keep their order. A member is named by the text
+//		of the value (numbers printed, "true", "false" or "null"), so a string
+//		"1" and the number 1 are two members with the same name. Elements
+//		without the key or with an object or array value are left out. The
+//		groups are built with JBBuilder which matches strings by text.
+//	- Both return NULL if the item is not an array, out of memory (info
+//		error_code JBERR_OUT_OF_MEMORY) or if an element can not be moved
+//		(JBERR_UNREPRESENTABLE).
+//	- Blocks with shared subtrees (JB_SHARED_SUBTREES) can not be copied.
+//	- Requires jbbuilder.cpp and jbthreads.cpp.
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+
+namespace jbin {
+
+enum JBSortOrder {
+	JBSORT_ASCENDING,
+	JBSORT_DESCENDING,
+};
+
+// new root array with the elements of an array sorted by the value of a key (0 = the element values)
+JBItem* JBSortArray(const JBItem *array, unsigned int keyHash, JBSortOrder order = JBSORT_ASCENDING,
+	unsigned int threads = 1, JBRet *info = 0);
+
+// new root object with an array of the elements for each value of a key
+JBItem* JBGroupBy(const JBItem *array, unsigned int keyHash, unsigned int threads = 1, JBRet *info = 0);
+
+}	// namespace jbin
+
+#endif
@@ -0,0 +1,103 @@
+//
+// JBParallelFor
+//
+// Details in jbthreads.h
+//
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// CreateThread
+#else
+#include <pthread.h>	// pthread_create
+#include <unistd.h>		// sysconf
+#endif
+#include "jbthreads.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+
+struct sRange {
+	JBRangeFunc func;
+	void *user;
+	uint first;
+	uint end;
+	uint thread;
+};
+
+#ifdef WIN32
+static DWORD WINAPI runRange(LPVOID param)
+#else
+static void* runRange(void *param)
+#endif
+{
+	sRange *range = (sRange*)param;
+	range->func(range->user, range->first, range->end, range->thread);
+	return 0;
+}
+
+void JBParallelFor(uint count, uint threads, JBRangeFunc func, void *user)
+{
+	if (!count)
+		return;
+	if (threads > count)
+		threads = count;
+	if (threads > JB_MAX_THREADS)
+		threads = JB_MAX_THREADS;
+	if (threads <= 1) {
+		func(user, 0, count, 0);
+		return;
+	}
+	sRange aRanges[JB_MAX_THREADS];
+#ifdef WIN32
+	HANDLE aThreads[JB_MAX_THREADS];
+#else
+	pthread_t aThreads[JB_MAX_THREADS];
+#endif
+	bool aStarted[JB_MAX_THREADS];
+	for (uint t = 0; t < threads; t++) {
+		aRanges[t].func = func;
+		aRanges[t].user = user;
+		aRanges[t].first = (uint)((unsigned long long)count * t / threads);
+		aRanges[t].end = (uint)((unsigned long long)count * (t + 1) / threads);
+		aRanges[t].thread = t;
+		aStarted[t] = false;
+	}
+	for (uint t = 1; t < threads; t++) {
+#ifdef WIN32
+		aThreads[t] = CreateThread(NULL, 0, runRange, &aRanges[t], 0, NULL);
+		aStarted[t] = aThreads[t] != NULL;
+#else
+		aStarted[t] = !pthread_create(&aThreads[t], NULL, runRange, &aRanges[t]);
+#endif
+	}
+	runRange(&aRanges[0]);
+	for (uint t = 1; t < threads; t++) {
+		if (!aStarted[t])
+			runRange(&aRanges[t]);
+	}
+	for (uint t = 1; t < threads; t++) {
+		if (aStarted[t]) {
+#ifdef WIN32
+			WaitForSingleObject(aThreads[t], INFINITE);
+			CloseHandle(aThreads[t]);
+#else
+			pthread_join(aThreads[t], NULL);
+#endif
+		}
+	}
+}
+
+unsigned int JBHardwareThreads()
+{
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (uint)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint)count : 1;
+#endif
+}
+
+}	// namespace jbin
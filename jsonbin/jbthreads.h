@@ -0,0 +1,44 @@
+#ifndef __JBTHREADS_H__
+#define __JBTHREADS_H__
+
+//
+// JBParallelFor
+//
+// Summary
+//	- Splits a count of work units into ranges and runs a function on each
+//		range on its own thread, for the modules that process large blocks in
+//		parallel (columns, indexes, sorting, line ingest).
+//
+// Usage
+//	- Write a range function and pass a pointer to the shared state:
+//		static void scale(void *user, unsigned int first, unsigned int end, unsigned int thread)
+//		{ for (unsigned int i = first; i < end; i++) ((float*)user)[i] *= 2.0f; }
+//		JBParallelFor(count, JBHardwareThreads(), scale, aValues);
+//	- thread is the range index (0 to threads - 1), use it to index per
+//		thread state such as partial results.
+//
+// Notes
+//	- Range 0 runs on the calling thread and JBParallelFor returns when all
+//		ranges are done. threads is clamped to count and to JB_MAX_THREADS.
+//	- A range that can not get a thread runs on the calling thread after the
+//		others have started, the result is the same.
+//	- Uses pthreads on POSIX systems and CreateThread on Windows.
+//
+
+namespace jbin {
+
+#ifndef JB_MAX_THREADS
+#define JB_MAX_THREADS 64
+#endif
+
+typedef void (*JBRangeFunc)(void *user, unsigned int first, unsigned int end, unsigned int thread);
+
+// run func over [0, count) split into threads ranges of about the same size
+void JBParallelFor(unsigned int count, unsigned int threads, JBRangeFunc func, void *user);
+
+// number of threads the system can run at once (at least 1)
+unsigned int JBHardwareThreads();
+
+}	// namespace jbin
+
+#endif
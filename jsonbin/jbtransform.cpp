@@ -0,0 +1,347 @@
+//
+// JBTransform
+//
+// Details in jbtransform.h
+//
+
+#include <stdlib.h>	// malloc/free
+#include <string.h>	// memchr
+#ifdef WIN32
+#include <windows.h>	// CreateFileMapping / MapViewOfFile
+#else
+#include <fcntl.h>		// open
+#include <unistd.h>		// close
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#endif
+#include "jbtransform.h"
+#include "../jsonout/jsonout.h"
+
+namespace jbin {
+
+typedef unsigned int uint;
+typedef unsigned long long ull;
+
+//
+// Rules
+//
+
+JBTransform::JBTransform() : numRules(0), numSteps(0), aNames(NULL), namesSize(0), namesCap(0),
+	filter(NULL), filterUser(NULL), keyBuf(NULL), keyBufSize(0), strBuf(NULL), strBufSize(0),
+	path_error(JBQERR_NONE), error_code(JBERR_NONE), error_offset(0)
+{
+}
+
+static bool compileStep(const JBQueryStep &src, JBTransformStep &step)
+{
+	step.hash = src.hash;
+	step.index = -1;
+	step.key = false;
+	step.any = false;
+	switch (src.op) {
+		case JBQ_CHILD:
+			step.key = true;
+			step.index = src.a;	// JSON Pointer numeric segment, -1 otherwise
+			return true;
+		case JBQ_INDEX:
+			step.index = src.a;
+			return src.a >= 0;	// counting from the end needs the element count
+		case JBQ_WILDCARD:
+			step.any = true;
+			return true;
+	}
+	return false;
+}
+
+// compile a path into a rule, -1 if not supported (see path_error)
+static int addRule(JBTransform &xf, const char *path, JBTransformKind kind)
+{
+	JBQuery query;
+	if (!query.compile(path)) {
+		xf.path_error = query.last_error();
+		return -1;
+	}
+	xf.path_error = JBQERR_NONE;
+	int first = 0;
+	bool anywhere = query.numSteps == 2 && query.aSteps[0].op == JBQ_DESCENT;
+	if (anywhere)
+		first = 1;
+	if (xf.numRules >= JBTransform::MAX_RULES || xf.numSteps + query.numSteps - first > JBTransform::MAX_STEPS)
+		xf.path_error = JBQERR_TOO_MANY_STEPS;
+	else if (!query.numSteps || (anywhere && kind == JBXF_KEEP))
+		xf.path_error = JBQERR_UNSUPPORTED;	// the root itself, or keep at any depth
+	for (int s = first; !xf.path_error && s < query.numSteps; s++) {
+		if (!compileStep(query.aSteps[s], xf.aSteps[xf.numSteps + s - first]))
+			xf.path_error = JBQERR_UNSUPPORTED;
+	}
+	if (xf.path_error)
+		return -1;
+	JBTransformRule &rule = xf.aRules[xf.numRules];
+	rule.kind = kind;
+	rule.anywhere = anywhere;
+	rule.firstStep = (uint)xf.numSteps;
+	rule.numSteps = (uint)(query.numSteps - first);
+	rule.name = 0;
+	xf.numSteps += (int)rule.numSteps;
+	return xf.numRules++;
+}
+
+bool JBTransform::keep(const char *path)
+{
+	return addRule(*this, path, JBXF_KEEP) >= 0;
+}
+
+bool JBTransform::drop(const char *path)
+{
+	return addRule(*this, path, JBXF_DROP) >= 0;
+}
+
+bool JBTransform::rename(const char *path, const jchar *name)
+{
+	uint len = 0;
+	while (name && name[len])
+		len++;
+	if (namesSize + len + 1 > namesCap) {
+		uint grow = namesCap ? namesCap * 2 : 256;
+		while (grow < namesSize + len + 1)
+			grow *= 2;
+		jchar *aGrow = (jchar*)realloc(aNames, grow * sizeof(jchar));
+		if (!aGrow)
+			return false;
+		aNames = aGrow;
+		namesCap = grow;
+	}
+	int rule = addRule(*this, path, JBXF_RENAME);
+	if (rule < 0)
+		return false;
+	aRules[rule].name = namesSize;
+	for (uint c = 0; c < len; c++)
+		aNames[namesSize++] = name[c];
+	aNames[namesSize++] = 0;
+	return true;
+}
+
+void JBTransform::release()
+{
+	free(aNames);
+	free(keyBuf);
+	free(strBuf);
+	aNames = keyBuf = strBuf = NULL;
+	namesSize = namesCap = keyBufSize = strBufSize = 0;
+	numRules = numSteps = 0;
+	filter = NULL;
+	filterUser = NULL;
+}
+
+//
+// Rewriting
+//
+
+static bool stepMatch(const JBTransformStep &step, const JBToken &token, uint index, uint &hash, bool &hashed)
+{
+	if (step.any)
+		return true;
+	if (!token.name)
+		return step.index == (int)index;
+	if (!step.key)
+		return false;
+	if (!hashed) {
+		hash = token.getHash();
+		hashed = true;
+	}
+	return step.hash == hash;
+}
+
+// make room for len characters and a terminator
+static bool scratch(jchar *&buf, uint &size, uint len)
+{
+	if (len < size)
+		return true;
+	uint grow = size ? size * 2 : 256;
+	while (grow <= len)
+		grow *= 2;
+	jchar *aGrow = (jchar*)realloc(buf, grow * sizeof(jchar));
+	if (!aGrow)
+		return false;
+	buf = aGrow;
+	size = grow;
+	return true;
+}
+
+bool JBTransform::run(const char *json, unsigned int size, jout::JSONOut &out)
+{
+	ull aMask[JSON_MAX_DEPTH];		// anchored rules that lead into the object or array open at each depth
+	uint aIndex[JSON_MAX_DEPTH];	// next element index of arrays
+	bool aKept[JSON_MAX_DEPTH];		// everything inside is written
+	ull anchored = 0, anywhere = 0, keeps = 0;
+	for (int r = 0; r < numRules; r++) {
+		if (aRules[r].anywhere)
+			anywhere |= 1ULL << r;
+		else
+			anchored |= 1ULL << r;
+		if (aRules[r].kind == JBXF_KEEP)
+			keeps |= 1ULL << r;
+	}
+
+	JBTokenReader reader(json, size);
+	JBToken token;
+	error_code = JBERR_NONE;
+	error_offset = 0;
+	while (reader.next(token)) {
+		int depth = token.depth;
+		if (token.kind == JBTOK_END) {
+			if (depth && !out.scope_end())	// the root is closed by finish
+				return false;
+			continue;
+		}
+		if (!depth) {
+#ifdef JO_ALLOW_ROOT_ARRAY
+			if (token.type == JB_ARRAY && !out.inArray())
+				out.set_rootArray();
+#endif
+			aMask[0] = anchored;
+			aIndex[0] = 0;
+			aKept[0] = !keeps;
+			continue;
+		}
+
+		// rules that end at this value and rules that lead into it
+		ull parent = aMask[depth - 1] | anywhere;
+		uint index = token.name ? 0 : aIndex[depth - 1]++;
+		uint hash = 0;
+		bool hashed = false;
+		ull carry = 0, ends = 0;
+		for (int r = 0; r < numRules; r++) {
+			if (!((parent >> r) & 1))
+				continue;
+			const JBTransformRule &rule = aRules[r];
+			uint step = rule.anywhere ? 0 : (uint)depth - 1;
+			if (!stepMatch(aSteps[rule.firstStep + step], token, index, hash, hashed))
+				continue;
+			if (rule.anywhere || rule.numSteps == (uint)depth)
+				ends |= 1ULL << r;
+			else
+				carry |= 1ULL << r;
+		}
+		const jchar *rename = NULL;
+		bool dropped = false, kept = aKept[depth - 1];
+		for (int r = 0; r < numRules; r++) {
+			if ((ends >> r) & 1) {
+				if (aRules[r].kind == JBXF_DROP)
+					dropped = true;
+				else if (aRules[r].kind == JBXF_KEEP)
+					kept = true;
+				else if (!rename)
+					rename = aNames + aRules[r].name;
+			}
+		}
+		if (!dropped && !kept)
+			dropped = token.kind != JBTOK_BEGIN || !(carry & keeps);	// not on the way to a kept value
+		if (!dropped && filter)
+			dropped = !filter(token, filterUser);
+		if (dropped) {
+			if (token.kind == JBTOK_BEGIN)
+				reader.skip();
+			continue;
+		}
+
+		// write the value
+		const jchar *name = rename;
+		if (!name && token.name) {
+			uint len = token.getNameLen();
+			if (!scratch(keyBuf, keyBufSize, len)) {
+				error_code = JBERR_OUT_OF_MEMORY;
+				error_offset = reader.offset();
+				return false;
+			}
+			name = token.getName(keyBuf, len + 1);
+		}
+		bool written = false;
+		switch (token.type) {
+			case JB_OBJECT:
+				written = out.push_object(name);
+				break;
+			case JB_ARRAY:
+				written = out.push_array(name);
+				break;
+			case JB_STRING:
+#ifndef JB_WCHAR16
+				if (!memchr(token.value, '\\', token.valueLen)) {	// no escape codes, write the text as is
+					written = out.push(name, token.value, (int)token.valueLen);
+					break;
+				}
+#endif
+				{
+					uint len = token.getStrLen();
+					if (!scratch(strBuf, strBufSize, len)) {
+						error_code = JBERR_OUT_OF_MEMORY;
+						error_offset = reader.offset();
+						return false;
+					}
+					written = out.push(name, token.getStr(strBuf, len + 1), (int)len);
+				}
+				break;
+			default:	// numbers, bool and null as the original text
+				written = out.push_raw(name, token.value, (int)token.valueLen);
+				break;
+		}
+		if (!written)
+			return false;
+		if (token.kind == JBTOK_BEGIN) {
+			aMask[depth] = carry;
+			aIndex[depth] = 0;
+			aKept[depth] = kept;
+		}
+	}
+	if ((error_code = reader.error()) != JBERR_NONE) {
+		error_offset = reader.offset();
+		return false;
+	}
+	return out.finish();
+}
+
+bool JBTransform::runFile(const char *path, jout::JSONOut &out)
+{
+	size_t size = 0;
+	const char *text = NULL;
+	error_code = JBERR_NONE;
+	error_offset = 0;
+#ifdef WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && file_size.QuadPart <= 0xffffffffLL) {
+		size = (size_t)file_size.QuadPart;
+		if (HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) {
+			text = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);	// the view keeps the mapping open
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat file_stat;
+	if (!fstat(file, &file_stat) && file_stat.st_size > 0 && (unsigned long long)file_stat.st_size <= 0xffffffffULL) {
+		size = (size_t)file_stat.st_size;
+		void *pMapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+		text = pMapped != MAP_FAILED ? (const char*)pMapped : NULL;
+		if (text)
+			madvise(pMapped, size, MADV_SEQUENTIAL);	// read once front to back
+	}
+	close(file);	// the mapping stays valid after closing
+#endif
+	if (!text)
+		return false;
+	bool result = run(text, (uint)size, out);
+#ifdef WIN32
+	UnmapViewOfFile(text);
+#else
+	munmap((void*)text, size);
+#endif
+	return result;
+}
+
+}	// namespace jbin
@@ -0,0 +1,129 @@
+#ifndef __JBTRANSFORM_H__
+#define __JBTRANSFORM_H__
+
+//
+// JBTransform
+//
+// Summary
+//	- Rewrites JSON text through a set of keep, drop and rename rules and an
+//		optional filter function, from the tokens of a JBTokenReader directly
+//		to a JSONOut writer. No JBItems are built and memory does not grow
+//		with the size of the text, only with the depth and the longest key or
+//		string with escape codes.
+//	- Objects and arrays that are dropped are stepped over by matching
+//		brackets and quotes.
+//	- Numbers, true, false and null are written as the original text so
+//		values are not rounded by the rewrite.
+//
+// Usage
+//	- Add rules (JSONPath with .key, ['key'], [n] and [*] / .*, or JSON
+//		Pointer), "$..key" drops or renames a key at any depth:
+//		JBTransform xf;
+//		xf.drop("$..internal_id");
+//		xf.rename("$.records[*].spd", "speed");
+//	- Only write some values, everything else is dropped:
+//		xf.keep("$.header");
+//		xf.keep("$.records[*].speed");
+//	- Drop values with a function, return false to drop:
+//		bool noNulls(const JBToken &token, void *user) { return token.type != JB_NULL_VALUE; }
+//		xf.setFilter(noNulls, NULL);
+//	- Rewrite text in memory or a file:
+//		jout::JSONOut out(file);
+//		if (!xf.run(json, size, out))	// or xf.runFile("in.json", out)
+//			check xf.error_code / xf.error_offset and out.last_error()
+//
+// Notes
+//	- Without keep rules every value is written unless it is dropped. With
+//		keep rules a value is written if a keep rule ends at it (with all of
+//		its children) or if it is an object or array that a keep rule leads
+//		into, so objects and arrays on the way to a kept value are written
+//		even if nothing inside them is kept.
+//	- Drop rules and the filter apply everywhere, also inside kept values. A
+//		dropped value is not passed to the filter. Drop wins over keep and
+//		rename, the first matching rename rule gives the new key.
+//	- Renaming an array element has no effect, elements have no key.
+//	- run() writes a whole file and calls finish, a JSONOut that is not in an
+//		array is switched to a root array for a root array (JO_ALLOW_ROOT_ARRAY).
+//	- runFile() memory maps the file, the operating system pages the text in
+//		and out as it is read. Sizes are unsigned int so a file is limited to
+//		4 GB. If the file can not be mapped runFile() returns false with
+//		error_code JBERR_NONE.
+//	- Requires jsonout.cpp and jbquery.cpp (path compiling).
+//
+
+#include <stddef.h>	// NULL
+#include "jsonbin.h"
+#include "jbquery.h"
+
+namespace jout { struct JSONOut; }
+
+namespace jbin {
+
+enum JBTransformKind {
+	JBXF_KEEP,		// write the value and everything inside it
+	JBXF_DROP,		// do not write the value
+	JBXF_RENAME,	// write the value with a different key
+};
+
+// return false to drop a value
+typedef bool (*JBTransformFilter)(const JBToken &token, void *user);
+
+// compiled path step
+struct JBTransformStep {
+	unsigned int hash;		// key hash if key is set
+	int index;				// array element, -1 if the step does not match elements
+	bool key;				// matches an object member by hash
+	bool any;				// matches every member and element
+};
+
+struct JBTransformRule {
+	JBTransformKind kind;
+	bool anywhere;			// "$..key", a single step matched at every depth
+	unsigned int firstStep;
+	unsigned int numSteps;
+	unsigned int name;		// JBXF_RENAME, offset of the new key in aNames
+};
+
+struct JBTransform {
+	enum {
+		MAX_RULES = 64,		// rules in one transform
+		MAX_STEPS = 256,	// steps of all rules
+	};
+
+	JBTransformRule aRules[MAX_RULES];
+	JBTransformStep aSteps[MAX_STEPS];
+	int numRules;
+	int numSteps;
+	jchar *aNames;				// zero terminated new keys
+	unsigned int namesSize;
+	unsigned int namesCap;
+	JBTransformFilter filter;
+	void *filterUser;
+	jchar *keyBuf;				// decoded key scratch
+	unsigned int keyBufSize;
+	jchar *strBuf;				// decoded string scratch
+	unsigned int strBufSize;
+	JBQueryError path_error;	// error of the last rule added
+	JBError error_code;			// error of the last run
+	unsigned int error_offset;	// offset in the text where the last run stopped at an error
+
+	JBTransform();
+	~JBTransform() { release(); }
+
+	bool keep(const char *path);	// false if the path is not supported, see path_error
+	bool drop(const char *path);
+	bool rename(const char *path, const jchar *name);
+	void setFilter(JBTransformFilter func, void *user) { filter = func; filterUser = user; }
+
+	bool run(const char *json, unsigned int size, jout::JSONOut &out);	// false at a syntax error, out of memory (see error_code) or an output error
+	bool runFile(const char *path, jout::JSONOut &out);
+	void release();	// free the scratch buffers and remove the rules
+
+private:
+	JBTransform(const JBTransform&);	// not copyable, the destructor frees the names and scratch buffers
+	JBTransform& operator=(const JBTransform&);
+};
+
+}	// namespace jbin
+
+#endif
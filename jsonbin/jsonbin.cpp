@@ -11,6 +11,9 @@
 #include <math.h>	// pow
 #include <float.h> // FLT_MAX
 #include "jsonbin.h"
+#ifdef WIN32
+#include <intrin.h>	// _InterlockedCompareExchangePointer
+#endif
 
 namespace jbin {
 
@@ -94,7 +97,7 @@ struct sStrCache {
 	int findHash(uint hash); // find a string with a hash that matches the given
 	bool checkStr(const char *str, uint len, int index); // compare strings when hashes match to make sure
 	int getStringIndex(const char *str, uint len); // get the index for a given string or -1 if not found
-	void addString(const char *str, uint len); // add a string if it wasn't already added
+	bool addString(const char *str, uint len); // add a string if it wasn't already added, false if out of room
 };
 
 // global strings for json keywords
@@ -455,11 +458,13 @@ static uint commentSize(const char *comment, uint left)
 			return endOfLine(comment, left);
 		case '*':
 			while (const char *body_end = findChar(body, body_left, '*')) {
-				uint end_left = left - (uint)(body_end-body);
+				uint end_left = body_left - (uint)(body_end-body);
 				if (end_left<2)
 					return left;
 				else if (body_end[1]=='/')
 					return uint(body_end+2-comment);
+				body_left = end_left - 1;	// continue after a '*' that did not end the comment
+				body = body_end + 1;
 			}
 			break;
 	}
@@ -502,6 +507,27 @@ bool sameWord(const char *wordA, const char *wordB, int lenA)
 }
 
 #ifdef JB_KEY_HASH
+// hash a single character as utf-8 bytes
+static uint hashCode(uint hash, uint c)
+{
+	if (c < 0x80)
+		hash = JB_KEY_HASH(hash, c);
+	else if (c < 0x800) {
+		hash = JB_KEY_HASH(hash, (u8)(0xc0 | (c >> 6)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
+	} else if (c < 0x10000) {
+		hash = JB_KEY_HASH(hash, (u8)(0xc0 | (c >> 12)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 6) & 0x3f)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
+	} else {
+		hash = JB_KEY_HASH(hash, (u8)(0xc0 | ((c >> 18) & 7)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 12) & 0x3f)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 6) & 0x3f)));
+		hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
+	}
+	return hash;
+}
+
 // It is necessary to do the hashing byte by byte because the input string is a raw JSON string
 static uint hashJSONStr(const char *s, int l)
 {
@@ -511,30 +537,46 @@ static uint hashJSONStr(const char *s, int l)
 		uint c = getChar(s, l, skip);
 		s += skip;
 		l -= skip;
-		if (c < 0x80)
-			hash = JB_KEY_HASH(hash, c);
-		else if (c < 0x800) {
-			hash = JB_KEY_HASH(hash, (u8)(0xc0 | (c >> 6)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
-		} else if (c < 0x10000) {
-			hash = JB_KEY_HASH(hash, (u8)(0xc0 | (c >> 12)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 6) & 0x3f)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
-		} else {
-			hash = JB_KEY_HASH(hash, (u8)(0xc0 | ((c >> 18) & 7)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 12) & 0x3f)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | ((c >> 6) & 0x3f)));
-			hash = JB_KEY_HASH(hash, (u8)(0x80 | (c & 0x3f)));
-		}
+		hash = hashCode(hash, c);
 	}
 	return hash;
 }
 
 #endif
 
+// hash a plain utf-8 key (no JSON escape codes) to match JBItem::getHash()
+unsigned int JBHashKey(const char *key, unsigned int len)
+{
+#ifdef JB_KEY_HASH
+	uint hash = JB_KEY_HASH_PRIME;
+	while (len) {
+		uint c = (u8)*key;
+		uint code_len = 1;
+		if (c >= 0xc0 && c < 0xf8) {	// decode utf-8 sequence the same way getChar does
+			uint total = c >= 0xf0 ? 4 : (c >= 0xe0 ? 3 : 2);
+			uint c8 = c & (0x7f >> total);
+			uint n = 1;
+			for (; n < total && n < len && ((u8)key[n] & 0xc0) == 0x80; n++)
+				c8 = (c8 << 6) | ((u8)key[n] & 0x3f);
+			if (n == total) {
+				c = c8;
+				code_len = total;
+			}
+		}
+		hash = hashCode(hash, c);
+		key += code_len;
+		len -= code_len;
+	}
+	return hash;
+#else
+	return fnv1A(key, len);
+#endif
+}
+
 const JBItem* JBItem::findByHash(unsigned int hash) const
 {
-	if ((type == JB_OBJECT || type == JB_ROOT) && data.i) {
+	JBType object = getType();
+	if ((object == JB_OBJECT || object == JB_ROOT) && getChildCount()) {
 		for (const JBItem *i = getChild(); i; i = i->getSibling())
 			if (i->getHash() == hash)
 				return i;
@@ -542,6 +584,34 @@ const JBItem* JBItem::findByHash(unsigned int hash) const
 	return NULL;
 }
 
+const JBItem* JBFieldCache::find(const JBItem *object)
+{
+	JBType type = object ? object->getType() : JB_NULL;
+	if (type != JB_OBJECT && type != JB_ROOT)
+		return NULL;
+	uint count = (uint)object->getChildCount();
+	if (slot < count) {
+		const JBItem *child;
+		if (object->type == type && object->sibling == (int)count + 1)	// no member has children
+			child = object + 1 + slot;
+		else {
+			child = object->getChild();
+			for (uint s = slot; s; s--)
+				child = child->getSibling();
+		}
+		if (child->getHash() == hash)
+			return child;
+	}
+	uint index = 0;
+	for (const JBItem *i = object->getChild(); i; i = i->getSibling(), index++) {
+		if (i->getHash() == hash) {
+			slot = index;
+			return i;
+		}
+	}
+	return NULL;
+}
+
 //
 // String Cache Operations
 //
@@ -586,7 +656,7 @@ int sStrCache::getStringIndex(const char *str, uint len)
 }
 
 // add a string if it wasn't already to the string cache
-void sStrCache::addString(const char *str, uint len)
+bool sStrCache::addString(const char *str, uint len)
 {
 	uint hash = fnv1A(str, len);
 	int element = 0;
@@ -598,6 +668,8 @@ void sStrCache::addString(const char *str, uint len)
 		}
 	}
 	if (!element) {
+		if (numStr >= numStrMax)
+			return false;
 		int slot = (hash ^ (hash >> 16 | hash << 16)) % hashTableSize;
 		int insert = numStr++;
 		aHashLinks[insert].hash = hash;
@@ -606,6 +678,7 @@ void sStrCache::addString(const char *str, uint len)
 		apStrings[insert] = str;
 		aStrLen[insert] = len;
 	}
+	return true;
 }
 
 //
@@ -638,46 +711,378 @@ void JBParse::step_value(JBType type) {
 #define JB_QUOTE_FIND '"'
 #endif
 
-// convert a text based json file to a binary representation
-JBItem* JSONBin(const char *json, uint size, JBRet *info)
+// count the strings in a range of JSON text to size the string cache
+static int countStrings(const char *json, uint size, uint &string_size_orig)
 {
-	JBParse read = { 0 };	// clear all members of parsing struct
-	JBItem *pRet = NULL;	// return data pointer
-	JBError error = JBERR_NONE;
+	int numStr = 0;
+	const char *quote_str = json;
+	uint quote_left = size;
+	while (const char *quote_next = findChar(quote_str, quote_left, JB_QUOTE_FIND)) {	// find start of a quote
+#ifdef JB_ALLOW_C_COMMENTS
+		if (*quote_next=='/' && (quote_next[1]=='/' || quote_next[1]=='*')) {
+			uint skip = (uint)(quote_next-quote_str);
+			text_skip(quote_str, quote_left, skip + commentSize(quote_next, quote_left - skip));
+		} else
+#endif
+		{
+			quote_left -= (uint)(quote_next - quote_str);
+			quote_str = quote_next;
+			if (const char *quote_end = quoteEnd(quote_str, quote_left)) {
+				numStr++;
+				quote_end++;
+				uint quote_len = (uint)(quote_end - quote_str);
+				string_size_orig += quote_len;
+				quote_left -= quote_len;
+				quote_str = quote_end;
+			}
+		}
+	}
+	return numStr;
+}
+
+//
+// Selective parsing (JSONBinSelect)
+//
+
+// path trie node, children of a node are the next steps of all paths through it
+struct sSelectNode {
+	uint hash;			// key hash
+	int index;			// array index or -1 if the key is not a number
+	int maxIndex;		// largest array index of any child, -1 if none
+	short first;		// first child node or 0 if none
+	short next;			// next sibling node or 0 if last
+	bool all;			// a path ends here, keep the entire value
+};
+
+// range of text to step over and the number of null values to insert in its place
+struct sSelectSkip {
+	const char *start;
+	const char *end;
+	int nulls;
+	bool defer;		// insert a JB_DEFERRED item for the object or array in the range instead (JBDeferred)
+};
+
+struct sSelect {
+	sSelectNode aNodes[JSON_MAX_SELECT];
+	int numNodes;
+	sSelectSkip *aSkips;	// ranges of text that are not selected, in text order
+	int numSkips;
+	int maxSkips;
+	bool out_of_memory;
+
+	bool addPath(const char *path);	// add a JSON Pointer path to the trie
+	int findKey(int node, uint hash) const;
+	int findIndex(int node, int index) const;
+	bool addSkip(const char *start, const char *end, int nulls, bool defer = false);
+	bool scan(int node, const char *&text, uint &left);	// find the unselected ranges of an object or array
+	bool scanDefer(int level, int levels, const char *&text, uint &left);	// find the objects and arrays below a number of levels
+};
+
+#ifdef JB_KEY_HASH
+#define hashKeyStr hashJSONStr
+#else
+// hash a raw JSON key the same way JBItem::getHash hashes the parsed name (fnv1a over utf-8)
+static uint hashKeyStr(const char *s, int l)
+{
+	int skip;
+	uint hash = JB_FNV1A_SEED;
+	while (l) {
+		uint c = getChar(s, l, skip);
+		s += skip;
+		l -= skip;
+		u8 utf8[4];
+		int bytes = c < 0x80 ? 1 : (c < 0x800 ? 2 : (c < 0x10000 ? 3 : 4));
+		if (bytes == 1)
+			utf8[0] = (u8)c;
+		else {
+			for (int b = bytes - 1; b; --b, c >>= 6)
+				utf8[b] = (u8)(0x80 | (c & 0x3f));
+			utf8[0] = (u8)((0xf00 >> bytes) | c);
+		}
+		for (int b = 0; b < bytes; b++)
+			hash = (utf8[b] ^ hash) * JB_FNV1A_PRIME;
+	}
+	return hash;
+}
+#endif
+
+// add a JSON Pointer ("/key/0/key", "~0" is '~' and "~1" is '/') to the trie, a numeric segment matches both a key and an array index
+bool sSelect::addPath(const char *path)
+{
+	if (!path || (*path && *path != '/'))
+		return false;
+	int node = 0;
+	while (*path) {
+		path++;	// skip '/'
+		char key[JSON_MAX_SELECT_KEY];
+		uint len = 0;
+		uint index = 0;
+		bool numeric = *path && *path != '/' && (*path != '0' || !path[1] || path[1] == '/');	// no leading zeroes
+		for (; *path && *path != '/'; path++) {
+			char c = *path;
+			if (c == '~') {
+				if (path[1] != '0' && path[1] != '1')
+					return false;
+				c = *++path == '0' ? '~' : '/';
+			}
+			if (c < '0' || c > '9')
+				numeric = false;
+			else if (numeric && index > (0x7fffffffU - (c - '0')) / 10)
+				numeric = false;	// too large to be an index, only match as a key
+			else if (numeric)
+				index = index * 10 + (c - '0');
+			if (len >= sizeof(key))
+				return false;
+			key[len++] = c;
+		}
+		uint hash = JBHashKey(key, len);
+		int child = aNodes[node].first;
+		while (child && (aNodes[child].hash != hash || aNodes[child].index != (numeric ? (int)index : -1)))
+			child = aNodes[child].next;
+		if (!child) {
+			if (numNodes >= JSON_MAX_SELECT)
+				return false;
+			child = numNodes++;
+			sSelectNode &n = aNodes[child];
+			n.hash = hash;
+			n.index = numeric ? (int)index : -1;
+			n.maxIndex = -1;
+			n.first = 0;
+			n.next = aNodes[node].first;
+			n.all = false;
+			aNodes[node].first = (short)child;
+			if (n.index > aNodes[node].maxIndex)
+				aNodes[node].maxIndex = n.index;
+		}
+		node = child;
+	}
+	aNodes[node].all = true;
+	return true;
+}
+
+int sSelect::findKey(int node, uint hash) const
+{
+	for (int child = aNodes[node].first; child; child = aNodes[child].next) {
+		if (aNodes[child].hash == hash)
+			return child;
+	}
+	return 0;
+}
+
+int sSelect::findIndex(int node, int index) const
+{
+	if (index > aNodes[node].maxIndex)
+		return 0;
+	for (int child = aNodes[node].first; child; child = aNodes[child].next) {
+		if (aNodes[child].index == index)
+			return child;
+	}
+	return 0;
+}
+
+// add a range of text to step over, merged with the previous range if only separated by commas and whitespace
+bool sSelect::addSkip(const char *start, const char *end, int nulls, bool defer)
+{
+	if (numSkips && !defer && !aSkips[numSkips - 1].defer) {
+		sSelectSkip &last = aSkips[numSkips - 1];
+		const char *gap = last.end;
+		while (gap < start && (*gap == ',' || *gap <= ' '))
+			gap++;
+		if (gap == start) {
+			last.end = end;
+			last.nulls += nulls;
+			return true;
+		}
+	}
+	if (numSkips == maxSkips) {
+		int grow = maxSkips ? maxSkips * 2 : 64;
+		sSelectSkip *aGrow = (sSelectSkip*)realloc(aSkips, sizeof(sSelectSkip) * grow);
+		if (!aGrow) {
+			out_of_memory = true;
+			return false;
+		}
+		aSkips = aGrow;
+		maxSkips = grow;
+	}
+	aSkips[numSkips].start = start;
+	aSkips[numSkips].end = end;
+	aSkips[numSkips].nulls = nulls;
+	aSkips[numSkips].defer = defer;
+	numSkips++;
+	return true;
+}
+
+// skip whitespace and comments
+static void skipSpace(const char *&text, uint &left)
+{
+	for (;;) {
+		text_skip(text, left, getWhiteSpaceSize(text, left));
+#ifdef JB_ALLOW_C_COMMENTS
+		if (left >= 2 && *text == '/' && (text[1] == '/' || text[1] == '*')) {
+			text_skip(text, left, commentSize(text, left));
+			continue;
+		}
+#endif
+		return;
+	}
+}
+
+// step over a value without interpreting it by matching brackets and quotes (the value is not validated)
+static bool skipValue(const char *&text, uint &left)
+{
+	if (left && *text != '"' && *text != '{' && *text != '[') {	// number, true, false or null
+		while (left && *text > ' ' && *text != ',' && *text != '}' && *text != ']' && *text != '/') {
+			text_step(text, left);
+		}
+		return true;
+	}
+	int depth = 0;
+	while (left) {
+		char c = *text;
+		if (c == '"') {
+			const char *quote_end = quoteEnd(text, left);
+			if (!quote_end)
+				return false;
+			text_skip(text, left, quote_end + 1 - text);
+		} else {
+#ifdef JB_ALLOW_C_COMMENTS
+			if (c == '/' && left >= 2 && (text[1] == '/' || text[1] == '*')) {
+				text_skip(text, left, commentSize(text, left));
+				continue;
+			}
+#endif
+			if (c == '{' || c == '[')
+				depth++;
+			else if (c == '}' || c == ']')
+				depth--;
+			text_step(text, left);
+		}
+		if (!depth)
+			return true;
+	}
+	return false;
+}
+
+// step through an object or array on a selected path and add ranges for values that are not selected
+bool sSelect::scan(int node, const char *&text, uint &left)
+{
+	bool array = *text == '[';
+	int index = 0;
+	text_step(text, left);
+	for (;;) {
+		skipSpace(text, left);
+		if (!left)
+			return false;
+		if (*text == (array ? ']' : '}')) {
+			text_step(text, left);
+			return true;
+		}
+		if (*text == ',') {
+			text_step(text, left);
+			continue;
+		}
+		const char *start = text;
+		int child;
+		if (array)
+			child = findIndex(node, index++);
+		else {
+			const char *quote_end = *text == '"' ? quoteEnd(text, left) : NULL;
+			if (!quote_end)
+				return false;
+			child = findKey(node, hashKeyStr(text + 1, (int)(quote_end - text - 1)));
+			text_skip(text, left, quote_end + 1 - text);
+			skipSpace(text, left);
+			if (!left || *text != ':')
+				return false;
+			text_step(text, left);
+			skipSpace(text, left);
+		}
+		if (child && !aNodes[child].all && left && (*text == '{' || *text == '[')) {
+			if (!scan(child, text, left))
+				return false;
+		} else {
+			if (!skipValue(text, left))
+				return false;
+			// keep whole values at the end of a path, replace skipped array elements before a selected index with null
+			if ((!child || !aNodes[child].all) && !addSkip(start, text, (array && index <= aNodes[node].maxIndex) ? 1 : 0))
+				return false;
+		}
+	}
+}
+
+// step through an object or array at a level that is parsed and add ranges for the objects and arrays one level down
+bool sSelect::scanDefer(int level, int levels, const char *&text, uint &left)
+{
+	bool array = *text == '[';
+	text_step(text, left);
+	for (;;) {
+		skipSpace(text, left);
+		if (!left)
+			return false;
+		if (*text == (array ? ']' : '}')) {
+			text_step(text, left);
+			return true;
+		}
+		if (*text == ',') {
+			text_step(text, left);
+			continue;
+		}
+		if (!array) {
+			const char *quote_end = *text == '"' ? quoteEnd(text, left) : NULL;
+			if (!quote_end)
+				return false;
+			text_skip(text, left, quote_end + 1 - text);
+			skipSpace(text, left);
+			if (!left || *text != ':')
+				return false;
+			text_step(text, left);
+			skipSpace(text, left);
+			if (!left)
+				return false;
+		}
+		if (*text == '{' || *text == '[') {
+			if (level + 1 < levels) {
+				if (!scanDefer(level + 1, levels, text, left))
+					return false;
+			} else {
+				const char *start = text;
+				if (!skipValue(text, left) || !addSkip(start, text, 0, true))
+					return false;
+			}
+		} else if (!skipValue(text, left))
+			return false;
+	}
+}
 
 #ifdef JB_HANDLE_UTF8_BOM
+// step over a utf-8 marker at the start of the text
+static void skipBOM(const char *&json, uint &size)
+{
 	if (size >= 3 && (u8)json[0] == 0xef && (u8)json[1] == 0xbb && (u8)json[2] == 0xbf) {
 		json += 3;
 		size -= 3;
 	}
+}
 #endif
 
+// convert a text based json file to a binary representation, stepping over the ranges in aSkips (JSONBinSelect)
+static JBItem* parseJSON(const char *json, uint size, JBRet *info, const sSelectSkip *aSkips, int numSkips)
+{
+	JBParse read = { 0 };	// clear all members of parsing struct
+	JBItem *pRet = NULL;	// return data pointer
+	JBError error = JBERR_NONE;
+
 	// Building a sorted hash array for the strings. first count the number of potential strings to allocate the hash array and string lookup
 	struct sStrCache strCache = { 0 };	// clear all members
 	{	// using scope to identify string counting section
 		int numStrMax = 0;
-		const char *quote_str = json;
-		uint quote_left = size;
 		uint string_size_orig = 0;
-		while (const char *quote_next = findChar(quote_str, quote_left, JB_QUOTE_FIND)) {	// find start of a quote
-#ifdef JB_ALLOW_C_COMMENTS
-			if (*quote_next=='/' && (quote_next[1]=='/' || quote_next[1]=='*')) {
-				text_skip(quote_str, quote_left, commentSize(quote_next, quote_left) + (quote_next-quote_str));
-			} else
-#endif
-			{
-				quote_left -= (uint)(quote_next - quote_str);
-				quote_str = quote_next;
-				if (const char *quote_end = quoteEnd(quote_str, quote_left)) {
-					numStrMax++;
-					quote_end++;
-					uint quote_len = (uint)(quote_end - quote_str);
-					string_size_orig += quote_len;
-					quote_left -= quote_len;
-					quote_str = quote_end;
-				}
-			}
+		const char *gap = json;
+		for (int skip = 0; skip < numSkips; skip++) {	// only count strings in text that is not stepped over
+			numStrMax += countStrings(gap, (uint)(aSkips[skip].start - gap), string_size_orig);
+			gap = aSkips[skip].end;
 		}
+		numStrMax += countStrings(gap, (uint)(json + size - gap), string_size_orig);
 		strCache.numStrMax = numStrMax;
 		strCache.hashTableSize = (numStrMax / JB_HASH_COUNT_DIV) < 1024 ? 1024 : (numStrMax / JB_HASH_COUNT_DIV);
 		if (info) {
@@ -718,8 +1123,24 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 		// go through entire file
 		cursor = json;
 		uint left = size;
+		int skip = 0;
 		while (left && error == JBERR_NONE) {
 			text_skip(cursor, left, getWhiteSpaceSize(cursor, left));
+			if (skip < numSkips && cursor >= aSkips[skip].start) {	// step over values that were not selected
+				if (aSkips[skip].defer) {	// object or array to parse later, keep the offset of its text
+					read.set_or_push_context(JSON_NULL_VALUE, read.get_context() == JSON_ARRAY);
+					if (read.pItem)
+						read.pItem->data.i = (jbint)(cursor - json);
+					read.step_value(JB_DEFERRED);
+				}
+				for (int n = aSkips[skip].nulls; n; --n) {
+					read.push_context(JSON_NULL_TAG);
+					read.step_value(JB_NULL);	// same type as a null array element
+				}
+				text_skip(cursor, left, aSkips[skip].end - cursor);
+				skip++;
+				continue;
+			}
 			eJSONCtx ctx = read.get_context();
 			char c = text_pop(cursor, left);
 			switch (c) {	// handle next JSON character
@@ -854,11 +1275,8 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 #endif
 						} else if (quote_len) {
 #ifdef JB_KEY_STRING
-							if (quote_len) {
-								strCache.addString(quote_start, quote_len);
-								if (strCache.numStr >= strCache.numStrMax)
-									error = JBERR_UNEXPECTED_STRCOUNT;
-							}
+							if (!strCache.addString(quote_start, quote_len))
+								error = JBERR_UNEXPECTED_STRCOUNT;
 #endif
 						}
 						read.set_context(JSON_COLON);
@@ -928,8 +1346,7 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 								}
 							}
 						} else if (quote_len) {
-							strCache.addString(quote_start, quote_len);
-							if (strCache.numStr >= strCache.numStrMax)
+							if (!strCache.addString(quote_start, quote_len))
 								error = JBERR_UNEXPECTED_STRCOUNT;
 						}
 						read.step_value(JB_STRING);
@@ -996,6 +1413,8 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 			if (read.ctx_stack == 0)	// parsing is complete
 				break;
 		}
+		if (error == JBERR_NONE && read.ctx_stack)	// text ended inside the root object or array
+			error = JBERR_UNEXPECTED_END;
 
 		// after the first pass allocate memory for the determined number of JBItem and the determined amount of unique strings
 		if (!pass) {
@@ -1059,6 +1478,7 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 	// Return stats setting
 	if (info) {
 		info->bytes_read = (uint)(cursor - json);
+		info->shared_items = 0;
 		info->err_line = 0;
 		info->err_column = 0;
 		info->error_code = error;	// report error to caller
@@ -1089,5 +1509,793 @@ JBItem* JSONBin(const char *json, uint size, JBRet *info)
 	return pRet;
 }
 
+//
+// On demand cursor (JBLazyDoc / JBLazyValue)
+//
+
+// read the object member or array element at text, or an invalid value at the end of the container
+static JBLazyValue lazyMember(const char *text, const char *end, bool object)
+{
+	JBLazyValue ret;
+	uint left = (uint)(end - text);
+	skipSpace(text, left);
+	if (!left || *text == '}' || *text == ']')
+		return ret;
+	if (object) {
+		const char *quote_end = *text == '"' ? quoteEnd(text, left) : NULL;
+		if (!quote_end)
+			return ret;
+		ret.name = text + 1;
+		ret.nameLen = (uint)(quote_end - text - 1);
+		text_skip(text, left, quote_end + 1 - text);
+		skipSpace(text, left);
+		if (!left || *text != ':')
+			return ret;
+		text_step(text, left);
+		skipSpace(text, left);
+		if (!left)
+			return ret;
+	}
+	ret.value = text;
+	ret.end = end;
+	return ret;
+}
+
+JBLazyValue JBLazyDoc::root() const
+{
+	JBLazyValue ret;
+	const char *text = json;
+	uint left = size;
+#ifdef JB_HANDLE_UTF8_BOM
+	skipBOM(text, left);
+#endif
+	skipSpace(text, left);
+#ifdef JB_ALLOW_ROOT_ARRAY
+	if (left && (*text == '{' || *text == '[')) {
+#else
+	if (left && *text == '{') {
+#endif
+		ret.value = text;
+		ret.end = text + left;
+		ret.root = true;
+	}
+	return ret;
+}
+
+JBType JBLazyValue::getType() const
+{
+	if (!value)
+		return JB_NULL;
+	switch (*value) {
+		case '{': return root ? JB_ROOT : JB_OBJECT;
+		case '[': return JB_ARRAY;
+		case '"': return JB_STRING;
+		case 't':
+		case 'f': return JB_BOOL;
+		case 'n': return name ? JB_NULL_VALUE : JB_NULL;	// same as JSONBin, null array elements are JB_NULL
+	}
+	int skip;
+	bool real, representable;
+	jbint valInt;
+	getNumStr(value, (int)(end - value), valInt, skip, real, representable);
+	return real ? JB_FLOAT : JB_INT;
+}
+
+unsigned int JBLazyValue::getHash() const
+{
+#ifdef JB_KEY_HASH
+	return (name && nameLen) ? hashKeyStr(name, nameLen) : 0;	// parser stores 0 for empty and missing names
+#else
+	return hashKeyStr(name ? name : "", nameLen);
+#endif
+}
+
+// decode a raw JSON string into a buffer, cut off at a whole character if the buffer is too small
+static const jchar *lazyDecode(const char *str, int left, jchar *buf, uint bufLen)
+{
+	if (!bufLen)
+		return NULL;
+	uint length = 0;
+	int skip;
+	while (left) {
+		jchar enc[4];
+		uint n = (uint)asEncoding(getChar(str, left, skip), enc);
+		if (length + n >= bufLen)
+			break;
+		for (uint e = 0; e < n; e++)
+			buf[length++] = enc[e];
+		text_skip(str, left, skip);
+	}
+	buf[length] = 0;
+	return buf;
+}
+
+const jchar *JBLazyValue::getName(jchar *buf, unsigned int bufLen) const
+{
+	return name ? lazyDecode(name, (int)nameLen, buf, bufLen) : NULL;
+}
+
+unsigned int JBLazyValue::getNameLen() const
+{
+	return name ? jbin::getStrLen(name, (int)nameLen) : 0;
+}
+
+const char *JBLazyValue::getRawStr(unsigned int &len) const
+{
+	len = 0;
+	if (!value || *value != '"')
+		return NULL;
+	const char *quote_end = quoteEnd(value, (uint)(end - value));
+	if (!quote_end)
+		return NULL;
+	len = (uint)(quote_end - value - 1);
+	return value + 1;
+}
+
+const jchar *JBLazyValue::getStr(jchar *buf, unsigned int bufLen) const
+{
+	uint len;
+	const char *str = getRawStr(len);
+	return str ? lazyDecode(str, (int)len, buf, bufLen) : NULL;
+}
+
+unsigned int JBLazyValue::getStrLen() const
+{
+	uint len;
+	const char *str = getRawStr(len);
+	return str ? jbin::getStrLen(str, (int)len) : 0;
+}
+
+jbint JBLazyValue::getInt() const
+{
+	jbint valInt = 0;
+	if (value && (*value == '-' || *value == '+' || *value == '.' || (*value >= '0' && *value <= '9'))) {
+		int skip;
+		bool real, representable;
+		getNumStr(value, (int)(end - value), valInt, skip, real, representable);
+	}
+	return valInt;
+}
+
+jbfloat JBLazyValue::getFloat() const
+{
+	if (value && (*value == '-' || *value == '+' || *value == '.' || (*value >= '0' && *value <= '9'))) {
+		int skip;
+		bool real, representable;
+		jbint valInt;
+		return getNumStr(value, (int)(end - value), valInt, skip, real, representable);
+	}
+	return jbfloat(0);
+}
+
+bool JBLazyValue::getBool() const
+{
+	return value && sameWord(value, _true, (int)(end - value));
+}
+
+JBLazyValue JBLazyValue::getChild() const
+{
+	if (!value || (*value != '{' && *value != '['))
+		return JBLazyValue();
+	return lazyMember(value + 1, end, *value == '{');
+}
+
+JBLazyValue JBLazyValue::getSibling() const
+{
+	if (!value || root)
+		return JBLazyValue();
+	const char *text = value;
+	uint left = (uint)(end - value);
+	if (!skipValue(text, left))
+		return JBLazyValue();
+	skipSpace(text, left);
+	if (!left || *text != ',')
+		return JBLazyValue();
+	return lazyMember(text + 1, end, name != NULL);
+}
+
+jbint JBLazyValue::getChildCount() const
+{
+	jbint count = 0;
+	for (JBLazyValue child = getChild(); child; child = child.getSibling())
+		count++;
+	return count;
+}
+
+JBLazyValue JBLazyValue::findByHash(unsigned int hash) const
+{
+	if (value && *value == '{') {
+		for (JBLazyValue child = getChild(); child; child = child.getSibling()) {
+			if (child.getHash() == hash)
+				return child;
+		}
+	}
+	return JBLazyValue();
+}
+
+//
+// Token stream (JBTokenReader / JBToken)
+//
+
+unsigned int JBToken::getHash() const
+{
+#ifdef JB_KEY_HASH
+	return (name && nameLen) ? hashKeyStr(name, nameLen) : 0;	// parser stores 0 for empty and missing names
+#else
+	return hashKeyStr(name ? name : "", nameLen);
+#endif
+}
+
+const jchar *JBToken::getName(jchar *buf, unsigned int bufLen) const
+{
+	return name ? lazyDecode(name, (int)nameLen, buf, bufLen) : NULL;
+}
+
+unsigned int JBToken::getNameLen() const
+{
+	return name ? jbin::getStrLen(name, (int)nameLen) : 0;
+}
+
+const jchar *JBToken::getStr(jchar *buf, unsigned int bufLen) const
+{
+	return type == JB_STRING ? lazyDecode(value, (int)valueLen, buf, bufLen) : NULL;
+}
+
+unsigned int JBToken::getStrLen() const
+{
+	return type == JB_STRING ? jbin::getStrLen(value, (int)valueLen) : 0;
+}
+
+JBTokenReader::JBTokenReader(const char *text, unsigned int length, bool sequence)
+{
+#ifdef JB_HANDLE_UTF8_BOM
+	skipBOM(text, length);
+#endif
+	json = this->text = text;
+	left = length;
+	begin = NULL;
+	depth = base = sequence ? 1 : 0;
+	member = false;
+	done = false;
+	error_code = JBERR_NONE;
+	memset(aArray, 0, sizeof(aArray));
+	if (sequence)
+		aArray[0] = 2;	// level 1 is the array without brackets
+}
+
+bool JBTokenReader::next(JBToken &token)
+{
+	if (done || error_code)
+		return false;
+	begin = NULL;
+	skipSpace(text, left);
+	token.name = NULL;
+	token.nameLen = 0;
+	if (depth) {
+		bool array = isArray(depth);
+		if (base && depth == base) {	// sequence, commas are optional
+			while (left && *text == ',') {
+				text_step(text, left);
+				skipSpace(text, left);
+			}
+			if (!left) {
+				done = true;
+				return false;
+			}
+			if (*text == ']' || *text == '}')
+				return fail(*text == ']' ? JBERR_UNEXPECTED_CLOSE_BRACKET : JBERR_UNEXPECTED_CLOSE_BRACE);
+		} else {
+			if (!left)
+				return fail(JBERR_UNEXPECTED_END);
+			if (*text == (array ? ']' : '}')) {	// close, the object or array counts as a value of its parent
+				text_step(text, left);
+				depth--;
+				token.kind = JBTOK_END;
+				token.type = array ? JB_ARRAY : (depth ? JB_OBJECT : JB_ROOT);
+				token.depth = depth;
+				token.value = text - 1;
+				token.valueLen = 0;
+				member = true;
+				done = !depth;
+				return true;
+			}
+			if (member) {
+				if (*text != ',')
+					return fail(*text == ':' ? JBERR_UNEXPECTED_COLON : JBERR_UNEXPECTED_CHARACTER);
+				text_step(text, left);
+				skipSpace(text, left);
+				if (!left)
+					return fail(JBERR_UNEXPECTED_END);
+			}
+		}
+		if (!array) {	// "name" :
+			if (*text != '"')
+				return fail(*text == ',' ? JBERR_UNEXPECTED_COMMA : JBERR_UNEXPECTED_CHARACTER);
+			const char *quote_end = quoteEnd(text, left);
+			if (!quote_end)
+				return fail(JBERR_UNTERMINATED_QUOTE);
+			token.name = text + 1;
+			token.nameLen = (uint)(quote_end - text - 1);
+			text_skip(text, left, quote_end + 1 - text);
+			skipSpace(text, left);
+			if (!left || *text != ':')
+				return fail(left ? JBERR_UNEXPECTED_CHARACTER : JBERR_UNEXPECTED_END);
+			text_step(text, left);
+			skipSpace(text, left);
+		}
+		if (!left)
+			return fail(JBERR_UNEXPECTED_END);
+	} else {	// root
+		if (!left)
+			return fail(JBERR_UNEXPECTED_END);
+#ifdef JB_ALLOW_ROOT_ARRAY
+		if (*text != '{' && *text != '[')
+#else
+		if (*text != '{')
+#endif
+			return fail(JBERR_UNEXPECTED_CHARACTER);
+	}
+
+	// value
+	token.depth = depth;
+	token.value = text;
+	token.valueLen = 0;
+	token.i = 0;
+	token.f = 0;
+	char c = *text;
+	if (c == '{' || c == '[') {
+		if (depth >= JSON_MAX_DEPTH - 1)
+			return fail(JBERR_EXCEED_MAX_DEPTH);
+		begin = text;
+		text_step(text, left);
+		depth++;
+		if (c == '[')
+			aArray[depth >> 3] |= (u8)(1 << (depth & 7));
+		else
+			aArray[depth >> 3] &= (u8)~(1 << (depth & 7));
+		token.kind = JBTOK_BEGIN;
+		token.type = c == '[' ? JB_ARRAY : (depth == 1 ? JB_ROOT : JB_OBJECT);
+		member = false;
+		return true;
+	}
+	token.kind = JBTOK_VALUE;
+	if (c == '"') {
+		const char *quote_end = quoteEnd(text, left);
+		if (!quote_end)
+			return fail(JBERR_UNTERMINATED_QUOTE);
+		token.type = JB_STRING;
+		token.value = text + 1;
+		token.valueLen = (uint)(quote_end - text - 1);
+		text_skip(text, left, quote_end + 1 - text);
+	} else if (c == 't' || c == 'f' || c == 'n') {
+		const char *word = c == 't' ? _true : (c == 'f' ? _false : _null);
+		if (!sameWord(text, word, left))
+			return fail(JBERR_UNEXPECTED_CHARACTER);
+		token.type = c == 'n' ? (token.name ? JB_NULL_VALUE : JB_NULL) : JB_BOOL;	// same as JSONBin, null array elements are JB_NULL
+		token.valueLen = (uint)strlen(word);
+		text_skip(text, left, token.valueLen);
+	} else if (c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9')) {
+		int num_len;
+		bool real, representable;
+		token.f = getNumStr(text, (int)left, token.i, num_len, real, representable);
+		if (!representable)
+			return fail(JBERR_UNREPRESENTABLE);
+		token.type = real ? JB_FLOAT : JB_INT;
+		token.valueLen = (uint)num_len;
+		text_skip(text, left, num_len);
+	} else
+		return fail(c == ':' ? JBERR_UNEXPECTED_COLON : (c == ',' ? JBERR_UNEXPECTED_COMMA : JBERR_UNEXPECTED_CHARACTER));
+	member = true;
+	return true;
+}
+
+bool JBTokenReader::skip()
+{
+	if (!begin || error_code || depth <= base)
+		return false;
+	left += (uint)(text - begin);
+	text = begin;
+	begin = NULL;
+	if (!skipValue(text, left))
+		return fail(JBERR_UNEXPECTED_END);
+	depth--;
+	member = true;
+	done = !depth;
+	return true;
+}
+
+#ifdef JB_SHARED_SUBTREES
+//
+// Shared subtrees (JB_SHARED_SUBTREES)
+//
+
+#define JB_SHARED_BIT 0x80000000U	// marks a shared item in aEnd, the rest is the index of the first copy
+
+// true if two subtrees of the same size have the same items, strings are shared so names and strings compare by address
+static bool sameSubtree(const JBItem *a, const JBItem *b, uint count)
+{
+	for (uint i = 0; i < count; i++) {
+		const JBItem &x = a[i], &y = b[i];
+		if (x.type != y.type)
+			return false;
+		if (i) {	// the top items may have different names and siblings (one copy can be the last child of its container)
+			if (x.sibling != y.sibling)
+				return false;
+#ifdef JB_KEY_HASH
+			if (x.hash != y.hash)
+				return false;
+#endif
+#ifdef JB_KEY_STRING
+			if (x.getName() != y.getName())
+				return false;
+#endif
+		}
+		switch (x.type) {
+			case JB_STRING:
+				if (x.getStr() != y.getStr())
+					return false;
+				break;
+			case JB_FLOAT:
+				if (memcmp(&x.data.f, &y.data.f, sizeof(jbfloat)))
+					return false;
+				break;
+			case JB_BOOL:
+				if (x.data.b != y.data.b)
+					return false;
+				break;
+			case JB_NULL:
+			case JB_NULL_VALUE:
+				break;
+			default:	// integers and child counts
+				if (x.data.i != y.data.i)
+					return false;
+				break;
+		}
+	}
+	return true;
+}
+
+// replace objects and arrays identical to an earlier one with a JB_SHARED item and compact the block
+static JBItem* shareSubtrees(JBItem *pRet, JBRet &info)
+{
+	uint count = info.num_items;
+	if (count < 3)
+		return pRet;
+	uint *aHash = (uint*)malloc(sizeof(uint) * count * 3);
+	if (!aHash)
+		return pRet;	// sharing is optional, keep the block as it is
+	uint *aEnd = aHash + count;		// one past the last item of each subtree
+	uint *aNew = aEnd + count;		// index of each kept item after compacting
+
+	// hash and extent of every subtree, children come after their parent so step backwards
+	uint numContainers = 0;
+	for (uint i = count; i--;) {
+		const JBItem &item = pRet[i];
+		uint hash = JB_FNV1A_SEED;
+		hash = (item.type ^ hash) * JB_FNV1A_PRIME;
+		aEnd[i] = i + 1;
+		if (item.type == JB_ROOT || item.type == JB_OBJECT || item.type == JB_ARRAY) {
+			numContainers++;
+			for (const JBItem *child = item.getChild(); child; child = child->getSibling()) {
+				uint c = (uint)(child - pRet);
+				uint key = child->getHash();
+				hash = (aHash[c] ^ hash) * JB_FNV1A_PRIME;
+				hash = (key ^ hash) * JB_FNV1A_PRIME;
+				aEnd[i] = aEnd[c];
+			}
+		} else if (item.type == JB_STRING) {
+			size_t str = (size_t)item.getStr();
+			hash = ((uint)str ^ (uint)(str >> 16 >> 16) ^ hash) * JB_FNV1A_PRIME;
+		} else if (item.type == JB_FLOAT || item.type == JB_INT || item.type == JB_BOOL) {
+			const unsigned char *bytes = (const unsigned char*)&item.data;
+			for (size_t b = 0; b < (item.type == JB_BOOL ? sizeof(bool) : sizeof(jbint)); b++)
+				hash = (bytes[b] ^ hash) * JB_FNV1A_PRIME;
+		}
+		aHash[i] = hash;
+	}
+
+	// first copies by hash (index + 1), open addressing
+	uint tableSize = 1024;
+	while (tableSize < numContainers * 2)
+		tableSize *= 2;
+	uint *aTable = (uint*)calloc(tableSize, sizeof(uint));
+	if (!aTable) {
+		free(aHash);
+		return pRet;
+	}
+
+	// walk the kept items in order, a repeated subtree keeps its top item and skips the rest
+	uint kept = 0, numShared = 0;
+	for (uint i = 0; i < count;) {
+		const JBItem &item = pRet[i];
+		aNew[i] = kept++;
+		uint end = aEnd[i];
+		if (i && item.data.i && (item.type == JB_OBJECT || item.type == JB_ARRAY)) {
+			uint slot = aHash[i] & (tableSize - 1);
+			for (; aTable[slot]; slot = (slot + 1) & (tableSize - 1)) {
+				uint first = aTable[slot] - 1;
+				if (aHash[first] == aHash[i] && aEnd[first] - first == end - i && sameSubtree(pRet + first, pRet + i, end - i))
+					break;
+			}
+			if (aTable[slot]) {
+				aEnd[i] = JB_SHARED_BIT | (aTable[slot] - 1);
+				numShared++;
+				i = end;
+				continue;
+			}
+			aTable[slot] = i + 1;
+		}
+		i++;
+	}
+	free(aTable);
+	if (!numShared) {
+		free(aHash);
+		return pRet;
+	}
+
+	// move the kept items down, strings move down by the size of the removed items
+	size_t removed = sizeof(JBItem) * (count - kept);
+	for (uint i = 0; i < count;) {
+		JBItem item = pRet[i];
+		uint to = aNew[i];
+#ifndef JB_INLINE_STRINGS
+		size_t moved = sizeof(JBItem) * (i - to);
+#ifdef JB_KEY_STRING
+		if (item.name.o)
+			item.name.o = (uint)(item.name.o + moved - removed);
+#endif
+		if (item.type == JB_STRING && item.data.s.o)
+			item.data.s.o = (uint)(item.data.s.o + moved - removed);
+#endif
+		if (item.sibling)
+			item.sibling = (int)(aNew[i + item.sibling] - to);
+		uint next = i + 1;
+		if (aEnd[i] & JB_SHARED_BIT) {
+			uint first = aEnd[i] & ~JB_SHARED_BIT;
+			next = aEnd[first] + (i - first);	// same extent as the first copy
+			item.type = JB_SHARED;
+			item.data.i = (jbint)aNew[first] - (jbint)to;
+		}
+		pRet[to] = item;
+		i = next;
+	}
+	free(aHash);
+
+	size_t items_size = sizeof(JBItem) * count;
+#ifdef JB_INLINE_STRINGS
+	removed = 0;	// string pointers can not move, the space of the removed items is kept
+#else
+	memmove((char*)pRet + items_size - removed, (char*)pRet + items_size, info.bin_size - items_size);
+	if (JBItem *pShrunk = (JBItem*)realloc(pRet, info.bin_size - removed))
+		pRet = pShrunk;
+#endif
+	info.bin_size -= (uint)removed;
+	info.num_items = kept;
+	info.shared_items = count - kept;
+	return pRet;
+}
+#endif
+
+// convert a text based json file to a binary representation
+JBItem* JSONBin(const char *json, uint size, JBRet *info)
+{
+#ifdef JB_HANDLE_UTF8_BOM
+	skipBOM(json, size);
+#endif
+#ifdef JB_SHARED_SUBTREES
+	JBRet ret;
+	if (!info)
+		info = &ret;
+	JBItem *pRet = parseJSON(json, size, info, NULL, 0);
+	return pRet ? shareSubtrees(pRet, *info) : NULL;
+#else
+	return parseJSON(json, size, info, NULL, 0);
+#endif
+}
+
+// convert only the values at a set of JSON Pointer paths and the objects and arrays leading to them
+JBItem* JSONBinSelect(const char *json, uint size, const char **paths, int numPaths, JBRet *info)
+{
+#ifdef JB_HANDLE_UTF8_BOM
+	skipBOM(json, size);
+#endif
+	sSelect *select = (sSelect*)malloc(sizeof(sSelect));	// trie is too large to keep on the stack next to JBParse
+	if (!select) {
+		if (info) {
+			memset(info, 0, sizeof(JBRet));
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		}
+		return NULL;
+	}
+	memset(&select->aNodes[0], 0, sizeof(sSelectNode));
+	select->aNodes[0].maxIndex = -1;
+	select->numNodes = 1;
+	select->aSkips = NULL;
+	select->numSkips = 0;
+	select->maxSkips = 0;
+	select->out_of_memory = false;
+
+	for (int p = 0; p < numPaths; p++) {
+		if (!select->addPath(paths[p])) {
+			free(select);
+			if (info) {
+				memset(info, 0, sizeof(JBRet));
+				info->error_code = JBERR_SELECT_PATH;
+			}
+			return NULL;
+		}
+	}
+
+	// find the ranges of text that are not selected, errors are left for the parser to report
+	JBItem *pRet = NULL;
+	if (!select->aNodes[0].all) {
+		const char *text = json;
+		uint left = size;
+		skipSpace(text, left);
+		if (left && (*text == '{' || *text == '['))
+			select->scan(0, text, left);
+	}
+	if (select->out_of_memory) {
+		if (info) {
+			memset(info, 0, sizeof(JBRet));
+			info->error_code = JBERR_OUT_OF_MEMORY;
+		}
+	} else
+		pRet = parseJSON(json, size, info, select->aSkips, select->numSkips);
+	if (select->aSkips)
+		free(select->aSkips);
+	free(select);
+	return pRet;
+}
+
+//
+// Deferred subtree parsing (JBDeferred)
+//
+
+// set a pointer if it is still NULL and return the pointer that ended up set
+static void *setPointerOnce(void * volatile *dest, void *value)
+{
+#ifdef WIN32
+	void *prev = _InterlockedCompareExchangePointer(dest, value, NULL);
+#else
+	void *prev = __sync_val_compare_and_swap(dest, (void*)NULL, value);
+#endif
+	return prev ? prev : value;
+}
+
+// read a pointer that another thread may have set with setPointerOnce
+static void *getPointer(void * volatile *src)
+{
+#ifdef WIN32
+	return _InterlockedCompareExchangePointer(src, NULL, NULL);	// full barrier read, plain volatile reads are only ordered with /volatile:ms
+#else
+	return __atomic_load_n(src, __ATOMIC_ACQUIRE);
+#endif
+}
+
+bool JBDeferred::open(const char *text, unsigned int length, int levels, JBRet *info)
+{
+	release();
+#ifdef JB_HANDLE_UTF8_BOM
+	skipBOM(text, length);
+#endif
+	json = text;
+	size = length;
+
+	sSelect *select = (sSelect*)calloc(1, sizeof(sSelect));	// only the skip list is used
+	JBRet ret = { 0 };
+	if (select) {
+		const char *scan = json;
+		uint left = size;
+		skipSpace(scan, left);
+		if (left && (*scan == '{' || *scan == '['))
+			select->scanDefer(0, levels < 1 ? 1 : levels, scan, left);	// errors are left for the parser to report
+		if (!select->out_of_memory)
+			pSkeleton = parseJSON(json, size, &ret, select->aSkips, select->numSkips);
+		else
+			ret.error_code = JBERR_OUT_OF_MEMORY;
+		numDeferred = select->numSkips;
+		if (select->aSkips)
+			free(select->aSkips);
+		free(select);
+	} else
+		ret.error_code = JBERR_OUT_OF_MEMORY;
+
+	// index the deferred items for finding their expanded blocks
+	if (pSkeleton && numDeferred) {
+		if ((apExpanded = (JBItem**)malloc(sizeof(JBItem*) * numDeferred + sizeof(unsigned int) * numDeferred))) {
+			aDeferred = (unsigned int*)&apExpanded[numDeferred];	// pointers first for alignment
+			int found = 0;
+			for (unsigned int i = 0; i < ret.num_items && found < numDeferred; i++) {
+				if (pSkeleton[i].type == JB_DEFERRED)
+					aDeferred[found++] = i;
+			}
+			memset((void*)apExpanded, 0, sizeof(JBItem*) * numDeferred);
+		} else {
+			free(pSkeleton);
+			pSkeleton = NULL;
+			memset(&ret, 0, sizeof(JBRet));
+			ret.error_code = JBERR_OUT_OF_MEMORY;
+		}
+	}
+	if (!pSkeleton)
+		numDeferred = 0;
+	if (info)
+		*info = ret;
+	return pSkeleton != NULL;
+}
+
+void JBDeferred::release()
+{
+	for (int d = 0; d < numDeferred; d++) {
+		if (apExpanded[d])
+			free(apExpanded[d]);
+	}
+	if (apExpanded)
+		free((void*)apExpanded);	// aDeferred is in the same allocation
+	if (pSkeleton)
+		free(pSkeleton);
+	pSkeleton = NULL;
+	aDeferred = NULL;
+	apExpanded = NULL;
+	numDeferred = 0;
+}
+
+const JBItem* JBDeferred::expand(const JBItem *item)
+{
+	if (!item || item->type != JB_DEFERRED || !pSkeleton)
+		return NULL;
+
+	// deferred items are indexed in memory order
+	unsigned int index = (unsigned int)(item - pSkeleton);
+	int low = 0, high = numDeferred;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (aDeferred[mid] < index)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low >= numDeferred || aDeferred[low] != index)
+		return NULL;
+	if (JBItem *expanded = (JBItem*)getPointer((void * volatile *)&apExpanded[low]))
+		return expanded;
+
+	// parse the subtree, if another thread got there first use its block
+	const char *text = json + (uint)item->data.i;
+	uint left = size - (uint)item->data.i;
+	const char *end = text;
+	if (!skipValue(end, left))
+		return NULL;
+	JBItem *expanded = parseJSON(text, (uint)(end - text), NULL, NULL, 0);
+	if (!expanded)
+		return NULL;
+	JBItem *set = (JBItem*)setPointerOnce((void * volatile *)&apExpanded[low], expanded);
+	if (set != expanded)
+		free(expanded);
+	return set;
+}
+
+const JBItem* JBDeferred::getChild(const JBItem *item)
+{
+	if (item && item->type == JB_DEFERRED)
+		item = expand(item);
+	return item ? item->getChild() : NULL;
+}
+
+jbint JBDeferred::getChildCount(const JBItem *item)
+{
+	if (item && item->type == JB_DEFERRED)
+		item = expand(item);
+	return item ? item->getChildCount() : 0;
+}
+
+const JBItem* JBDeferred::findByHash(const JBItem *item, unsigned int hash)
+{
+	if (item && item->type == JB_DEFERRED)
+		item = expand(item);
+	return item ? item->findByHash(hash) : NULL;
+}
+
 } // namespace jsonbin
 
@@ -12,8 +12,25 @@
 // Usage
 //	- Call JSONBin with a text json file in memory
 //	- Check parsing stats with optional JBRet structure
+//	- Text that ends before the root object or array is closed returns NULL
+//		with JBERR_UNEXPECTED_END in JBRet::error_code
 //	- Iterate over an array of fixed size items to process data (tree structure intact)
 //	- Single call to free(return address) to clean up.
+//	- To only build a few values of a large file call JSONBinSelect with a list
+//		of JSON Pointer paths ("/scene/objects/0/name", "~0" is '~' and "~1" is
+//		'/', "" is the whole file). The returned data only has the values at the
+//		paths and the objects and arrays leading to them, everything else is
+//		stepped over by matching brackets and quotes without creating items or
+//		strings so time and memory follows the selected data. Array elements
+//		skipped before a selected index are kept as null values so indices
+//		still match. Text that is stepped over is not validated.
+//	- To read a few values without parsing the rest use JBLazyDoc and JBLazyValue
+//		(see below), a forward only cursor over the original text that decodes
+//		values when asked and steps over unread siblings by matching brackets.
+//	- To parse only the top levels of a large file up front use JBDeferred (see
+//		below), deeper objects and arrays are parsed on first access.
+//	- To process a file as it is read without building items use JBTokenReader
+//		(see below), a forward only stream of begin / value / end tokens.
 //	- JBItem member functions
 //		- getType(): Get item type (JB_OBJECT, JB_STRING, etc. See JBType enum)
 //		- getHash(): Get the hashed value of the item name (user defined or fnv1a)
@@ -40,6 +57,14 @@
 //		==/!=: compare if two iterators point to same JBItem
 //		bool(): check if JBIterator has a valid reference to a JBItem
 //
+//	- JBFieldCache usage (looking up the same key in many objects)
+//		JBFieldCache speed(_FNV1A_speed);	// one per key, outside the loop
+//		for (JBIterator i = pObjects->begin(); i.valid(); ++i)
+//			if (const JBItem *pSpeed = speed.find(*i)) ...
+//		find(object) returns the same child as object->findByHash(hash) but
+//		first tries the child position where the key was found in the previous
+//		object, it only scans the children when the key moved.
+//
 // Detail of operation
 //
 // Read in a text JSON file and return a binary interpretation with the following traits:
@@ -89,6 +114,14 @@
 //	- C style comments (JB_ALLOW_C_COMMENTS): if "//" or "/*" encountered outside
 //		of strings, treat that as a C comment instead of an error. Definitely not
 //		valid JSON and can be disabled.
+//	- shared subtrees (JB_SHARED_SUBTREES): JSONBin replaces an object or array
+//		that is identical to an earlier one (same members, names and values) with
+//		a single JB_SHARED item referring to the first copy, like strings are
+//		shared. getType, getChild, getChildCount, begin and findByHash follow the
+//		reference so reading is unchanged, the shared item keeps its own name and
+//		sibling. The tree is still relocatable. Modules that copy or index items
+//		by position (JBBuilder, JBEditor, JBPatch, JBDiff, sectioned snapshots)
+//		expect blocks without shared subtrees.
 //
 // License
 //	Public Domain; no warranty implied; use at your own risk; attribution appreciated.
@@ -105,6 +138,12 @@ struct JBRet;
 
 JBItem* JSONBin(const char *json, unsigned int size, JBRet *info = 0);
 
+// Same as JSONBin but only includes the values at a set of JSON Pointer paths
+JBItem* JSONBinSelect(const char *json, unsigned int size, const char **paths, int numPaths, JBRet *info = 0);
+
+// Hash a plain utf-8 key string (no JSON escape codes) the same way the parser hashes names
+unsigned int JBHashKey(const char *key, unsigned int len);
+
 #define JB_FNV1A_PRIME 16777619	// as a default, FNV-1A is used for hash
 #define JB_FNV1A_SEED 2166136261
 
@@ -122,6 +161,7 @@ JBItem* JSONBin(const char *json, unsigned int size, JBRet *info = 0);
 #define JB_HANDLE_UTF8_BOM // if utf8 marker is detected, deal with it
 #define JB_ALLOW_ROOT_ARRAY // If a JSON file begins with '[' instead of '{', handle it and change the root node to type JB_ARRAY instead of JB_ROOT.
 #define JB_ALLOW_C_COMMENTS	// if "//" or "/*" encountered outside of strings, treat that as a C comment instead of an error.
+//#define JB_SHARED_SUBTREES // replace repeated objects and arrays with a reference to the first copy (JB_SHARED items)
 
 // ITEM TYPES
 enum JBType {
@@ -133,7 +173,9 @@ enum JBType {
 	JB_FLOAT,		// float value
 	JB_BOOL,		// bool value
 	JB_NULL,		// null tag (null)
-	JB_NULL_VALUE	// null value ("name" : null)
+	JB_NULL_VALUE,	// null value ("name" : null)
+	JB_DEFERRED,	// object or array that is not parsed yet (JBDeferred only), data is the offset of its text
+	JB_SHARED		// object or array identical to an earlier one (JB_SHARED_SUBTREES only), data is the item offset to it, not returned by getType
 };
 
 // ERROR CODES (return from JSONBin)
@@ -154,12 +196,18 @@ enum JBError {
 	JBERR_INTERNAL_MISS_STR,			// this indiactes an internal missing string (bug)
 	JBERR_UNREPRESENTABLE,				// value can not be represented
 	JBERR_OUT_OF_MEMORY,				// failed to allocate a buffer for processing
+	JBERR_SELECT_PATH,					// JSONBinSelect path is not a JSON Pointer or exceeds JSON_MAX_SELECT
+	JBERR_UNEXPECTED_END,				// text ended before the root object or array was closed
 };
 
 // Assumption of max hierarchical depth in a JSON file
 enum { JSON_MAX_DEPTH = 256 };
 enum { JSON_MAX_CONTEXT = 256 };
 
+// Limits for JSONBinSelect paths (total unique path steps and bytes per key)
+enum { JSON_MAX_SELECT = 256 };
+enum { JSON_MAX_SELECT_KEY = 256 };
+
 // evaluates to true if JBItem should contain named items (otherwise hashed value of name only)
 #if !defined(JB_KEY_HASH) || defined(JB_KEY_HASH_AND_NAME)
 #define JB_KEY_STRING 
@@ -204,6 +252,7 @@ struct JBRet {
 	JBError error_code;			// Look up error in JBError enum
 	int err_line;				// if error this is the line number where stopped
 	int err_column;				// if error this is the column (tabs counts as 1) where stopped
+	unsigned int shared_items;	// items removed by sharing repeated objects and arrays (JB_SHARED_SUBTREES)
 };
 
 // JBItem JBIterator (forward only)
@@ -243,7 +292,12 @@ struct JBItem {
 	} data;
 
 	// access data
+#ifdef JB_SHARED_SUBTREES
+	const JBItem* shared() const { return type == JB_SHARED ? this + data.i : this; }	// the object or array a JB_SHARED item refers to
+	JBType getType() const { return shared()->type; }
+#else
 	JBType getType() const { return type; }
+#endif
 #ifdef JB_KEY_HASH
 	unsigned int getHash() const { return hash; }
 #else
@@ -277,19 +331,205 @@ struct JBItem {
 	jbint getInt() const { return type == JB_INT ? data.i : (type == JB_FLOAT ? (jbint)data.f : 0); } // if value is number, get integer value or zero if not
 	jbfloat getFloat() const { return type == JB_FLOAT ? data.f : (type == JB_INT ? (jbfloat)data.i : jbfloat(0)); } // if value is number, get floating point value or zero if not
 	bool getBool() const { return type == JB_BOOL ? data.b : false; } // if value is bool, get bool value otherwise false
+#ifdef JB_SHARED_SUBTREES
+	const JBItem* getChild() const { return this ? shared()->getOwnChild() : 0; }
+	const JBItem* getOwnChild() const { return (data.i && (type == JB_ROOT || type == JB_OBJECT || type == JB_ARRAY)) ? this + 1 : 0; }
+#else
 	const JBItem* getChild() const { return (this && data.i && (type == JB_ROOT || type == JB_OBJECT || type == JB_ARRAY)) ? this + 1 : 0;  }
+#endif
 	const JBItem* getSibling() const { return sibling ? (this + sibling) : NULL; }
+#ifdef JB_SHARED_SUBTREES
+	jbint getChildCount() const { return this ? shared()->size() : 0; }
+#else
 	jbint getChildCount() const { return (this && (type == JB_ROOT || type == JB_OBJECT || type == JB_ARRAY)) ? data.i : 0; }
+#endif
 
 	// counts
+#ifdef JB_SHARED_SUBTREES
+	jbint size() const { const JBItem *c = shared(); return (c->type == JB_ARRAY || c->type == JB_ROOT || c->type == JB_OBJECT) ? c->data.i : 0; } // if this is an array or object or root, get number of (child) elements
+#else
 	jbint size() const { return (type == JB_ARRAY || type == JB_ROOT || type == JB_OBJECT) ? data.i : 0; } // if this is an array or object or root, get number of (child) elements
+#endif
 
 	static JBIterator end() { return JBIterator(NULL); } // end JBIterator is NULL pointer
+#ifdef JB_SHARED_SUBTREES
+	JBIterator begin() const { return JBIterator(shared()->getOwnChild()); } // if this is the root, an object or an array, return first child as an JBIterator
+#else
 	JBIterator begin() const { return ((type==JB_ARRAY || type==JB_OBJECT || type==JB_ROOT) && data.i) ? JBIterator(this+1) : JBIterator(); } // if this is the root, an object or an array, return first child as an JBIterator
+#endif
 
 	const JBItem* findByHash(unsigned int hash) const;	// get a child item by hashed name (NULL if not found)
 };
 
+// Remembers where a key was found to look it up in the next object first
+//	- Objects that repeat the same keys in the same order (records of an array)
+//		find the key at its previous position, when no member before it has
+//		children the position is read directly, otherwise the siblings are
+//		stepped without comparing hashes.
+//	- Objects with a key more than once may return a later duplicate than
+//		findByHash when the later one was cached.
+//	- Not thread safe, use one cache per thread.
+struct JBFieldCache {
+	unsigned int hash;	// key hash
+	unsigned int slot;	// child index where the key was found last
+
+	JBFieldCache(unsigned int key_hash) : hash(key_hash), slot(0) {}
+	const JBItem* find(const JBItem *object);	// get a child item by hashed name (NULL if not found)
+};
+
+// On demand cursor over JSON text (no allocations, text must stay in memory)
+//	- JBLazyDoc doc(json, size); JBLazyValue root = doc.root();
+//	- JBLazyValue has the same accessors as JBItem but is passed by value and
+//		tested with valid() or bool instead of NULL:
+//			for (JBLazyValue v = root.getChild(); v; v = v.getSibling())
+//	- getName and getStr decode into a buffer provided by the caller,
+//		getRawName / getRawStr return the text between the quotes without decoding
+//	- getSibling steps over the current value so reading forward is cheapest,
+//		getChildCount and findByHash step through the children each call
+//	- text is only checked where it is read, use JSONBin to validate a file
+struct JBLazyValue {
+	const char *name;		// key text after the opening quote, NULL if not an object member
+	const char *value;		// first character of the value, NULL if not valid
+	const char *end;		// end of the json text
+	unsigned int nameLen;	// key text length (not decoded)
+	bool root;				// root object or array
+
+	JBLazyValue() : name(0), value(0), end(0), nameLen(0), root(false) {}
+	bool valid() const { return value != 0; }
+	operator bool() const { return value != 0; }
+
+	JBType getType() const;
+	unsigned int getHash() const;
+	const jchar *getName(jchar *buf, unsigned int bufLen) const;	// decode the key, NULL if not an object member
+	unsigned int getNameLen() const;
+	const char *getRawName(unsigned int &len) const { len = nameLen; return name; }
+	const jchar *getStr(jchar *buf, unsigned int bufLen) const;	// decode a string value, NULL if not a string
+	unsigned int getStrLen() const;
+	const char *getRawStr(unsigned int &len) const;
+	jbint getInt() const;
+	jbfloat getFloat() const;
+	bool getBool() const;
+	JBLazyValue getChild() const;
+	JBLazyValue getSibling() const;
+	jbint getChildCount() const;
+	jbint size() const { return getChildCount(); }
+	JBLazyValue findByHash(unsigned int hash) const;
+};
+
+struct JBLazyDoc {
+	const char *json;
+	unsigned int size;
+
+	JBLazyDoc(const char *text, unsigned int length) : json(text), size(length) {}
+	JBLazyValue root() const;	// root object or array, not valid if the text does not begin with one
+};
+
+// Token stream over JSON text (no allocations, text must stay in memory)
+//	- JBTokenReader reader(json, size); JBToken token;
+//		while (reader.next(token)) ...
+//		returns each value in document order: JBTOK_BEGIN when an object or
+//		array opens (type JB_ROOT, JB_OBJECT or JB_ARRAY), JBTOK_VALUE for a
+//		string, number, bool or null and JBTOK_END when an object or array
+//		closes. depth is 0 for the root, 1 for its members and so on.
+//	- JBToken has the name and value accessors of JBLazyValue, numbers are
+//		converted once as they are read.
+//	- skip() after a JBTOK_BEGIN steps over the rest of that object or array
+//		by matching brackets and quotes (not validated), no JBTOK_END follows.
+//	- next() returns false after the root closes or at an error, error() is
+//		JBERR_NONE for a complete document and offset() is where reading stopped.
+//	- A sequence reader (sequence = true) reads values separated by commas
+//		and/or white space as if they were elements of a root array that has
+//		no brackets, at depth 1 without a JBTOK_BEGIN for the root (a part of
+//		an array, or one value per line). It ends at the end of the text.
+//	- Memory is fixed (a bit per level), the depth is limited by JSON_MAX_DEPTH.
+enum JBTokenKind {
+	JBTOK_BEGIN,	// object or array opened
+	JBTOK_VALUE,	// string, number, bool or null
+	JBTOK_END,		// object or array closed
+};
+
+struct JBToken {
+	JBTokenKind kind;
+	JBType type;			// JB_ROOT, JB_OBJECT, JB_ARRAY, JB_STRING, JB_INT, JB_FLOAT, JB_BOOL, JB_NULL or JB_NULL_VALUE
+	int depth;				// open objects and arrays around this value
+	const char *name;		// key text after the opening quote, NULL if not an object member
+	unsigned int nameLen;	// key text length (not decoded)
+	const char *value;		// first character of the value, a string starts after the quote
+	unsigned int valueLen;	// length of the value text (a string without quotes), 0 for objects and arrays
+	jbint i;				// number value
+	jbfloat f;
+
+	unsigned int getHash() const;
+	const jchar *getName(jchar *buf, unsigned int bufLen) const;	// decode the key, NULL if not an object member
+	unsigned int getNameLen() const;
+	const char *getRawName(unsigned int &len) const { len = nameLen; return name; }
+	const jchar *getStr(jchar *buf, unsigned int bufLen) const;	// decode a string value, NULL if not a string
+	unsigned int getStrLen() const;
+	const char *getRawStr(unsigned int &len) const { len = valueLen; return type == JB_STRING ? value : 0; }
+	jbint getInt() const { return (type == JB_INT || type == JB_FLOAT) ? i : 0; }
+	jbfloat getFloat() const { return (type == JB_INT || type == JB_FLOAT) ? f : jbfloat(0); }
+	bool getBool() const { return type == JB_BOOL && *value == 't'; }
+};
+
+struct JBTokenReader {
+	const char *json;
+	const char *text;		// read position
+	unsigned int left;
+	const char *begin;		// last object or array opened, for skip()
+	int depth;				// open objects and arrays
+	int base;				// depth of the root (1 for a sequence)
+	bool member;			// a value was read in the innermost object or array
+	bool done;
+	JBError error_code;
+	unsigned char aArray[JSON_MAX_DEPTH / 8];	// bit per level, set for arrays
+
+	JBTokenReader(const char *text, unsigned int length, bool sequence = false);
+	bool next(JBToken &token);
+	bool skip();
+	JBError error() const { return error_code; }
+	unsigned int offset() const { return (unsigned int)(text - json); }
+
+	// internal
+	bool fail(JBError error) { error_code = error; return false; }
+	bool isArray(int level) const { return (aArray[level >> 3] >> (level & 7)) & 1; }
+};
+
+// Deferred subtree parsing
+//	- JBDeferred doc; doc.open(json, size, levels) parses the first levels of the
+//		file (1 = the children of the root) into a skeleton block. Objects and
+//		arrays below that are stepped over by matching brackets and quotes and
+//		kept as JB_DEFERRED items.
+//	- doc.getChild(item), getChildCount(item) and findByHash(item, hash) work
+//		like the JBItem functions but parse a JB_DEFERRED item into its own block
+//		on first access. expand(item) returns the root of that block (JB_ROOT
+//		for an object, JB_ARRAY for an array which requires JB_ALLOW_ROOT_ARRAY).
+//	- Expanding is thread safe without locks, if two threads expand the same
+//		item at once one block is kept and the other is freed.
+//	- The json text must stay in memory until release() or the destructor.
+struct JBDeferred {
+	const char *json;
+	unsigned int size;
+	JBItem *pSkeleton;				// top levels of the file
+	unsigned int *aDeferred;		// item index of each JB_DEFERRED item in the skeleton
+	JBItem * volatile *apExpanded;	// parsed block for each deferred item or NULL
+	int numDeferred;
+
+	JBDeferred() : json(0), size(0), pSkeleton(0), aDeferred(0), apExpanded(0), numDeferred(0) {}
+	~JBDeferred() { release(); }
+	bool open(const char *text, unsigned int length, int levels, JBRet *info = 0);
+	void release();
+	const JBItem* root() const { return pSkeleton; }
+
+	const JBItem* expand(const JBItem *item);
+	const JBItem* getChild(const JBItem *item);
+	jbint getChildCount(const JBItem *item);
+	const JBItem* findByHash(const JBItem *item, unsigned int hash);
+
+private:
+	JBDeferred(const JBDeferred&);	// not copyable, the destructor frees the blocks
+	JBDeferred& operator=(const JBDeferred&);
+};
+
 // inlined JBIterator member functions
 inline JBIterator& JBIterator::operator++() { ptr = ptr->sibling ? ptr + ptr->sibling : NULL; return *this; }
 inline JBIterator JBIterator::successor() const { return (ptr&&ptr->sibling) ? JBIterator(ptr + ptr->sibling) : JBIterator(); }
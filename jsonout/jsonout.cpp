@@ -621,6 +621,24 @@ bool JSONOut::push_array(const char *name)
 
 
 
+bool JSONOut::push_raw(const char *name, const char *text, int length)
+{
+	if (error_cause != ERR_NONE)
+		return false;
+	if (inArray()) {
+		if (next_element() && add_string(text, length)) {
+			hasValue.set(hier_depth);
+			prev_type = JO_NUMBER;
+			return true;
+		}
+	} else if (next_line_indent() && add_quote_str(name) && add_string(" : ", 3) && add_string(text, length)) {
+		hasValue.set(hier_depth);
+		prev_type = JO_NUMBER;
+		return true;
+	}
+	return false;
+}
+
 // array elements
 bool JSONOut::element(const char* value)
 {
@@ -770,6 +788,21 @@ bool JSONOut::element_null()
 	return false;
 }
 
+bool JSONOut::element_raw(const char *text, int length)
+{
+	if (error_cause != ERR_NONE)
+		return false;
+	if (!isArray[hier_depth])
+		return error(ERR_NOT_ARRAY);
+
+	if (next_element() && add_string(text, length)) {
+		hasValue.set(hier_depth);
+		prev_type = JO_NUMBER;
+		return true;
+	}
+	return false;
+}
+
 bool JSONOut::element_object()
 {
 	if (error_cause != ERR_NONE)
@@ -1160,6 +1193,24 @@ bool JSONOut::push_array(const wchar_t *name)
 	return add_string(" : [", 4);
 }
 
+bool JSONOut::push_raw(const wchar_t *name, const char *text, int length)
+{
+	if (error_cause != ERR_NONE)
+		return false;
+	if (inArray()) {
+		if (next_element() && add_string(text, length)) {
+			hasValue.set(hier_depth);
+			prev_type = JO_NUMBER;
+			return true;
+		}
+	} else if (next_line_indent() && add_quote_str(name) && add_string(" : ", 3) && add_string(text, length)) {
+		hasValue.set(hier_depth);
+		prev_type = JO_NUMBER;
+		return true;
+	}
+	return false;
+}
+
 bool JSONOut::element(const wchar_t* value)
 {
 	if (error_cause != ERR_NONE)
@@ -154,6 +154,7 @@ struct JSONOut {
 	bool push_null(); // push a null
 	bool push_array(const char *name); // push a new array
 	bool push_object(const char *name); // push a new object
+	bool push_raw(const char *name, const char *text, int length); // push a number, true, false or null as text (written as is, not checked)
 
 	// value array elements
 	bool element(const char* value); // add a string element to an array (zero terminated)
@@ -166,6 +167,7 @@ struct JSONOut {
 	bool element_object(); // add an object as a value to an array (close with scope_end())
 	bool element_array(); // add an array to an array (close with scope_end())
 	bool element_null(); // add a null element to an array
+	bool element_raw(const char *text, int length); // add a number, true, false or null element as text (written as is, not checked)
 
 #ifdef JO_SUPPORT_WCHAR
 	bool push(const wchar_t *name, const wchar_t *value);	// push a string value
@@ -182,6 +184,7 @@ struct JSONOut {
 	bool push_null(const wchar_t *name); // push a null or a null value
 	bool push_array(const wchar_t *name);
 	bool push_object(const wchar_t *name); // push a new object
+	bool push_raw(const wchar_t *name, const char *text, int length); // push a number, true, false or null as text
 
 	bool element(const wchar_t* value); // add a string element to an array (zero terminated)
 	bool element(const wchar_t* value, int length); // add a string elelemnt to an array
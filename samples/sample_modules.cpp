@@ -0,0 +1,1282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../jsonbin/jsonbin.h"
+#include "../jsonbin/jbsnapshot.h"
+#include "../jsonbin/jbcache.h"
+#include "../jsonbin/jbshared.h"
+#include "../jsonbin/jblive.h"
+#include "../jsonbin/jbbuilder.h"
+#include "../jsonbin/jbeditor.h"
+#include "../jsonbin/jbpatch.h"
+#include "../jsonbin/jbdiff.h"
+#include "../jsonbin/jbshape.h"
+#include "../jsonbin/jbcolumns.h"
+#include "../jsonbin/jbindex.h"
+#include "../jsonbin/jbquery.h"
+#include "../jsonbin/jbaggregate.h"
+#include "../jsonbin/jbtransform.h"
+#include "../jsonbin/jbsort.h"
+#include "../jsonbin/jblines.h"
+#include "../jsonout/jsonout.h"
+
+#ifdef WIN32
+#include <direct.h>	// _rmdir
+#define snprintf sprintf_s
+#define rmdir _rmdir
+#else
+#include <unistd.h>	// rmdir
+#endif
+
+//
+// Run each optional jsonbin module on small documents and check the results,
+//	most checks are a round trip compared against a plain JSONBin parse.
+//
+// Requires JSONBin and the optional modules listed in readme.md
+//
+
+//=========================================================================
+// Coding style is not representative of a real product, it is kept simple
+//      to improve readability and avoid confusing dependencies.
+//=========================================================================
+
+static const char *sSceneJSON =
+"{\n"
+"  \"scene\" : {\n"
+"    \"name\" : \"harbor\",\n"
+"    \"objects\" : [\n"
+"      { \"name\" : \"boat\", \"kind\" : \"Geo\", \"speed\" : 4.5, \"matrix\" : [1, 0, 0, 0] },\n"
+"      { \"name\" : \"gull\", \"kind\" : \"Character\", \"speed\" : 12, \"behavior\" : \"circle.bt\" },\n"
+"      { \"name\" : \"crate\", \"kind\" : \"Geo\", \"speed\" : 0 },\n"
+"      { \"name\" : \"diver\", \"kind\" : \"Character\", \"speed\" : 1.5, \"behavior\" : \"swim.bt\" }\n"
+"    ]\n"
+"  },\n"
+"  \"version\" : 3,\n"
+"  \"tags\" : [\"sea\", \"day\", true, null]\n"
+"}\n";
+
+static int sFailed = 0;
+
+// print the result of a single check
+static void Check(bool ok, const char *what)
+{
+	printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok)
+		sFailed++;
+}
+
+// parse text with JSONBin, NULL on error
+static jbin::JBItem* Parse(const char *json, jbin::JBRet *info = NULL)
+{
+	return jbin::JSONBin(json, (unsigned int)strlen(json), info);
+}
+
+// child of an object by key
+static const jbin::JBItem* Key(const jbin::JBItem *item, const char *key)
+{
+	return item ? item->findByHash(jbin::JBHashKey(key, (unsigned int)strlen(key))) : NULL;
+}
+
+// child of an object or array by position
+static const jbin::JBItem* Index(const jbin::JBItem *item, int index)
+{
+	const jbin::JBItem *child = item ? item->getChild() : NULL;
+	while (child && index--)
+		child = child->getSibling();
+	return child;
+}
+
+// compare two strings that may be NULL, NULL is the same as empty
+static bool SameStr(const jbin::jchar *a, const jbin::jchar *b)
+{
+	return !strcmp(a ? a : "", b ? b : "");
+}
+
+// compare two items and everything below them, including member names and order unless any_order is set
+static bool SameValue(const jbin::JBItem *a, const jbin::JBItem *b, bool any_order = false)
+{
+	if (!a || !b)
+		return a == b;
+	jbin::JBType type = a->getType() == jbin::JB_ROOT ? jbin::JB_OBJECT : a->getType();
+	if (type != (b->getType() == jbin::JB_ROOT ? jbin::JB_OBJECT : b->getType()))
+		return false;
+	switch (type) {
+		case jbin::JB_INT: return a->getInt() == b->getInt();
+		case jbin::JB_FLOAT: return a->getFloat() == b->getFloat();
+		case jbin::JB_BOOL: return a->getBool() == b->getBool();
+		case jbin::JB_STRING: return SameStr(a->getStr(), b->getStr());
+		case jbin::JB_OBJECT:
+		case jbin::JB_ARRAY: {
+			if (a->getChildCount() != b->getChildCount())
+				return false;
+			const jbin::JBItem *ca = a->getChild(), *cb = b->getChild();
+			for (; ca && cb; ca = ca->getSibling(), cb = cb->getSibling()) {
+				const jbin::JBItem *match = (any_order && type == jbin::JB_OBJECT) ? b->findByHash(ca->getHash()) : cb;
+				if (!match || (type == jbin::JB_OBJECT && !SameStr(ca->getName(), match->getName())) || !SameValue(ca, match, any_order))
+					return false;
+			}
+			return ca == cb;
+		}
+		default: return true;
+	}
+}
+
+// compare a parsed block with a text document
+static bool SameAsText(const jbin::JBItem *item, const char *json, bool any_order = false)
+{
+	jbin::JBItem *pExpected = Parse(json);
+	bool same = pExpected && SameValue(item, pExpected, any_order);
+	free(pExpected);
+	return same;
+}
+
+// compare two text documents
+static bool SameText(const char *json, const char *expected)
+{
+	jbin::JBItem *pJSON = Parse(json);
+	bool same = pJSON && SameAsText(pJSON, expected);
+	free(pJSON);
+	return same;
+}
+
+// file for JSONOut output that is read back with ReadOut
+static FILE* OpenOut()
+{
+	return tmpfile();
+}
+
+// read back and close a file written by JSONOut, release with free
+static char* ReadOut(FILE *f)
+{
+	if (!f)
+		return NULL;
+	long size = ftell(f);
+	char *text = size >= 0 ? (char*)malloc(size + 1) : NULL;
+	if (text) {
+		fseek(f, 0, SEEK_SET);
+		text[fread(text, 1, size, f)] = 0;
+	}
+	fclose(f);
+	return text;
+}
+
+//
+// JSONBinSelect
+//
+
+static void CheckSelect()
+{
+	const char *aPaths[] = { "/scene/objects/1/name", "/version" };
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pSel = jbin::JSONBinSelect(sSceneJSON, (unsigned int)strlen(sSceneJSON), aPaths, 2, &ret);
+	const jbin::JBItem *objects = Key(Key(pSel, "scene"), "objects");
+	Check(pSel && objects && objects->getChildCount() == 2 && Index(objects, 0)->getType() == jbin::JB_NULL &&
+		SameStr(Key(Index(objects, 1), "name")->getStr(), "gull") && !Key(Index(objects, 1), "kind") &&
+		Key(pSel, "version") && Key(pSel, "version")->getInt() == 3 && !Key(pSel, "tags") && !Key(Key(pSel, "scene"), "name"),
+		"JSONBinSelect keeps only the selected paths");
+	free(pSel);
+
+	const char *aWhole[] = { "" };
+	pSel = jbin::JSONBinSelect(sSceneJSON, (unsigned int)strlen(sSceneJSON), aWhole, 1);
+	Check(SameAsText(pSel, sSceneJSON), "JSONBinSelect \"\" matches JSONBin");
+	free(pSel);
+
+	const char *aTruncated[] = { "{\"a\":", "[1,", "{\"a\":[1,2]" };
+	bool ended = true;
+	for (int t = 0; t < 3; t++) {
+		jbin::JBRet err = { 0 };
+		jbin::JBItem *pBad = Parse(aTruncated[t], &err);
+		ended = ended && !pBad && err.error_code == jbin::JBERR_UNEXPECTED_END;
+		free(pBad);
+	}
+	Check(ended, "JSONBin reports JBERR_UNEXPECTED_END for truncated text");
+}
+
+//
+// JBLazyDoc
+//
+
+// compare a lazy value and everything below it with a parsed item
+static bool SameLazy(const jbin::JBLazyValue &lazy, const jbin::JBItem *item)
+{
+	jbin::JBType type = item->getType() == jbin::JB_ROOT ? jbin::JB_OBJECT : item->getType();
+	if ((lazy.getType() == jbin::JB_ROOT ? jbin::JB_OBJECT : lazy.getType()) != type)
+		return false;
+	jbin::jchar buf[64];
+	switch (type) {
+		case jbin::JB_INT: return lazy.getInt() == item->getInt();
+		case jbin::JB_FLOAT: return lazy.getFloat() == item->getFloat();
+		case jbin::JB_BOOL: return lazy.getBool() == item->getBool();
+		case jbin::JB_STRING: return SameStr(lazy.getStr(buf, 64), item->getStr()) && lazy.getStrLen() == item->getStrLen();
+		case jbin::JB_OBJECT:
+		case jbin::JB_ARRAY: {
+			if (lazy.getChildCount() != item->getChildCount())
+				return false;
+			jbin::JBLazyValue child = lazy.getChild();
+			const jbin::JBItem *pChild = item->getChild();
+			for (; child && pChild; child = child.getSibling(), pChild = pChild->getSibling()) {
+				if (type == jbin::JB_OBJECT && (!SameStr(child.getName(buf, 64), pChild->getName()) ||
+					child.getHash() != pChild->getHash() || !lazy.findByHash(pChild->getHash())))
+					return false;
+				if (!SameLazy(child, pChild))
+					return false;
+			}
+			return !child && !pChild;
+		}
+		default: return true;
+	}
+}
+
+static void CheckLazy()
+{
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBLazyDoc doc(sSceneJSON, (unsigned int)strlen(sSceneJSON));
+	jbin::JBLazyValue root = doc.root();
+	Check(pJSON && root && SameLazy(root, pJSON), "JBLazyDoc reads the same values as JSONBin");
+	jbin::JBLazyValue missing = root.findByHash(jbin::JBHashKey("missing", 7));
+	Check(!missing && !root.findByHash(jbin::JBHashKey("scene", 5)).findByHash(jbin::JBHashKey("version", 7)), "JBLazyValue findByHash of a missing key is not valid");
+	free(pJSON);
+}
+
+//
+// JBDeferred
+//
+
+// compare a deferred item and everything below it with a parsed item, expanding on the way
+static bool SameDeferred(jbin::JBDeferred &doc, const jbin::JBItem *item, const jbin::JBItem *expected)
+{
+	if (item->getType() == jbin::JB_DEFERRED)
+		item = doc.expand(item);
+	if (!item || doc.getChildCount(item) != expected->getChildCount())
+		return false;
+	if (!expected->getChildCount())
+		return SameValue(item, expected);
+	const jbin::JBItem *child = doc.getChild(item), *pExpected = expected->getChild();
+	for (; child && pExpected; child = child->getSibling(), pExpected = pExpected->getSibling()) {
+		if (expected->getType() != jbin::JB_ARRAY && (!SameStr(child->getName(), pExpected->getName()) ||
+			doc.findByHash(item, pExpected->getHash()) != child))
+			return false;
+		if (!SameDeferred(doc, child, pExpected))
+			return false;
+	}
+	return !child && !pExpected;
+}
+
+static void CheckDeferred()
+{
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBDeferred doc;
+	bool opened = doc.open(sSceneJSON, (unsigned int)strlen(sSceneJSON), 1);
+	const jbin::JBItem *scene = Key(doc.root(), "scene");
+	Check(opened && scene && scene->getType() == jbin::JB_DEFERRED && Key(doc.root(), "version")->getInt() == 3,
+		"JBDeferred keeps objects below the first level deferred");
+	Check(opened && SameDeferred(doc, doc.root(), pJSON), "JBDeferred expands to the same values as JSONBin");
+	Check(opened && doc.expand(scene) == doc.expand(scene), "JBDeferred expands an item once");
+	free(pJSON);
+}
+
+//
+// Snapshots
+//
+
+static void CheckSnapshot()
+{
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = Parse(sSceneJSON, &ret);
+	jbin::JBSnapshotError error = jbin::JBSERR_NONE;
+	bool saved = pJSON && jbin::JBSave("sample_modules.jbin", pJSON, &ret, &error);
+	Check(saved && error == jbin::JBSERR_NONE, "JBSave writes a snapshot");
+
+	jbin::JBItem *pLoaded = jbin::JBLoad("sample_modules.jbin", &error, true);
+	Check(pLoaded && SameValue(pLoaded, pJSON), "JBLoad round trip matches JSONBin");
+	free(pLoaded);
+
+	const jbin::JBItem *pMapped = jbin::JBLoadMapped("sample_modules.jbin", &error, true);
+	Check(pMapped && SameValue(pMapped, pJSON), "JBLoadMapped round trip matches JSONBin");
+	if (pMapped)
+		jbin::JBUnloadMapped(pMapped);
+
+	// a text file is not a snapshot
+	if (FILE *f = fopen("sample_modules.jbin", "wb")) {
+		fwrite(sSceneJSON, 1, strlen(sSceneJSON), f);
+		fclose(f);
+	}
+	pLoaded = jbin::JBLoad("sample_modules.jbin", &error);
+	Check(!pLoaded && error == jbin::JBSERR_NOT_SNAPSHOT, "JBLoad refuses a file that is not a snapshot");
+	free(pLoaded);
+	remove("sample_modules.jbin");
+	free(pJSON);
+}
+
+// every top level key found through the section index is the same item as a lookup in the mapped root
+static void CheckSectioned(const char *json)
+{
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = Parse(json, &ret);
+	jbin::JBSnapshotError error = jbin::JBSERR_NONE;
+	bool saved = pJSON && jbin::JBSaveSectioned("sample_modules.jbsec", pJSON, &ret, &error);
+	jbin::JBSectioned doc;
+	bool ok = saved && doc.open("sample_modules.jbsec", &error, true) && SameValue(doc.root(), pJSON) &&
+		doc.numSections == (int)pJSON->getChildCount();
+	for (const jbin::JBItem *child = pJSON ? pJSON->getChild() : NULL; ok && child; child = child->getSibling()) {
+		const jbin::JBItem *found = doc.findByHash(child->getHash());
+		ok = found && found == doc.root()->findByHash(child->getHash()) && SameValue(found, child);
+	}
+	ok = ok && !doc.findByHash(jbin::JBHashKey("missing", 7));
+	char what[128];
+	snprintf(what, sizeof(what), "JBSectioned findByHash matches the mapped root for %d top level keys", pJSON ? (int)pJSON->getChildCount() : 0);
+	Check(ok, what);
+	doc.close();
+	remove("sample_modules.jbsec");
+	free(pJSON);
+}
+
+//
+// JBCache
+//
+
+static void CheckCache()
+{
+	if (FILE *f = fopen("sample_modules.json", "wb")) {
+		fwrite(sSceneJSON, 1, strlen(sSceneJSON), f);
+		fclose(f);
+	}
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBCache cache;
+	bool ok = cache.init("sample_modules_cache");
+	{
+		jbin::JBCacheDoc doc;
+		ok = ok && cache.load("sample_modules.json", doc) && !doc.hit && SameValue(doc.pJSON, pJSON);
+	}
+	Check(ok && cache.misses == 1 && cache.stores == 1, "JBCache parses and stores a new file");
+	{
+		jbin::JBCacheDoc doc;
+		ok = ok && cache.load("sample_modules.json", doc) && doc.hit && SameValue(doc.pJSON, pJSON);
+	}
+	Check(ok && cache.hits == 1, "JBCache maps the stored entry on the next load");
+
+	cache.max_bytes = 1;	// evict everything
+	cache.trim();
+	Check(cache.evictions == 1 && !rmdir("sample_modules_cache"), "JBCache trim evicts entries over the size limit");
+	remove("sample_modules.json");
+	free(pJSON);
+}
+
+//
+// JBShared
+//
+
+static void CheckShared()
+{
+#ifdef WIN32
+	const char *name = "Local\\sample_modules";
+#else
+	const char *name = "/sample_modules";
+#endif
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = Parse(sSceneJSON, &ret);
+	jbin::JBUnpublishShared(name);	// left over from a run that did not finish
+	jbin::JBShared publisher, reader, again;
+	bool published = pJSON && publisher.publish(name, pJSON, &ret);
+	Check(published && SameValue(publisher.pJSON, pJSON), "JBShared publishes a copy of the block");
+	Check(published && reader.attach(name, NULL, true) && reader.pJSON != pJSON && SameValue(reader.pJSON, pJSON),
+		"JBShared attach maps the published block");
+	Check(published && !again.publish(name, pJSON, &ret), "JBShared refuses to publish a name twice");
+	reader.detach();
+	publisher.detach();
+	jbin::JBUnpublishShared(name);
+	free(pJSON);
+}
+
+//
+// JBLiveDoc
+//
+
+static void CheckLive()
+{
+	static jbin::JBLiveDoc live;	// large reader slot table
+	int slot = live.attach();
+	bool ok = slot >= 0 && !live.enter(slot);
+	live.leave(slot);
+	ok = ok && live.reload(sSceneJSON, (unsigned int)strlen(sSceneJSON));
+	const jbin::JBItem *pFirst = live.enter(slot);
+	ok = ok && SameAsText(pFirst, sSceneJSON);
+
+	// replacing the version while a reader holds it keeps the old block until the reader leaves
+	const char *update = "{ \"version\" : 4 }";
+	ok = ok && live.reload(update, (unsigned int)strlen(update));
+	ok = ok && live.numRetired == 1 && SameAsText(pFirst, sSceneJSON);
+	live.leave(slot);
+	live.reclaim();
+	ok = ok && live.numRetired == 0;
+	{
+		jbin::JBLiveRead read(live, slot);
+		ok = ok && SameAsText(read.pJSON, update);
+	}
+	jbin::JBRet ret = { 0 };
+	ok = ok && !live.reload("{ \"version\" :", 13, &ret) && ret.error_code == jbin::JBERR_UNEXPECTED_END;
+	{
+		jbin::JBLiveRead read(live, slot);
+		ok = ok && SameAsText(read.pJSON, update);
+	}
+	live.detach(slot);
+	Check(ok, "JBLiveDoc keeps a version alive while it is read and swaps on reload");
+}
+
+//
+// JBBuilder / JBEditor
+//
+
+static void CheckBuilder()
+{
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBBuilder build;
+	build.begin();
+	build.key("scene", 5); build.copy(Key(pJSON, "scene"));
+	build.key("version", 7); build.addInt(3);
+	build.key("tags", 4); build.open(jbin::JB_ARRAY);
+		build.addStr("sea", 3); build.addStr("day", 3); build.addBool(true); build.addNull();
+	build.close();
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pBuilt = build.finish(&ret);
+	Check(pBuilt && SameValue(pBuilt, pJSON) && ret.num_items == (unsigned int)(jbin::JBSubtreeLast(pJSON) - pJSON) + 1,
+		"JBBuilder builds the same block as JSONBin");
+	free(pBuilt);
+
+	build.begin();
+	build.addInt(1);	// object members need a key
+	Check(!build.finish(), "JBBuilder fails on a member without a key");
+
+	jbin::JBEditor edit(pJSON);
+	jbin::JBEditRef scene = edit.find(edit.root(), jbin::JBHashKey("scene", 5));
+	jbin::JBEditRef objects = edit.find(scene, jbin::JBHashKey("objects", 7));
+	edit.setStr(edit.find(scene, jbin::JBHashKey("name", 4)), "lagoon");
+	edit.remove(edit.child(objects));
+	edit.setInt(edit.find(edit.root(), jbin::JBHashKey("version", 7)), 4);
+	edit.setBool(edit.insert(edit.root(), "edited"), true);
+	edit.insert(edit.find(edit.root(), jbin::JBHashKey("tags", 4)), NULL, edit.child(edit.find(edit.root(), jbin::JBHashKey("tags", 4))));
+	const char *expected =
+		"{ \"scene\" : { \"name\" : \"lagoon\", \"objects\" : ["
+		"{ \"name\" : \"gull\", \"kind\" : \"Character\", \"speed\" : 12, \"behavior\" : \"circle.bt\" },"
+		"{ \"name\" : \"crate\", \"kind\" : \"Geo\", \"speed\" : 0 },"
+		"{ \"name\" : \"diver\", \"kind\" : \"Character\", \"speed\" : 1.5, \"behavior\" : \"swim.bt\" } ] },"
+		"\"version\" : 4, \"tags\" : [null, \"sea\", \"day\", true, null], \"edited\" : true }";
+	jbin::JBItem *pEdited = edit.compact();
+	Check(pEdited && SameAsText(pEdited, expected) && SameAsText(pJSON, sSceneJSON), "JBEditor compact applies the edits and keeps the base block");
+	free(pEdited);
+
+	FILE *f = OpenOut();
+	if (f) {
+		jout::JSONOut out(f);
+		edit.write(out);
+		out.finish();
+	}
+	char *text = ReadOut(f);
+	Check(text && SameText(text, expected), "JBEditor write outputs the edited document");
+	free(text);
+	edit.release();
+	free(pJSON);
+}
+
+//
+// JBMergePatch / JBApplyPatch
+//
+
+// apply a merge patch or a JSON Patch (text) to a document (text) and compare with the expected document
+static bool PatchResult(const char *json, const char *patch, const char *expected, bool merge, jbin::JBPatchError expected_error = jbin::JBPATCH_NONE)
+{
+	jbin::JBItem *pJSON = Parse(json);
+	jbin::JBItem *pPatch = Parse(patch);
+	jbin::JBPatchError error = jbin::JBPATCH_NONE;
+	jbin::JBItem *pPatched = !pJSON || !pPatch ? NULL :
+		(merge ? jbin::JBMergePatch(pJSON, pPatch) : jbin::JBApplyPatch(pJSON, pPatch, NULL, &error));
+	bool ok = expected ? (pPatched && SameAsText(pPatched, expected)) : !pPatched;
+	ok = ok && error == expected_error;
+	free(pPatched);
+	free(pPatch);
+	free(pJSON);
+	return ok;
+}
+
+static void CheckPatch()
+{
+	Check(PatchResult("{ \"a\" : \"b\", \"c\" : { \"d\" : \"e\", \"f\" : \"g\" } }",
+		"{ \"a\" : \"z\", \"c\" : { \"f\" : null } }",
+		"{ \"a\" : \"z\", \"c\" : { \"d\" : \"e\" } }", true), "JBMergePatch replaces and removes members");
+	Check(PatchResult("{ \"title\" : \"Goodbye!\", \"author\" : { \"givenName\" : \"John\", \"familyName\" : \"Doe\" }, \"tags\" : [\"example\", \"sample\"], \"content\" : \"This will be unchanged\" }",
+		"{ \"title\" : \"Hello!\", \"phoneNumber\" : \"+01-123-456-7890\", \"author\" : { \"familyName\" : null }, \"tags\" : [\"example\"] }",
+		"{ \"title\" : \"Hello!\", \"author\" : { \"givenName\" : \"John\" }, \"tags\" : [\"example\"], \"content\" : \"This will be unchanged\", \"phoneNumber\" : \"+01-123-456-7890\" }",
+		true), "JBMergePatch RFC 7396 example");
+	Check(PatchResult("{ \"a\" : 1 }", "[1, 2]", "[1, 2]", true), "JBMergePatch replaces the document with a patch that is not an object");
+
+	const char *base = "{ \"foo\" : [\"bar\", \"baz\"], \"obj\" : { \"x\" : 1, \"y\" : [1, 2] }, \"n\" : 1 }";
+	Check(PatchResult(base,
+		"[ { \"op\" : \"add\", \"path\" : \"/foo/1\", \"value\" : \"qux\" },"
+		"  { \"op\" : \"remove\", \"path\" : \"/obj/x\" },"
+		"  { \"op\" : \"replace\", \"path\" : \"/n\", \"value\" : { \"deep\" : true } },"
+		"  { \"op\" : \"copy\", \"from\" : \"/obj/y\", \"path\" : \"/foo/-\" },"
+		"  { \"op\" : \"move\", \"from\" : \"/foo/0\", \"path\" : \"/first\" },"
+		"  { \"op\" : \"test\", \"path\" : \"/foo/2/1\", \"value\" : 2.0 } ]",
+		"{ \"foo\" : [\"qux\", \"baz\", [1, 2]], \"obj\" : { \"y\" : [1, 2] }, \"n\" : { \"deep\" : true }, \"first\" : \"bar\" }",
+		false), "JBApplyPatch add, remove, replace, copy, move and test");
+	Check(PatchResult(base, "[ { \"op\" : \"replace\", \"path\" : \"/n\", \"value\" : 2 }, { \"op\" : \"test\", \"path\" : \"/n\", \"value\" : 1 } ]",
+		NULL, false, jbin::JBPATCH_TEST), "JBApplyPatch fails the whole patch on a failed test");
+	Check(PatchResult(base, "[ { \"op\" : \"remove\", \"path\" : \"/foo/2\" } ]", NULL, false, jbin::JBPATCH_PATH),
+		"JBApplyPatch reports a missing path");
+}
+
+//
+// JBDiff
+//
+
+// diff two documents, apply the patch to the first and compare with the second
+static bool DiffRoundTrip(const char *from, const char *to, int expected_ops)
+{
+	jbin::JBItem *pFrom = Parse(from);
+	jbin::JBItem *pTo = Parse(to);
+	FILE *f = OpenOut();
+	bool ok = pFrom && pTo && f;
+	if (ok) {
+		jout::JSONOut out(f, true);
+		ok = jbin::JBDiff(pFrom, pTo, out);
+	}
+	char *patch = ReadOut(f);
+	jbin::JBItem *pPatch = (ok && patch) ? Parse(patch) : NULL;
+	jbin::JBItem *pPatched = pPatch ? jbin::JBApplyPatch(pFrom, pPatch) : NULL;
+	ok = pPatched && SameValue(pPatched, pTo, true) && (expected_ops < 0 || pPatch->getChildCount() == expected_ops);
+
+	// equal documents have the same root hash regardless of member order
+	unsigned long long *aPatchedHashes = pPatched ? jbin::JBSubtreeHashes(pPatched) : NULL;
+	unsigned long long *aToHashes = pTo ? jbin::JBSubtreeHashes(pTo) : NULL;
+	ok = ok && aPatchedHashes && aToHashes && aPatchedHashes[0] == aToHashes[0];
+	free(aToHashes);
+	free(aPatchedHashes);
+	free(pPatched);
+	free(pPatch);
+	free(patch);
+	free(pTo);
+	free(pFrom);
+	return ok;
+}
+
+static void CheckDiff()
+{
+	Check(DiffRoundTrip(sSceneJSON, sSceneJSON, 0), "JBDiff of equal documents is empty");
+	Check(DiffRoundTrip(sSceneJSON, "{ \"version\" : 3, \"tags\" : [\"sea\", \"day\", true, null], \"scene\" : { \"objects\" : ["
+		"{ \"name\" : \"boat\", \"kind\" : \"Geo\", \"speed\" : 4.5, \"matrix\" : [1, 0, 0, 0] },"
+		"{ \"name\" : \"gull\", \"kind\" : \"Character\", \"speed\" : 12, \"behavior\" : \"circle.bt\" },"
+		"{ \"name\" : \"crate\", \"kind\" : \"Geo\", \"speed\" : 0 },"
+		"{ \"name\" : \"diver\", \"kind\" : \"Character\", \"speed\" : 1.5, \"behavior\" : \"swim.bt\" } ], \"name\" : \"harbor\" } }", 0),
+		"JBDiff ignores member order");
+	Check(DiffRoundTrip(sSceneJSON, "{ \"scene\" : { \"name\" : \"lagoon\", \"objects\" : ["
+		"{ \"name\" : \"boat\", \"kind\" : \"Geo\", \"speed\" : 5, \"matrix\" : [1, 0, 0, 0] },"
+		"{ \"name\" : \"raft\" },"
+		"{ \"name\" : \"gull\", \"kind\" : \"Character\", \"speed\" : 12, \"behavior\" : \"circle.bt\" },"
+		"{ \"name\" : \"diver\", \"kind\" : \"Character\", \"speed\" : 1.5, \"behavior\" : \"swim.bt\" } ] },"
+		"\"tags\" : [\"sea\", \"day\", true, null], \"added\" : { \"x\" : [] } }", -1),
+		"JBDiff patch turns the first document into the second");
+	Check(DiffRoundTrip("[1, 2, 3, 4]", "[1, 2, 9, 3, 4]", 1) && DiffRoundTrip("[1, 2, 3, 4]", "[1, 3, 4]", 1) && DiffRoundTrip("[1, 2, 3, 4]", "[4, 3, 2]", -1),
+		"JBDiff of arrays inserts and removes elements");
+	Check(DiffRoundTrip("{ \"a\" : 1 }", "{ \"a\" : 1.0 }", 1), "JBDiff tells int and float apart");
+}
+
+//
+// JB_SHARED_SUBTREES
+//
+
+// repeated objects and arrays are shared when JB_SHARED_SUBTREES is defined and read the same either way
+static void CheckSharedSubtrees()
+{
+	const char *aJSON[] = {
+		"{ \"v\" : [[0, 0, 0], [0, 0, 0]] }",
+		"{ \"a\" : { \"x\" : 1 }, \"b\" : { \"x\" : 1 } }",
+		"{ \"a\" : [1, 2], \"b\" : [1, 2], \"c\" : [1, 3], \"d\" : { \"e\" : [1, 2] } }",
+	};
+	const unsigned int aShared[] = { 3, 1, 4 };	// items removed
+	bool ok = true;
+	for (int t = 0; t < 3; t++) {
+		jbin::JBRet ret = { 0 };
+		jbin::JBItem *pJSON = Parse(aJSON[t], &ret);
+		jbin::JBLazyDoc doc(aJSON[t], (unsigned int)strlen(aJSON[t]));
+		ok = ok && pJSON && SameLazy(doc.root(), pJSON);
+#ifdef JB_SHARED_SUBTREES
+		ok = ok && ret.shared_items == aShared[t];
+#else
+		ok = ok && ret.shared_items == 0 && aShared[t];
+#endif
+		free(pJSON);
+	}
+	Check(ok, "JB_SHARED_SUBTREES shares repeated objects and arrays, including the last child");
+}
+
+//
+// JBExtract
+//
+
+static void CheckExtract()
+{
+	jbin::JBRet whole = { 0 };
+	jbin::JBItem *pJSON = Parse(sSceneJSON, &whole);
+	const jbin::JBItem *objects = Key(Key(pJSON, "scene"), "objects");
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pScene = jbin::JBExtract(Key(pJSON, "scene"), &ret);
+	Check(pScene && pScene->getType() == jbin::JB_ROOT && SameValue(pScene, Key(pJSON, "scene")) &&
+		ret.num_items == (unsigned int)(jbin::JBSubtreeLast(Key(pJSON, "scene")) - Key(pJSON, "scene")) + 1 && ret.bin_size < whole.bin_size,
+		"JBExtract copies an object into a root object with only its strings");
+	jbin::JBItem *pObjects = jbin::JBExtract(objects);
+	Check(pObjects && pObjects->getType() == jbin::JB_ARRAY && SameValue(pObjects, objects), "JBExtract copies an array into a root array");
+	jbin::JBItem *pBoat = jbin::JBExtract(Index(objects, 0));
+	Check(pBoat && SameAsText(pBoat, "{ \"name\" : \"boat\", \"kind\" : \"Geo\", \"speed\" : 4.5, \"matrix\" : [1, 0, 0, 0] }") &&
+		!jbin::JBExtract(Key(pJSON, "version")), "JBExtract copies an array element and refuses plain values");
+	free(pBoat);
+	free(pObjects);
+	free(pScene);
+	free(pJSON);
+}
+
+//
+// JBConcat / JBMergeObjects
+//
+
+static void CheckConcat()
+{
+	const char *aParts[] = { "[1, \"a\", { \"b\" : [] }]", "{ \"c\" : \"a\" }", "[]", "[null, \"c\"]" };
+	jbin::JBItem *apBlocks[4];
+	for (int b = 0; b < 4; b++)
+		apBlocks[b] = Parse(aParts[b]);
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pAll = jbin::JBConcat(apBlocks, 4, &ret);
+	Check(pAll && SameAsText(pAll, "[1, \"a\", { \"b\" : [] }, { \"c\" : \"a\" }, null, \"c\"]") && ret.num_items == 9,
+		"JBConcat appends root arrays and root objects");
+	free(pAll);
+	for (int b = 0; b < 4; b++)
+		free(apBlocks[b]);
+
+	const char *aLayers[] = { "{ \"a\" : 1, \"b\" : { \"x\" : 1 }, \"c\" : [1] }", "{ \"b\" : { \"y\" : 2 }, \"d\" : true }", "{ \"a\" : \"top\" }" };
+	for (int b = 0; b < 3; b++)
+		apBlocks[b] = Parse(aLayers[b]);
+	jbin::JBItem *pMerged = jbin::JBMergeObjects(apBlocks, 3);
+	Check(pMerged && SameAsText(pMerged, "{ \"a\" : \"top\", \"b\" : { \"y\" : 2 }, \"c\" : [1], \"d\" : true }", true),
+		"JBMergeObjects replaces members with later layers");
+	free(pMerged);
+	free(apBlocks[2]);
+	apBlocks[2] = Parse("[1, 2]");
+	pMerged = jbin::JBMergeObjects(apBlocks, 3);
+	Check(!pMerged, "JBMergeObjects refuses a block that is not a root object");
+	free(pMerged);
+	for (int b = 0; b < 3; b++)
+		free(apBlocks[b]);
+}
+
+//
+// JBShapes
+//
+
+static const char *sRecordsJSON =
+"{\n"
+"  \"points\" : [ { \"x\" : 1, \"y\" : 2 }, { \"x\" : 3, \"y\" : 4 }, { \"x\" : 5, \"y\" : 6 } ],\n"
+"  \"items\" : [ { \"id\" : 1, \"v\" : [1], \"name\" : \"a\" }, { \"id\" : 2, \"v\" : [2, 3], \"name\" : \"b\" } ],\n"
+"  \"mixed\" : [ { \"x\" : 1 }, { \"y\" : 1 } ],\n"
+"  \"more\" : [ { \"x\" : 7, \"y\" : 8 }, { \"x\" : 9, \"y\" : 10 } ]\n"
+"}\n";
+
+// every field found through the shape is the same item as findByHash
+static bool SameFields(const jbin::JBShapes &shapes, const jbin::JBItem *array)
+{
+	const jbin::JBShapedArray *records = shapes.find(array);
+	if (!records)
+		return false;
+	const jbin::JBShape &shape = shapes.getShape(records->shape);
+	for (const jbin::JBItem *rec = array->getChild(); rec; rec = rec->getSibling()) {
+		for (unsigned int k = 0; k < shape.numKeys; k++) {
+			unsigned int hash = shapes.getKeyHash(records->shape, (int)k);
+			if (shapes.slot(records->shape, hash) != (int)k || records->field(rec, (int)k) != rec->findByHash(hash))
+				return false;
+		}
+	}
+	return shapes.slot(records->shape, jbin::JBHashKey("missing", 7)) < 0 && !records->field(array->getChild(), -1);
+}
+
+static void CheckShapes()
+{
+	jbin::JBItem *pJSON = Parse(sRecordsJSON);
+	jbin::JBShapes shapes;
+	bool built = pJSON && shapes.build(pJSON);
+	const jbin::JBShapedArray *points = built ? shapes.find(Key(pJSON, "points")) : NULL;
+	const jbin::JBShapedArray *items = built ? shapes.find(Key(pJSON, "items")) : NULL;
+	const jbin::JBShapedArray *more = built ? shapes.find(Key(pJSON, "more")) : NULL;
+	Check(points && items && more && !shapes.find(Key(pJSON, "mixed")) && shapes.numArrays == 3 && shapes.numShapes == 2 &&
+		points->shape == more->shape && shapes.getShape(points->shape).numRecords == 5 && points->flat && !items->flat,
+		"JBShapes finds arrays of same-keyed records");
+	Check(built && SameFields(shapes, Key(pJSON, "points")) && SameFields(shapes, Key(pJSON, "items")),
+		"JBShapedArray field matches findByHash for every record");
+	free(pJSON);
+}
+
+//
+// JBFieldCache
+//
+
+static void CheckFieldCache()
+{
+	const char *json = "[ { \"a\" : 1, \"b\" : [2], \"c\" : 3 }, { \"a\" : 4, \"b\" : [], \"c\" : 6 }, { \"c\" : 7, \"a\" : 8 },"
+		" { \"b\" : { \"x\" : 1 } }, {}, { \"x\" : 0, \"a\" : 9, \"b\" : null, \"c\" : 10 } ]";
+	jbin::JBItem *pJSON = Parse(json);
+	const char *aKeys[] = { "a", "b", "c", "x" };
+	bool ok = pJSON != NULL;
+	for (int k = 0; ok && k < 4; k++) {
+		jbin::JBFieldCache cache(jbin::JBHashKey(aKeys[k], 1));
+		for (int pass = 0; pass < 2; pass++) {	// second pass starts with the slot of the last object
+			for (const jbin::JBItem *rec = pJSON->getChild(); ok && rec; rec = rec->getSibling())
+				ok = cache.find(rec) == rec->findByHash(cache.hash);
+		}
+	}
+	Check(ok, "JBFieldCache finds the same member as findByHash when keys move or are missing");
+	free(pJSON);
+}
+
+//
+// JBToColumns
+//
+
+// every column value matches the member of its record
+static bool SameColumns(const jbin::JBColumns &cols, const jbin::JBItem *array)
+{
+	if (cols.numRecords != (unsigned int)array->getChildCount())
+		return false;
+	unsigned int r = 0;
+	for (const jbin::JBItem *rec = array->getChild(); rec; rec = rec->getSibling(), r++) {
+		for (unsigned int c = 0; c < cols.numColumns; c++) {
+			const jbin::JBColumn &col = cols.aColumns[c];
+			const jbin::JBItem *value = rec->findByHash(col.hash);
+			jbin::JBType type = value ? value->getType() : jbin::JB_NULL;
+			bool number = type == jbin::JB_INT || type == jbin::JB_FLOAT;
+			switch (col.type) {
+				case jbin::JBCOL_INT:
+					if (col.valid(r) != number || (number && col.ints()[r] != value->getInt()))
+						return false;
+					break;
+				case jbin::JBCOL_FLOAT:
+					if (col.valid(r) != number || (number && col.floats()[r] != value->getFloat()))
+						return false;
+					break;
+				case jbin::JBCOL_BOOL:
+					if (col.valid(r) != (type == jbin::JB_BOOL) || (type == jbin::JB_BOOL && col.bools()[r] != value->getBool()))
+						return false;
+					break;
+				case jbin::JBCOL_STRING:
+					if (col.valid(r) != (type == jbin::JB_STRING) || (type == jbin::JB_STRING && (!SameStr(col.getStr(r), value->getStr()) ||
+						col.getStrLen(r) != value->getStrLen())))
+						return false;
+					break;
+			}
+		}
+	}
+	return true;
+}
+
+static void CheckColumns()
+{
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	const jbin::JBItem *objects = Key(Key(pJSON, "scene"), "objects");
+	jbin::JBColumnDef aSchema[] = { { "name", jbin::JBCOL_STRING }, { "speed", jbin::JBCOL_FLOAT }, { "speed", jbin::JBCOL_INT },
+		{ "behavior", jbin::JBCOL_STRING }, { "kind", jbin::JBCOL_BOOL }, { "missing", jbin::JBCOL_INT } };
+	jbin::JBColumns cols;
+	bool ok = objects && jbin::JBToColumns(cols, objects, aSchema, 6, 2);
+	Check(ok && SameColumns(cols, objects) && !cols.aColumns[3].valid(0) && cols.aColumns[3].valid(1),
+		"JBToColumns fills typed columns with a valid bit per record");
+	jbin::JBColumns loaded;
+	ok = ok && cols.save("sample_modules.jbcol") && loaded.load("sample_modules.jbcol");
+	Check(ok && loaded.numColumns == 6 && SameColumns(loaded, objects), "JBColumns save and load round trip");
+	loaded.release();
+	remove("sample_modules.jbcol");
+	free(pJSON);
+}
+
+//
+// JBStringIndex
+//
+
+// every string value of the block is found with the same items as a walk over all items
+static bool SameStringHits(const jbin::JBStringIndex &index, const jbin::JBItem *pJSON, unsigned int num_items)
+{
+	for (unsigned int i = 0; i < num_items; i++) {
+		const jbin::jchar *str = pJSON[i].getStr();
+		if (pJSON[i].getType() != jbin::JB_STRING || !str)
+			continue;
+		const jbin::JBItem *aHits[16];
+		unsigned int len = (unsigned int)strlen(str);
+		unsigned int hits = index.findAll(str, len, aHits, 16), expected = 0;
+		for (unsigned int j = 0; j < num_items; j++) {
+			if (pJSON[j].getType() == jbin::JB_STRING && SameStr(pJSON[j].getStr(), str)) {
+				if (expected >= hits || aHits[expected] != pJSON + j)
+					return false;
+				expected++;
+			}
+		}
+		if (hits != expected)
+			return false;
+	}
+	return index.findString("missing", 7) < 0;
+}
+
+static void CheckStringIndex()
+{
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = Parse(sSceneJSON, &ret);
+	jbin::JBStringIndex index;
+	bool ok = pJSON && index.build(pJSON, &ret, 2);
+	const jbin::JBItem *aHits[4];
+	unsigned int geo = ok ? index.findByKey(jbin::JBHashKey("kind", 4), "Geo", 3, aHits, 4) : 0;
+	unsigned int day = ok ? index.findByKey(0, "day", 3, aHits + 2, 2) : 0;	// array elements have key hash 0
+	Check(ok && SameStringHits(index, pJSON, ret.num_items) && geo == 2 && aHits[0] == Key(Index(Key(Key(pJSON, "scene"), "objects"), 0), "kind") &&
+		day == 1 && aHits[2] == Index(Key(pJSON, "tags"), 1) && !index.findByKey(jbin::JBHashKey("name", 4), "Geo", 3, aHits, 4),
+		"JBStringIndex finds the items with a string value");
+	jbin::JBStringIndex loaded;
+	ok = ok && index.save("sample_modules.idx") && loaded.load("sample_modules.idx", pJSON, ret.num_items, ret.bin_size);
+	Check(ok && SameStringHits(loaded, pJSON, ret.num_items) && !jbin::JBStringIndex().load("sample_modules.idx", pJSON, ret.num_items + 1, ret.bin_size),
+		"JBStringIndex save and load round trip");
+	loaded.release();
+	remove("sample_modules.idx");
+	free(pJSON);
+}
+
+//
+// JBKeySummary
+//
+
+// a query finds the same items with and without the key summary
+static bool SameWithSummary(const jbin::JBItem *pJSON, const jbin::JBKeySummary &summary, const char *path, int expected)
+{
+	jbin::JBQuery query(path);
+	const jbin::JBItem *aPlain[16], *aPruned[16];
+	int plain = query.run(pJSON, aPlain, 16);
+	int pruned = query.run(pJSON, aPruned, 16, &summary);
+	if (!query.valid() || plain != expected || pruned != plain)
+		return false;
+	for (int i = 0; i < plain && i < 16; i++) {
+		if (aPlain[i] != aPruned[i])
+			return false;
+	}
+	return query.first(pJSON, &summary) == (plain ? aPlain[0] : NULL);
+}
+
+static void CheckKeySummary()
+{
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBKeySummary summary;
+	bool ok = pJSON && summary.build(pJSON, 2) && summary.numBlooms;
+	const jbin::JBItem *objects = Key(Key(pJSON, "scene"), "objects");
+	Check(ok && SameWithSummary(pJSON, summary, "$..name", 5) && SameWithSummary(pJSON, summary, "$..behavior", 2) &&
+		SameWithSummary(pJSON, summary, "$.scene..speed", 4) && SameWithSummary(pJSON, summary, "$..missing", 0) &&
+		SameWithSummary(pJSON, summary, "$..objects[1].name", 1),
+		"JBKeySummary recursive descent finds the same items as without it");
+	unsigned int behavior = jbin::JBHashKey("behavior", 8), missing = jbin::JBHashKey("missing", 7);
+	Check(ok && summary.findBelow(pJSON, behavior) == Key(Index(objects, 1), "behavior") &&
+		summary.findBelow(Index(objects, 2), behavior) == NULL && summary.findBelow(objects, jbin::JBHashKey("matrix", 6)) == Key(Index(objects, 0), "matrix") &&
+		!summary.mayContain(pJSON, missing) && !summary.findBelow(pJSON, missing) && summary.mayContain(objects, behavior),
+		"JBKeySummary findBelow and mayContain");
+	free(pJSON);
+}
+
+//
+// JBTokenReader and JBAggregate
+//
+
+// the tokens of the text are the items of the parsed block in the same order
+static bool SameTokens(jbin::JBTokenReader &reader, const jbin::JBItem *item, int depth)
+{
+	jbin::JBToken token;
+	if (!reader.next(token) || token.depth != depth || token.type != item->getType() || token.getHash() != item->getHash())
+		return false;
+	switch (item->getType()) {
+		case jbin::JB_ROOT:
+		case jbin::JB_OBJECT:
+		case jbin::JB_ARRAY:
+			if (token.kind != jbin::JBTOK_BEGIN)
+				return false;
+			for (const jbin::JBItem *child = item->getChild(); child; child = child->getSibling()) {
+				if (!SameTokens(reader, child, depth + 1))
+					return false;
+			}
+			return reader.next(token) && token.kind == jbin::JBTOK_END && token.depth == depth;
+		case jbin::JB_STRING: {
+			jbin::jchar buf[64];
+			return token.kind == jbin::JBTOK_VALUE && SameStr(token.getStr(buf, 64), item->getStr());
+		}
+		case jbin::JB_INT: return token.kind == jbin::JBTOK_VALUE && token.getInt() == item->getInt();
+		case jbin::JB_FLOAT: return token.kind == jbin::JBTOK_VALUE && token.getFloat() == item->getFloat();
+		case jbin::JB_BOOL: return token.kind == jbin::JBTOK_VALUE && token.getBool() == item->getBool();
+		default: return token.kind == jbin::JBTOK_VALUE;
+	}
+}
+
+// number value of an int or float item
+static double Number(const jbin::JBItem *item)
+{
+	return item->getType() == jbin::JB_INT ? (double)item->getInt() : (double)item->getFloat();
+}
+
+// the stats and histogram of a key in every element of a root array, counted over the parsed block
+static bool SameStats(const jbin::JBAggregate &agg, int slot, const jbin::JBItem *array, const char *key, double lo, double hi, unsigned int numBuckets)
+{
+	const jbin::JBAggResult &r = agg.get(slot);
+	unsigned int count = 0, numbers = 0, below = 0, above = 0, aBuckets[8] = { 0 };
+	double sum = 0.0, min = 0.0, max = 0.0;
+	for (const jbin::JBItem *element = array->getChild(); element; element = element->getSibling()) {
+		const jbin::JBItem *item = Key(element, key);
+		if (!item)
+			continue;
+		count++;
+		if (item->getType() != jbin::JB_INT && item->getType() != jbin::JB_FLOAT)
+			continue;
+		double value = Number(item);
+		min = (!numbers || value < min) ? value : min;
+		max = (!numbers || value > max) ? value : max;
+		numbers++;
+		sum += value;
+		if (!numBuckets)
+			continue;
+		if (value < lo)
+			below++;
+		else if (value > hi)
+			above++;
+		else {
+			unsigned int bucket = (unsigned int)((value - lo) / (hi - lo) * numBuckets);
+			aBuckets[bucket < numBuckets ? bucket : numBuckets - 1]++;
+		}
+	}
+	if (r.count != count || r.numbers != numbers || r.sum != sum || r.min != min || r.max != max)
+		return false;
+	if (numBuckets && (!r.aBuckets || r.below != below || r.above != above || memcmp(r.aBuckets, aBuckets, numBuckets * sizeof(unsigned int))))
+		return false;
+	return true;
+}
+
+// the distinct string values of a key in order of first appearance
+static bool SameCategories(const jbin::JBAggregate &agg, int slot, const jbin::JBItem *array, const char *key)
+{
+	const jbin::JBAggResult &r = agg.get(slot);
+	unsigned int total = 0;
+	for (const jbin::JBItem *element = array->getChild(); element; element = element->getSibling()) {
+		const jbin::JBItem *item = Key(element, key);
+		if (!item)
+			continue;
+		unsigned int len = (unsigned int)strlen(item->getStr()), c = 0;
+		while (c < r.numCategories && (r.aCategories[c].len != len || strncmp(r.aCategories[c].text, item->getStr(), len)))
+			c++;
+		if (c == r.numCategories || r.aCategories[c].type != jbin::JB_STRING)
+			return false;
+		if (c > total)	// categories are listed in order of first appearance
+			return false;
+		total += c == total;
+	}
+	for (unsigned int c = 0; c < r.numCategories; c++) {
+		unsigned int count = 0;
+		for (const jbin::JBItem *element = array->getChild(); element; element = element->getSibling())
+			count += Key(element, key) && (unsigned int)strlen(Key(element, key)->getStr()) == r.aCategories[c].len && !strncmp(Key(element, key)->getStr(), r.aCategories[c].text, r.aCategories[c].len);
+		if (count != r.aCategories[c].count)
+			return false;
+	}
+	return total == r.numCategories;
+}
+
+static void CheckAggregate()
+{
+	static char sRecords[4096];
+	int len = snprintf(sRecords, sizeof(sRecords), "[");
+	for (int i = 0; i < 40; i++) {
+		const char *sep = i ? ",\n" : "\n";
+		if (i % 7 == 3)
+			len += snprintf(sRecords + len, sizeof(sRecords) - len, "%s{ \"id\" : %d, \"kind\" : \"k%d\", \"pos\" : { \"speed\" : [%d, \"]\"] } }", sep, i, i % 3, i);
+		else if (i % 11 == 5)
+			len += snprintf(sRecords + len, sizeof(sRecords) - len, "%s{ \"id\" : %d, \"kind\" : \"k%d\", \"speed\" : \"fast\" }", sep, i, i % 3);
+		else
+			len += snprintf(sRecords + len, sizeof(sRecords) - len, (i & 1) ? "%s{ \"id\" : %d, \"kind\" : \"k%d\", \"speed\" : %d.5 }" :
+				"%s{ \"id\" : %d, \"kind\" : \"k%d\", \"speed\" : %d }", sep, i, i % 3, i / 2);	// float and int speeds
+	}
+	len += snprintf(sRecords + len, sizeof(sRecords) - len, "\n]\n");
+
+	jbin::JBItem *pJSON = Parse(sSceneJSON);
+	jbin::JBTokenReader reader(sSceneJSON, (unsigned int)strlen(sSceneJSON));
+	jbin::JBToken token;
+	Check(pJSON && SameTokens(reader, pJSON, 0) && !reader.next(token) && reader.error() == jbin::JBERR_NONE,
+		"JBTokenReader returns the items of a parse in document order");
+	free(pJSON);
+
+	pJSON = Parse(sRecords);
+	jbin::JBAggregate agg;
+	int speed = agg.add("$[*].speed");
+	int hist = agg.addHistogram("$.*.speed", 2.0, 14.0, 6);
+	int kinds = agg.add("$[*].kind", jbin::JBAGG_CATEGORIES);
+	int fifth = agg.add("/4/speed");
+	bool ok = pJSON && speed >= 0 && hist >= 0 && kinds >= 0 && fifth >= 0 && agg.run(sRecords, (unsigned int)len);
+	Check(ok && SameStats(agg, speed, pJSON, "speed", 0.0, 1.0, 0) && SameStats(agg, hist, pJSON, "speed", 2.0, 14.0, 6) &&
+		SameCategories(agg, kinds, pJSON, "kind") && agg.get(kinds).numCategories == 3 && agg.get(fifth).count == 1 && agg.get(fifth).sum == 2.0,
+		"JBAggregate matches the values counted over a parsed block");
+
+	jbin::JBAggregate parallel;
+	parallel.add("$[*].speed");
+	parallel.addHistogram("$.*.speed", 2.0, 14.0, 6);
+	parallel.add("$[*].kind", jbin::JBAGG_CATEGORIES);
+	parallel.add("/4/speed");
+	ok = ok && parallel.runParallel(sRecords, (unsigned int)len, 2);
+	Check(ok && SameStats(parallel, speed, pJSON, "speed", 0.0, 1.0, 0) && SameStats(parallel, hist, pJSON, "speed", 2.0, 14.0, 6) &&
+		SameCategories(parallel, kinds, pJSON, "kind") && parallel.get(fifth).sum == 2.0,
+		"JBAggregate runParallel matches run");
+
+	ok = ok && parallel.merge(agg);
+	Check(ok && parallel.get(speed).count == 2 * agg.get(speed).count && parallel.get(speed).sum == 2 * agg.get(speed).sum &&
+		parallel.get(hist).aBuckets[0] == 2 * agg.get(hist).aBuckets[0] && parallel.get(kinds).aCategories[0].count == 2 * agg.get(kinds).aCategories[0].count,
+		"JBAggregate merge adds the results");
+
+	const char *bad = "[{ \"speed\" : 1 }, { \"speed\" : }]";
+	agg.reset();
+	Check(!agg.run(bad, (unsigned int)strlen(bad)) && agg.error_code != jbin::JBERR_NONE && agg.add("$[*].speed[") < 0,
+		"JBAggregate reports syntax errors in the text and the path");
+	free(pJSON);
+}
+
+//
+// JBTransform
+//
+
+// rewrite text through a transform into JSONOut and read the result back, release with free
+static char* TransformText(jbin::JBTransform &xf, const char *json, const char *path = NULL)
+{
+	FILE *f = OpenOut();
+	bool ok = f != NULL;
+	if (ok) {
+		jout::JSONOut out(f);
+		ok = path ? xf.runFile(path, out) : xf.run(json, (unsigned int)strlen(json), out);
+	}
+	char *text = ReadOut(f);
+	if (!ok) {
+		free(text);
+		text = NULL;
+	}
+	return text;
+}
+
+// rewrite text through a transform and compare with the expected text
+static bool TransformResult(jbin::JBTransform &xf, const char *json, const char *expected)
+{
+	char *text = TransformText(xf, json);
+	bool same = text && SameText(text, expected);
+	free(text);
+	return same;
+}
+
+// transform filter that drops null values
+static bool NoNulls(const jbin::JBToken &token, void *)
+{
+	return token.type != jbin::JB_NULL && token.type != jbin::JB_NULL_VALUE;
+}
+
+static void CheckTransform()
+{
+	const char *sDropped =
+		"{ \"scene\" : { \"name\" : \"harbor\", \"objects\" : ["
+		"{ \"name\" : \"boat\", \"type\" : \"Geo\", \"speed\" : 4.5, \"matrix\" : [1, 0, 0, 0] },"
+		"{ \"name\" : \"gull\", \"type\" : \"Character\", \"speed\" : 12 },"
+		"{ \"name\" : \"crate\", \"type\" : \"Geo\", \"speed\" : 0 },"
+		"{ \"name\" : \"diver\", \"type\" : \"Character\", \"speed\" : 1.5 } ] },"
+		"\"version\" : 3, \"tags\" : [\"sea\", \"day\", true, null] }";
+	jbin::JBTransform xf;
+	bool ok = xf.drop("$..behavior") && xf.rename("$.scene.objects[*].kind", "type");
+	Check(ok && TransformResult(xf, sSceneJSON, sDropped), "JBTransform drops and renames keys");
+
+	if (FILE *f = fopen("sample_modules.json", "wb")) {
+		fwrite(sSceneJSON, 1, strlen(sSceneJSON), f);
+		fclose(f);
+	}
+	char *text = ok ? TransformText(xf, NULL, "sample_modules.json") : NULL;
+	Check(text && SameText(text, sDropped), "JBTransform runFile matches run");
+	free(text);
+	remove("sample_modules.json");
+
+	jbin::JBTransform kept;
+	ok = kept.keep("$.scene.objects[*].name") && kept.keep("/version") && kept.drop("$.scene.objects[2]");
+	Check(ok && TransformResult(kept, sSceneJSON,
+		"{ \"scene\" : { \"objects\" : [{ \"name\" : \"boat\" }, { \"name\" : \"gull\" }, { \"name\" : \"diver\" }] }, \"version\" : 3 }"),
+		"JBTransform keeps only the paths and the objects leading to them");
+
+	jbin::JBTransform filtered;
+	filtered.setFilter(NoNulls, NULL);
+	text = TransformText(filtered, "[1, null, { \"a\" : null, \"b\" : 1.2345678901234567890123 }, [null]]");
+	Check(text && SameText(text, "[1, { \"b\" : 1.2345678901234567890123 }, []]") && strstr(text, "1.2345678901234567890123"),
+		"JBTransform filter drops values and numbers keep their text");
+	free(text);
+
+	const char *bad = "{ \"a\" : [1, 2 }";
+	Check(!TransformText(filtered, bad) && filtered.error_code != jbin::JBERR_NONE && !filtered.keep("$.a[") && filtered.path_error != jbin::JBQERR_NONE,
+		"JBTransform reports syntax errors in the text and the path");
+}
+
+//
+// JBSortArray / JBGroupBy
+//
+
+static const char *sMixedJSON =
+"[{ \"id\" : 0, \"v\" : 3 }, { \"id\" : 1, \"v\" : \"b\" }, { \"id\" : 2 }, { \"id\" : 3, \"v\" : 1.5 }, { \"id\" : 4, \"v\" : 3 },"
+" { \"id\" : 5, \"v\" : true }, { \"id\" : 6, \"v\" : \"a\" }, { \"id\" : 7, \"v\" : null }, { \"id\" : 8, \"v\" : false }, 9,"
+" { \"id\" : 10, \"v\" : 1 }, { \"id\" : 11, \"v\" : [1] }]";
+
+// sort a document with a root array by a key and compare with the expected text
+static bool SortResult(const char *json, const char *key, jbin::JBSortOrder order, const char *expected)
+{
+	jbin::JBItem *pJSON = Parse(json);
+	jbin::JBItem *pSorted = pJSON ? jbin::JBSortArray(pJSON, key ? jbin::JBHashKey(key, (unsigned int)strlen(key)) : 0, order, 2) : NULL;
+	bool same = pSorted && SameAsText(pSorted, expected);
+	free(pSorted);
+	free(pJSON);
+	return same;
+}
+
+// a large array sorted on several threads (runs of at least 1024 keys) is ordered by value and then by original position
+static bool SortedInOrder(unsigned int threads)
+{
+	const int count = 5000;
+	const size_t size = count * 40;
+	char *values = (char*)malloc(size);
+	if (!values)
+		return false;
+	int len = snprintf(values, size, "[");
+	for (int i = 0; i < count; i++)
+		len += snprintf(values + len, size - len, "%s{ \"i\" : %d, \"v\" : %d }", i ? ", " : "", i, (i * 37) % 101);
+	snprintf(values + len, size - len, "]");
+	jbin::JBItem *pJSON = Parse(values);
+	free(values);
+	jbin::JBItem *pSorted = pJSON ? jbin::JBSortArray(pJSON, jbin::JBHashKey("v", 1), jbin::JBSORT_ASCENDING, threads) : NULL;
+	bool ok = pSorted && pSorted->getChildCount() == count;
+	const jbin::JBItem *prev = NULL;
+	for (const jbin::JBItem *element = pSorted ? pSorted->getChild() : NULL; ok && element; prev = element, element = element->getSibling()) {
+		if (prev) {
+			jbin::jbint pv = Key(prev, "v")->getInt(), v = Key(element, "v")->getInt();
+			ok = pv < v || (pv == v && Key(prev, "i")->getInt() < Key(element, "i")->getInt());
+		}
+	}
+	free(pSorted);
+	free(pJSON);
+	return ok;
+}
+
+static void CheckSort()
+{
+	Check(SortResult(sMixedJSON, "v", jbin::JBSORT_ASCENDING,
+		"[{ \"id\" : 10, \"v\" : 1 }, { \"id\" : 3, \"v\" : 1.5 }, { \"id\" : 0, \"v\" : 3 }, { \"id\" : 4, \"v\" : 3 }, { \"id\" : 6, \"v\" : \"a\" },"
+		" { \"id\" : 1, \"v\" : \"b\" }, { \"id\" : 8, \"v\" : false }, { \"id\" : 5, \"v\" : true }, { \"id\" : 7, \"v\" : null },"
+		" { \"id\" : 11, \"v\" : [1] }, { \"id\" : 2 }, 9]"),
+		"JBSortArray ascending sorts numbers, strings, bools and null with missing keys last");
+	Check(SortResult(sMixedJSON, "v", jbin::JBSORT_DESCENDING,
+		"[{ \"id\" : 11, \"v\" : [1] }, { \"id\" : 7, \"v\" : null }, { \"id\" : 5, \"v\" : true }, { \"id\" : 8, \"v\" : false },"
+		" { \"id\" : 1, \"v\" : \"b\" }, { \"id\" : 6, \"v\" : \"a\" }, { \"id\" : 0, \"v\" : 3 }, { \"id\" : 4, \"v\" : 3 },"
+		" { \"id\" : 3, \"v\" : 1.5 }, { \"id\" : 10, \"v\" : 1 }, { \"id\" : 2 }, 9]"),
+		"JBSortArray descending is stable with missing keys last");
+	Check(SortResult("[3, \"x\", 1, true, 2.5]", NULL, jbin::JBSORT_ASCENDING, "[1, 2.5, 3, \"x\", true]"),
+		"JBSortArray sorts an array by the element values");
+	Check(SortedInOrder(1) && SortedInOrder(4), "JBSortArray on several threads keeps equal elements in order");
+
+	jbin::JBItem *pJSON = Parse(sMixedJSON);
+	jbin::JBItem *pGroups = pJSON ? jbin::JBGroupBy(pJSON, jbin::JBHashKey("v", 1), 2) : NULL;
+	Check(pGroups && SameAsText(pGroups,
+		"{ \"1\" : [{ \"id\" : 10, \"v\" : 1 }], \"1.5\" : [{ \"id\" : 3, \"v\" : 1.5 }], \"3\" : [{ \"id\" : 0, \"v\" : 3 }, { \"id\" : 4, \"v\" : 3 }],"
+		" \"a\" : [{ \"id\" : 6, \"v\" : \"a\" }], \"b\" : [{ \"id\" : 1, \"v\" : \"b\" }], \"false\" : [{ \"id\" : 8, \"v\" : false }],"
+		" \"true\" : [{ \"id\" : 5, \"v\" : true }], \"null\" : [{ \"id\" : 7, \"v\" : null }] }"),
+		"JBGroupBy groups elements by value in sort order");
+	Check(!jbin::JBSortArray(Index(pJSON, 0), 0) && !jbin::JBGroupBy(Index(pJSON, 0), 0), "JBSortArray and JBGroupBy refuse an item that is not an array");
+	free(pGroups);
+	free(pJSON);
+}
+
+//
+// JSONBinLines
+//
+
+static void CheckLines()
+{
+	// records on every line with some empty and some malformed lines
+	static const char *sBadLines[] = { "{ \"line\" : }", "[1, 2", "{ } x", "42", "{ \"line\" : 1 } { }" };
+	const int numLines = 200, numBad = 5;
+	const size_t size = numLines * 48;
+	char *text = (char*)malloc(size), *expected = (char*)malloc(size);
+	unsigned int aLineStart[numLines + 1], aBadLine[numBad], numErrors = 0;
+	if (!text || !expected) {
+		free(expected);
+		free(text);
+		Check(false, "JSONBinLines test text");
+		return;
+	}
+	int len = 0, expected_len = snprintf(expected, size, "["), records = 0;
+	for (int line = 1; line <= numLines; line++) {
+		aLineStart[line] = (unsigned int)len;
+		if (line % 40 == 7) {
+			aBadLine[numErrors] = line;
+			len += snprintf(text + len, size - len, " %s\n", sBadLines[numErrors++]);
+		} else if (line % 25 == 0)
+			len += snprintf(text + len, size - len, "  \n");
+		else {
+			int record = snprintf(text + len, size - len, "{ \"line\" : %d, \"tag\" : \"t%d\" }", line, line % 5);
+			expected_len += snprintf(expected + expected_len, size - expected_len, "%s%s", records++ ? ", " : "", text + len);
+			len += record;
+			len += snprintf(text + len, size - len, "\n");
+		}
+	}
+	snprintf(expected + expected_len, size - expected_len, "]");
+
+	for (unsigned int threads = 1; threads <= 4; threads += 3) {
+		jbin::JBLineError aErrors[numBad];
+		jbin::JBLinesReport report = { aErrors, numBad, 0, 0, 0 };
+		jbin::JBRet ret;
+		jbin::JBItem *pRecords = jbin::JSONBinLines(text, (unsigned int)len, threads, &ret, &report);
+		bool ok = pRecords && SameAsText(pRecords, expected) && report.numErrors == numErrors &&
+			report.numLines == numLines && report.numRecords == (unsigned int)records && pRecords->getChildCount() == records;
+		for (unsigned int e = 0; ok && e < numErrors; e++) {
+			unsigned int line = aBadLine[e];
+			ok = aErrors[e].line == line && aErrors[e].error_code != jbin::JBERR_NONE &&
+				aErrors[e].offset > aLineStart[line] && aErrors[e].offset < aLineStart[line + 1];
+		}
+		char what[80];
+		snprintf(what, sizeof(what), "JSONBinLines on %u thread(s) concatenates the records and reports bad lines", threads);
+		Check(ok, what);
+		free(pRecords);
+	}
+
+	jbin::JBLinesReport report = { NULL, 0, 0, 0, 0 };	// count errors without a list
+	jbin::JBItem *pRecords = jbin::JSONBinLines(text, (unsigned int)len, 2, NULL, &report);
+	Check(pRecords && report.numErrors == numErrors && report.numRecords == (unsigned int)records, "JSONBinLines counts bad lines without an error list");
+	free(pRecords);
+	free(expected);
+	free(text);
+}
+
+int main()
+{
+	CheckSelect();
+	CheckLazy();
+	CheckDeferred();
+	CheckSnapshot();
+	CheckSectioned(sSceneJSON);
+	CheckSectioned("{ \"a\" : 1, \"b\" : [2, 3], \"c\" : { \"d\" : \"e\" }, \"f\" : \"g\" }");
+	CheckCache();
+	CheckShared();
+	CheckLive();
+	CheckBuilder();
+	CheckPatch();
+	CheckDiff();
+	CheckSharedSubtrees();
+	CheckExtract();
+	CheckConcat();
+	CheckShapes();
+	CheckFieldCache();
+	CheckColumns();
+	CheckStringIndex();
+	CheckKeySummary();
+	CheckAggregate();
+	CheckTransform();
+	CheckSort();
+	CheckLines();
+
+	printf("%s\n", sFailed ? "Some checks FAILED" : "All checks passed");
+	return sFailed ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../jsonbin/jsonbin.h"
+#include "../jsonbin/jbquery.h"
+
+#ifdef WIN32
+#define snprintf sprintf_s
+#endif
+
+//
+// Run JSON Pointer, JSONPath and multiple path queries on a small document
+//	and check the results.
+//
+// Requires JSONBin and JBQuery
+//
+
+//=========================================================================
+// Coding style is not representative of a real product, it is kept simple
+//      to improve readability and avoid confusing dependencies.
+//=========================================================================
+
+static const char *sSceneJSON =
+"{\n"
+"  \"scene\" : {\n"
+"    \"name\" : \"harbor\",\n"
+"    \"objects\" : [\n"
+"      { \"name\" : \"boat\", \"kind\" : \"Geo\", \"speed\" : 4.5, \"matrix\" : [1, 0, 0, 0] },\n"
+"      { \"name\" : \"gull\", \"kind\" : \"Character\", \"speed\" : 12, \"behavior\" : \"circle.bt\" },\n"
+"      { \"name\" : \"crate\", \"kind\" : \"Geo\", \"speed\" : 0 },\n"
+"      { \"name\" : \"diver\", \"kind\" : \"Character\", \"speed\" : 1.5, \"behavior\" : \"swim.bt\" }\n"
+"    ]\n"
+"  },\n"
+"  \"a/b\" : 1,\n"
+"  \"m~n\" : 2\n"
+"}\n";
+
+static int sFailed = 0;
+
+// print an item value (or name for objects and arrays) on a single line
+static void PrintItem(const jbin::JBItem *item)
+{
+	switch (item->getType()) {
+		case jbin::JB_STRING: printf(" \"%s\"", item->getStr() ? item->getStr() : ""); break;
+		case jbin::JB_INT: printf(" %d", (int)item->getInt()); break;
+		case jbin::JB_FLOAT: printf(" %g", (double)item->getFloat()); break;
+		case jbin::JB_BOOL: printf(" %s", item->getBool() ? "true" : "false"); break;
+		default: printf(" <%s>", item->getName() ? item->getName() : "root"); break;
+	}
+}
+
+// run a query and compare the results with an expected list of strings or numbers (as text)
+static void CheckQuery(const jbin::JBItem *pJSON, const char *path, int expected_count, const char **expected)
+{
+	jbin::JBQuery query(path);
+	const jbin::JBItem *aResults[16];
+	int count = query.valid() ? query.run(pJSON, aResults, 16) : -1;
+	bool ok = count == expected_count;
+	for (int r = 0; ok && r < count && r < 16; r++) {
+		char buf[64];
+		const char *value = buf;
+		switch (aResults[r]->getType()) {
+			case jbin::JB_STRING: value = aResults[r]->getStr(); break;
+			case jbin::JB_INT: snprintf(buf, sizeof(buf), "%d", (int)aResults[r]->getInt()); break;
+			case jbin::JB_FLOAT: snprintf(buf, sizeof(buf), "%g", (double)aResults[r]->getFloat()); break;
+			default: value = aResults[r]->getName(); break;
+		}
+		ok = value && !strcmp(value, expected[r]);
+	}
+	printf("%s %s :", ok ? "ok  " : "FAIL", path);
+	for (int r = 0; r < count && r < 16; r++)
+		PrintItem(aResults[r]);
+	printf("\n");
+	if (!ok)
+		sFailed++;
+}
+
+static void CheckMultiPath(const jbin::JBItem *pJSON)
+{
+	const char *aPaths[] = { "/scene/name", "/scene/objects/1/behavior", "$.scene.objects[-1].name", "/m~0n", "/scene/missing" };
+	const char *aExpected[] = { "harbor", "circle.bt", "diver", "2", NULL };
+	const int numPaths = sizeof(aPaths) / sizeof(aPaths[0]);
+
+	jbin::JBMultiPath paths;
+	int aSlot[numPaths];
+	for (int p = 0; p < numPaths; p++)
+		aSlot[p] = paths.add(aPaths[p]);
+
+	const jbin::JBItem *aSlots[numPaths];
+	int found = paths.extract(pJSON, aSlots);
+	bool ok = found == numPaths - 1 && paths.add("$..name") < 0;	// recursive descent is not a key/index path
+	for (int p = 0; p < numPaths; p++) {
+		const jbin::JBItem *item = aSlot[p] >= 0 ? aSlots[aSlot[p]] : NULL;
+		char buf[32];
+		const char *value = NULL;
+		if (item && item->getType() == jbin::JB_INT) {
+			snprintf(buf, sizeof(buf), "%d", (int)item->getInt());
+			value = buf;
+		} else if (item)
+			value = item->getStr();
+		if (aExpected[p] ? (!value || strcmp(value, aExpected[p])) : item != NULL)
+			ok = false;
+	}
+	printf("%s JBMultiPath : %d of %d paths found\n", ok ? "ok  " : "FAIL", found, numPaths);
+	if (!ok)
+		sFailed++;
+}
+
+// a key repeated in the document only counts once, the first one is used like JBItem::findByHash
+static void CheckDuplicateKeys()
+{
+	const char *json = "{ \"a\" : 1, \"a\" : 2, \"b\" : 3 }";
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = jbin::JSONBin(json, (unsigned int)strlen(json), &ret);
+	jbin::JBMultiPath paths;
+	int slotA = paths.add("/a");
+	int slotB = paths.add("/b");
+	const jbin::JBItem *aSlots[2] = { NULL, NULL };
+	int found = pJSON ? paths.extract(pJSON, aSlots) : 0;
+	bool ok = found == 2 && aSlots[slotA] && aSlots[slotA]->getInt() == 1 && aSlots[slotB] && aSlots[slotB]->getInt() == 3;
+	printf("%s JBMultiPath duplicate keys : %d of 2 paths found\n", ok ? "ok  " : "FAIL", found);
+	if (!ok)
+		sFailed++;
+	free(pJSON);
+}
+
+int main()
+{
+	jbin::JBRet ret = { 0 };
+	jbin::JBItem *pJSON = jbin::JSONBin(sSceneJSON, (unsigned int)strlen(sSceneJSON), &ret);
+	if (!pJSON) {
+		printf("Error at line %d column %d\n", ret.err_line, ret.err_column);
+		return 1;
+	}
+
+	// JSON Pointer
+	{ const char *e[] = { "harbor" }; CheckQuery(pJSON, "/scene/name", 1, e); }
+	{ const char *e[] = { "crate" }; CheckQuery(pJSON, "/scene/objects/2/name", 1, e); }
+	{ const char *e[] = { "1" }; CheckQuery(pJSON, "/a~1b", 1, e); }
+	{ const char *e[] = { "2" }; CheckQuery(pJSON, "/m~0n", 1, e); }
+	CheckQuery(pJSON, "/scene/objects/4", 0, NULL);
+
+	// JSONPath
+	{ const char *e[] = { "boat", "gull", "crate", "diver" }; CheckQuery(pJSON, "$.scene.objects[*].name", 4, e); }
+	{ const char *e[] = { "gull", "crate" }; CheckQuery(pJSON, "$.scene.objects[1:3].name", 2, e); }
+	{ const char *e[] = { "boat", "crate" }; CheckQuery(pJSON, "$.scene.objects[::2].name", 2, e); }
+	{ const char *e[] = { "diver" }; CheckQuery(pJSON, "$.scene.objects[-1].name", 1, e); }
+	{ const char *e[] = { "circle.bt", "swim.bt" }; CheckQuery(pJSON, "$..behavior", 2, e); }
+	{ const char *e[] = { "harbor", "boat", "gull", "crate", "diver" }; CheckQuery(pJSON, "$..name", 5, e); }
+	{ const char *e[] = { "boat", "crate" }; CheckQuery(pJSON, "$.scene.objects[?(@.kind == 'Geo')].name", 2, e); }
+	{ const char *e[] = { "boat", "gull" }; CheckQuery(pJSON, "$.scene.objects[?(@.speed > 2)].name", 2, e); }
+	{ const char *e[] = { "gull", "diver" }; CheckQuery(pJSON, "$.scene.objects[?(@.behavior)].name", 2, e); }
+	{ const char *e[] = { "1" }; CheckQuery(pJSON, "$.scene.objects[0].matrix[?(@ >= 1)]", 1, e); }
+
+	// multiple paths in one pass
+	CheckMultiPath(pJSON);
+	CheckDuplicateKeys();
+
+	free(pJSON);
+	printf("%s\n", sFailed ? "Some queries FAILED" : "All queries passed");
+	return sFailed ? 1 : 0;
+}
@@ -60,6 +60,9 @@ static bool ExportJSON(FILE *f, const jbin::JBItem *pJSON)
 				case jbin::JB_NULL_VALUE:	// null value
 					o.push_null(i->getName());	// either null type or null object
 					break;
+				case jbin::JB_DEFERRED:	// not returned by JSONBin
+				case jbin::JB_SHARED:	// not returned by getType
+					break;
 			}
 
 			if (o.last_error() != jout::JSONOut::ERR_NONE)
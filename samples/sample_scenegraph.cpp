@@ -48,6 +48,14 @@
 #define _FNV1A_scene 0x2063cb13			// "scene"
 #define _FNV1A_objects 0xa8c6206b       // "objects"
 
+// components of the same type repeat their keys in the same order, each key
+// is found where the previous component had it
+static jbin::JBFieldCache s_nameField(_FNV1A_name);
+static jbin::JBFieldCache s_geoFileField(_FNV1A_geoFile);
+static jbin::JBFieldCache s_wayPointsField(_FNV1A_wayPoints);
+static jbin::JBFieldCache s_behaviorField(_FNV1A_behavior);
+static jbin::JBFieldCache s_spawnPointField(_FNV1A_spawnPoint);
+
 inline float randFloat(float range_min, float range_max)
 {
 	return float(rand()) * (range_max - range_min) / float(RAND_MAX) + range_min;
@@ -242,7 +250,7 @@ void SceneMatrix::Save(jout::JSONOut *o, const char *name)
 
 bool SceneComponent::Load(const jbin::JBItem *pJSON)
 {
-	if (const jbin::JBItem *pNameSrc = pJSON->findByHash(_FNV1A_name)) {
+	if (const jbin::JBItem *pNameSrc = s_nameField.find(pJSON)) {
 		pName = no_warn_strdup(pNameSrc->getStr());
 		return true;
 	}
@@ -258,7 +266,7 @@ void SceneComponent::Save(jout::JSONOut *o)
 bool SceneGeo::Load(const jbin::JBItem *pJSON)
 {
 	SceneComponent::Load(pJSON);
-	if (const jbin::JBItem *pNameSrc = pJSON->findByHash(_FNV1A_geoFile)) {
+	if (const jbin::JBItem *pNameSrc = s_geoFileField.find(pJSON)) {
 		pGeoFileName = no_warn_strdup(pNameSrc->getStr());
 	}
 	return false;
@@ -276,7 +284,7 @@ void SceneGeo::Save(jout::JSONOut *o)
 bool ScenePathFollow::Load(const jbin::JBItem *pJSON)
 {
 	SceneComponent::Load(pJSON);
-	if (const jbin::JBItem *pPointsSrc = pJSON->findByHash(_FNV1A_wayPoints)) {
+	if (const jbin::JBItem *pPointsSrc = s_wayPointsField.find(pJSON)) {
 		if ((nPoints = (int)pPointsSrc->getChildCount())) {
 			pPoints = new SceneVec[nPoints];
 			SceneVec *ptr = pPoints;
@@ -309,10 +317,10 @@ bool SceneCharacter::Load(const jbin::JBItem *pJSON)
 {
 	SceneComponent::Load(pJSON);
 
-	if (const jbin::JBItem *pBehavior = pJSON->findByHash(_FNV1A_behavior))
+	if (const jbin::JBItem *pBehavior = s_behaviorField.find(pJSON))
 		pBehaviorScript = no_warn_strdup(pBehavior->getStr());
 
-	if (const jbin::JBItem *pSpawn = pJSON->findByHash(_FNV1A_spawnPoint))
+	if (const jbin::JBItem *pSpawn = s_spawnPointField.find(pJSON))
 		spawnPoint.Load(pSpawn);
 
 	return false;